@@ -247,7 +247,9 @@ static int AdpcmMashS(
         return (int) sqrt(d2);
 }
 
-static inline void AdpcmMashChannel(
+/* Finds the best coefficient set and step for one channel of a block,
+ * putting the set's index in its place in obuff[] */
+static void AdpcmMashChannel(
         unsigned ch,             /* channel number to encode, REQUIRE 0 <= ch < chans  */
         unsigned chans,          /* total channels */
         const SAMPL *ip,    /* ip[] is interleaved input samples */
@@ -293,7 +295,6 @@ static inline void AdpcmMashChannel(
         }
         *st = smin;
         lsx_debug_more("kmin %d, smin %5d, ",kmin,smin);
-        AdpcmMashS(ch, chans, v, lsx_ms_adpcm_i_coef[kmin], ip, n, st, obuff);
         obuff[ch] = kmin;
 }
 
@@ -306,7 +307,7 @@ void lsx_ms_adpcm_block_mash_i(
         int blockAlign      /* >= 7*chans + chans*(n-2)/2.0    */
 )
 {
-        unsigned ch;
+        int ch;
         unsigned char *p;
 
         lsx_debug_more("AdpcmMashI(chans %d, ip %p, n %d, st %p, obuff %p, bA %d)\n",
@@ -314,8 +315,19 @@ void lsx_ms_adpcm_block_mash_i(
 
         for (p=obuff+7*chans; p<obuff+blockAlign; p++) *p=0;
 
-        for (ch=0; ch<chans; ch++)
-                AdpcmMashChannel(ch, chans, ip, n, st+ch, obuff);
+        /* The channels' searches are independent so can be shared out,
+         * but their output nibbles share bytes so are written in turn. */
+#ifdef HAVE_OPENMP
+        #pragma omp parallel for if(sox_globals.use_threads && chans > 1) schedule(static)
+#endif
+        for (ch=0; ch<(int)chans; ch++)
+                AdpcmMashChannel((unsigned)ch, chans, ip, n, st+ch, obuff);
+        for (ch=0; ch<(int)chans; ch++) {
+                SAMPL v[2];
+                v[1] = ip[ch];
+                v[0] = ip[ch+chans];
+                AdpcmMashS((unsigned)ch, chans, v, lsx_ms_adpcm_i_coef[obuff[ch]], ip, n, st+ch, obuff);
+        }
 }
 
 /*
@@ -53,9 +53,6 @@ static lsx_enum_item modulation_kind_map[] ={
 /** the type used in the delay lines */
 typedef sox_sample_t chorus_delay_sample_t;
 
-/** an auxiliary macro for doing a modular increment */
-#define MODULAR_INCREMENT(a, b)     a = ((a) + 1) % (b)
-
 /*--------------------*/
 
 /** a single stage in the chorus effect */
@@ -66,14 +63,10 @@ typedef struct {
         float                  speed;       /* in Hz */
         float                  depth;       /* in seconds */
         lsx_wave_t             wave_type;
-        /* sample tables, table counts and indices */
-        sox_uint32_t           delay_line_index;
+        /* delay line length, modulation depth and wave table */
         sox_uint32_t           delay_line_length;
-        chorus_delay_sample_t  *delay_line;
         sox_uint32_t           depth_sample_count;
-        sox_uint32_t           wave_index;
-        sox_uint32_t           wave_length;
-        int                    *wave_table;
+        lsx_lfo_t              lfo;
 } chorus_stage_t;
 
 /*--------------------*/
@@ -88,6 +81,11 @@ typedef struct {
         sox_uint32_t    stage_count;
         chorus_stage_t  *stage;
 
+        /* the input delay line that all stages tap, and the number of
+         * samples that can be processed at once */
+        lsx_delay_t     delay_line;
+        size_t          block;
+
         /* remaining samples for drain phase */
         sox_uint32_t    remaining_samples;
 } chorus_priv_t;
@@ -185,6 +183,7 @@ static int sox_chorus_start (sox_effect_t *effp)
 {
         chorus_priv_t *chorus = (chorus_priv_t *) effp->priv;
         sox_uint32_t i;
+        size_t wave_length;
 
         /* start is called once per channel, but each channel gets a copy
          * of the "stage" pointer, pointing to the same array of stages
@@ -205,6 +204,7 @@ static int sox_chorus_start (sox_effect_t *effp)
                 chorus->stage = newstages;
         }
 
+        chorus->block = LSX_DELAY_BLOCK;
         for (i = 0;  i < chorus->stage_count;  i++) {
                 chorus_stage_t *stage = &chorus->stage[i];
 		double dll;
@@ -226,29 +226,34 @@ static int sox_chorus_start (sox_effect_t *effp)
 			     1000 / effp->in_signal.rate);
 		    return SOX_EOF;
 		}
-                stage->delay_line =
-                    lsx_calloc(stage->delay_line_length,
-                               sizeof(chorus_delay_sample_t));
 
                 /* modulation wave table */
-                stage->wave_length = effp->in_signal.rate / stage->speed;
-		if (stage->wave_length < 1) {
+                wave_length = effp->in_signal.rate / stage->speed;
+		if (wave_length < 1) {
 		    lsx_fail("speed can't be more than the sample rate");
 		    return SOX_EOF;
 		}
-                lsx_valloc(stage->wave_table, stage->wave_length);
-                lsx_generate_wave_table(stage->wave_type, SOX_INT,
-                                        stage->wave_table,
-                                        stage->wave_length,
-                                        0., stage->depth_sample_count,
-                                        M_PI_2);
- 
+                lsx_lfo_init(&stage->lfo, stage->wave_type, SOX_INT,
+                             wave_length, 0., stage->depth_sample_count,
+                             M_PI_2);
+
                 /* find maximum delay line length across all stages */
                 chorus->remaining_samples =
                         max(chorus->remaining_samples,
                              stage->delay_line_length);
+
+                /* a block must be no longer than the shortest delay,
+                 * so that all its delayed samples are in the delay line,
+                 * nor than a cycle of the modulation */
+                chorus->block = min(chorus->block, wave_length);
+                if (stage->depth_sample_count < stage->delay_line_length)
+                        chorus->block = min(chorus->block,
+                            stage->delay_line_length - stage->depth_sample_count);
+                else chorus->block = 1;
         }
 
+        lsx_delay_init(&chorus->delay_line, chorus->remaining_samples);
+
         effp->out_signal.length = SOX_UNKNOWN_LEN;
         /* TODO: calculate actual length */
 
@@ -280,49 +285,60 @@ static int sox_chorus_flow_or_drain (sox_effect_t *effp,
 {
         chorus_priv_t *chorus = (chorus_priv_t *) effp->priv;
         const sox_bool is_drain = (ibuf == NULL);
-        size_t len = min(*isamp, *osamp);
+        size_t len = min(*isamp, *osamp), n;
         int result = (!is_drain
                       ? SOX_SUCCESS
                       : (*isamp > *osamp ? SOX_SUCCESS : SOX_EOF));
 
         *isamp = *osamp = len;
 
-        while (len--) {
+        for (; len; len -= n) {
+                chorus_delay_sample_t d_in[LSX_DELAY_BLOCK];
+                chorus_delay_sample_t d_out[LSX_DELAY_BLOCK];
+                double tap[LSX_DELAY_BLOCK];
                 sox_uint32_t i;
-                sox_sample_t output_sample;
+                size_t j;
+
+                n = min(len, chorus->block);
 
                 /* Scale samples down to prevent arithmetic overflow
                  * when adding up many delay lines */
-                const chorus_delay_sample_t d_in =
-                    (is_drain
-                     ? 0
-                     : (chorus_delay_sample_t) *ibuf++ / SCALING_FACTOR);
-
-                /* Compute output */
-                chorus_delay_sample_t d_out = d_in * chorus->gain_in;
+                for (j = 0; j < n; j++) {
+                    d_in[j] = (is_drain
+                               ? 0
+                               : (chorus_delay_sample_t) *ibuf++ / SCALING_FACTOR);
+                    d_out[j] = d_in[j] * chorus->gain_in;
+                }
 
+                /* Each stage taps the delay line at a modulated delay of
+                 * from 1 to delay_line_length samples */
                 for (i = 0; i < chorus->stage_count; i++) {
                     chorus_stage_t *stage = &chorus->stage[i];
-                    sox_uint32_t wave_index = stage->wave_index;
-                    sox_uint32_t offset = stage->wave_table[wave_index];
-                    sox_uint32_t delay_line_index =
-                        ((stage->delay_line_index + offset)
-                         % stage->delay_line_length);
-                    chorus_delay_sample_t sample =
-                        stage->delay_line[delay_line_index];
-                    d_out += sample * stage->decay;
-                    stage->delay_line[stage->delay_line_index] = d_in;
-                    MODULAR_INCREMENT(stage->delay_line_index,
-                                      stage->delay_line_length);
-                    MODULAR_INCREMENT(stage->wave_index, stage->wave_length);
+                    sox_uint32_t length = stage->delay_line_length;
+
+                    for (j = 0; j < n; j++) {
+                        sox_uint32_t offset =
+                            (sox_uint32_t)lsx_lfo_at(&stage->lfo, j);
+                        size_t delay = length - offset % length;
+                        chorus_delay_sample_t sample =
+                            lsx_delay_tap(&chorus->delay_line, delay - 1 - j);
+                        d_out[j] += sample * stage->decay;
+                    }
+                    lsx_lfo_advance(&stage->lfo, n);
                 }
 
-                /* Adjust the output volume by gain_out, check for
-                 * clipping and scale output up again */
-                d_out = d_out * chorus->gain_out;
-                output_sample = CLIP_COUNT_PROC((sox_sample_t) d_out,
-                                                effp->clips);
-                *obuf++ = output_sample * SCALING_FACTOR;
+                for (j = 0; j < n; j++) {
+                    sox_sample_t output_sample;
+
+                    /* Adjust the output volume by gain_out, check for
+                     * clipping and scale output up again */
+                    d_out[j] = d_out[j] * chorus->gain_out;
+                    output_sample = CLIP_COUNT_PROC((sox_sample_t) d_out[j],
+                                                    effp->clips);
+                    *obuf++ = output_sample * SCALING_FACTOR;
+                    tap[j] = d_in[j];
+                }
+                lsx_delay_write(&chorus->delay_line, tap, n);
         }
 
         return result;
@@ -395,10 +411,10 @@ static int sox_chorus_stop (sox_effect_t * effp)
 
         for (i = 0;  i < chorus->stage_count;  i++) {
                 chorus_stage_t *stage = &chorus->stage[i];
-                free(stage->wave_table);
-                free(stage->delay_line);
+                lsx_lfo_stop(&stage->lfo);
         }
         free(chorus->stage);
+        lsx_delay_stop(&chorus->delay_line);
 
         return (SOX_SUCCESS);
 }
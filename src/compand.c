@@ -18,21 +18,19 @@
  * Compressor/expander effect for libSoX.
  */
 
+#define BLOCK 1024 /* Frames processed at a time */
+
 typedef struct {
   sox_compandt_t transfer_fn;
 
-  struct {
-    double attack_times[2]; /* 0:attack_time, 1:decay_time */
-    double volume;          /* Current "volume" of each channel */
-  } * channels;
+  double * attack_times;    /* Attack time of each channel */
+  double * decay_times;     /*    ... and decay time */
+  double * volume;          /* Current "volume" of each channel */
   unsigned expectedChannels;/* Also flags that channels aren't to be treated
                                individually when = 1 and input not mono */
   double delay;             /* Delay to apply before companding */
-  sox_sample_t *delay_buf;   /* Old samples, used for delay processing */
-  ptrdiff_t delay_buf_size;/* Size of delay_buf in samples */
-  ptrdiff_t delay_buf_index; /* Index into delay_buf */
-  ptrdiff_t delay_buf_cnt; /* No. of active entries in delay_buf */
-  int delay_buf_full;       /* Shows buffer situation (important for drain) */
+  sox_compandt_delay_t delay_buf;
+  double * gain;            /* Gain for each sample of a block */
 
   char *arg0;  /* copies of arguments, so that they may be modified */
   char *arg1;
@@ -61,17 +59,20 @@ static int getopts(sox_effect_t * effp, int argc, char * * argv)
     return SOX_EOF;
   }
   pairs = 1 + commas/2;
-  lsx_vcalloc(l->channels, pairs);
+  lsx_vcalloc(l->attack_times, pairs);
+  lsx_vcalloc(l->decay_times, pairs);
+  lsx_vcalloc(l->volume, pairs);
   l->expectedChannels = pairs;
 
   /* Now tokenise the rates string and set up these arrays.  Keep
      them in seconds at the moment: we don't know the sample rate yet. */
   for (i = 0, s = strtok(l->arg0, ","); s != NULL; ++i) {
     for (j = 0; j < 2; ++j) {
-      if (sscanf(s, "%lf %c", &l->channels[i].attack_times[j], &dummy) != 1) {
+      double * time = j? &l->decay_times[i] : &l->attack_times[i];
+      if (sscanf(s, "%lf %c", time, &dummy) != 1) {
         lsx_fail("syntax error trying to read attack/decay time");
         return SOX_EOF;
-      } else if (l->channels[i].attack_times[j] < 0) {
+      } else if (*time < 0) {
         lsx_fail("attack & decay times can't be less than 0 seconds");
         return SOX_EOF;
       }
@@ -94,7 +95,7 @@ static int getopts(sox_effect_t * effp, int argc, char * * argv)
       lsx_fail("initial volume is relative to maximum volume so can't exceed 0dB");
       return SOX_EOF;
     }
-    l->channels[i].volume = pow(10., init_vol_dB / 20);
+    l->volume[i] = pow(10., init_vol_dB / 20);
   }
 
   /* If there is a delay, store it. */
@@ -109,109 +110,66 @@ static int getopts(sox_effect_t * effp, int argc, char * * argv)
   return SOX_SUCCESS;
 }
 
+static double rate(double time, double sample_rate)
+{
+  return time > 1.0 / sample_rate? 1.0 - exp(-1.0 / (sample_rate * time)) : 1.0;
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t * l = (priv_t *) effp->priv;
-  unsigned i, j;
+  unsigned i, channels = effp->out_signal.channels;
+  size_t delay;
 
   lsx_debug("%i input channel(s) expected: actually %i",
-      l->expectedChannels, effp->out_signal.channels);
+      l->expectedChannels, channels);
+  if (l->expectedChannels > 1 && l->expectedChannels < channels) {
+    lsx_fail("there must be an attack/decay pair for each channel");
+    return SOX_EOF;
+  }
   for (i = 0; i < l->expectedChannels; ++i)
     lsx_debug("Channel %i: attack = %g decay = %g", i,
-        l->channels[i].attack_times[0], l->channels[i].attack_times[1]);
+        l->attack_times[i], l->decay_times[i]);
   if (!lsx_compandt_show(&l->transfer_fn, effp->global_info->plot))
     return SOX_EOF;
 
   /* Convert attack and decay rates using number of samples */
-  for (i = 0; i < l->expectedChannels; ++i)
-    for (j = 0; j < 2; ++j)
-      if (l->channels[i].attack_times[j] > 1.0/effp->out_signal.rate)
-        l->channels[i].attack_times[j] = 1.0 -
-          exp(-1.0/(effp->out_signal.rate * l->channels[i].attack_times[j]));
-      else
-        l->channels[i].attack_times[j] = 1.0;
+  for (i = 0; i < l->expectedChannels; ++i) {
+    l->attack_times[i] = rate(l->attack_times[i], effp->out_signal.rate);
+    l->decay_times[i] = rate(l->decay_times[i], effp->out_signal.rate);
+  }
+
+  lsx_compandt_make_table(&l->transfer_fn);
 
   /* Allocate the delay buffer */
-  l->delay_buf_size = l->delay * effp->out_signal.rate * effp->out_signal.channels;
-  if (l->delay_buf_size > 0)
-    lsx_vcalloc(l->delay_buf, l->delay_buf_size);
-  l->delay_buf_index = 0;
-  l->delay_buf_cnt = 0;
-  l->delay_buf_full= 0;
+  delay = (size_t)(l->delay * effp->out_signal.rate) * channels;
+  lsx_compandt_delay_init(&l->delay_buf, delay, delay, BLOCK * channels);
+  lsx_valloc(l->gain, BLOCK * channels);
 
   return SOX_SUCCESS;
 }
 
-/*
- * Update a volume value using the given sample
- * value, the attack rate and decay rate
- */
-static void doVolume(double *v, double samp, priv_t * l, int chan)
-{
-  double s = -samp / SOX_SAMPLE_MIN;
-  double delta = s - *v;
-
-  if (delta > 0.0) /* increase volume according to attack rate */
-    *v += delta * l->channels[chan].attack_times[0];
-  else             /* reduce volume according to decay rate */
-    *v += delta * l->channels[chan].attack_times[1];
-}
-
 static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
                     size_t *isamp, size_t *osamp)
 {
   priv_t * l = (priv_t *) effp->priv;
-  int len =  (*isamp > *osamp) ? *osamp : *isamp;
-  int filechans = effp->out_signal.channels;
-  int idone,odone;
-
-  for (idone = 0,odone = 0; idone < len; ibuf += filechans) {
-    int chan;
-
-    /* Maintain the volume fields by simulating a leaky pump circuit */
-    for (chan = 0; chan < filechans; ++chan) {
-      if (l->expectedChannels == 1 && filechans > 1) {
-        /* User is expecting same compander for all channels */
-        int i;
-        double maxsamp = 0.0;
-        for (i = 0; i < filechans; ++i) {
-          double rect = fabs((double)ibuf[i]);
-          if (rect > maxsamp) maxsamp = rect;
-        }
-        doVolume(&l->channels[0].volume, maxsamp, l, 0);
-        break;
-      } else
-        doVolume(&l->channels[chan].volume, fabs((double)ibuf[chan]), l, chan);
-    }
-
-    /* Volume memory is updated: perform compand */
-    for (chan = 0; chan < filechans; ++chan) {
-      int ch = l->expectedChannels > 1 ? chan : 0;
-      double level_in_lin = l->channels[ch].volume;
-      double level_out_lin = lsx_compandt(&l->transfer_fn, level_in_lin);
-      double checkbuf;
-
-      if (l->delay_buf_size <= 0) {
-        checkbuf = ibuf[chan] * level_out_lin;
-        SOX_SAMPLE_CLIP_COUNT(checkbuf, effp->clips);
-        obuf[odone++] = checkbuf;
-        idone++;
-      } else {
-        if (l->delay_buf_cnt >= l->delay_buf_size) {
-          l->delay_buf_full=1; /* delay buffer is now definitely full */
-          checkbuf = l->delay_buf[l->delay_buf_index] * level_out_lin;
-          SOX_SAMPLE_CLIP_COUNT(checkbuf, effp->clips);
-          obuf[odone] = checkbuf;
-          odone++;
-          idone++;
-        } else {
-          l->delay_buf_cnt++;
-          idone++; /* no "odone++" because we did not fill obuf[...] */
-        }
-        l->delay_buf[l->delay_buf_index++] = ibuf[chan];
-        l->delay_buf_index %= l->delay_buf_size;
-      }
-    }
+  unsigned channels = effp->out_signal.channels;
+  sox_bool linked = l->expectedChannels == 1 && channels > 1;
+  size_t len = min(*isamp, *osamp) / channels * channels;
+  size_t idone, odone;
+
+  for (idone = odone = 0; idone < len;) {
+    size_t n = min(len - idone, BLOCK * channels), out_n;
+    sox_sample_t const * out;
+
+    lsx_compandt_gains(&l->transfer_fn, l->gain, ibuf + idone, n / channels,
+        channels, linked, -(double)SOX_SAMPLE_MIN,
+        l->volume, l->attack_times, l->decay_times);
+    out = lsx_compandt_delay_flow(&l->delay_buf, ibuf + idone, l->gain, n,
+        &effp->clips, &out_n);
+    memcpy(obuf + odone, out, out_n * sizeof(*obuf));
+    idone += n;
+    odone += out_n;
   }
 
   *isamp = idone; *osamp = odone;
@@ -221,30 +179,25 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obu
 static int drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
   priv_t * l = (priv_t *) effp->priv;
-  size_t chan, done = 0;
-
-  if (l->delay_buf_full == 0)
-    l->delay_buf_index = 0;
-
-  l->delay_buf_full = 1;
-  while (done+effp->out_signal.channels <= *osamp && l->delay_buf_cnt > 0)
-    for (chan = 0; chan < effp->out_signal.channels; ++chan) {
-      int c = l->expectedChannels > 1 ? chan : 0;
-      double level_in_lin = l->channels[c].volume;
-      double level_out_lin = lsx_compandt(&l->transfer_fn, level_in_lin);
-      obuf[done++] = l->delay_buf[l->delay_buf_index++] * level_out_lin;
-      l->delay_buf_index %= l->delay_buf_size;
-      l->delay_buf_cnt--;
-    }
-  *osamp = done;
-  return l->delay_buf_cnt > 0 ? SOX_SUCCESS : SOX_EOF;
+  unsigned chan, channels = effp->out_signal.channels;
+  sox_sample_t const * out;
+
+  /* The remaining samples get the last gains */
+  for (chan = 0; chan < channels; ++chan)
+    l->gain[chan] = lsx_compandt_lookup(&l->transfer_fn,
+        l->volume[l->expectedChannels > 1 ? chan : 0]);
+  out = lsx_compandt_delay_drain(&l->delay_buf, l->gain, channels,
+      *osamp / channels * channels, &effp->clips, osamp);
+  memcpy(obuf, out, *osamp * sizeof(*obuf));
+  return l->delay_buf.cnt > 0 ? SOX_SUCCESS : SOX_EOF;
 }
 
 static int stop(sox_effect_t * effp)
 {
   priv_t * l = (priv_t *) effp->priv;
 
-  free(l->delay_buf);
+  lsx_compandt_delay_stop(&l->delay_buf);
+  free(l->gain);
   return SOX_SUCCESS;
 }
 
@@ -253,7 +206,9 @@ static int lsx_kill(sox_effect_t * effp)
   priv_t * l = (priv_t *) effp->priv;
 
   lsx_compandt_kill(&l->transfer_fn);
-  free(l->channels);
+  free(l->attack_times);
+  free(l->decay_times);
+  free(l->volume);
   free(l->arg0);
   free(l->arg1);
   free(l->arg2);
@@ -222,8 +222,199 @@ sox_bool lsx_compandt_parse(sox_compandt_t * t, char * points, char * gain)
   return sox_true;
 }
 
+/* Interpolated gains must make an error in the output below -120dB; the
+ * bins where they can't, such as those across a sharp corner, are marked
+ * and lsx_compandt_lookup() uses the function itself there.  The points per
+ * octave are doubled until few bins are marked. */
+#define TABLE_MAX_ERROR 1e-6
+#define TABLE_MIN_BINS 64
+#define TABLE_MAX_BINS 4096
+
+static double table_gain(sox_compandt_t * t, int e, double j)
+{
+  return lsx_compandt(t, ldexp(.5 + .5 * j / t->table_bins, e));
+}
+
+/* Mark the inaccurate bins and return how many there are */
+static size_t mark_inaccurate(sox_compandt_t * t)
+{
+  int e;
+  unsigned j, k;
+  size_t marked = 0;
+  double const * g = t->table;
+  char * exact = t->table_exact;
+
+  for (e = t->table_min_exp; e <= t->table_max_exp; ++e)
+    for (j = 0; j < t->table_bins; ++j, ++g, ++exact) {
+      *exact = 0;
+      for (k = 1; k < 8 && !*exact; ++k) {
+        double in_lin = ldexp(.5 + .5 * (j + k * .125) / t->table_bins, e);
+        double error = g[0] + (g[1] - g[0]) * k * .125 - lsx_compandt(t, in_lin);
+        *exact = fabs(error) > TABLE_MAX_ERROR;
+      }
+      marked += *exact;
+    }
+  return marked;
+}
+
+void lsx_compandt_make_table(sox_compandt_t * t)
+{
+  int e;
+  unsigned j;
+  size_t n, marked;
+
+  frexp(t->in_min_lin, &t->table_min_exp);
+  t->table_max_exp = 0; /* Up to level 1, full scale; the last point is 1 */
+  t->table_min_exp = min(t->table_min_exp, t->table_max_exp);
+
+  for (t->table_bins = TABLE_MIN_BINS; ; t->table_bins <<= 1) {
+    double * g;
+
+    n = (size_t)(t->table_max_exp - t->table_min_exp + 1) * t->table_bins;
+    lsx_revalloc(t->table, n + 1);
+    lsx_revalloc(t->table_exact, n);
+    g = t->table;
+
+    for (e = t->table_min_exp; e <= t->table_max_exp; ++e)
+      for (j = 0; j < t->table_bins; ++j)
+        *g++ = table_gain(t, e, (double)j);
+    *g = table_gain(t, t->table_max_exp + 1, 0.);
+    marked = mark_inaccurate(t);
+    if (marked <= n / 64 || t->table_bins >= TABLE_MAX_BINS)
+      break;
+  }
+  lsx_debug("transfer function table: %u points per octave, %lu of %lu bins exact",
+      t->table_bins, (unsigned long)marked, (unsigned long)n);
+}
+
 void lsx_compandt_kill(sox_compandt_t * p)
 {
   free(p->segments);
+  free(p->table);
+  free(p->table_exact);
+  p->table = NULL;
+  p->table_exact = NULL;
+}
+
+/* Follow the level of each channel with its attack and decay rates and
+ * set gain[] to the transfer function of the level after each sample.
+ * When linked, all channels follow the loudest with the first rates. */
+void lsx_compandt_gains(sox_compandt_t * t, double * gain,
+    sox_sample_t const * in, size_t frames, unsigned channels, sox_bool linked,
+    double full_scale, double * volume, double const * attack,
+    double const * decay)
+{
+  size_t i, n = frames * channels;
+  unsigned c, followed = linked? 1 : channels;
+  double * env = gain;
+
+  if (linked) for (i = 0; i < frames; ++i, in += channels) {
+    double peak = 0;
+    for (c = 0; c < channels; ++c)
+      peak = max(peak, fabs((double)in[c]));
+    gain[i] = peak / full_scale;
+  }
+  else for (i = 0; i < n; ++i)
+    gain[i] = fabs((double)in[i]) / full_scale;
+
+  /* Simulate a leaky pump circuit; the channels run side by side */
+  for (i = 0; i < frames; ++i, env += followed)
+    for (c = 0; c < followed; ++c) {
+      double delta = env[c] - volume[c];
+      volume[c] += delta * (delta > 0? attack[c] : decay[c]);
+      env[c] = volume[c];
+    }
+
+  if (linked) for (i = frames; i--;) {
+    double g = lsx_compandt_lookup(t, gain[i]);
+    for (c = channels; c--;)
+      gain[i * channels + c] = g;
+  }
+  else for (i = 0; i < n; ++i)
+    gain[i] = lsx_compandt_lookup(t, gain[i]);
+}
+
+/* block is the most samples that will be passed to flow at once */
+void lsx_compandt_delay_init(sox_compandt_delay_t * d, size_t apply,
+    size_t length, size_t block)
+{
+  d->apply = apply;
+  d->length = length;
+  d->head = d->cnt = 0;
+  d->alloc = 2 * (length + block);
+  d->drained = sox_false;
+  lsx_valloc(d->buf, d->alloc);
+}
+
+void lsx_compandt_delay_stop(sox_compandt_delay_t * d)
+{
+  free(d->buf);
+  d->buf = NULL;
+}
+
+static void apply_gains(sox_sample_t * p, double const * gain, size_t n,
+    sox_uint64_t * clips)
+{
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    double out = p[i] * gain[i];
+    SOX_SAMPLE_CLIP_COUNT(out, (*clips));
+    p[i] = out;
+  }
+}
+
+/* Add n samples and their gains and return the *out_n samples that are
+ * ready, which stay valid until the next call */
+sox_sample_t const * lsx_compandt_delay_flow(sox_compandt_delay_t * d,
+    sox_sample_t const * in, double const * gain, size_t n,
+    sox_uint64_t * clips, size_t * out_n)
+{
+  sox_sample_t * p;
+  size_t old = d->cnt;
+
+  if (d->head + d->cnt + n > d->alloc) {
+    memmove(d->buf, d->buf + d->head, d->cnt * sizeof(*d->buf));
+    d->head = 0;
+  }
+  p = d->buf + d->head + d->cnt;
+  memcpy(p, in, n * sizeof(*p));
+  d->cnt += n;
+
+  if (old >= d->apply)
+    apply_gains(p - d->apply, gain, n, clips);
+  else if (old + n > d->apply) /* The first samples have no earlier ones */
+    apply_gains(d->buf + d->head, gain + d->apply - old, old + n - d->apply, clips);
+
+  p = d->buf + d->head;
+  *out_n = d->cnt > d->length? d->cnt - d->length : 0;
+  d->head += *out_n;
+  d->cnt -= *out_n;
+  if (!d->cnt)
+    d->head = 0;
+  return p;
+}
+
+/* Return up to max of the remaining samples, the last ones with gain[] for
+ * each channel */
+sox_sample_t const * lsx_compandt_delay_drain(sox_compandt_delay_t * d,
+    double const * gain, unsigned channels, size_t max,
+    sox_uint64_t * clips, size_t * out_n)
+{
+  sox_sample_t * p = d->buf + d->head;
+
+  if (!d->drained) {
+    size_t i, n = min(d->apply, d->cnt);
+    for (i = d->cnt - n; i < d->cnt; ++i) {
+      double out = p[i] * gain[i % channels];
+      SOX_SAMPLE_CLIP_COUNT(out, (*clips));
+      p[i] = out;
+    }
+    d->drained = sox_true;
+  }
+  *out_n = min(max, d->cnt);
+  d->head += *out_n;
+  d->cnt -= *out_n;
+  return p;
 }
 
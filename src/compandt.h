@@ -26,12 +26,41 @@ typedef struct {
   double out_min_lin;
   double outgain_dB;        /* Post processor gain */
   double curve_dB;
+  double * table;           /* Gains at table_bins points per octave */
+  char * table_exact;       /* Bins where the function itself is used */
+  unsigned table_bins;
+  int table_min_exp, table_max_exp; /* Octaves covered, as from frexp() */
 } sox_compandt_t;
 
+/* Lookahead delay: each gain is applied to the sample apply samples before
+ * the one it was measured at and samples are output length samples late */
+typedef struct {
+  sox_sample_t * buf;
+  size_t apply, length;
+  size_t head, cnt, alloc;  /* Samples waiting are buf[head] to buf[head+cnt-1] */
+  sox_bool drained;
+} sox_compandt_delay_t;
+
 sox_bool lsx_compandt_parse(sox_compandt_t * t, char * points, char * gain);
 sox_bool lsx_compandt_show(sox_compandt_t * t, sox_plot_t plot);
+void    lsx_compandt_make_table(sox_compandt_t * t);
 void    lsx_compandt_kill(sox_compandt_t * p);
 
+void lsx_compandt_gains(sox_compandt_t * t, double * gain,
+    sox_sample_t const * in, size_t frames, unsigned channels, sox_bool linked,
+    double full_scale, double * volume, double const * attack,
+    double const * decay);
+
+void lsx_compandt_delay_init(sox_compandt_delay_t * d, size_t apply,
+    size_t length, size_t block);
+void lsx_compandt_delay_stop(sox_compandt_delay_t * d);
+sox_sample_t const * lsx_compandt_delay_flow(sox_compandt_delay_t * d,
+    sox_sample_t const * in, double const * gain, size_t n,
+    sox_uint64_t * clips, size_t * out_n);
+sox_sample_t const * lsx_compandt_delay_drain(sox_compandt_delay_t * d,
+    double const * gain, unsigned channels, size_t max,
+    sox_uint64_t * clips, size_t * out_n);
+
 /* Place in header to allow in-lining */
 static double lsx_compandt(sox_compandt_t * t, double in_lin)
 {
@@ -50,3 +79,26 @@ static double lsx_compandt(sox_compandt_t * t, double in_lin)
 
   return exp(out_log);
 }
+
+/* The same from the table made by lsx_compandt_make_table(), linearly
+ * interpolated within each octave */
+static double lsx_compandt_lookup(sox_compandt_t * t, double in_lin)
+{
+  double pos;
+  size_t i;
+  int e;
+
+  if (in_lin <= t->in_min_lin)
+    return t->out_min_lin;
+  pos = frexp(in_lin, &e); /* in_lin = pos * 2^e, .5 <= pos < 1 */
+  if (e > t->table_max_exp) /* Level >= 1 */
+    return lsx_compandt(t, in_lin);
+
+  pos = (pos * 2 - 1) * t->table_bins;
+  i = (size_t)pos;
+  pos -= i;
+  i += (size_t)(e - t->table_min_exp) * t->table_bins;
+  if (t->table_exact[i])
+    return lsx_compandt(t, in_lin);
+  return t->table[i] + (t->table[i + 1] - t->table[i]) * pos;
+}
@@ -81,13 +81,17 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
   size_t odone = min(*osamp, (size_t)fifo_occupancy(&p->output_fifo));
 
   double const * s = fifo_read(&p->output_fifo, (int)odone, NULL);
-  lsx_save_samples(obuf, s, odone, &effp->clips);
+  if (effp->handler.flags & LSX_EFF_OUT_DOUBLE)
+    lsx_save_double_samples(obuf, s, odone);
+  else lsx_save_samples(obuf, s, odone, &effp->clips);
   p->samples_out += odone;
 
   if (*isamp && odone < *osamp) {
     double * t = fifo_write(&p->input_fifo, (int)*isamp, NULL);
     p->samples_in += *isamp;
-    lsx_load_samples(t, ibuf, *isamp);
+    if (effp->handler.flags & LSX_EFF_IN_DOUBLE)
+      lsx_load_double_samples(t, ibuf, *isamp);
+    else lsx_load_samples(t, ibuf, *isamp);
     filter(p);
   }
   else *isamp = 0;
@@ -132,7 +136,7 @@ static int stop(sox_effect_t * effp)
 sox_effect_handler_t const * lsx_dft_filter_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    NULL, NULL, NULL, SOX_EFF_GAIN, NULL, start, flow, drain, stop, NULL, 0
+    NULL, NULL, NULL, SOX_EFF_GAIN | SOX_EFF_FLOAT, NULL, start, flow, drain, stop, NULL, 0
   };
   return &handler;
 }
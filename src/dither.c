@@ -458,7 +458,7 @@ sox_effect_handler_t const * lsx_dither_effect_fn(void)
     NULL
   };
   static sox_effect_handler_t handler = {
-    "dither", usage, extra_usage, SOX_EFF_PREC,
+    "dither", usage, extra_usage, SOX_EFF_PREC | SOX_EFF_ONCE,
     getopts, start, flow, drain, stop, 0, sizeof(priv_t)
   };
   return &handler;
@@ -17,12 +17,12 @@
 
 /* Private data */
 typedef struct {
-        int     counter;
         int     num_delays;
-        float   *delay_buf;
+        lsx_delay_t line;
         float   gain_in, gain_out;
         float   *delay, *decay;
         ptrdiff_t *samples, maxsamples;
+        size_t  block;          /* Samples that can be processed at once */
         size_t fade_out;
 } priv_t;
 
@@ -95,19 +95,21 @@ static int sox_echo_start(sox_effect_t * effp)
                 if ( echo->samples[i] > echo->maxsamples )
                         echo->maxsamples = echo->samples[i];
         }
-	echo->delay_buf = NULL;	/* Provoke segfault if accessed */
-	if (echo->maxsamples > 0) {
-                echo->delay_buf = lsx_calloc(echo->maxsamples,
-                                             sizeof(*(echo->delay_buf)));
-		/* calloc() sets the memory to zero */
-	}
+        /* A delay too short to be a sample reads the oldest one */
+        echo->block = LSX_DELAY_BLOCK;
+        for ( i = 0; i < echo->num_delays && echo->maxsamples > 0; i++ ) {
+                if ( echo->samples[i] == 0 )
+                        echo->samples[i] = echo->maxsamples;
+                echo->block = min(echo->block, (size_t)echo->samples[i]);
+        }
+	if (echo->maxsamples > 0)
+                lsx_delay_init(&echo->line, (size_t)echo->maxsamples);
         sum_in_volume = echo->gain_in;
         for ( i = 0; i < echo->num_delays; i++ )
                 sum_in_volume += echo->decay[i];
         if ( fabsf(sum_in_volume * echo->gain_out) > 1.0 )
                 lsx_warn("the output may saturate; a safe gain-out is %g",
 		         fabsf(1.0f / sum_in_volume));
-        echo->counter = 0;
         echo->fade_out = echo->maxsamples;
 
   effp->out_signal.length = SOX_UNKNOWN_LEN; /* TODO: calculate actual length */
@@ -116,43 +118,62 @@ static int sox_echo_start(sox_effect_t * effp)
 }
 
 /*
- * Processed signed long samples from ibuf to obuf.
- * Return number of samples processed.
+ * Process len samples from ibuf, or silence if ibuf is NULL, to obuf
+ * a block at a time; no delay is shorter than a block, so each block's
+ * delayed samples are all in the delay line already.
  */
-static int sox_echo_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
-                 size_t *isamp, size_t *osamp)
+static void echo_process(sox_effect_t * effp, const sox_sample_t *ibuf,
+                         sox_sample_t *obuf, size_t len)
 {
         priv_t * echo = (priv_t *) effp->priv;
+        float d_in[LSX_DELAY_BLOCK], d_out[LSX_DELAY_BLOCK];
+        double tap[LSX_DELAY_BLOCK];
+        size_t i, n;
         int j;
-        float d_in, d_out;
-        size_t len = min(*isamp, *osamp);
-        *isamp = *osamp = len;
 
-        while (len--) {
-                d_in = (float) *ibuf++;
-                /* Compute output first */
-                d_out = d_in * echo->gain_in;
+        for (; len; len -= n) {
+                n = min(len, echo->block);
+                for (i = 0; i < n; i++) {
+                        d_in[i] = ibuf? (float) *ibuf++ : 0;
+                        /* Compute output first */
+                        d_out[i] = d_in[i] * echo->gain_in;
+                }
 		if (echo->maxsamples == 0) {
-			for ( j = 0; j < echo->num_delays; j++ ) {
-				d_out += d_in * echo->decay[j];
-			}
+			for ( j = 0; j < echo->num_delays; j++ )
+				for (i = 0; i < n; i++)
+					d_out[i] += d_in[i] * echo->decay[j];
 		} else {
 			for ( j = 0; j < echo->num_delays; j++ ) {
-				d_out += echo->delay_buf[
-	(echo->counter + echo->maxsamples - echo->samples[j]) % echo->maxsamples]
-				* echo->decay[j];
+				lsx_delay_read(&echo->line, tap, (size_t)echo->samples[j], n);
+				for (i = 0; i < n; i++)
+					d_out[i] += (float)tap[i] * echo->decay[j];
 			}
 		}
-                /* Adjust the output volume and size to 24 bit */
-                d_out = d_out * echo->gain_out;
-                *obuf++ = SOX_ROUND_CLIP_COUNT(d_out, effp->clips);
+                for (i = 0; i < n; i++) {
+                        /* Adjust the output volume and size to 24 bit */
+                        d_out[i] = d_out[i] * echo->gain_out;
+                        *obuf++ = SOX_ROUND_CLIP_COUNT(d_out[i], effp->clips);
+                }
                 /* Store input in delay buffer */
                 if (echo->maxsamples > 0) {
-		        echo->delay_buf[echo->counter] = d_in;
-			/* Adjust the counter */
-			echo->counter = ( echo->counter + 1 ) % echo->maxsamples;
-		}
+                        for (i = 0; i < n; i++)
+                                tap[i] = d_in[i];
+                        lsx_delay_write(&echo->line, tap, n);
+                }
         }
+}
+
+/*
+ * Processed signed long samples from ibuf to obuf.
+ * Return number of samples processed.
+ */
+static int sox_echo_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
+                 size_t *isamp, size_t *osamp)
+{
+        size_t len = min(*isamp, *osamp);
+        *isamp = *osamp = len;
+
+        echo_process(effp, ibuf, obuf, len);
         /* processed all samples */
         return (SOX_SUCCESS);
 }
@@ -163,32 +184,11 @@ static int sox_echo_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_samp
 static int sox_echo_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
         priv_t * echo = (priv_t *) effp->priv;
-        float d_in, d_out;
-        int j;
-        size_t done;
+        size_t done = min(*osamp, echo->fade_out);
 
-        done = 0;
         /* drain out delay samples */
-        while ( ( done < *osamp ) && ( done < echo->fade_out ) ) {
-                d_in = 0;
-                d_out = 0;
-		if (echo->maxsamples > 0) {
-		    for ( j = 0; j < echo->num_delays; j++ ) {
-			    d_out += echo->delay_buf[
-    (echo->counter + echo->maxsamples - echo->samples[j]) % echo->maxsamples]
-			    * echo->decay[j];
-		    }
-		}
-                /* Adjust the output volume and size to 24 bit */
-                d_out = d_out * echo->gain_out;
-                *obuf++ = SOX_ROUND_CLIP_COUNT(d_out, effp->clips);
-                /* Store input in delay buffer */
-                echo->delay_buf[echo->counter] = d_in;
-                /* Adjust the counters */
-                echo->counter = ( echo->counter + 1 ) % echo->maxsamples;
-                done++;
-                echo->fade_out--;
-        };
+        echo_process(effp, NULL, obuf, done);
+        echo->fade_out -= done;
         /* samples played, it remains */
         *osamp = done;
         if (echo->fade_out == 0)
@@ -203,7 +203,7 @@ static int sox_echo_stop(sox_effect_t * effp)
 
         /* free per-channel data */
         free(echo->samples);
-        free(echo->delay_buf);
+        lsx_delay_stop(&echo->line);
         return (SOX_SUCCESS);
 }
 
@@ -24,12 +24,13 @@
  *            <delay> microseconds (== samples[i] samples) in the future.
  */
 typedef struct {
-        int     *counter;
         int     num_delays;
-        float   **delay_buf;
+        lsx_delay_t *line;
+        double  *tap;           /* A block of each line's output */
         float   gain_in, gain_out;
         float   *delay, *decay;
         ptrdiff_t *samples;
+        size_t  block;          /* Samples that can be processed at once */
         size_t sumsamples;
 } priv_t;
 
@@ -87,10 +88,11 @@ static int sox_echos_start(sox_effect_t * effp)
         int i;
         float sum_in_volume;
 
-	lsx_vcalloc(echos->counter, echos->num_delays);
+	lsx_vcalloc(echos->line, echos->num_delays);
 	lsx_vcalloc(echos->samples, echos->num_delays);
-	lsx_vcalloc(echos->delay_buf, echos->num_delays);
+	lsx_valloc(echos->tap, echos->num_delays * LSX_DELAY_BLOCK);
         echos->sumsamples = 0;
+        echos->block = LSX_DELAY_BLOCK;
         for ( i = 0; i < echos->num_delays; i++ ) {
                 echos->samples[i] = echos->delay[i] * effp->in_signal.rate / 1000.0;
                 if ( echos->samples[i] < 1 ) {
@@ -98,11 +100,9 @@ static int sox_echos_start(sox_effect_t * effp)
 		             1000 / effp->in_signal.rate);
                     return (SOX_EOF);
                 }
-		echos->delay_buf[i] = lsx_calloc(echos->samples[i],
-		                                 sizeof(*echos->delay_buf[i]));
-	        /* calloc() returns the memory already zeroed */
-                echos->counter[i] = 0;
+		lsx_delay_init(&echos->line[i], (size_t)echos->samples[i]);
                 echos->sumsamples += echos->samples[i];
+                echos->block = min(echos->block, (size_t)echos->samples[i]);
         }
         sum_in_volume = echos->gain_in;
         for ( i = 0; i < echos->num_delays; i++ )
@@ -117,40 +117,64 @@ static int sox_echos_start(sox_effect_t * effp)
 }
 
 /*
- * Processed signed long samples from ibuf to obuf.
- * Return number of samples processed.
+ * Process len samples from ibuf, or silence if ibuf is NULL, to obuf
+ * a block at a time.  No delay is shorter than a block, so the outputs of
+ * all the delay lines for a block can be read before any input is stored.
  */
-static int sox_echos_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
-                size_t *isamp, size_t *osamp)
+static void echos_process(sox_effect_t * effp, const sox_sample_t *ibuf,
+                          sox_sample_t *obuf, size_t len)
 {
         priv_t * echos = (priv_t *) effp->priv;
+        float d_in[LSX_DELAY_BLOCK], d_out[LSX_DELAY_BLOCK];
+        size_t i, n;
         int j;
-        float d_in, d_out;
-        size_t len = min(*isamp, *osamp);
-        *isamp = *osamp = len;
 
-        while (len--) {
-                /* Store delays as 24-bit signed longs */
-                d_in = (float) *ibuf++;
-                /* Compute output first */
-                d_out = d_in * echos->gain_in;
+        for (; len; len -= n) {
+                n = min(len, echos->block);
+                for ( j = 0; j < echos->num_delays; j++ )
+                        lsx_delay_read(&echos->line[j],
+                            echos->tap + j * LSX_DELAY_BLOCK,
+                            (size_t)echos->samples[j], n);
+                for (i = 0; i < n; i++) {
+                        /* Store delays as 24-bit signed longs */
+                        d_in[i] = ibuf? (float) *ibuf++ : 0;
+                        /* Compute output first */
+                        d_out[i] = d_in[i] * echos->gain_in;
+                }
                 for ( j = 0; j < echos->num_delays; j++ ) {
-                        d_out += echos->delay_buf[j][echos->counter[j]] * echos->decay[j];
+                        double const * tap = echos->tap + j * LSX_DELAY_BLOCK;
+                        for (i = 0; i < n; i++)
+                                d_out[i] += (float)tap[i] * echos->decay[j];
+                }
+                for (i = 0; i < n; i++) {
+                        /* Adjust the output volume and size to 24 bit */
+                        d_out[i] = d_out[i] * echos->gain_out;
+                        *obuf++ = SOX_ROUND_CLIP_COUNT(d_out[i], effp->clips);
                 }
-                /* Adjust the output volume and size to 24 bit */
-                d_out = d_out * echos->gain_out;
-                *obuf++ = SOX_ROUND_CLIP_COUNT(d_out, effp->clips);
                 /* Mix decay of delays and input */
                 for ( j = echos->num_delays - 1; j > 0; j-- ) {
-		    echos->delay_buf[j][echos->counter[j]] =
-		    echos->delay_buf[j-1][echos->counter[j-1]] + d_in;
+                        double * tap = echos->tap + (j - 1) * LSX_DELAY_BLOCK;
+                        for (i = 0; i < n; i++)
+                                tap[i] = (float)tap[i] + d_in[i];
+                        lsx_delay_write(&echos->line[j], tap, n);
                 }
-                echos->delay_buf[0][echos->counter[0]] = d_in;
-                /* Adjust the counters */
-                for ( j = 0; j < echos->num_delays; j++ )
-                        echos->counter[j] =
-                           ( echos->counter[j] + 1 ) % echos->samples[j];
+                for (i = 0; i < n; i++)
+                        echos->tap[i] = d_in[i];
+                lsx_delay_write(&echos->line[0], echos->tap, n);
         }
+}
+
+/*
+ * Processed signed long samples from ibuf to obuf.
+ * Return number of samples processed.
+ */
+static int sox_echos_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
+                size_t *isamp, size_t *osamp)
+{
+        size_t len = min(*isamp, *osamp);
+        *isamp = *osamp = len;
+
+        echos_process(effp, ibuf, obuf, len);
         /* processed all samples */
         return (SOX_SUCCESS);
 }
@@ -161,33 +185,11 @@ static int sox_echos_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sam
 static int sox_echos_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
         priv_t * echos = (priv_t *) effp->priv;
-        float d_out;
-        int j;
-        size_t done;
+        size_t done = min(*osamp, echos->sumsamples);
 
-        done = 0;
         /* drain out delay samples */
-        while ( ( done < *osamp ) && ( done < echos->sumsamples ) ) {
-                d_out = 0;
-                for ( j = 0; j < echos->num_delays; j++ ) {
-                        d_out += echos->delay_buf[j][echos->counter[j]] * echos->decay[j];
-                }
-                /* Adjust the output volume and size to 24 bit */
-                d_out = d_out * echos->gain_out;
-                *obuf++ = SOX_ROUND_CLIP_COUNT(d_out, effp->clips);
-                /* Mix decay of delays and input */
-                for ( j = echos->num_delays - 1; j > 0; j-- ) {
-                        echos->delay_buf[j][echos->counter[j]] =
-                        echos->delay_buf[j-1][echos->counter[j-1]];
-                }
-                echos->delay_buf[0][echos->counter[0]] = 0;
-                /* Adjust the counters */
-                for ( j = 0; j < echos->num_delays; j++ )
-                        echos->counter[j] =
-                           ( echos->counter[j] + 1 ) % echos->samples[j];
-                done++;
-                echos->sumsamples--;
-        };
+        echos_process(effp, NULL, obuf, done);
+        echos->sumsamples -= done;
         /* samples played, it remains */
         *osamp = done;
         if (echos->sumsamples == 0)
@@ -204,12 +206,12 @@ static int sox_echos_stop(sox_effect_t * effp)
         priv_t * echos = (priv_t *) effp->priv;
 	int i;
 
-        free(echos->counter);
         free(echos->samples);
 	for (i=0; i<echos->num_delays; i++)
-	    free(echos->delay_buf[i]);
-        free(echos->delay_buf);
-        echos->delay_buf = NULL;
+	    lsx_delay_stop(&echos->line[i]);
+        free(echos->line);
+        echos->line = NULL;
+        free(echos->tap);
         return (SOX_SUCCESS);
 }
 
@@ -17,9 +17,46 @@
 
 #define LSX_EFF_ALIAS
 #include "sox_i.h"
+#include <time.h>
 
 #define DEBUG_EFFECTS_CHAIN 0
 
+/* Gets the wall-clock time and the calling thread's CPU time in seconds,
+ * for the effects' stats, if they are being timed */
+static void now(double t[2])
+{
+  if (!sox_globals.profile) {
+    t[0] = t[1] = 0;
+    return;
+  }
+#if defined HAVE_CLOCK_GETTIME && defined CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  t[0] = ts.tv_sec + ts.tv_nsec * 1e-9;
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  t[1] = ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+  t[1] = (double)clock() / CLOCKS_PER_SEC;
+#endif
+#else
+  t[0] = t[1] = (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Adds the times since t0 to *wall and *cpu */
+static void add_times(double const t0[2], double * wall, double * cpu)
+{
+  double t[2];
+
+  if (!sox_globals.profile)
+    return;
+  now(t);
+  *wall += t[0] - t0[0];
+  *cpu += t[1] - t0[1];
+}
+
 /* Default effect handler functions for do-nothing situations: */
 
 static int default_function(sox_effect_t * effp UNUSED)
@@ -116,6 +153,36 @@ int lsx_effect_set_imin(sox_effect_t * effp, size_t imin)
   return SOX_SUCCESS;
 }
 
+/* Set whether effect n of the chain (all of its flows) gives doubles */
+static void set_out_double(sox_effects_chain_t * chain, size_t n, sox_bool out_double)
+{
+  size_t f;
+
+  for (f = 0; f < chain->effects[n]->flows; ++f)
+    if (out_double)
+      chain->effects[n][f].handler.flags |= LSX_EFF_OUT_DOUBLE;
+    else chain->effects[n][f].handler.flags &= ~LSX_EFF_OUT_DOUBLE;
+}
+
+/* Whether effect n takes doubles from the one before it */
+static sox_bool exchanges_doubles(sox_effects_chain_t const * chain, size_t n,
+    sox_effect_t const * effp)
+{
+  return n && (effp->handler.flags &
+      chain->effects[n - 1]->handler.flags & SOX_EFF_FLOAT) != 0;
+}
+
+/* The size of the samples in an effect's output buffer */
+static size_t sample_size(sox_effect_t const * effp)
+{
+  return effp->handler.flags & LSX_EFF_OUT_DOUBLE?
+      sizeof(double) : sizeof(sox_sample_t);
+}
+
+/* The address of sample i of an output buffer of effp */
+#define OBUF(effp, buf, i) \
+    ((sox_sample_t *)((char *)(buf) + (i) * sample_size(effp)))
+
 /* Effects table to be extended in steps of EFF_TABLE_STEP */
 #define EFF_TABLE_STEP 8
 
@@ -124,6 +191,9 @@ int lsx_effect_set_imin(sox_effect_t * effp, size_t imin)
  * given options and *in, the effect can choose to do differently.  Whatever
  * output rate and channels the effect does produce are written back to *in,
  * ready for the next effect in the chain.
+ * If this effect and the one before it can both exchange doubles
+ * (SOX_EFF_FLOAT), they do so, saving the conversion to sox_sample_ts and
+ * back and any clipping in between.
  */
 int sox_add_effect(sox_effects_chain_t * chain, sox_effect_t * effp, sox_signalinfo_t * in, sox_signalinfo_t const * out)
 {
@@ -150,6 +220,10 @@ int sox_add_effect(sox_effects_chain_t * chain, sox_effect_t * effp, sox_signali
     (effp->handler.flags & SOX_EFF_MCHAN)? 1 : effp->in_signal.channels;
   effp->clips = 0;
   effp->imin = 0;
+  memset(&effp->stats, 0, sizeof(effp->stats));
+  effp->handler.flags &= ~(LSX_EFF_IN_DOUBLE | LSX_EFF_OUT_DOUBLE);
+  if (exchanges_doubles(chain, chain->length, effp))
+    effp->handler.flags |= LSX_EFF_IN_DOUBLE;
   eff0 = *effp, eff0.priv = lsx_memdup(eff0.priv, eff0.handler.priv_size);
   eff0.in_signal.mult = NULL; /* Only used in channel 0 */
   ret = start(effp);
@@ -204,6 +278,11 @@ int sox_add_effect(sox_effects_chain_t * chain, sox_effect_t * effp, sox_signali
     }
   }
 
+  if (effp->handler.flags & LSX_EFF_IN_DOUBLE) {
+    lsx_debug("exchanging doubles with `%s'",
+        chain->effects[chain->length - 1]->handler.name);
+    set_out_double(chain, chain->length - 1, sox_true);
+  }
   ++chain->length;
   free(eff0.priv);
   return SOX_SUCCESS;
@@ -231,10 +310,10 @@ int sox_add_effect(sox_effects_chain_t * chain, sox_effect_t * effp, sox_signali
  * The interleave() and deinterleave() functions convert between these
  * two representations.
  */
-static void interleave(size_t flows, size_t length, sox_sample_t *from,
-    size_t bufsiz, size_t offset, sox_sample_t *to);
-static void deinterleave(size_t flows, size_t length, sox_sample_t *from,
-    sox_sample_t *to, size_t bufsiz, size_t offset);
+static void interleave(sox_effect_t const * effp, size_t flows, size_t length,
+    sox_sample_t *from, size_t bufsiz, size_t offset, sox_sample_t *to);
+static void deinterleave(sox_effect_t const * effp, size_t flows, size_t length,
+    sox_sample_t *from, sox_sample_t *to, size_t bufsiz, size_t offset);
 
 static int flow_effect(sox_effects_chain_t * chain, size_t n)
 {
@@ -250,19 +329,28 @@ static int flow_effect(sox_effects_chain_t * chain, size_t n)
   size_t pre_idone = idone;
   size_t pre_odone = obeg;
 #endif
+  double t0[2], dummy = 0;
 
   if (effp->flows == 1) {     /* Run effect on all channels at once */
     idone -= idone % effp->in_signal.channels;
-    effstatus = effp->handler.flow(effp, effp1->obuf + effp1->obeg,
-                    il_change ? chain->il_buf : effp->obuf + effp->oend,
+    now(t0);
+    effstatus = effp->handler.flow(effp, OBUF(effp1, effp1->obuf, effp1->obeg),
+                    il_change ? chain->il_buf : OBUF(effp, effp->obuf, effp->oend),
                     &idone, &obeg);
+    add_times(t0, &effp->stats.flow_time, &effp->stats.flow_cpu_time);
+    ++effp->stats.flow_calls;
+    effp->stats.samples_in += idone;
+    effp->stats.samples_out += obeg;
     if (obeg % effp->out_signal.channels != 0) {
       lsx_fail("multi-channel effect flowed asymmetrically!");
       effstatus = SOX_EOF;
     }
-    if (il_change)
-      deinterleave(chain->effects[n+1]->flows, obeg, chain->il_buf,
+    if (il_change) {
+      now(t0);
+      deinterleave(effp, chain->effects[n+1]->flows, obeg, chain->il_buf,
           effp->obuf, sox_globals.bufsiz, effp->oend);
+      add_times(t0, &effp->stats.interleave_time, &dummy);
+    }
   } else {               /* Run effect on each channel individually */
     sox_sample_t *obuf = il_change ? chain->il_buf : effp->obuf;
     size_t flow_offs = sox_globals.bufsiz/effp->flows;
@@ -284,12 +372,21 @@ static int flow_effect(sox_effects_chain_t * chain, size_t n)
         lastprivate(idone_min,odone_min,idone_max,odone_max)
 #endif
     for (f = 0; f < effp->flows; ++f) {
+      sox_effect_stats_t * stats = &chain->effects[n][f].stats;
       size_t idonec = idone / effp->flows;
       size_t odonec = obeg / effp->flows;
-      int eff_status_c = effp->handler.flow(&chain->effects[n][f],
-          effp1->obuf + f*flow_offs + effp1->obeg/effp->flows,
-          obuf + f*flow_offs + effp->oend/effp->flows,
+      double t0c[2];
+      int eff_status_c;
+
+      now(t0c);
+      eff_status_c = effp->handler.flow(&chain->effects[n][f],
+          OBUF(effp1, effp1->obuf, f*flow_offs + effp1->obeg/effp->flows),
+          OBUF(effp, obuf, f*flow_offs + effp->oend/effp->flows),
           &idonec, &odonec);
+      add_times(t0c, &stats->flow_time, &stats->flow_cpu_time);
+      ++stats->flow_calls;
+      stats->samples_in += idonec;
+      stats->samples_out += odonec;
       idone_min = min(idonec, idone_min); idone_max = max(idonec, idone_max);
       odone_min = min(odonec, odone_min); odone_max = max(odonec, odone_max);
 
@@ -304,9 +401,12 @@ static int flow_effect(sox_effects_chain_t * chain, size_t n)
     idone = effp->flows * idone_max;
     obeg = effp->flows * odone_max;
 
-    if (il_change)
-      interleave(effp->flows, obeg, chain->il_buf, sox_globals.bufsiz,
-          effp->oend, effp->obuf + effp->oend);
+    if (il_change) {
+      now(t0);
+      interleave(effp, effp->flows, obeg, chain->il_buf, sox_globals.bufsiz,
+          effp->oend, OBUF(effp, effp->obuf, effp->oend));
+      add_times(t0, &effp->stats.interleave_time, &dummy);
+    }
   }
   effp1->obeg += idone;
   if (effp1->obeg == effp1->oend)
@@ -314,9 +414,9 @@ static int flow_effect(sox_effects_chain_t * chain, size_t n)
   else if (effp1->oend - effp1->obeg < effp->imin) { /* Need to refill? */
     size_t flow_offs = sox_globals.bufsiz/effp->flows;
     for (f = 0; f < effp->flows; ++f)
-      memcpy(effp1->obuf + f * flow_offs,
-          effp1->obuf + f * flow_offs + effp1->obeg/effp->flows,
-          (effp1->oend - effp1->obeg)/effp->flows * sizeof(*effp1->obuf));
+      memcpy(OBUF(effp1, effp1->obuf, f * flow_offs),
+          OBUF(effp1, effp1->obuf, f * flow_offs + effp1->obeg/effp->flows),
+          (effp1->oend - effp1->obeg)/effp->flows * sample_size(effp1));
     effp1->oend -= effp1->obeg;
     effp1->obeg = 0;
   }
@@ -346,45 +446,65 @@ static int drain_effect(sox_effects_chain_t * chain, size_t n)
 #if DEBUG_EFFECTS_CHAIN
   size_t pre_odone = obeg;
 #endif
+  double t0[2], dummy = 0;
 
   if (effp->flows == 1) { /* Run effect on all channels at once */
+    now(t0);
     effstatus = effp->handler.drain(effp,
-                    il_change ? chain->il_buf : effp->obuf + effp->oend,
+                    il_change ? chain->il_buf : OBUF(effp, effp->obuf, effp->oend),
                     &obeg);
+    add_times(t0, &effp->stats.drain_time, &effp->stats.drain_cpu_time);
+    ++effp->stats.drain_calls;
+    effp->stats.samples_out += obeg;
     if (obeg % effp->out_signal.channels != 0) {
       lsx_fail("multi-channel effect drained asymmetrically!");
       effstatus = SOX_EOF;
     }
-    if (il_change)
-      deinterleave(chain->effects[n+1]->flows, obeg, chain->il_buf,
+    if (il_change) {
+      now(t0);
+      deinterleave(effp, chain->effects[n+1]->flows, obeg, chain->il_buf,
           effp->obuf, sox_globals.bufsiz, effp->oend);
+      add_times(t0, &effp->stats.interleave_time, &dummy);
+    }
   } else {                       /* Run effect on each channel individually */
     sox_sample_t *obuf = il_change ? chain->il_buf : effp->obuf;
     size_t flow_offs = sox_globals.bufsiz/effp->flows;
     size_t odone_last = 0; /* Initialised to prevent warning */
 
     for (f = 0; f < effp->flows; ++f) {
+      sox_effect_stats_t * stats = &chain->effects[n][f].stats;
       size_t odonec = obeg / effp->flows;
-      int eff_status_c = effp->handler.drain(&chain->effects[n][f],
-          obuf + f*flow_offs + effp->oend/effp->flows,
+      int eff_status_c;
+
+      now(t0);
+      eff_status_c = effp->handler.drain(&chain->effects[n][f],
+          OBUF(effp, obuf, f*flow_offs + effp->oend/effp->flows),
           &odonec);
+      add_times(t0, &stats->drain_time, &stats->drain_cpu_time);
+      ++stats->drain_calls;
+      stats->samples_out += odonec;
       if (f && (odonec != odone_last)) {
         lsx_fail("drained asymmetrically!");
         effstatus = SOX_EOF;
       }
       odone_last = odonec;
 
-      if (eff_status_c != SOX_SUCCESS)
+      if (eff_status_c == SOX_REPLAY && effstatus != SOX_EOF)
+        effstatus = SOX_REPLAY;
+      else if (eff_status_c != SOX_SUCCESS)
         effstatus = SOX_EOF;
     }
 
     obeg = effp->flows * odone_last;
 
-    if (il_change)
-      interleave(effp->flows, obeg, chain->il_buf, sox_globals.bufsiz,
-          effp->oend, effp->obuf + effp->oend);
+    if (il_change) {
+      now(t0);
+      interleave(effp, effp->flows, obeg, chain->il_buf, sox_globals.bufsiz,
+          effp->oend, OBUF(effp, effp->obuf, effp->oend));
+      add_times(t0, &effp->stats.interleave_time, &dummy);
+    }
   }
-  if (!obeg)   /* This is the only thing that drain has and flow hasn't */
+  if (!obeg && effstatus != SOX_REPLAY) /* This is the only thing that drain has and flow hasn't */
     effstatus = SOX_EOF;
 
   effp->oend += obeg;
@@ -395,10 +515,11 @@ static int drain_effect(sox_effects_chain_t * chain, size_t n)
       n, effp->flows, (size_t)0, pre_odone, (size_t)0, obeg);
 #endif
 
-  return effstatus == SOX_SUCCESS? SOX_SUCCESS : SOX_EOF;
+  return effstatus == SOX_SUCCESS || effstatus == SOX_REPLAY? effstatus : SOX_EOF;
 }
 
-/* Flow data through the effects chain until an effect or callback gives EOF */
+/* Flow data through the effects chain until an effect or callback gives EOF
+ * or an effect asks for its input to be replayed */
 int sox_flow_effects(sox_effects_chain_t * chain, int (* callback)(sox_bool all_done, void * client_data), void * client_data)
 {
   int flow_status = SOX_SUCCESS;
@@ -408,7 +529,8 @@ int sox_flow_effects(sox_effects_chain_t * chain, int (* callback)(sox_bool all_
 
   for (e = 0; e < chain->length; ++e) {
     sox_effect_t *effp = chain->effects[e];
-    lsx_revalloc(effp->obuf, sox_globals.bufsiz);
+    /* Room for doubles, which an effect may give depending on the next */
+    effp->obuf = lsx_realloc(effp->obuf, sox_globals.bufsiz * sizeof(double));
       /* Memory will be freed by sox_delete_effect() later. */
       /* Possibly there was already a buffer, if this is a used effect;
          it may still contain samples in that case. */
@@ -420,7 +542,7 @@ int sox_flow_effects(sox_effects_chain_t * chain, int (* callback)(sox_bool all_
     max_flows = max(max_flows, effp->flows);
   }
   if (max_flows > 1) /* might need interleave buffer */
-    lsx_valloc(chain->il_buf, sox_globals.bufsiz);
+    chain->il_buf = lsx_malloc(sox_globals.bufsiz * sizeof(double));
   else
     chain->il_buf = NULL;
 
@@ -430,7 +552,7 @@ int sox_flow_effects(sox_effects_chain_t * chain, int (* callback)(sox_bool all_
     sox_effect_t *effp = chain->effects[e];
     if (effp->oend > effp->obeg && chain->effects[e+1]->flows > 1) {
       sox_sample_t *sw = chain->il_buf; chain->il_buf = effp->obuf; effp->obuf = sw;
-      deinterleave(chain->effects[e+1]->flows, effp->oend - effp->obeg,
+      deinterleave(effp, chain->effects[e+1]->flows, effp->oend - effp->obeg,
           chain->il_buf, effp->obuf, sox_globals.bufsiz, effp->obeg);
     }
   }
@@ -440,17 +562,26 @@ int sox_flow_effects(sox_effects_chain_t * chain, int (* callback)(sox_bool all_
 #define have_imin (e > 0 && e < chain->length && chain->effects[e - 1]->oend - chain->effects[e - 1]->obeg >= chain->effects[e]->imin)
     size_t osize = chain->effects[e]->oend - chain->effects[e]->obeg;
     if (e == source_e && (draining || !have_imin)) {
-      if (drain_effect(chain, e) == SOX_EOF) {
+      int drain_status = drain_effect(chain, e);
+      if (drain_status == SOX_REPLAY) {
+        flow_status = SOX_REPLAY;
+        break;
+      }
+      if (drain_status == SOX_EOF) {
         ++source_e;
         draining = sox_false;
       }
-    } else if (have_imin && flow_effect(chain, e) == SOX_EOF) {
-      flow_status = SOX_EOF;
-      if (e == chain->length - 1)
-        break;
-      source_e = e;
-      draining = sox_true;
-    }
+    } else if (have_imin) {
+      if (flow_effect(chain, e) == SOX_EOF) {
+        flow_status = SOX_EOF;
+        if (e == chain->length - 1)
+          break;
+        source_e = e;
+        draining = sox_true;
+      }
+    } else if (e > 0 && e < chain->length &&
+        chain->effects[e - 1]->oend > chain->effects[e - 1]->obeg)
+      ++chain->effects[e]->stats.stalls;
     if (e < chain->length && chain->effects[e]->oend - chain->effects[e]->obeg > osize) /* False for output */
       ++e;
     else if (e == source_e)
@@ -473,7 +604,7 @@ int sox_flow_effects(sox_effects_chain_t * chain, int (* callback)(sox_bool all_
     sox_effect_t *effp = chain->effects[e];
     if (effp->oend > effp->obeg && chain->effects[e+1]->flows > 1) {
       sox_sample_t *sw = chain->il_buf; chain->il_buf = effp->obuf; effp->obuf = sw;
-      interleave(chain->effects[e+1]->flows, effp->oend - effp->obeg,
+      interleave(effp, chain->effects[e+1]->flows, effp->oend - effp->obeg,
           chain->il_buf, sox_globals.bufsiz, effp->obeg, effp->obuf);
     }
   }
@@ -482,6 +613,30 @@ int sox_flow_effects(sox_effects_chain_t * chain, int (* callback)(sox_bool all_
   return flow_status;
 }
 
+int sox_effects_chain_stats(sox_effects_chain_t const * chain, size_t n,
+    sox_effect_stats_t * stats)
+{
+  size_t f;
+
+  memset(stats, 0, sizeof(*stats));
+  if (n >= chain->length)
+    return SOX_EOF;
+  for (f = 0; f < chain->effects[n]->flows; ++f) {
+    sox_effect_stats_t const * s = &chain->effects[n][f].stats;
+    stats->flow_calls += s->flow_calls;
+    stats->drain_calls += s->drain_calls;
+    stats->samples_in += s->samples_in;
+    stats->samples_out += s->samples_out;
+    stats->stalls += s->stalls;
+    stats->flow_time += s->flow_time;
+    stats->flow_cpu_time += s->flow_cpu_time;
+    stats->drain_time += s->drain_time;
+    stats->drain_cpu_time += s->drain_cpu_time;
+    stats->interleave_time += s->interleave_time;
+  }
+  return SOX_SUCCESS;
+}
+
 sox_uint64_t sox_effects_clips(sox_effects_chain_t * chain)
 {
   size_t i, f;
@@ -506,6 +661,8 @@ sox_uint64_t sox_stop_effect(sox_effect_t *effp)
 
 void sox_push_effect_last(sox_effects_chain_t *chain, sox_effect_t *effp)
 {
+  size_t f;
+
   if (chain->length == chain->table_size) {
     chain->table_size += EFF_TABLE_STEP;
     lsx_debug_more("sox_push_effect_last: extending effects table, "
@@ -513,6 +670,14 @@ void sox_push_effect_last(sox_effects_chain_t *chain, sox_effect_t *effp)
     lsx_revalloc(chain->effects, chain->table_size);
   }
 
+  /* Exchange doubles with whatever effect it now follows */
+  for (f = 0; f < effp->flows; ++f) {
+    effp[f].handler.flags &= ~(LSX_EFF_IN_DOUBLE | LSX_EFF_OUT_DOUBLE);
+    if (exchanges_doubles(chain, chain->length, effp))
+      effp[f].handler.flags |= LSX_EFF_IN_DOUBLE;
+  }
+  if (effp->handler.flags & LSX_EFF_IN_DOUBLE)
+    set_out_double(chain, chain->length - 1, sox_true);
   chain->effects[chain->length++] = effp;
 } /* sox_push_effect_last */
 
@@ -524,6 +689,8 @@ sox_effect_t *sox_pop_effect_last(sox_effects_chain_t *chain)
     chain->length--;
     effp = chain->effects[chain->length];
     chain->effects[chain->length] = NULL;
+    if (chain->length)
+      set_out_double(chain, chain->length - 1, sox_false);
     return effp;
   }
   else
@@ -561,6 +728,8 @@ void sox_delete_effect_last(sox_effects_chain_t *chain)
     chain->length--;
     sox_delete_effect(chain->effects[chain->length]);
     chain->effects[chain->length] = NULL;
+    if (chain->length)
+      set_out_double(chain, chain->length - 1, sox_false);
   }
 } /* sox_delete_effect_last */
 
@@ -611,6 +780,7 @@ sox_effect_handler_t const * sox_find_effect(char const * name)
 /*----------------------------- Helper functions -----------------------------*/
 
 /* interleave() parameters:
+ *   effp: the effect whose output it is, which gives the sample size
  *   flows: number of samples per wide sample
  *   length: number of samples to copy
  *     [pertaining to the (non-interleaved) source buffer:]
@@ -620,25 +790,32 @@ sox_effect_handler_t const * sox_find_effect(char const * name)
  *     [pertaining to the (interleaved) destination buffer:]
  *   to: start address
  */
-static void interleave(size_t flows, size_t length, sox_sample_t *from,
-    size_t bufsiz, size_t offset, sox_sample_t *to)
+#define INTERLEAVE(T) { \
+  size_t i; \
+  const size_t wide_samples = length/flows; \
+  const size_t flow_offs = bufsiz/flows; \
+  T *from_ = (T *)from + offset/flows; \
+  for (i = 0; i < wide_samples; i++) { \
+    T *inner_from = from_ + i; \
+    T *inner_to = (T *)to + i * flows; \
+    size_t f; \
+    for (f = 0; f < flows; f++) { \
+      *inner_to++ = *inner_from; \
+      inner_from += flow_offs; \
+    } \
+  } \
+}
+
+static void interleave(sox_effect_t const * effp, size_t flows, size_t length,
+    sox_sample_t *from, size_t bufsiz, size_t offset, sox_sample_t *to)
 {
-  size_t i;
-  const size_t wide_samples = length/flows;
-  const size_t flow_offs = bufsiz/flows;
-  from += offset/flows;
-  for (i = 0; i < wide_samples; i++) {
-    sox_sample_t *inner_from = from + i;
-    sox_sample_t *inner_to = to + i * flows;
-    size_t f;
-    for (f = 0; f < flows; f++) {
-      *inner_to++ = *inner_from;
-      inner_from += flow_offs;
-    }
-  }
+  if (sample_size(effp) == sizeof(double))
+    INTERLEAVE(double)
+  else INTERLEAVE(sox_sample_t)
 }
 
 /* deinterleave() parameters:
+ *   effp: the effect whose output it is, which gives the sample size
  *   flows: number of samples per wide sample
  *   length: number of samples to copy
  *     [pertaining to the (interleaved) source buffer:]
@@ -648,20 +825,26 @@ static void interleave(size_t flows, size_t length, sox_sample_t *from,
  *   bufsiz: total size
  *   offset: position at which to start writing
  */
-static void deinterleave(size_t flows, size_t length, sox_sample_t *from,
-    sox_sample_t *to, size_t bufsiz, size_t offset)
+#define DEINTERLEAVE(T) { \
+  const size_t wide_samples = length/flows; \
+  const size_t flow_offs = bufsiz/flows; \
+  T *to_ = (T *)to + offset/flows; \
+  size_t f; \
+  for (f = 0; f < flows; f++) { \
+    T *inner_to = to_ + f*flow_offs; \
+    T *inner_from = (T *)from + f; \
+    size_t i = wide_samples; \
+    while (i--) { \
+      *inner_to++ = *inner_from; \
+      inner_from += flows; \
+    } \
+  } \
+}
+
+static void deinterleave(sox_effect_t const * effp, size_t flows, size_t length,
+    sox_sample_t *from, sox_sample_t *to, size_t bufsiz, size_t offset)
 {
-  const size_t wide_samples = length/flows;
-  const size_t flow_offs = bufsiz/flows;
-  size_t f;
-  to += offset/flows;
-  for (f = 0; f < flows; f++) {
-    sox_sample_t *inner_to = to + f*flow_offs;
-    sox_sample_t *inner_from = from + f;
-    size_t i = wide_samples;
-    while (i--) {
-      *inner_to++ = *inner_from;
-      inner_from += flows;
-    }
-  }
+  if (sample_size(effp) == sizeof(double))
+    DEINTERLEAVE(double)
+  else DEINTERLEAVE(sox_sample_t)
 }
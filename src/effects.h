@@ -52,6 +52,7 @@
   EFFECT(ladspa)
 #endif
   EFFECT(loudness)
+  EFFECT(loudnorm)
   EFFECT(lowpass)
   EFFECT(mcompand)
   EFFECT(noiseprof)
@@ -87,6 +88,9 @@
   EFFECT(swap)
   EFFECT(synth)
   EFFECT(tempo)
+#ifdef HAVE_PTHREAD_H
+  EFFECT(tee)
+#endif
   EFFECT(treble)
   EFFECT(tremolo)
   EFFECT(trim)
@@ -74,6 +74,20 @@ typedef struct {
   omp_destroy_lock(&p.mutex_1);\
 } while (0)
 
+#elif defined HAVE_PTHREAD_H
+
+/* Without OpenMP, effects can still run on several threads (tee's branch) */
+#include <pthread.h>
+
+typedef pthread_rwlock_t ccrw2_t;
+
+#define ccrw2_become_reader(p) pthread_rwlock_rdlock(&p)
+#define ccrw2_cease_reading(p) pthread_rwlock_unlock(&p)
+#define ccrw2_become_writer(p) pthread_rwlock_wrlock(&p)
+#define ccrw2_cease_writing(p) pthread_rwlock_unlock(&p)
+#define ccrw2_init(p) pthread_rwlock_init(&p, NULL)
+#define ccrw2_clear(p) pthread_rwlock_destroy(&p)
+
 #else
 
 #define ccrw2_become_reader(x) (void)0
@@ -83,7 +97,7 @@ typedef struct {
 #define ccrw2_init(x) (void)0
 #define ccrw2_clear(x) (void)0
 
-#endif /* HAVE_OPENMP */
+#endif /* HAVE_OPENMP, HAVE_PTHREAD_H */
 
 /* Numerical Recipes cubic spline: */
 
@@ -159,7 +173,7 @@ int lsx_set_dft_length(int num_taps) /* Set to 4 x nearest power of 2 */
 static int * lsx_fft_br;
 static double * lsx_fft_sc;
 static int fft_len = -1;
-#if defined HAVE_OPENMP
+#if defined HAVE_OPENMP || defined HAVE_PTHREAD_H
 static ccrw2_t fft_cache_ccrw;
 #endif
 
@@ -652,3 +666,112 @@ void lsx_load_samples(double * const dest, sox_sample_t const * const src,
 }
 
 #endif
+
+/* The same for the double samples that adjacent SOX_EFF_FLOAT effects
+ * exchange in place of sox_sample_ts.  They hold the values that
+ * lsx_save_samples would give, rounded the same way but not clipped,
+ * so the output is the same as through sox_sample_ts unless they clip. */
+#if defined lrint32
+#pragma STDC FENV_ACCESS ON
+
+void lsx_save_double_samples(sox_sample_t * const dest, double const * const src,
+    size_t const n)
+{
+  double * const d = (double *)dest;
+  size_t i;
+  for (i = 0; i < n; ++i)
+    d[i] = rint(src[i]);
+}
+
+void lsx_load_double_samples(double * const dest, sox_sample_t const * const src,
+    size_t const n)
+{
+  memcpy(dest, src, n * sizeof(*dest));
+}
+
+#pragma STDC FENV_ACCESS OFF
+#else
+
+void lsx_save_double_samples(sox_sample_t * const dest, double const * const src,
+    size_t const n)
+{
+  double * const d = (double *)dest;
+  size_t i;
+  for (i = 0; i < n; ++i) {
+    double x = src[i] * (SOX_SAMPLE_MAX + 1.);
+    d[i] = x < 0? ceil(x - .5) : floor(x + .5);
+  }
+}
+
+void lsx_load_double_samples(double * const dest, sox_sample_t const * const src,
+    size_t const n)
+{
+  double const * const s = (double const *)src;
+  size_t i;
+  for (i = 0; i < n; ++i)
+    dest[i] = s[i] * (1. / (SOX_SAMPLE_MAX + 1.));
+}
+
+#endif
+
+void lsx_delay_init(lsx_delay_t * d, size_t length)
+{
+  d->length = length;
+  d->pos = 0;
+  lsx_vcalloc(d->buf, 2 * length);
+}
+
+void lsx_delay_stop(lsx_delay_t * d)
+{
+  free(d->buf);
+  d->buf = NULL;
+}
+
+/* Push n samples, oldest first */
+void lsx_delay_write(lsx_delay_t * d, double const * x, size_t n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+    lsx_delay_push(d, x[i]);
+}
+
+/* Read the samples that were pushed delay samples before each of the next
+ * n to be pushed; 0 < n <= delay <= length */
+void lsx_delay_read(lsx_delay_t const * d, double * y, size_t delay, size_t n)
+{
+  double const * p = d->buf + d->pos + delay - 1;
+  size_t i;
+  for (i = 0; i < n; ++i)
+    y[i] = p[-(ptrdiff_t)i];
+}
+
+void lsx_lfo_init(lsx_lfo_t * lfo, lsx_wave_t wave_type, sox_data_t data_type,
+    size_t length, double min, double max, double phase)
+{
+  size_t i;
+
+  lfo->length = length;
+  lfo->pos = 0;
+  lsx_valloc(lfo->table, 2 * length);
+  /* Generate the values as data_type so that they are rounded the same */
+  if (data_type == SOX_INT) {
+    int * t = lsx_malloc(length * sizeof(*t));
+    lsx_generate_wave_table(wave_type, data_type, t, length, min, max, phase);
+    for (i = 0; i < length; ++i)
+      lfo->table[i] = t[i];
+    free(t);
+  } else if (data_type == SOX_FLOAT) {
+    float * t = lsx_malloc(length * sizeof(*t));
+    lsx_generate_wave_table(wave_type, data_type, t, length, min, max, phase);
+    for (i = 0; i < length; ++i)
+      lfo->table[i] = t[i];
+    free(t);
+  } else lsx_generate_wave_table(wave_type, SOX_DOUBLE, lfo->table, length, min, max, phase);
+  memcpy(lfo->table + length, lfo->table, length * sizeof(*lfo->table));
+}
+
+void lsx_lfo_stop(lsx_lfo_t * lfo)
+{
+  free(lfo->table);
+  lfo->table = NULL;
+}
@@ -0,0 +1,131 @@
+/* Simple example of using SoX libraries
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef NDEBUG /* N.B. assert used with active statements so enable always. */
+#undef NDEBUG /* Must undef above assert.h or other that might include it. */
+#endif
+
+#include "sox_ng.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/* Example of reading and writing audio through the client's own I/O
+ * functions instead of files: the input is read from a stdio stream that
+ * the program opens itself and the output is encoded as WAV into a
+ * growing memory buffer, which is then written to the output file.
+ *
+ * Usage: example7 input output
+ */
+
+static sox_int64_t file_read(void * client_data, void * buf, size_t len)
+{
+  size_t n = fread(buf, 1, len, (FILE *)client_data);
+  return n || !ferror((FILE *)client_data)? (sox_int64_t)n : -1;
+}
+
+static int file_seek(void * client_data, sox_int64_t offset, int whence)
+{
+  return fseek((FILE *)client_data, (long)offset, whence);
+}
+
+static sox_int64_t file_tell(void * client_data)
+{
+  return ftell((FILE *)client_data);
+}
+
+static sox_io_callbacks_t const file_io = {file_read, NULL, file_seek, file_tell};
+
+typedef struct {
+  char * data;
+  size_t size, alloc, pos;
+} buffer_t;
+
+static sox_int64_t buffer_write(void * client_data, void const * buf, size_t len)
+{
+  buffer_t * b = (buffer_t *)client_data;
+
+  if (b->pos + len > b->alloc) {
+    b->alloc = (b->pos + len) * 2;
+    b->data = realloc(b->data, b->alloc);
+    assert(b->data);
+  }
+  if (b->pos > b->size) /* Filling a gap left by seeking forwards */
+    memset(b->data + b->size, 0, b->pos - b->size);
+  memcpy(b->data + b->pos, buf, len);
+  b->pos += len;
+  if (b->pos > b->size)
+    b->size = b->pos;
+  return (sox_int64_t)len;
+}
+
+static int buffer_seek(void * client_data, sox_int64_t offset, int whence)
+{
+  buffer_t * b = (buffer_t *)client_data;
+  sox_int64_t base = whence == SEEK_SET? 0 :
+                     whence == SEEK_CUR? (sox_int64_t)b->pos : (sox_int64_t)b->size;
+
+  if (base + offset < 0)
+    return -1;
+  b->pos = (size_t)(base + offset);
+  return 0;
+}
+
+static sox_int64_t buffer_tell(void * client_data)
+{
+  return (sox_int64_t)((buffer_t *)client_data)->pos;
+}
+
+static sox_io_callbacks_t const buffer_io = {NULL, buffer_write, buffer_seek, buffer_tell};
+
+int main(int argc, char * argv[])
+{
+  static sox_format_t * in, * out; /* input and output files */
+  #define MAX_SAMPLES (size_t)2048
+  sox_sample_t samples[MAX_SAMPLES]; /* Temporary store whilst copying. */
+  buffer_t buffer = {NULL, 0, 0, 0};
+  size_t number_read;
+  FILE * f;
+
+  assert(argc == 3);
+
+  /* All libSoX applications must start by initialising the SoX library */
+  assert(sox_init() == SOX_SUCCESS);
+  assert(sox_format_init() == SOX_SUCCESS);
+
+  f = fopen(argv[1], "rb");
+  assert(f);
+  in = sox_open_read_callbacks(&file_io, f, NULL, NULL, NULL);
+  assert(in);
+  out = sox_open_write_callbacks(&buffer_io, &buffer, &in->signal, NULL, "wav", NULL);
+  assert(out);
+  while ((number_read = sox_read(in, samples, MAX_SAMPLES)))
+    assert(sox_write(out, samples, number_read) == number_read);
+  sox_close(out); /* Seeks back to complete the WAV header */
+  sox_close(in);
+  fclose(f);
+
+  f = fopen(argv[2], "wb");
+  assert(f);
+  assert(fwrite(buffer.data, 1, buffer.size, f) == buffer.size);
+  fclose(f);
+  free(buffer.data);
+
+  sox_quit();
+  return 0;
+}
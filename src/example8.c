@@ -0,0 +1,76 @@
+/* Simple example of using SoX libraries
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef NDEBUG /* N.B. assert used with active statements so enable always. */
+#undef NDEBUG /* Must undef above assert.h or other that might include it. */
+#endif
+
+#include "sox_ng.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/* Example of transcoding many short files in one process: headerless
+ * 8kHz mono telephony recordings (e.g. A-law .al or u-law .ul files) are
+ * converted to 16-bit WAV.  Each line of standard input names an input
+ * file and an output file, separated by a tab.
+ *
+ * Usage: example8 < list
+ */
+
+int main(int argc, char * argv[])
+{
+  sox_signalinfo_t signal = {8000, 1, 0, SOX_UNSPEC, NULL};
+  sox_encodinginfo_t encoding;
+  sox_transcoder_t * transcoder;
+  char line[4096];
+  unsigned long done = 0, failed = 0;
+
+  assert(argc == 1);
+  (void)argv;
+
+  /* All libSoX applications must start by initialising the SoX library */
+  assert(sox_init() == SOX_SUCCESS);
+  assert(sox_format_init() == SOX_SUCCESS);
+
+  sox_init_encodinginfo(&encoding);
+  encoding.encoding = SOX_ENCODING_SIGN2;
+  encoding.bits_per_sample = 16;
+
+  /* The input type comes from each file's extension */
+  transcoder = sox_transcoder_create(&signal, NULL, NULL, &encoding, "wav");
+  assert(transcoder);
+
+  while (fgets(line, (int)sizeof(line), stdin)) {
+    char * out = strchr(line, '\t');
+
+    line[strcspn(line, "\r\n")] = '\0';
+    if (!out)
+      continue;
+    *out++ = '\0';
+    if (sox_transcode(transcoder, line, out) == SOX_SUCCESS)
+      ++done;
+    else ++failed;
+  }
+
+  sox_transcoder_delete(transcoder);
+  fprintf(stderr, "%lu files transcoded, %lu failed\n", done, failed);
+
+  sox_quit();
+  return failed != 0;
+}
@@ -37,6 +37,11 @@ static int startread(sox_format_t * ft)
   char const * const command_fmt = "ffmpeg -loglevel quiet -nostdin -strict -2 -i \"%s\" -f au -";
   char *command;
 
+  if (ft->io) {
+    lsx_fail_errno(ft, SOX_EPERM, "ffmpeg can't read through I/O callbacks");
+    return SOX_EOF;
+  }
+
   /* Quote special characters in the filename. */
   /* This is for the Unix shell. I dunno about Windows. */
   quoted_filename = lsx_malloc(strlen(ft->filename) * 2 + 1);
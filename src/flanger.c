@@ -34,16 +34,14 @@ typedef struct {
   double     phase;
   interp_t   interpolation;
 
-  /* Delay buffers */
-  double **  delay_bufs;
+  /* Delay lines */
+  lsx_delay_t * delay_lines;
   size_t  delay_buf_length;
-  size_t  delay_buf_pos;
   double  *  delay_last;
 
-  /* Low Frequency Oscillator */
-  float *    lfo;
-  size_t  lfo_length;
-  size_t  lfo_pos;
+  /* Low Frequency Oscillator, and its offset for each channel */
+  lsx_lfo_t  lfo;
+  size_t  *  lfo_phase;
 
   /* Balancing */
   double     gain_in;
@@ -117,9 +115,11 @@ static int start(sox_effect_t * effp)
 {
   priv_t * f = (priv_t *) effp->priv;
   int c, channels = effp->in_signal.channels;
+  size_t lfo_length;
 
-  lsx_valloc(f->delay_bufs, channels);
-  lsx_valloc(f->delay_last, channels);
+  lsx_valloc(f->delay_lines, channels);
+  lsx_vcalloc(f->delay_last, channels);
+  lsx_valloc(f->lfo_phase, channels);
 
   /* Balance output */
   if (isfinite(f->width)) {
@@ -145,26 +145,27 @@ static int start(sox_effect_t * effp)
   ++f->delay_buf_length;  /* Need 0 to n, i.e. n + 1. */
   ++f->delay_buf_length;  /* Quadratic interpolator needs one more. */
   for (c = 0; c < channels; ++c)
-    lsx_vcalloc(f->delay_bufs[c], f->delay_buf_length);
+    lsx_delay_init(&f->delay_lines[c], f->delay_buf_length);
 
   /* Create the LFO lookup table: */
-  f->lfo_length = effp->in_signal.rate / f->speed;
-  if (f->lfo_length < 1) {
+  lfo_length = effp->in_signal.rate / f->speed;
+  if (lfo_length < 1) {
     lsx_fail("speed can't be more that the sample rate");
     return SOX_EOF;
   }
-  lsx_vcalloc(f->lfo, f->lfo_length);
-  lsx_generate_wave_table(
+  lsx_lfo_init(
+      &f->lfo,
       f->wave_shape,
       SOX_FLOAT,
-      f->lfo,
-      f->lfo_length,
+      lfo_length,
       floor(f->delay * effp->in_signal.rate + .5),
       f->delay_buf_length - 2.,
       3 * M_PI_2);  /* Start the sweep at minimum delay (for mono at least) */
+  for (c = 0; c < channels; ++c)
+    f->lfo_phase[c] = (size_t)(c * lfo_length * f->phase + .5) % lfo_length;
 
   lsx_debug("delay_buf_length=%" PRIuPTR " lfo_length=%" PRIuPTR "\n",
-      f->delay_buf_length, f->lfo_length);
+      f->delay_buf_length, lfo_length);
 
   return SOX_SUCCESS;
 }
@@ -181,32 +182,27 @@ static int flow(sox_effect_t * effp, sox_sample_t const * ibuf,
   *isamp = *osamp = len * channels;
 
   while (len--) {
-    f->delay_buf_pos =
-      (f->delay_buf_pos + f->delay_buf_length - 1) % f->delay_buf_length;
     for (c = 0; c < channels; ++c) {
+      lsx_delay_t * line = &f->delay_lines[c];
       double delayed_0, delayed_1;
       double delayed;
       double in, out;
-      size_t phase = c * f->lfo_length * f->phase + .5;
-      double delay = f->lfo[(f->lfo_pos + phase) % f->lfo_length];
+      double delay = lsx_lfo_at(&f->lfo, f->lfo_phase[c]);
       double frac_delay = modf(delay, &delay);
       size_t int_delay = (size_t)delay;
 
       in = *ibuf++;
-      f->delay_bufs[c][f->delay_buf_pos] = in + f->delay_last[c] * f->regen;
+      lsx_delay_push(line, in + f->delay_last[c] * f->regen);
 
-      delayed_0 = f->delay_bufs[c]
-        [(f->delay_buf_pos + int_delay++) % f->delay_buf_length];
-      delayed_1 = f->delay_bufs[c]
-        [(f->delay_buf_pos + int_delay++) % f->delay_buf_length];
+      delayed_0 = lsx_delay_tap(line, int_delay);
+      delayed_1 = lsx_delay_tap(line, int_delay + 1);
 
       if (f->interpolation == INTERP_LINEAR)
         delayed = delayed_0 + (delayed_1 - delayed_0) * frac_delay;
       else /* if (f->interpolation == INTERP_QUADRATIC) */
       {
         double a, b;
-        double delayed_2 = f->delay_bufs[c]
-          [(f->delay_buf_pos + int_delay++) % f->delay_buf_length];
+        double delayed_2 = lsx_delay_tap(line, int_delay + 2);
         delayed_2 -= delayed_0;
         delayed_1 -= delayed_0;
         a = delayed_2 *.5 - delayed_1;
@@ -218,7 +214,7 @@ static int flow(sox_effect_t * effp, sox_sample_t const * ibuf,
       out = in * f->gain_in + delayed * f->width;
       *obuf++ = SOX_ROUND_CLIP_COUNT(out, effp->clips);
     }
-    f->lfo_pos = (f->lfo_pos + 1) % f->lfo_length;
+    lsx_lfo_advance(&f->lfo, 1);
   }
 
   return SOX_SUCCESS;
@@ -232,10 +228,11 @@ static int stop(sox_effect_t * effp)
   int c, channels = effp->in_signal.channels;
 
   for (c = 0; c < channels; ++c)
-    free(f->delay_bufs[c]);
-  free(f->delay_bufs);
+    lsx_delay_stop(&f->delay_lines[c]);
+  free(f->delay_lines);
   free(f->delay_last);
-  free(f->lfo);
+  free(f->lfo_phase);
+  lsx_lfo_stop(&f->lfo);
 
   memset(f, 0, sizeof(*f));
 
@@ -809,6 +809,8 @@ static sox_format_t * open_read(
     char               const * path,
     void                     * buffer UNUSED,
     size_t                     buffer_size UNUSED,
+    sox_io_callbacks_t const * io,
+    void                     * io_data,
     sox_signalinfo_t   const * signal,
     sox_encodinginfo_t const * encoding,
     char               const * filetype)
@@ -829,7 +831,21 @@ static sox_format_t * open_read(
     ft->handler = *handler;
   }
 
-  if (!(ft->handler.flags & SOX_FILE_NOSTDIO)) {
+  if (io) {
+    if (!io->read) {
+      lsx_fail("no read function in the I/O callbacks");
+      goto error;
+    }
+    if (ft->handler.flags & SOX_FILE_NOSTDIO) {
+      lsx_fail("can't read file type `%s' through I/O callbacks", filetype);
+      goto error;
+    }
+    ft->io = io;
+    ft->io_data = io_data;
+    ft->seekable = io->seek && io->tell;
+    ft->io_type = ft->seekable? lsx_io_file : lsx_io_pipe;
+  }
+  else if (!(ft->handler.flags & SOX_FILE_NOSTDIO)) {
     if (!strcmp(path, "-")) { /* Use stdin if the filename is "-" */
       if (sox_globals.stdin_in_use_by) {
         lsx_fail("`-' (stdin) already in use by `%s'", sox_globals.stdin_in_use_by);
@@ -886,6 +902,10 @@ static sox_format_t * open_read(
     }
     ft->handler = *handler;
     if (ft->handler.flags & SOX_FILE_NOSTDIO) {
+      if (io) {
+        lsx_fail("can't read file type `%s' through I/O callbacks", filetype);
+        goto error;
+      }
       xfclose(ft->fp, ft->io_type);
       ft->fp = NULL;
     }
@@ -952,7 +972,7 @@ sox_format_t * sox_open_read(
     sox_encodinginfo_t const * encoding,
     char               const * filetype)
 {
-  return open_read(path, NULL, (size_t)0, signal, encoding, filetype);
+  return open_read(path, NULL, (size_t)0, NULL, NULL, signal, encoding, filetype);
 }
 
 sox_format_t * sox_open_mem_read(
@@ -962,7 +982,17 @@ sox_format_t * sox_open_mem_read(
     sox_encodinginfo_t const * encoding,
     char               const * filetype)
 {
-  return open_read("", buffer, buffer_size, signal,encoding,filetype);
+  return open_read("", buffer, buffer_size, NULL, NULL, signal,encoding,filetype);
+}
+
+sox_format_t * sox_open_read_callbacks(
+    sox_io_callbacks_t const * io,
+    void                     * client_data,
+    sox_signalinfo_t   const * signal,
+    sox_encodinginfo_t const * encoding,
+    char               const * filetype)
+{
+  return open_read("", NULL, (size_t)0, io, client_data, signal, encoding, filetype);
 }
 
 sox_bool sox_format_supports_encoding(
@@ -1193,6 +1223,8 @@ static sox_format_t * open_write(
     size_t                     buffer_size UNUSED,
     char                     * * buffer_ptr UNUSED,
     size_t                   * buffer_size_ptr UNUSED,
+    sox_io_callbacks_t const * io,
+    void                     * io_data,
     sox_signalinfo_t   const * signal,
     sox_encodinginfo_t const * encoding,
     char               const * filetype,
@@ -1212,7 +1244,21 @@ static sox_format_t * open_write(
 
   ft->handler = *handler;
 
-  if (!(ft->handler.flags & SOX_FILE_NOSTDIO)) {
+  if (io) {
+    if (!io->write) {
+      lsx_fail("no write function in the I/O callbacks");
+      goto error;
+    }
+    if (ft->handler.flags & SOX_FILE_NOSTDIO) {
+      lsx_fail("can't write file type `%s' through I/O callbacks", filetype);
+      goto error;
+    }
+    ft->io = io;
+    ft->io_data = io_data;
+    ft->seekable = io->seek && io->tell;
+    ft->io_type = ft->seekable? lsx_io_file : lsx_io_pipe;
+  }
+  else if (!(ft->handler.flags & SOX_FILE_NOSTDIO)) {
     if (!strcmp(path, "-")) { /* Use stdout if the filename is "-" */
       if (sox_globals.stdout_in_use_by) {
         lsx_fail("`-' (stdout) already in use by `%s'", sox_globals.stdout_in_use_by);
@@ -1315,7 +1361,7 @@ sox_format_t * sox_open_write(
     sox_oob_t          const * oob,
     sox_bool           (*overwrite_permitted)(const char *filename))
 {
-  return open_write(path, NULL, (size_t)0, NULL, NULL, signal, encoding, filetype, oob, overwrite_permitted);
+  return open_write(path, NULL, (size_t)0, NULL, NULL, NULL, NULL, signal, encoding, filetype, oob, overwrite_permitted);
 }
 
 sox_format_t * sox_open_mem_write(
@@ -1326,7 +1372,7 @@ sox_format_t * sox_open_mem_write(
     char               const * filetype,
     sox_oob_t          const * oob)
 {
-  return open_write("", buffer, buffer_size, NULL, NULL, signal, encoding, filetype, oob, NULL);
+  return open_write("", buffer, buffer_size, NULL, NULL, NULL, NULL, signal, encoding, filetype, oob, NULL);
 }
 
 sox_format_t * sox_open_memstream_write(
@@ -1337,7 +1383,18 @@ sox_format_t * sox_open_memstream_write(
     char               const * filetype,
     sox_oob_t          const * oob)
 {
-  return open_write("", NULL, (size_t)0, buffer_ptr, buffer_size_ptr, signal, encoding, filetype, oob, NULL);
+  return open_write("", NULL, (size_t)0, buffer_ptr, buffer_size_ptr, NULL, NULL, signal, encoding, filetype, oob, NULL);
+}
+
+sox_format_t * sox_open_write_callbacks(
+    sox_io_callbacks_t const * io,
+    void                     * client_data,
+    sox_signalinfo_t   const * signal,
+    sox_encodinginfo_t const * encoding,
+    char               const * filetype,
+    sox_oob_t          const * oob)
+{
+  return open_write("", NULL, (size_t)0, NULL, NULL, io, client_data, signal, encoding, filetype, oob, NULL);
 }
 
 size_t sox_read(sox_format_t * ft, sox_sample_t * buf, size_t len)
@@ -1367,12 +1424,9 @@ int sox_close(sox_format_t * ft)
   else {
     if (ft->handler.flags & SOX_FILE_REWIND) {
       /* Really write out a final zero byte if we're writing a sparse file.
-       * See lsx_writebuf() */
-      if (ft->last_byte_was_zero) {
-	if (lsx_seeki(ft, (off_t)-1, SEEK_CUR) == SOX_SUCCESS)
-	  putc('\0', (FILE *)ft->fp);
-	ft->last_byte_was_zero = sox_false;
-      }
+       * See lsx_writebuf(); lsx_seeki() writes it. */
+      if (ft->last_byte_was_zero)
+        lsx_seeki(ft, (off_t)0, SEEK_CUR);
       if (ft->olength != ft->signal.length && ft->seekable) {
         result = lsx_seeki(ft, (off_t)0, 0);
         if (result == SOX_SUCCESS)
@@ -1382,12 +1436,9 @@ int sox_close(sox_format_t * ft)
     } else {
       result = ft->handler.stopwrite? (*ft->handler.stopwrite)(ft) : SOX_SUCCESS;
       /* Really write out a final zero byte if we're writing a sparse file.
-       * See lsx_writebuf() */
-      if (ft->last_byte_was_zero) {
-	if (lsx_seeki(ft, (off_t)-1, SEEK_CUR) == SOX_SUCCESS)
-	  putc('\0', (FILE *)ft->fp);
-	ft->last_byte_was_zero = sox_false;
-      }
+       * See lsx_writebuf(); lsx_seeki() writes it. */
+      if (ft->last_byte_was_zero)
+        lsx_seeki(ft, (off_t)0, SEEK_CUR);
     }
   }
 
@@ -1411,11 +1462,145 @@ int sox_seek(sox_format_t * ft, sox_uint64_t offset, int whence)
     /* If file is a seekable file and this handler supports seeking,
      * then invoke handler's function.
      */
-    if (ft->seekable && ft->handler.seek)
-      return (*ft->handler.seek)(ft, offset);
+    if (ft->seekable && ft->handler.seek) {
+      int result = (*ft->handler.seek)(ft, offset);
+      if (result == SOX_SUCCESS)
+        ft->olength = offset; /* sox_read() stops at the length from here */
+      return result;
+    }
     return SOX_EOF; /* FIXME: return SOX_EBADF */
 }
 
+/* The transcoder copies the samples unchanged so it fails rather than
+ * write them at another rate, with other channels or with less precision
+ * than the input's, which would need rate, remix or dither.  An output
+ * rate or channels of 0 can't be written; an output precision of 0 is
+ * unknown. */
+static int check_transcodable(char const * name, sox_signalinfo_t const * in,
+    sox_rate_t out_rate, unsigned out_channels, unsigned out_precision)
+{
+  if (in->rate && out_rate != in->rate) {
+    lsx_fail("transcoder: `%s' can't be written at the input's rate of %gHz",
+        name, in->rate);
+    return SOX_EOF;
+  }
+  if (in->channels && out_channels != in->channels) {
+    lsx_fail("transcoder: `%s' can't be written with the input's %u channels",
+        name, in->channels);
+    return SOX_EOF;
+  }
+  if (in->precision && out_precision && out_precision < in->precision &&
+      out_precision < 24) {
+    lsx_fail("transcoder: %u-bit input would need dither to be written to `%s' at %u bits",
+        in->precision, name, out_precision);
+    return SOX_EOF;
+  }
+  return SOX_SUCCESS;
+}
+
+sox_transcoder_t * sox_transcoder_create(
+    sox_signalinfo_t   const * signal,
+    sox_encodinginfo_t const * in_encoding,
+    char               const * in_type,
+    sox_encodinginfo_t const * out_encoding,
+    char               const * out_type)
+{
+  sox_transcoder_t * t;
+  sox_format_handler_t const * handler = NULL;
+
+  if (in_type && !sox_find_format(in_type, sox_false)) {
+    lsx_fail("no handler for given file type `%s'", in_type);
+    return NULL;
+  }
+  if (out_type && !(handler = sox_write_handler(NULL, out_type, &out_type)))
+    return NULL;
+
+  if (handler && signal) {
+    sox_signalinfo_t in = *signal;
+    sox_rate_t out_rate = in.rate;
+    unsigned out_channels = in.channels, i;
+
+    if (in_encoding && sox_precision(in_encoding->encoding, in_encoding->bits_per_sample))
+      in.precision = sox_precision(in_encoding->encoding, in_encoding->bits_per_sample);
+    if (in.rate && handler->write_rates) {
+      for (i = 0; handler->write_rates[i] && handler->write_rates[i] != in.rate; ++i);
+      out_rate = handler->write_rates[i];
+    }
+    if (handler->flags & SOX_FILE_CHANS && (
+        (in.channels == 1 && !(handler->flags & SOX_FILE_MONO)) ||
+        (in.channels == 2 && !(handler->flags & SOX_FILE_STEREO)) ||
+        (in.channels == 4 && !(handler->flags & SOX_FILE_QUAD))))
+      out_channels = 0;
+    if (check_transcodable(out_type, &in, out_rate, out_channels,
+          out_encoding? sox_precision(out_encoding->encoding,
+          out_encoding->bits_per_sample) : 0) != SOX_SUCCESS)
+      return NULL;
+  }
+
+  t = lsx_calloc(1, sizeof(*t));
+  if ((t->has_signal = signal != NULL))
+    t->signal = *signal;
+  if ((t->has_in_encoding = in_encoding != NULL))
+    t->in_encoding = *in_encoding;
+  if ((t->has_out_encoding = out_encoding != NULL))
+    t->out_encoding = *out_encoding;
+  t->in_type = in_type? lsx_strdup(in_type) : NULL;
+  t->out_type = out_type? lsx_strdup(out_type) : NULL;
+  t->bufsiz = sox_globals.bufsiz;
+  lsx_valloc(t->buf, t->bufsiz);
+  return t;
+}
+
+int sox_transcode(sox_transcoder_t * t, char const * in_path, char const * out_path)
+{
+  sox_format_t * in, * out;
+  size_t n;
+  int result = SOX_SUCCESS;
+
+  in = open_read(in_path, NULL, (size_t)0, NULL, NULL,
+      t->has_signal? &t->signal : NULL,
+      t->has_in_encoding? &t->in_encoding : NULL, t->in_type);
+  if (!in)
+    return SOX_EOF;
+  /* The input's length goes into the output header, so that it needn't
+   * be rewritten afterwards */
+  out = open_write(out_path, NULL, (size_t)0, NULL, NULL, NULL, NULL,
+      &in->signal, t->has_out_encoding? &t->out_encoding : NULL,
+      t->out_type, &in->oob, NULL);
+  if (!out || check_transcodable(out->filename, &in->signal, out->signal.rate,
+        out->signal.channels, out->signal.precision) != SOX_SUCCESS) {
+    if (out)
+      sox_close(out);
+    sox_close(in);
+    return SOX_EOF;
+  }
+  in->sox_errno = 0;
+  while ((n = sox_read(in, t->buf, t->bufsiz)))
+    if (sox_write(out, t->buf, n) != n) {
+      lsx_fail("`%s' %s: %s", out->filename, out->sox_errstr, sox_strerror(out->sox_errno));
+      result = SOX_EOF;
+      break;
+    }
+  if (result == SOX_SUCCESS && in->sox_errno) {
+    lsx_fail("`%s' %s: %s", in->filename, in->sox_errstr, sox_strerror(in->sox_errno));
+    result = SOX_EOF;
+  }
+  if (sox_close(out) != SOX_SUCCESS)
+    result = SOX_EOF;
+  sox_close(in);
+  return result;
+}
+
+void sox_transcoder_delete(sox_transcoder_t * t)
+{
+  if (t) {
+    free(t->in_type);
+    free(t->out_type);
+    free(t->buf);
+    free(t);
+  }
+}
+
 static int strcaseends(char const * str, char const * end)
 {
   size_t str_len = strlen(str), end_len = strlen(end);
@@ -98,6 +98,79 @@ int lsx_check_read_params(sox_format_t * ft, unsigned channels,
   return SOX_EOF;
 }
 
+/* The byte-level I/O below goes through the client's callbacks if it
+ * opened the file with sox_open_read/write_callbacks() and through stdio
+ * otherwise. Like fread/fwrite, io_read and io_write only transfer less than
+ * len bytes at the end of the stream or on an error.
+ */
+static size_t io_read(sox_format_t * ft, void * buf, size_t len)
+{
+  size_t done = 0;
+
+  if (!ft->io)
+    return fread(buf, (size_t)1, len, (FILE*)ft->fp);
+  while (done < len && !ft->io_eof && !ft->io_error) {
+    sox_int64_t n = ft->io->read(ft->io_data, (char *)buf + done, len - done);
+    if (n > 0)
+      done += n;
+    else if (n == 0)
+      ft->io_eof = sox_true;
+    else ft->io_error = sox_true;
+  }
+  return done;
+}
+
+static size_t io_write(sox_format_t * ft, void const * buf, size_t len)
+{
+  size_t done = 0;
+
+  if (!ft->io)
+    return fwrite(buf, (size_t)1, len, (FILE*)ft->fp);
+  while (done < len && !ft->io_error) {
+    sox_int64_t n = ft->io->write(ft->io_data, (char const *)buf + done, len - done);
+    if (n > 0)
+      done += n;
+    else ft->io_error = sox_true;
+  }
+  return done;
+}
+
+static int io_seek(sox_format_t * ft, off_t offset, int whence)
+{
+  if (!ft->io)
+    return fseeko((FILE*)ft->fp, offset, whence);
+  if (!ft->io->seek || ft->io->seek(ft->io_data, (sox_int64_t)offset, whence)) {
+    errno = ESPIPE;
+    return -1;
+  }
+  ft->io_eof = sox_false;
+  return 0;
+}
+
+static off_t io_tell(sox_format_t * ft)
+{
+  if (!ft->io)
+    return ftello((FILE*)ft->fp);
+  return ft->io->tell? (off_t)ft->io->tell(ft->io_data) : -1;
+}
+
+static void io_clearerr(sox_format_t * ft)
+{
+  if (!ft->io)
+    clearerr((FILE*)ft->fp);
+  else ft->io_eof = ft->io_error = sox_false;
+}
+
+static int io_eof(sox_format_t * ft)
+{
+  return ft->io? ft->io_eof : feof((FILE*)ft->fp);
+}
+
+static int io_error(sox_format_t * ft)
+{
+  return ft->io? ft->io_error : ferror((FILE*)ft->fp);
+}
+
 /* Read in a buffer of data of length len bytes.
  * Returns number of bytes read.
  */
@@ -115,15 +188,15 @@ size_t lsx_readbuf(sox_format_t * ft, void *buf, size_t len)
       free(ft->pending_buffer);
   }
 
-  clearerr((FILE*)ft->fp);  /* So that we can read again from a file being written */
+  io_clearerr(ft);  /* So that we can read again from a file being written */
 
   ret = bytes_read;
   if (bytes_read < len) {
-    size_t new = fread((char *)buf + bytes_read, (size_t) 1, len - bytes_read, (FILE*)ft->fp);
+    size_t new = io_read(ft, (char *)buf + bytes_read, len - bytes_read);
     ret += new;
   }
 
-  if (ret != len && ferror((FILE*)ft->fp))
+  if (ret != len && io_error(ft))
     lsx_fail_errno(ft, errno, "lsx_readbuf");
   ft->tell_off += ret;
   return ret;
@@ -189,19 +262,19 @@ size_t lsx_readbuf_rewind(sox_format_t * ft, void *buf, size_t len)
     if (bytes_read < len) lsx_warn("Won't be able to rewind again");
   }
 
-  clearerr((FILE*)ft->fp);  /* So that we can read again from a file being written */
+  io_clearerr(ft);  /* So that we can read again from a file being written */
 
   while (bytes_read < len) {
     size_t new;
 
-    new = fread((char *)buf + bytes_read, (size_t) 1, len - bytes_read, (FILE*)ft->fp);
+    new = io_read(ft, (char *)buf + bytes_read, len - bytes_read);
     if (new == 0) /* EOF */
       break;
     bytes_read += new;
   }
 
   ret = bytes_read;
-  if (ret != len && ferror((FILE*)ft->fp))
+  if (ret != len && io_error(ft))
     lsx_fail_errno(ft, errno, "lsx_readbuf");
 
   if (!ft->seekable) {
@@ -212,7 +285,8 @@ size_t lsx_readbuf_rewind(sox_format_t * ft, void *buf, size_t len)
     memcpy(ft->pending_bytes, buf, bytes_read);
     ft->pending_count = bytes_read;
   } else {
-    rewind((FILE *)ft->fp);
+    io_seek(ft, (off_t)0, SEEK_SET);
+    io_clearerr(ft);
   }
   ft->tell_off = 0;
   return ret;
@@ -265,15 +339,15 @@ size_t lsx_writebuf(sox_format_t * ft, void const * buf, size_t len)
   /* If writing zero bytes, use sparse files to save disk space.
    * See sox_close() */
   if (ft->seekable && is_zero(buf, len) &&
-      fseeko((FILE *)ft->fp, (off_t)len, SEEK_CUR) == 0) {
+      io_seek(ft, (off_t)len, SEEK_CUR) == 0) {
       /* but if the seek fails, try a normal write */
     ft->last_byte_was_zero = sox_true;
     ret = len;
   } else {
-    ret = fwrite(buf, (size_t) 1, len, (FILE*)ft->fp);
+    ret = io_write(ft, buf, len);
     if (ret != len) {
       lsx_fail_errno(ft, errno, "error writing output file");
-      clearerr((FILE*)ft->fp); /* Allows us to seek back to write header */
+      io_clearerr(ft); /* Allows us to seek back to write header */
     }
     ft->last_byte_was_zero = sox_false;
   }
@@ -284,41 +358,53 @@ size_t lsx_writebuf(sox_format_t * ft, void const * buf, size_t len)
 sox_uint64_t lsx_filelength(sox_format_t * ft)
 {
   struct stat st;
-  int ret = ft->fp ? fstat(fileno((FILE*)ft->fp), &st) : 0;
+  int ret;
+
+  if (ft->io) { /* Only a seekable stream has a known length */
+    off_t here, end;
+
+    if (!ft->seekable || (here = io_tell(ft)) < 0 ||
+        io_seek(ft, (off_t)0, SEEK_END) || (end = io_tell(ft)) < 0)
+      return 0;
+    io_seek(ft, here, SEEK_SET);
+    return (sox_uint64_t)end;
+  }
+  ret = ft->fp ? fstat(fileno((FILE*)ft->fp), &st) : 0;
 
   return (!ret && (st.st_mode & S_IFREG))? (sox_uint64_t)st.st_size : 0;
 }
 
 int lsx_flush(sox_format_t * ft)
 {
-  return fflush((FILE*)ft->fp);
+  return ft->io? 0 : fflush((FILE*)ft->fp);
 }
 
 off_t lsx_tell(sox_format_t * ft)
 {
-  return ft->seekable? (off_t)ftello((FILE*)ft->fp) : (off_t)ft->tell_off;
+  return ft->seekable? io_tell(ft) : (off_t)ft->tell_off;
 }
 
 int lsx_eof(sox_format_t * ft)
 {
   if (ft->pending_count) return sox_false;
-  return feof((FILE*)ft->fp);
+  return io_eof(ft);
 }
 
 int lsx_error(sox_format_t * ft)
 {
-  return ferror((FILE*)ft->fp);
+  return io_error(ft);
 }
 
 void lsx_rewind(sox_format_t * ft)
 {
-  rewind((FILE*)ft->fp);
+  io_seek(ft, (off_t)0, SEEK_SET);
+  io_clearerr(ft);
   ft->tell_off = 0;
 }
 
 void lsx_clearerr(sox_format_t * ft)
 {
-  clearerr((FILE*)ft->fp);
+  io_clearerr(ft);
   ft->sox_errno = 0;
 }
 
@@ -351,10 +437,11 @@ int lsx_seeki(sox_format_t * ft, off_t offset, int whence)
                 free(ft->pending_buffer);
 
             /* If a stream peel off chars else EPERM */
-            while (offset > 0 && !feof((FILE*)ft->fp)) {
-                getc((FILE*)ft->fp);
-                offset--;
-                ++ft->tell_off;
+            while (offset > 0 && !io_eof(ft) && !io_error(ft)) {
+                char trash[4096];
+                size_t n = io_read(ft, trash, min((size_t)offset, sizeof(trash)));
+                offset -= n;
+                ft->tell_off += n;
             }
             if (offset)
                 lsx_fail_errno(ft,SOX_EOF, "offset past EOF");
@@ -365,12 +452,12 @@ int lsx_seeki(sox_format_t * ft, off_t offset, int whence)
         /* If we are writing sparse files, actually write the last byte.
          * See lsx_writebuf() */
         if (ft->last_byte_was_zero) {
-          if (fseeko(ft->fp, (off_t)-1, SEEK_CUR) == SOX_SUCCESS)
-          putc('\0', (FILE *)ft->fp);
+          if (io_seek(ft, (off_t)-1, SEEK_CUR) == SOX_SUCCESS)
+            io_write(ft, "", (size_t)1);
           ft->last_byte_was_zero = sox_false;
         }
 
-        if (fseeko((FILE*)ft->fp, offset, whence))
+        if (io_seek(ft, offset, whence))
             lsx_fail_errno(ft,errno, "%s", strerror(errno));
         else {
             ft->tell_off = lsx_tell(ft);
@@ -27,7 +27,10 @@ typedef struct {
   double        mult, reclaim, rms, limiter;
   off_t         num_samples;
   sox_sample_t  min, max;
-  FILE          * tmp_file;
+  sox_bool      replay;   /* Scan, then have the input sent again */
+  sox_bool      measured; /* So apply mult in flow() */
+  uint64_t      pos;
+  lsx_tmpstore_t store;
 } priv_t;
 
 static int create(sox_effect_t * effp, int argc, char * * argv)
@@ -63,6 +66,27 @@ static int create(sox_effect_t * effp, int argc, char * * argv)
   return argc? lsx_usage(effp) : SOX_SUCCESS;
 }
 
+static void start_drain(sox_effect_t * effp);
+
+/* Take the measurements that flow() would make from an index of the input */
+static void use_index(sox_effect_t * effp, sox_index_t const * index)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  sox_index_block_t total;
+  size_t i;
+
+  sox_index_total(index, effp->flows == 1? index->channels : effp->flow, &total);
+  p->max = max(p->max, total.max);
+  p->min = min(p->min, total.min);
+  p->rms = total.sum2;
+  p->num_samples = index->length * (effp->flows == 1? index->channels : 1);
+  if (effp->flow == effp->flows - 1) { /* All flows have been started */
+    start_drain(effp - effp->flow);
+    for (i = 0; i < effp->flows; ++i)
+      ((priv_t *)(effp - effp->flow + i)->priv)->measured = sox_true;
+  }
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
@@ -82,12 +106,14 @@ static int start(sox_effect_t * effp)
   p->mult = 0;
   p->max = 1;
   p->min = -1;
-  if (p->do_scan) {
-    p->tmp_file = lsx_tmpfile();
-    if (p->tmp_file == NULL) {
-      lsx_fail("can't create temporary file: %s", strerror(errno));
-      return SOX_EOF;
-    }
+  lsx_tmpstore_init(&p->store, sox_globals.tmp_memory / effp->flows);
+  p->pos = 0;
+  p->replay = p->do_scan && effp->global_info->replay;
+  p->measured = sox_false;
+  if (p->do_scan && effp->global_info->index &&
+      effp->global_info->index->channels == effp->in_signal.channels) {
+    p->replay = sox_false;
+    use_index(effp, effp->global_info->index);
   }
   if (p->do_limiter)
     p->limiter = (1 - 1 / p->fixed_gain) * (1. / SOX_SAMPLE_MAX);
@@ -96,14 +122,33 @@ static int start(sox_effect_t * effp)
   return SOX_SUCCESS;
 }
 
+static void apply_mult(sox_effect_t * effp, const sox_sample_t * ibuf,
+    sox_sample_t * obuf, size_t len)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  if (!p->do_limiter) for (; len; --len, ++ibuf)
+    *obuf++ = SOX_ROUND_CLIP_COUNT(*ibuf * p->mult, effp->clips);
+  else for (; len; --len, ++ibuf) {
+    double d = *ibuf * p->mult;
+    *obuf++ = d < 0 ? 1 / (1 / d - p->limiter) - .5 :
+              d > 0 ? 1 / (1 / d + p->limiter) + .5 : 0;
+  }
+}
+
 static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
     sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
   size_t len;
 
-  if (p->do_scan) {
-    if (fwrite(ibuf, sizeof(*ibuf), *isamp, p->tmp_file) != *isamp) {
+  if (p->measured) {
+    len = *isamp = *osamp = min(*isamp, *osamp);
+    apply_mult(effp, ibuf, obuf, len);
+  }
+  else if (p->do_scan) {
+    if (!p->replay &&
+        lsx_tmpstore_write(&p->store, ibuf, *isamp * sizeof(*ibuf)) != SOX_SUCCESS) {
       lsx_fail("error writing temporary file: %s", strerror(errno));
       return SOX_EOF;
     }
@@ -151,7 +196,6 @@ static void start_drain(sox_effect_t * effp)
     for (i = 0; i < effp->flows; ++i) {
       priv_t * q = (priv_t *)(effp - effp->flow + i)->priv;
       max_rms = max(max_rms, sqrt(q->rms / q->num_samples));
-      rewind(q->tmp_file);
     }
     for (i = 0; i < effp->flows; ++i) {
       priv_t * q = (priv_t *)(effp - effp->flow + i)->priv;
@@ -172,7 +216,6 @@ static void start_drain(sox_effect_t * effp)
       double this_peak = max(q->max / max, q->min / (double)SOX_SAMPLE_MIN);
       max_peak = max(max_peak, this_peak);
       q->mult = p->fixed_gain / this_peak;
-      rewind(q->tmp_file);
     }
     for (i = 0; i < effp->flows; ++i) {
       priv_t * q = (priv_t *)(effp - effp->flow + i)->priv;
@@ -186,7 +229,6 @@ static void start_drain(sox_effect_t * effp)
       else p->mult = p->reclaim;
     }
     p->mult *= p->fixed_gain;
-    rewind(p->tmp_file);
   }
 }
 
@@ -201,18 +243,22 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
   if (p->do_scan) {
     if (!p->mult)
       start_drain(effp);
-    len = fread(obuf, sizeof(*obuf), *osamp, p->tmp_file);
-    if (len != *osamp && !feof(p->tmp_file)) {
+    if (p->measured || p->replay) {
+      *osamp = 0;
+      if (p->measured)
+        return SOX_EOF;
+      p->measured = sox_true;
+      return SOX_REPLAY;
+    }
+    len = min(*osamp, lsx_tmpstore_len(&p->store) / sizeof(*obuf) - p->pos);
+    if (lsx_tmpstore_read(&p->store, p->pos * sizeof(*obuf), obuf,
+          len * sizeof(*obuf)) != SOX_SUCCESS) {
       lsx_fail("error reading temporary file: %s", strerror(errno));
       result = SOX_EOF;
+      len = 0;
     }
-    if (!p->do_limiter) for (*osamp = len; len; --len, ++obuf)
-      *obuf = SOX_ROUND_CLIP_COUNT(*obuf * p->mult, effp->clips);
-    else for (*osamp = len; len; --len) {
-      double d = *obuf * p->mult;
-      *obuf++ = d < 0 ? 1 / (1 / d - p->limiter) - .5 :
-                d > 0 ? 1 / (1 / d + p->limiter) + .5 : 0;
-    }
+    p->pos += len;
+    apply_mult(effp, obuf, obuf, *osamp = len);
   }
   else *osamp = 0;
   return result;
@@ -221,8 +267,7 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
 static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  if (p->do_scan)
-    lsx_close_tmpfile(p->tmp_file);
+  lsx_tmpstore_close(&p->store);
   return SOX_SUCCESS;
 }
 
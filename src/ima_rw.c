@@ -302,9 +302,13 @@ void lsx_ima_block_mash_i(
         int opt             /* non-zero allows some cpu-intensive code to improve output */
 )
 {
-        unsigned ch;
-        for (ch=0; ch<chans; ch++)
-                ImaMashChannel(ch, chans, ip, n, st+ch, obuff, opt);
+        int ch;
+        /* Each channel has its own state and bytes of the block */
+#ifdef HAVE_OPENMP
+        #pragma omp parallel for if(sox_globals.use_threads && chans > 1) schedule(static)
+#endif
+        for (ch=0; ch<(int)chans; ch++)
+                ImaMashChannel((unsigned)ch, chans, ip, n, st+ch, obuff, opt);
 }
 
 /*
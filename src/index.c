@@ -0,0 +1,313 @@
+/* libSoX: cached per-block measurements of files' audio
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sox_i.h"
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+  #include <unistd.h>
+#endif
+
+/* An index is stored as this header, the absolute name of the file it
+ * measures, then its blocks, all in the machine's own byte order: it is a
+ * cache, not for exchange between machines. */
+#define INDEX_MAGIC     "SoXindex"
+#define INDEX_VERSION   2
+#define INDEX_BLOCK_LEN ((uint64_t)1 << 16) /* Wide samples */
+
+typedef struct {
+  char         magic[8];
+  uint32_t     version, byte_order;
+  uint32_t     channels, name_len;
+  uint64_t     block_len, length, num_blocks, file_size;
+  int64_t      mtime;
+  sox_sample_t full_scale;
+  uint32_t     encoding, bits_per_sample; /* How the samples were read */
+  uint32_t     reverse_bytes, reverse_nibbles, reverse_bits, opposite_endian;
+  char         filetype[16];
+} header_t;
+
+#define KEY_SIZE (sizeof(header_t) - offsetof(header_t, encoding))
+
+static char * absolute_name(char const * name)
+{
+#ifdef _WIN32
+  return _fullpath(NULL, name, 0);
+#else
+  return realpath(name, NULL);
+#endif
+}
+
+/* Where to keep something about a file, or NULL if not a regular file:
+ * only those can be found again and known to be unchanged.  The key, if
+ * any, tells apart different ways of reading the same file. */
+static char * cache_path(sox_format_t const * ft, char const * ext,
+    void const * key, size_t key_len,
+    uint64_t * file_size, int64_t * mtime, char * * absolute)
+{
+  char const * dir = sox_globals.index_path;
+  struct stat st;
+  char * name, * path;
+  uint64_t hash = 14695981039346656037ULL; /* FNV-1a */
+  unsigned char const * c;
+
+  if (!dir || !*dir || ft->mode != 'r' || !ft->seekable || !ft->fp ||
+      fstat(fileno((FILE *)ft->fp), &st) ||
+      !(name = absolute_name(ft->filename)))
+    return NULL;
+  for (c = (unsigned char const *)name; *c; ++c)
+    hash = (hash ^ *c) * 1099511628211ULL;
+  for (c = key; key_len; ++c, --key_len)
+    hash = (hash ^ *c) * 1099511628211ULL;
+  *file_size = st.st_size;
+  *mtime = st.st_mtime;
+  *absolute = lsx_strdup(name);
+  free(name);
+  path = lsx_malloc(strlen(dir) + 1 + 16 + strlen(ext) + 1);
+  sprintf(path, "%s/%016" PRIx64 "%s", dir, hash, ext);
+  return path;
+}
+
+/* Writes beside, under a name of its own so that two processes saving the
+ * same file don't mix their writes, and renames so that no one reads a
+ * partial file */
+static int save(char const * path, char const * name, void const * header,
+    size_t header_size, void const * data, size_t size, size_t n)
+{
+  FILE * file = NULL;
+  char * tmp = lsx_malloc(strlen(path) + sizeof(".XXXXXX"));
+  size_t name_len = strlen(name);
+  int result = SOX_SUCCESS;
+
+  sprintf(tmp, "%s.XXXXXX", path);
+#ifdef HAVE_MKSTEMP
+  {
+    int fd = mkstemp(tmp);
+    if (fd >= 0 && !(file = fdopen(fd, "wb"))) {
+      close(fd);
+      remove(tmp);
+    }
+  }
+#else
+  if (mktemp(tmp) && *tmp)
+    file = fopen(tmp, "wb");
+#endif
+  if (!file) {
+    lsx_warn("can't create `%s': %s", tmp, strerror(errno));
+    free(tmp);
+    return SOX_EOF;
+  }
+  if (fwrite(header, header_size, (size_t)1, file) != 1 ||
+      fwrite(name, (size_t)1, name_len, file) != name_len ||
+      fwrite(data, size, n, file) != n)
+    result = SOX_EOF;
+  if (fclose(file))
+    result = SOX_EOF;
+#ifdef _WIN32
+  if (result == SOX_SUCCESS)
+    remove(path); /* As rename() won't replace it */
+#endif
+  if (result != SOX_SUCCESS || rename(tmp, path)) {
+    lsx_warn("can't write `%s': %s", path, strerror(errno));
+    remove(tmp);
+    result = SOX_EOF;
+  }
+  free(tmp);
+  return result;
+}
+
+/* What, besides the file itself, decides the samples that are measured */
+static void index_key(sox_index_t const * index, header_t * h)
+{
+  h->encoding = index->encoding.encoding;
+  h->bits_per_sample = index->encoding.bits_per_sample;
+  h->reverse_bytes = index->encoding.reverse_bytes;
+  h->reverse_nibbles = index->encoding.reverse_nibbles;
+  h->reverse_bits = index->encoding.reverse_bits;
+  h->opposite_endian = index->encoding.opposite_endian;
+  memcpy(h->filetype, index->filetype, sizeof(h->filetype));
+}
+
+sox_index_t * sox_index_create(sox_format_t const * ft)
+{
+  sox_index_t * index = lsx_calloc(1, sizeof(*index));
+  header_t key;
+
+  index->channels = max(ft->signal.channels, 1);
+  index->block_len = INDEX_BLOCK_LEN;
+  index->full_scale = ft->signal.precision && ft->signal.precision < 32 ?
+    SOX_SAMPLE_MAX & ~(((sox_sample_t)1 << (32 - ft->signal.precision)) - 1) :
+    SOX_SAMPLE_MAX;
+  index->encoding = ft->encoding;
+  if (ft->filetype)
+    strncpy(index->filetype, ft->filetype, sizeof(index->filetype) - 1);
+  memset(&key, 0, sizeof(key));
+  index_key(index, &key);
+  index->path = cache_path(ft, ".soxidx", &key.encoding, KEY_SIZE,
+      &index->file_size, &index->mtime, &index->name);
+  return index;
+}
+
+sox_index_t * sox_index_load(sox_format_t const * ft)
+{
+  sox_index_t * index = sox_index_create(ft);
+  header_t h, key;
+  FILE * file;
+  char * name = NULL;
+  size_t n;
+
+  memset(&key, 0, sizeof(key));
+  index_key(index, &key);
+  if (!index->path || !(file = fopen(index->path, "rb"))) {
+    sox_index_close(index);
+    return NULL;
+  }
+  if (fread(&h, sizeof(h), (size_t)1, file) != 1 ||
+      memcmp(h.magic, INDEX_MAGIC, sizeof(h.magic)) ||
+      h.version != INDEX_VERSION || h.byte_order != 0x01020304 ||
+      h.channels != index->channels || h.file_size != index->file_size ||
+      h.mtime != index->mtime || h.full_scale != index->full_scale ||
+      memcmp(&h.encoding, &key.encoding, KEY_SIZE) ||
+      h.name_len != strlen(index->name) || !h.block_len ||
+      h.num_blocks != (h.length + h.block_len - 1) / h.block_len ||
+      h.num_blocks > SOX_SIZE_MAX / sizeof(*index->blocks) / h.channels)
+    goto stale;
+  name = lsx_malloc(h.name_len + 1);
+  if (fread(name, (size_t)1, (size_t)h.name_len, file) != h.name_len ||
+      memcmp(name, index->name, (size_t)h.name_len))
+    goto stale;
+  n = h.num_blocks * h.channels;
+  index->blocks = lsx_malloc(max(n, 1) * sizeof(*index->blocks));
+  if (fread(index->blocks, sizeof(*index->blocks), n, file) != n)
+    goto stale;
+  index->block_len = h.block_len;
+  index->length = h.length;
+  index->num_blocks = index->size = h.num_blocks;
+  free(name);
+  fclose(file);
+  lsx_debug("using index `%s' of `%s'", index->path, index->name);
+  return index;
+
+stale:
+  lsx_debug("index `%s' of `%s' is out of date", index->path, index->name);
+  free(name);
+  fclose(file);
+  sox_index_close(index);
+  return NULL;
+}
+
+void sox_index_add(sox_index_t * index, sox_sample_t const * buf, size_t len)
+{
+  size_t block_samples = index->block_len * index->channels;
+
+  while (len) {
+    size_t i, n;
+    sox_index_block_t * b;
+
+    if (!index->pos) {
+      if (index->num_blocks == index->size) {
+        index->size = max(index->size * 2, 16);
+        lsx_revalloc(index->blocks, index->size * index->channels);
+      }
+      b = index->blocks + index->num_blocks++ * index->channels;
+      for (i = 0; i < index->channels; ++i) {
+        b[i].min = SOX_SAMPLE_MAX;
+        b[i].max = SOX_SAMPLE_MIN;
+        b[i].clips = 0;
+        b[i].sum = b[i].sum2 = 0;
+      }
+    }
+    b = index->blocks + (index->num_blocks - 1) * index->channels;
+    n = min(len, block_samples - index->pos);
+    for (i = 0; i < n; ++i) {
+      sox_index_block_t * c = b + (index->pos + i) % index->channels;
+      sox_sample_t s = buf[i];
+      double d = SOX_SAMPLE_TO_FLOAT_64BIT(s,);
+      c->min = min(c->min, s);
+      c->max = max(c->max, s);
+      c->clips += s == SOX_SAMPLE_MIN || s >= index->full_scale;
+      c->sum += d;
+      c->sum2 += d * d;
+    }
+    index->pos += n;
+    index->length = ((index->num_blocks - 1) * block_samples + index->pos) /
+      index->channels;
+    if (index->pos == block_samples)
+      index->pos = 0;
+    buf += n, len -= n;
+  }
+}
+
+int sox_index_save(sox_index_t const * index)
+{
+  header_t h;
+  int result;
+
+  if (!index->path)
+    return SOX_EOF;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+  h.version = INDEX_VERSION;
+  h.byte_order = 0x01020304;
+  h.channels = index->channels;
+  h.name_len = strlen(index->name);
+  h.block_len = index->block_len;
+  h.length = index->length;
+  h.num_blocks = index->num_blocks;
+  h.file_size = index->file_size;
+  h.mtime = index->mtime;
+  h.full_scale = index->full_scale;
+  index_key(index, &h);
+  result = save(index->path, index->name, &h, sizeof(h), index->blocks,
+      sizeof(*index->blocks), index->num_blocks * index->channels);
+  if (result == SOX_SUCCESS)
+    lsx_debug("saved index `%s' of `%s'", index->path, index->name);
+  return result;
+}
+
+void sox_index_total(sox_index_t const * index, unsigned channel,
+    sox_index_block_t * total)
+{
+  size_t i;
+  unsigned c;
+
+  total->min = SOX_SAMPLE_MAX;
+  total->max = SOX_SAMPLE_MIN;
+  total->clips = 0;
+  total->sum = total->sum2 = 0;
+  for (i = 0; i < index->num_blocks; ++i)
+    for (c = 0; c < index->channels; ++c)
+      if (channel == index->channels || c == channel) {
+        sox_index_block_t const * b = index->blocks + i * index->channels + c;
+        total->min = min(total->min, b->min);
+        total->max = max(total->max, b->max);
+        total->clips += b->clips;
+        total->sum += b->sum;
+        total->sum2 += b->sum2;
+      }
+}
+
+void sox_index_close(sox_index_t * index)
+{
+  if (index) {
+    free(index->blocks);
+    free(index->name);
+    free(index->path);
+    free(index);
+  }
+}
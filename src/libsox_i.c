@@ -29,6 +29,14 @@
   #include <unistd.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+  #include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+  #include <sys/mman.h>
+#endif
+
 #if defined(_MSC_VER) || defined(__MINGW32__)
   #define MKTEMP_X _O_BINARY|_O_TEMPORARY
 #else
@@ -113,8 +121,17 @@ FILE * lsx_tmpfile(void)
   if (path && path[0]) {
     /* Emulate tmpfile (delete on close); tmp dir is given tmp_path: */
     char const * const end = "/libSoX.tmp.XXXXXX";
-    char * name = lsx_malloc(strlen(path) + strlen(end) + 1);
+    char * name;
     int fildes;
+
+#if defined O_TMPFILE && !defined _WIN32
+    /* An unnamed file that vanishes on close, if the filesystem can */
+    if ((fildes = open(path, O_TMPFILE | O_RDWR | O_EXCL, 0600)) != -1) {
+      lsx_debug("O_TMPFILE in %s", path);
+      return fdopen(fildes, "w+b");
+    }
+#endif
+    name = lsx_malloc(strlen(path) + strlen(end) + 1);
     strcpy(name, path);
     strcat(name, end);
     fildes = mkstemp(name);
@@ -178,3 +195,138 @@ void lsx_close_tmpfile(FILE *fp)
 #endif
   fclose(fp);
 }
+
+#define TMPSTORE_BLOCK (4 << 20) /* A multiple of any page size */
+
+void lsx_tmpstore_init(lsx_tmpstore_t * t, size_t budget)
+{
+  memset(t, 0, sizeof(*t));
+  t->budget = budget;
+}
+
+int lsx_tmpstore_write(lsx_tmpstore_t * t, void const * buf, size_t len)
+{
+  if (!t->file) {
+    size_t n = min(len, t->budget - t->mem_len);
+
+    if (t->mem_len + n > t->mem_size) {
+      t->mem_size = min(t->budget, max(t->mem_len + n, t->mem_size * 2));
+      t->mem = lsx_realloc(t->mem, t->mem_size);
+    }
+    memcpy(t->mem + t->mem_len, buf, n);
+    t->mem_len += n;
+    buf = (char const *)buf + n, len -= n;
+    if (!len)
+      return SOX_SUCCESS;
+    lsx_debug("spilling to a temporary file after %" PRIuPTR " bytes", t->mem_len);
+    if (!(t->file = lsx_tmpfile()))
+      return SOX_EOF;
+    t->write_buf = lsx_malloc(TMPSTORE_BLOCK / 4);
+    setvbuf(t->file, t->write_buf, _IOFBF, TMPSTORE_BLOCK / 4);
+    t->at_end = sox_true;
+  }
+  if (!t->at_end && fseeko(t->file, (off_t)0, SEEK_END))
+    return SOX_EOF;
+  t->at_end = sox_true;
+  if (fwrite(buf, 1, len, t->file) != len)
+    return SOX_EOF;
+  t->file_len += len;
+  t->dirty = sox_true;
+  return SOX_SUCCESS;
+}
+
+static void release_block(lsx_tmpstore_t * t)
+{
+#ifdef HAVE_SYS_MMAN_H
+  if (t->mapped)
+    munmap(t->block, t->block_len);
+#endif
+  t->mapped = sox_false;
+  t->block = NULL;
+  t->block_len = 0;
+}
+
+/* Make the block of the file containing pos current and ask the system
+ * to start reading the next one in the direction of travel, which is
+ * taken to be backwards if the first read isn't at the start. */
+static int load_block(lsx_tmpstore_t * t, uint64_t pos)
+{
+  uint64_t start = pos / TMPSTORE_BLOCK * TMPSTORE_BLOCK;
+  size_t len = min(TMPSTORE_BLOCK, t->file_len - start);
+  sox_bool backwards = t->block? start < t->block_pos : start != 0;
+
+  if (t->dirty && fflush(t->file))
+    return SOX_EOF;
+  t->dirty = sox_false;
+  release_block(t);
+
+#ifdef HAVE_SYS_MMAN_H
+  t->block = mmap(NULL, len, PROT_READ, MAP_SHARED, fileno(t->file), (off_t)start);
+  if (t->block != MAP_FAILED) {
+    t->mapped = sox_true;
+#ifdef MADV_WILLNEED
+    madvise(t->block, len, MADV_WILLNEED);
+#endif
+  }
+  else
+#endif
+  {
+    if (!t->block_buf)
+      t->block_buf = lsx_malloc(TMPSTORE_BLOCK);
+    t->block = t->block_buf;
+    t->at_end = sox_false;
+    if (fseeko(t->file, (off_t)start, SEEK_SET) ||
+        fread(t->block, 1, len, t->file) != len) {
+      t->block = NULL;
+      return SOX_EOF;
+    }
+  }
+  t->block_pos = start;
+  t->block_len = len;
+
+#if defined HAVE_POSIX_FADVISE && defined POSIX_FADV_WILLNEED
+  if (backwards? start != 0 : start + len < t->file_len)
+    (void)posix_fadvise(fileno(t->file),
+        (off_t)(backwards? start - TMPSTORE_BLOCK : start + len),
+        (off_t)TMPSTORE_BLOCK, POSIX_FADV_WILLNEED);
+#else
+  (void)backwards;
+#endif
+  return SOX_SUCCESS;
+}
+
+int lsx_tmpstore_read(lsx_tmpstore_t * t, uint64_t pos, void * buf, size_t len)
+{
+  char * dest = buf;
+
+  if (pos + len > lsx_tmpstore_len(t)) {
+    errno = EINVAL;
+    return SOX_EOF;
+  }
+  if (pos < t->mem_len) {
+    size_t n = min(len, t->mem_len - pos);
+    memcpy(dest, t->mem + pos, n);
+    dest += n, pos += n, len -= n;
+  }
+  for (pos -= t->mem_len; len; ) {
+    size_t n;
+    if ((!t->block || pos < t->block_pos || pos >= t->block_pos + t->block_len)
+        && load_block(t, pos) != SOX_SUCCESS)
+      return SOX_EOF;
+    n = min(len, t->block_pos + t->block_len - pos);
+    memcpy(dest, t->block + (pos - t->block_pos), n);
+    dest += n, pos += n, len -= n;
+  }
+  return SOX_SUCCESS;
+}
+
+void lsx_tmpstore_close(lsx_tmpstore_t * t)
+{
+  release_block(t);
+  if (t->file)
+    lsx_close_tmpfile(t->file);
+  free(t->write_buf);
+  free(t->block_buf);
+  free(t->mem);
+  lsx_tmpstore_init(t, t->budget);
+}
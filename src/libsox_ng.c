@@ -131,7 +131,10 @@ static sox_globals_t s_sox_globals = {
   NULL,            /* char       * tmp_path */
   sox_false,       /* sox_bool     use_magic */
   sox_true,        /* sox_bool     use_threads */
-  10               /* size_t       log2_dft_min_size */
+  10,              /* size_t       log2_dft_min_size */
+  64 << 20,        /* size_t       tmp_memory */
+  NULL,            /* char       * index_path */
+  sox_false        /* sox_bool     profile */
 };
 
 sox_globals_t * sox_get_globals(void)
@@ -141,7 +144,7 @@ sox_globals_t * sox_get_globals(void)
 
 /* FIXME: Not thread safe using globals */
 static sox_effects_globals_t s_sox_effects_globals =
-    {sox_plot_off, &s_sox_globals};
+    {sox_plot_off, &s_sox_globals, sox_false, NULL};
 
 sox_effects_globals_t *
 sox_get_effects_globals(void)
@@ -0,0 +1,420 @@
+/* libSoX effect: loudnorm - normalise loudness to an EBU R128 target
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Loudness is measured as in ITU-R BS.1770: K-weighting, 400ms blocks every
+ * 100ms, an absolute gate at -70 LUFS and a relative one 10 LU below the
+ * level of the blocks above that.  The gain that would bring the integrated
+ * loudness so far to the target is applied to the audio as it leaves a
+ * lookahead delay, so only the first seconds rely on a partial measurement,
+ * and a limiter then holds the 4x oversampled (true) peak under a ceiling. */
+
+#include "sox_i.h"
+#include <string.h>
+
+#define BIN_MIN     -70.     /* LUFS; also the absolute gate */
+#define BINS_PER_LU 100
+#define BINS        (80 * BINS_PER_LU)
+#define PHASES      4        /* True-peak oversampling */
+#define TAPS        12       /* Per phase */
+
+typedef struct {
+  double b0, b1, b2, a1, a2;
+} coefs_t;
+
+typedef struct {           /* Loudness meter */
+  double    * state;       /* 2 per channel per filter */
+  double    sub[4];        /* Weighted energy of the last 100ms sub-blocks */
+  double    energy;        /* of the current one */
+  size_t    pos;           /* Frames into the current sub-block */
+  unsigned  subs;
+  uint64_t  * count;       /* Gated blocks by loudness */
+  double    * sum;         /* and their mean squares */
+} meter_t;
+
+typedef struct {
+  double    target, ceiling, lookahead;
+  sox_bool  measure;
+
+  unsigned  channels;
+  double    * frame;
+  coefs_t   shelf, high_pass;
+  double    * weight;
+  size_t    hop;
+  meter_t   in, out;
+
+  double    * delay;       /* Lookahead, before the loudness gain */
+  size_t    delay_len, delay_pos;
+  double    gain, gain_step;
+  size_t    ramp;
+
+  double    * fir, * hist; /* True-peak interpolator */
+  size_t    hist_pos;
+  double    limit, peak, release, min_gain;
+  size_t    attack, window, dq_front, dq_len;
+  double    * dq_val;      /* Running minimum over the window */
+  uint64_t  * dq_idx;
+  double    * avg, avg_sum;
+  size_t    avg_pos;
+  double    * ldelay;      /* Limiter's delay, after the loudness gain */
+  size_t    ldelay_len, ldelay_pos;
+
+  uint64_t  frames_in, frames_fed, frames_out, latency;
+} priv_t;
+
+static int getopts(sox_effect_t * effp, int argc, char **argv)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  int c;
+  lsx_getopt_t optstate;
+  lsx_getopt_init(argc, argv, "+t:p:w:m", NULL, lsx_getopt_flag_none, 1, &optstate);
+
+  p->target = -23;
+  p->ceiling = -1;
+  p->lookahead = 3;
+  while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
+    GETOPT_NUMERIC(optstate, 't', target    , -70, 0)
+    GETOPT_NUMERIC(optstate, 'p', ceiling   , -20, 0)
+    GETOPT_NUMERIC(optstate, 'w', lookahead , .1 , 60)
+    case 'm': p->measure = sox_true; break;
+    default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  return optstate.ind != argc? lsx_usage(effp) : SOX_SUCCESS;
+}
+
+/* K-weighting at any rate, from the analogue prototypes of BS.1770's filters */
+static void make_k_weighting(priv_t * p, double rate)
+{
+  double K, Vh, Vb, a0, Q;
+
+  K = tan(M_PI * 1681.974450955533 / rate);
+  Vh = pow(10., 3.999843853973347 / 20);
+  Vb = pow(Vh, .4996667741545416);
+  Q = .7071752369554196;
+  a0 = 1 + K / Q + K * K;
+  p->shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+  p->shelf.b1 = 2 * (K * K - Vh) / a0;
+  p->shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+  p->shelf.a1 = 2 * (K * K - 1) / a0;
+  p->shelf.a2 = (1 - K / Q + K * K) / a0;
+
+  K = tan(M_PI * 38.13547087602444 / rate);
+  Q = .5003270373238773;
+  a0 = 1 + K / Q + K * K;
+  p->high_pass.b0 = 1;
+  p->high_pass.b1 = -2;
+  p->high_pass.b2 = 1;
+  p->high_pass.a1 = 2 * (K * K - 1) / a0;
+  p->high_pass.a2 = (1 - K / Q + K * K) / a0;
+}
+
+static void meter_init(priv_t * p, meter_t * m)
+{
+  m->state = lsx_calloc(4 * p->channels, sizeof(*m->state));
+  m->count = lsx_calloc(BINS, sizeof(*m->count));
+  m->sum = lsx_calloc(BINS, sizeof(*m->sum));
+}
+
+static void meter_stop(meter_t * m)
+{
+  free(m->state);
+  free(m->count);
+  free(m->sum);
+}
+
+static double biquad(coefs_t const * f, double * s, double x)
+{
+  double y = f->b0 * x + s[0];
+  s[0] = f->b1 * x - f->a1 * y + s[1];
+  s[1] = f->b2 * x - f->a2 * y;
+  return y;
+}
+
+/* Returns whether a 400ms block has just been measured */
+static sox_bool meter_add(priv_t * p, meter_t * m, double const * x)
+{
+  unsigned c;
+  double z;
+  int bin;
+
+  for (c = 0; c < p->channels; ++c) {
+    double * s = m->state + 4 * c;
+    double y = biquad(&p->high_pass, s + 2, biquad(&p->shelf, s, x[c]));
+    m->energy += p->weight[c] * y * y;
+  }
+  if (++m->pos < p->hop)
+    return sox_false;
+  m->sub[m->subs++ % 4] = m->energy;
+  m->energy = 0;
+  m->pos = 0;
+  if (m->subs < 4)
+    return sox_false;
+  z = (m->sub[0] + m->sub[1] + m->sub[2] + m->sub[3]) / (4 * p->hop);
+  bin = z > 0? floor((-.691 + 10 * log10(z) - BIN_MIN) * BINS_PER_LU) : -1;
+  if (bin >= 0) {
+    bin = min(bin, BINS - 1);
+    ++m->count[bin];
+    m->sum[bin] += z;
+  }
+  return sox_true;
+}
+
+/* Integrated loudness of the blocks so far, or -HUGE_VAL if all are gated */
+static double meter_integrated(meter_t const * m)
+{
+  double sum = 0;
+  uint64_t count = 0;
+  int i, gate;
+
+  for (i = 0; i < BINS; ++i)
+    sum += m->sum[i], count += m->count[i];
+  if (!count)
+    return -HUGE_VAL;
+  gate = ceil((-.691 + 10 * log10(sum / count) - 10 - BIN_MIN) * BINS_PER_LU);
+  for (i = 0; i < gate && i < BINS; ++i)
+    sum -= m->sum[i], count -= m->count[i];
+  return count && sum > 0? -.691 + 10 * log10(sum / count) : -HUGE_VAL;
+}
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  double rate = effp->in_signal.rate;
+  unsigned c;
+
+  p->channels = effp->in_signal.channels;
+  make_k_weighting(p, rate);
+  p->frame = lsx_malloc(p->channels * sizeof(*p->frame));
+  p->weight = lsx_malloc(p->channels * sizeof(*p->weight));
+  for (c = 0; c < p->channels; ++c)  /* Surrounds weighted; no LFE in 5.1 */
+    p->weight[c] = (p->channels == 5 && c >= 3) ||
+      (p->channels == 6 && c >= 4)? 1.41 : p->channels == 6 && c == 3? 0 : 1;
+  p->hop = max(1, (size_t)(rate * .1 + .5));
+  meter_init(p, &p->in);
+
+  p->fir = lsx_make_lpf(PHASES * TAPS, 1. / PHASES, lsx_kaiser_beta(80., .5),
+      0., (double)PHASES, sox_true);
+  p->hist = lsx_calloc(TAPS * p->channels, sizeof(*p->hist));
+  p->limit = dB_to_linear(p->ceiling);
+  p->gain = 1;
+  p->frames_in = p->frames_fed = p->frames_out = 0;
+  if (p->measure)
+    return SOX_SUCCESS;
+
+  meter_init(p, &p->out);
+  p->delay_len = max(1, (size_t)(rate * p->lookahead + .5));
+  p->delay = lsx_calloc(p->delay_len * p->channels, sizeof(*p->delay));
+  p->attack = max(1, (size_t)(rate * .005 + .5));
+  p->window = p->attack + 2;
+  p->dq_val = lsx_malloc(p->window * sizeof(*p->dq_val));
+  p->dq_idx = lsx_malloc(p->window * sizeof(*p->dq_idx));
+  p->avg = lsx_malloc(p->attack * sizeof(*p->avg));
+  for (c = 0; c < p->attack; ++c)
+    p->avg[c] = 1;
+  p->avg_sum = p->attack;
+  p->release = 1 - exp(-1 / (rate * .1));
+  p->ldelay_len = p->attack + TAPS / 2;
+  p->ldelay = lsx_calloc(p->ldelay_len * p->channels, sizeof(*p->ldelay));
+  p->latency = p->delay_len + p->ldelay_len;
+  p->min_gain = 1;
+  return SOX_SUCCESS;
+}
+
+/* Largest magnitude of the signal between this frame and the last */
+static double true_peak(priv_t * p, double const * x)
+{
+  double peak = 0;
+  unsigned c;
+  int i, j;
+
+  for (c = 0; c < p->channels; ++c) {
+    double * h = p->hist + TAPS * c;
+    h[p->hist_pos] = x[c];
+    peak = max(peak, fabs(x[c]));
+    for (i = 1; i < PHASES; ++i) {
+      double v = 0;
+      for (j = 0; j < TAPS; ++j)
+        v += p->fir[i + PHASES * j] * h[(p->hist_pos + TAPS - j) % TAPS];
+      peak = max(peak, fabs(v));
+    }
+  }
+  p->hist_pos = (p->hist_pos + 1) % TAPS;
+  p->peak = max(p->peak, peak);
+  return peak;
+}
+
+/* Gain that keeps the true peak under the ceiling: the least required over a
+ * window, released gradually then averaged over the attack time so that it
+ * has reached the least by the time the peak leaves the limiter's delay */
+static double limiter_gain(priv_t * p, double peak)
+{
+  double need = peak > p->limit? p->limit / peak : 1, g;
+  uint64_t n = p->frames_fed;
+  size_t back;
+
+  while (p->dq_len && p->dq_val[back =
+      (p->dq_front + p->dq_len - 1) % p->window] >= need)
+    --p->dq_len;
+  back = (p->dq_front + p->dq_len++) % p->window;
+  p->dq_val[back] = need;
+  p->dq_idx[back] = n;
+  if (p->dq_idx[p->dq_front] + p->window <= n)
+    p->dq_front = (p->dq_front + 1) % p->window, --p->dq_len;
+
+  g = p->avg[(p->avg_pos + p->attack - 1) % p->attack];
+  g = min(p->dq_val[p->dq_front], g + (1 - g) * p->release);
+  p->avg_sum += g - p->avg[p->avg_pos];
+  p->avg[p->avg_pos] = g;
+  p->avg_pos = (p->avg_pos + 1) % p->attack;
+  g = min(1, p->avg_sum / p->attack);
+  p->min_gain = min(p->min_gain, g);
+  return g;
+}
+
+/* Feeds one frame through; returns whether x now holds an output frame */
+static sox_bool process(priv_t * p, double * x, sox_bool real)
+{
+  double * d = p->delay + p->delay_pos * p->channels, g;
+  unsigned c;
+
+  if (real && meter_add(p, &p->in, x)) {
+    double integrated = meter_integrated(&p->in);
+    if (integrated > -HUGE_VAL) {
+      p->ramp = p->hop;
+      p->gain_step = (dB_to_linear(p->target - integrated) - p->gain) / p->ramp;
+    }
+  }
+  for (c = 0; c < p->channels; ++c) {
+    double t = d[c];
+    d[c] = x[c];
+    x[c] = t * p->gain;
+  }
+  p->delay_pos = (p->delay_pos + 1) % p->delay_len;
+  if (p->ramp)
+    --p->ramp, p->gain += p->gain_step;
+
+  g = limiter_gain(p, true_peak(p, x));
+  d = p->ldelay + p->ldelay_pos * p->channels;
+  for (c = 0; c < p->channels; ++c) {
+    double t = d[c];
+    d[c] = x[c];
+    x[c] = t * g;
+  }
+  p->ldelay_pos = (p->ldelay_pos + 1) % p->ldelay_len;
+  return ++p->frames_fed > p->latency;
+}
+
+static void output(sox_effect_t * effp, double const * x, sox_sample_t * obuf)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  unsigned c;
+  SOX_SAMPLE_LOCALS;
+
+  meter_add(p, &p->out, x);
+  for (c = 0; c < p->channels; ++c)
+    obuf[c] = SOX_FLOAT_64BIT_TO_SAMPLE(x[c], effp->clips);
+  ++p->frames_out;
+}
+
+static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t i, len = min(*isamp, *osamp) / p->channels, olen = 0;
+  double * frame = p->frame;
+  unsigned c;
+
+  for (i = 0; i < len; ++i, ibuf += p->channels) {
+    for (c = 0; c < p->channels; ++c)
+      frame[c] = SOX_SAMPLE_TO_FLOAT_64BIT(ibuf[c],);
+    if (p->measure) {
+      meter_add(p, &p->in, frame);
+      true_peak(p, frame);
+      memcpy(obuf + olen, ibuf, p->channels * sizeof(*obuf));
+      olen += p->channels;
+    }
+    else if (process(p, frame, sox_true)) {
+      output(effp, frame, obuf + olen);
+      olen += p->channels;
+    }
+  }
+  p->frames_in += len;
+  *isamp = len * p->channels;
+  *osamp = olen;
+  return SOX_SUCCESS;
+}
+
+static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t len = *osamp / p->channels, olen = 0;
+  double * frame = p->frame;
+
+  while (!p->measure && len && p->frames_out < p->frames_in) {
+    memset(frame, 0, p->channels * sizeof(*frame));
+    if (process(p, frame, sox_false)) {
+      output(effp, frame, obuf + olen);
+      olen += p->channels;
+      --len;
+    }
+  }
+  *osamp = olen;
+  return p->measure || p->frames_out == p->frames_in? SOX_EOF : SOX_SUCCESS;
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  double in = meter_integrated(&p->in);
+
+  if (p->measure) {
+    fprintf(stderr, "Integrated loudness %6.1f LUFS\n", in);
+    fprintf(stderr, "True peak           %6.1f dBTP\n", linear_to_dB(p->peak));
+  }
+  else {
+    lsx_report("input %.1f LUFS; output %.1f LUFS; limited by up to %.1f dB",
+        in, meter_integrated(&p->out), -linear_to_dB(p->min_gain));
+    meter_stop(&p->out);
+    free(p->delay);
+    free(p->dq_val);
+    free(p->dq_idx);
+    free(p->avg);
+    free(p->ldelay);
+  }
+  meter_stop(&p->in);
+  free(p->frame);
+  free(p->weight);
+  free(p->fir);
+  free(p->hist);
+  return SOX_SUCCESS;
+}
+
+sox_effect_handler_t const * lsx_loudnorm_effect_fn(void)
+{
+  static char const usage[] = "[-m] [-t target] [-p ceiling] [-w lookahead]";
+  static char const * const extra_usage[] = {
+    "-m       Only measure the integrated loudness and true peak",
+    "-t LUFS  Integrated loudness to aim for (default: -23)",
+    "-p dBTP  Ceiling for the true peak level (default: -1)",
+    "-w time  Seconds to measure ahead of the output (default: 3)",
+    NULL
+  };
+  static sox_effect_handler_t handler = {
+    "loudnorm", usage, extra_usage,
+    SOX_EFF_MCHAN | SOX_EFF_GAIN | SOX_EFF_ONCE,
+    getopts, start, flow, drain, stop, NULL, sizeof(priv_t)};
+  return &handler;
+}
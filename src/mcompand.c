@@ -33,6 +33,8 @@
 #include "compandt.h"
 #include "mcompand_xover.h"
 
+#define BLOCK 1024 /* Frames processed at a time */
+
 typedef struct {
   sox_compandt_t transfer_fn;
 
@@ -44,17 +46,18 @@ typedef struct {
   double delay;         /* Delay to apply before companding */
   double topfreq;       /* upper bound crossover frequency */
   crossover_t filter;
-  sox_sample_t *delay_buf;   /* Old samples, used for delay processing */
   size_t delay_size;    /* lookahead for this band (in samples) - function of delay, above */
-  ptrdiff_t delay_buf_ptr; /* Index into delay_buf */
-  size_t delay_buf_cnt; /* No. of active entries in delay_buf */
+  sox_compandt_delay_t delay_buf;
+  size_t done;          /* Samples output by the last flow */
+  sox_uint64_t clips;   /* Counted apart while the bands run in parallel */
 } comp_band_t;
 
 typedef struct {
   size_t nBands;
-  sox_sample_t *band_buf1, *band_buf2, *band_buf3;
+  sox_sample_t *band_bufs; /* band_buf_len samples for each band */
   size_t band_buf_len;
   size_t delay_buf_size;/* Size of delay_buf in samples */
+  double *gains;        /* Gain for each sample of a block, for each band */
   comp_band_t *bands;
 
   char *arg; /* copy of current argument */
@@ -88,7 +91,6 @@ static int sox_mcompand_getopts_1(comp_band_t * l, size_t n, char **argv)
       lsx_valloc(l->decayRate, rates);
       lsx_valloc(l->volume, rates);
       l->expectedChannels = rates;
-      l->delay_buf = NULL;
 
       /* Now tokenise the rates string and set up these arrays.  Keep
          them in seconds at the moment: we don't know the sample rate yet. */
@@ -153,7 +155,7 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
   priv_t * c = (priv_t *) effp->priv;
   --argc, ++argv;
 
-  c->band_buf1 = c->band_buf2 = c->band_buf3 = 0;
+  c->band_bufs = NULL;
   c->band_buf_len = 0;
 
   /* how many bands? */
@@ -201,10 +203,15 @@ static int start(sox_effect_t * effp)
   comp_band_t * l;
   size_t i;
   size_t band;
+  unsigned channels = effp->out_signal.channels;
 
   for (band=0;band<c->nBands;++band) {
     l = &c->bands[band];
-    l->delay_size = c->bands[band].delay * effp->out_signal.rate * effp->out_signal.channels;
+    if (l->expectedChannels > 1 && l->expectedChannels < channels) {
+      lsx_fail("there must be an attack/decay pair for each channel");
+      return SOX_EOF;
+    }
+    l->delay_size = (size_t)(l->delay * effp->out_signal.rate) * channels;
     if (l->delay_size > c->delay_buf_size)
       c->delay_buf_size = l->delay_size;
   }
@@ -226,113 +233,41 @@ static int start(sox_effect_t * effp)
         l->decayRate[i] = 1.0;
     }
 
-    /* Allocate the delay buffer */
-    if (c->delay_buf_size > 0)
-      lsx_vcalloc(l->delay_buf, c->delay_buf_size);
-    l->delay_buf_ptr = 0;
-    l->delay_buf_cnt = 0;
+    lsx_compandt_make_table(&l->transfer_fn);
+
+    /* Allocate the delay buffer; every band's output is delayed as much as
+       the longest lookahead so that they stay in step */
+    lsx_compandt_delay_init(&l->delay_buf, l->delay_size, c->delay_buf_size,
+        BLOCK * channels);
 
     if (l->topfreq != 0)
       crossover_setup(effp, &l->filter, l->topfreq);
   }
+  lsx_valloc(c->gains, c->nBands * BLOCK * channels);
   return (SOX_SUCCESS);
 }
 
-/*
- * Update a volume value using the given sample
- * value, the attack rate and decay rate
- */
-
-static void doVolume(double *v, double samp, comp_band_t * l, size_t chan)
-{
-  double s = samp/(~((sox_sample_t)1<<31));
-  double delta = s - *v;
-
-  if (delta > 0.0) /* increase volume according to attack rate */
-    *v += delta * l->attackRate[chan];
-  else             /* reduce volume according to decay rate */
-    *v += delta * l->decayRate[chan];
-}
-
-static int sox_mcompand_flow_1(sox_effect_t * effp, priv_t * c, comp_band_t * l, const sox_sample_t *ibuf, sox_sample_t *obuf, size_t len, size_t filechans)
+/* Compand one band of len samples in buf, replacing them with the samples
+ * that come out of its delay buffer and setting l->done to how many */
+static void sox_mcompand_flow_1(comp_band_t * l, double *gain, sox_sample_t *buf, size_t len, unsigned filechans)
 {
+  sox_bool linked = l->expectedChannels == 1 && filechans > 1;
   size_t idone, odone;
 
-  for (idone = 0, odone = 0; idone < len; ibuf += filechans) {
-    size_t chan;
-
-    /* Maintain the volume fields by simulating a leaky pump circuit */
-
-    if (l->expectedChannels == 1 && filechans > 1) {
-      /* User is expecting same compander for all channels */
-      double maxsamp = 0.0;
-      for (chan = 0; chan < filechans; ++chan) {
-        double rect = fabs((double)ibuf[chan]);
-        if (rect > maxsamp)
-          maxsamp = rect;
-      }
-      doVolume(&l->volume[0], maxsamp, l, (size_t) 0);
-    } else {
-      for (chan = 0; chan < filechans; ++chan)
-        doVolume(&l->volume[chan], fabs((double)ibuf[chan]), l, chan);
-    }
-
-    /* Volume memory is updated: perform compand */
-    for (chan = 0; chan < filechans; ++chan) {
-      int ch = l->expectedChannels > 1 ? chan : 0;
-      double level_in_lin = l->volume[ch];
-      double level_out_lin = lsx_compandt(&l->transfer_fn, level_in_lin);
-      double checkbuf;
-
-      if (c->delay_buf_size <= 0) {
-        checkbuf = ibuf[chan] * level_out_lin;
-        SOX_SAMPLE_CLIP_COUNT(checkbuf, effp->clips);
-        obuf[odone++] = checkbuf;
-        idone++;
-      } else {
-        /* FIXME: note that this lookahead algorithm is really lame:
-           the response to a peak is released before the peak
-           arrives. */
-
-        /* because volume application delays differ band to band, but
-           total delay doesn't, the volume is applied in an iteration
-           preceding that in which the sample goes to obuf, except in
-           the band(s) with the longest vol app delay.
-
-           the offset between delay_buf_ptr and the sample to apply
-           vol to, is a constant equal to the difference between this
-           band's delay and the longest delay of all the bands. */
-
-        if (l->delay_buf_cnt >= l->delay_size) {
-          checkbuf = l->delay_buf[(l->delay_buf_ptr + c->delay_buf_size - l->delay_size)%c->delay_buf_size] * level_out_lin;
-          SOX_SAMPLE_CLIP_COUNT(checkbuf, effp->clips);
-          l->delay_buf[(l->delay_buf_ptr + c->delay_buf_size - l->delay_size)%c->delay_buf_size] = checkbuf;
-        }
-        if (l->delay_buf_cnt >= c->delay_buf_size) {
-          obuf[odone] = l->delay_buf[l->delay_buf_ptr];
-          odone++;
-          idone++;
-        } else {
-          l->delay_buf_cnt++;
-          idone++; /* no "odone++" because we did not fill obuf[...] */
-        }
-        l->delay_buf[l->delay_buf_ptr++] = ibuf[chan];
-        l->delay_buf_ptr %= c->delay_buf_size;
-      }
-    }
-  }
-
-  if (idone != odone || idone != len) {
-    /* Emergency brake - will lead to memory corruption otherwise since we
-       cannot report back to flow() how many samples were consumed/emitted.
-       Additionally, flow() doesn't know how to handle diverging
-       sub-compander delays. */
-    lsx_fail("using a compander delay is currently not supported");
-    exit(1);
-    /* FIXME */
+  for (idone = odone = 0; idone < len;) {
+    size_t n = min(len - idone, BLOCK * filechans), out_n;
+    sox_sample_t const * out;
+
+    lsx_compandt_gains(&l->transfer_fn, gain, buf + idone, n / filechans,
+        filechans, linked, (double)SOX_SAMPLE_MAX,
+        l->volume, l->attackRate, l->decayRate);
+    out = lsx_compandt_delay_flow(&l->delay_buf, buf + idone, gain, n,
+        &l->clips, &out_n);
+    memcpy(buf + odone, out, out_n * sizeof(*buf));
+    idone += n;
+    odone += out_n;
   }
-
-  return (SOX_SUCCESS);
+  l->done = odone;
 }
 
 /*
@@ -343,70 +278,82 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obu
                      size_t *isamp, size_t *osamp) {
   priv_t * c = (priv_t *) effp->priv;
   comp_band_t * l;
+  unsigned channels = effp->out_signal.channels;
   size_t len = min(*isamp, *osamp);
-  size_t band, i;
-  sox_sample_t *abuf, *bbuf, *cbuf, *oldabuf, *ibuf_copy;
+  size_t band, i, odone;
+  sox_sample_t const *src = ibuf;
+  sox_sample_t *bbuf, *high;
   double out;
+  int b;
+
+  len -= len % channels;
 
   if (c->band_buf_len < len) {
-    lsx_revalloc(c->band_buf1, len);
-    lsx_revalloc(c->band_buf2, len);
-    lsx_revalloc(c->band_buf3, len);
+    lsx_revalloc(c->band_bufs, c->nBands * len);
     c->band_buf_len = len;
   }
 
-  len -= len % effp->out_signal.channels;
-
-  lsx_valloc(ibuf_copy, *isamp);
-  memcpy(ibuf_copy, ibuf, *isamp * sizeof(sox_sample_t));
-
-  /* split ibuf into bands using filters, pipe each band through sox_mcompand_flow_1, then add back together and write to obuf */
+  /* Split ibuf into bands with each crossover in turn, the last band
+     being what is left above the last crossover */
+  high = c->band_bufs + (c->nBands - 1) * c->band_buf_len;
+  for (band = 0; band < c->nBands - 1; ++band) {
+    bbuf = c->band_bufs + band * c->band_buf_len;
+    crossover_flow(effp, &c->bands[band].filter, src, bbuf, high, len);
+    src = high;
+  }
+  if (c->nBands == 1)
+    memcpy(high, ibuf, len * sizeof(*high));
 
-  memset(obuf,0,len * sizeof *obuf);
-  for (band=0,abuf=ibuf_copy,bbuf=c->band_buf2,cbuf=c->band_buf1;band<c->nBands;++band) {
+  /* Once split, the bands are companded independently */
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if(sox_globals.use_threads) schedule(static)
+#endif
+  for (b = 0; b < (int)c->nBands; ++b)
+    sox_mcompand_flow_1(&c->bands[b], c->gains + b * BLOCK * channels,
+        c->band_bufs + b * c->band_buf_len, len, channels);
+
+  /* All bands have the same total delay so output the same number;
+     add them back together */
+  odone = c->bands[0].done;
+  memset(obuf,0,odone * sizeof *obuf);
+  for (band=0;band<c->nBands;++band) {
     l = &c->bands[band];
-
-    if (l->topfreq)
-      crossover_flow(effp, &l->filter, abuf, bbuf, cbuf, len);
-    else {
-      bbuf = abuf;
-      abuf = cbuf;
-    }
-    if (abuf == ibuf_copy)
-      abuf = c->band_buf3;
-    (void)sox_mcompand_flow_1(effp, c,l,bbuf,abuf,len, (size_t)effp->out_signal.channels);
-    for (i=0;i<len;++i)
+    bbuf = c->band_bufs + band * c->band_buf_len;
+    for (i=0;i<odone;++i)
     {
-      out = (double)obuf[i] + (double)abuf[i];
+      out = (double)obuf[i] + (double)bbuf[i];
       SOX_SAMPLE_CLIP_COUNT(out, effp->clips);
       obuf[i] = out;
     }
-    oldabuf = abuf;
-    abuf = cbuf;
-    cbuf = oldabuf;
+    effp->clips += l->clips;
+    l->clips = 0;
   }
 
-  *isamp = *osamp = len;
-
-  free(ibuf_copy);
+  *isamp = len;
+  *osamp = odone;
 
   return SOX_SUCCESS;
 }
 
-static int sox_mcompand_drain_1(sox_effect_t * effp, priv_t * c, comp_band_t * l, sox_sample_t *obuf, size_t maxdrain)
+static size_t sox_mcompand_drain_1(sox_effect_t * effp, priv_t * c, comp_band_t * l, sox_sample_t *obuf, size_t maxdrain)
 {
-  size_t done;
+  unsigned chan, channels = effp->out_signal.channels;
+  sox_sample_t const * delayed;
+  size_t done, i;
   double out;
 
   /*
-   * Drain out delay samples.  Note that this loop does all channels.
+   * Drain out delay samples, the last ones with the last gains.
    */
-  for (done = 0;  done < maxdrain  &&  l->delay_buf_cnt > 0;  done++) {
-    out = obuf[done] + l->delay_buf[l->delay_buf_ptr++];
+  for (chan = 0; chan < channels; ++chan)
+    c->gains[chan] = lsx_compandt_lookup(&l->transfer_fn,
+        l->volume[l->expectedChannels > 1 ? chan : 0]);
+  delayed = lsx_compandt_delay_drain(&l->delay_buf, c->gains, channels,
+      maxdrain, &effp->clips, &done);
+  for (i = 0; i < done; ++i) {
+    out = (double)obuf[i] + (double)delayed[i];
     SOX_SAMPLE_CLIP_COUNT(out, effp->clips);
-    obuf[done] = out;
-    l->delay_buf_ptr %= c->delay_buf_size;
-    l->delay_buf_cnt--;
+    obuf[i] = out;
   }
 
   /* tell caller number of samples played */
@@ -450,16 +397,15 @@ static int stop(sox_effect_t * effp)
   comp_band_t * l;
   size_t band;
 
-  free(c->band_buf1);
-  c->band_buf1 = NULL;
-  free(c->band_buf2);
-  c->band_buf2 = NULL;
-  free(c->band_buf3);
-  c->band_buf3 = NULL;
+  free(c->band_bufs);
+  c->band_bufs = NULL;
+  c->band_buf_len = 0;
+  free(c->gains);
+  c->gains = NULL;
 
   for (band = 0; band < c->nBands; band++) {
     l = &c->bands[band];
-    free(l->delay_buf);
+    lsx_compandt_delay_stop(&l->delay_buf);
     if (l->topfreq != 0)
       free(l->filter.previous);
   }
@@ -18,11 +18,10 @@
 #define N 4          /* 4th order Linkwitz-Riley IIRs */
 #define CONVOLVE _ _ _ _
 
-typedef struct {double in, out_low, out_high;} previous_t[N * 2];
-
 typedef struct {
-  previous_t * previous;
-  size_t       pos;
+  double     * previous; /* Planes of in, out_low and out_high, each of N*2
+                            rows with the channels side by side */
+  size_t       channels, pos;
   double       coefs[3 *(N+1)];
 } crossover_t;
 
@@ -63,44 +62,43 @@ static int crossover_setup(sox_effect_t * effp, crossover_t * p, double frequenc
   square_quadratic("hb", x + 3, p->coefs + 5);
   square_quadratic("a" , x + 6, p->coefs + 10);
 
-  p->previous = lsx_calloc(effp->in_signal.channels, sizeof(*p->previous));
+  p->channels = effp->in_signal.channels;
+  p->pos = 0;
+  p->previous = lsx_calloc(3 * N * 2 * p->channels, sizeof(*p->previous));
   return SOX_SUCCESS;
 }
 
+/* obuf_high may be ibuf.  The loop over the channels vectorises. */
 static int crossover_flow(sox_effect_t * effp, crossover_t * p, sox_sample_t
-    *ibuf, sox_sample_t *obuf_low, sox_sample_t *obuf_high, size_t len0)
+    const *ibuf, sox_sample_t *obuf_low, sox_sample_t *obuf_high, size_t len0)
 {
-  double out_low, out_high;
-  size_t c, len = len0 / effp->in_signal.channels;
-  assert(len * effp->in_signal.channels == len0);
+  size_t c, channels = p->channels, len = len0 / channels;
+  size_t plane = N * 2 * channels;
+  assert(len * channels == len0);
+
+  for (; len--; ibuf += channels, obuf_low += channels, obuf_high += channels) {
+    double * in, * low, * high;
 
-  while (len--) {
     p->pos = p->pos? p->pos - 1 : N - 1;
-    for (c = 0; c < effp->in_signal.channels; ++c) {
-#define _ out_low += p->coefs[j] * p->previous[c][p->pos + j].in \
-        - p->coefs[2*N+2 + j] * p->previous[c][p->pos + j].out_low, ++j;
-      {
-        int j = 1;
-        out_low = p->coefs[0] * *ibuf;
-        CONVOLVE
-        assert(j == N+1);
-        *obuf_low++ = SOX_ROUND_CLIP_COUNT(out_low, effp->clips);
-      }
+    in = p->previous + p->pos * channels;
+    low = in + plane;
+    high = low + plane;
+    for (c = 0; c < channels; ++c) {
+      double x = ibuf[c];
+      double out_low = p->coefs[0] * x, out_high = p->coefs[N+1] * x;
+      int j = 1;
+#define _ out_low += p->coefs[j] * in[j * channels + c] \
+        - p->coefs[2*N+2 + j] * low[j * channels + c], \
+      out_high += p->coefs[j+N+1] * in[j * channels + c] \
+        - p->coefs[2*N+2 + j] * high[j * channels + c], ++j;
+      CONVOLVE
 #undef _
-#define _ out_high += p->coefs[j+N+1] * p->previous[c][p->pos + j].in \
-        - p->coefs[2*N+2 + j] * p->previous[c][p->pos + j].out_high, ++j;
-      {
-        int j = 1;
-        out_high = p->coefs[N+1] * *ibuf;
-        CONVOLVE
-        assert(j == N+1);
-        *obuf_high++ = SOX_ROUND_CLIP_COUNT(out_high, effp->clips);
-      }
-      p->previous[c][p->pos + N].in = p->previous[c][p->pos].in = *ibuf++;
-      p->previous[c][p->pos + N].out_low = p->previous[c][p->pos].out_low = out_low;
-      p->previous[c][p->pos + N].out_high = p->previous[c][p->pos].out_high = out_high;
+      obuf_low[c] = SOX_ROUND_CLIP_COUNT(out_low, effp->clips);
+      obuf_high[c] = SOX_ROUND_CLIP_COUNT(out_high, effp->clips);
+      in[N * channels + c] = in[c] = x;
+      low[N * channels + c] = low[c] = out_low;
+      high[N * channels + c] = high[c] = out_high;
     }
   }
   return SOX_SUCCESS;
 }
-
@@ -26,6 +26,7 @@ typedef struct {
     int   *profilecount;
 
     float *window;
+    double *work;
 } chandata_t;
 
 typedef struct {
@@ -83,6 +84,7 @@ static int sox_noiseprof_start(sox_effect_t * effp)
     lsx_vcalloc(data->chandata[i].sum, FREQCOUNT);
     lsx_vcalloc(data->chandata[i].profilecount, FREQCOUNT);
     lsx_vcalloc(data->chandata[i].window, WINDOWSIZE);
+    lsx_valloc(data->chandata[i].work, WINDOWSIZE);
   }
 
   return SOX_SUCCESS;
@@ -90,22 +92,23 @@ static int sox_noiseprof_start(sox_effect_t * effp)
 
 /* Collect statistics from the complete window on channel chan. */
 static void collect_data(chandata_t* chan) {
-    float *out;
+    double *work = chan->work;
     int i;
 
-    lsx_vcalloc(out, FREQCOUNT);
-
-    lsx_power_spectrum_f(WINDOWSIZE, chan->window, out);
+    for (i = 0; i < WINDOWSIZE; i ++)
+        work[i] = chan->window[i];
+    lsx_safe_rdft(WINDOWSIZE, 1, work);
 
     for (i = 0; i < FREQCOUNT; i ++) {
-        if (out[i] > 0) {
-            float value = log(out[i]);
+        float out = i == 0 ? sqr(work[0]) :
+                    i == FREQCOUNT - 1 ? sqr(work[1]) :
+                    sqr(work[2 * i]) + sqr(work[2 * i + 1]);
+        if (out > 0) {
+            float value = log(out);
             chan->sum[i] += value;
             chan->profilecount[i] ++;
         }
     }
-
-    free(out);
 }
 
 /*
@@ -194,6 +197,8 @@ static int sox_noiseprof_stop(sox_effect_t * effp)
 
         free(chan->sum);
         free(chan->profilecount);
+        free(chan->window);
+        free(chan->work);
     }
 
     free(data->chandata);
@@ -207,7 +212,7 @@ static int sox_noiseprof_stop(sox_effect_t * effp)
 static sox_effect_handler_t sox_noiseprof_effect = {
   "noiseprof",
   "[profile-file(-)]", NULL,
-  SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+  SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_ONCE,
   sox_noiseprof_getopts,
   sox_noiseprof_start,
   sox_noiseprof_flow,
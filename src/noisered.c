@@ -11,11 +11,20 @@
 #include "sox_i.h"
 #include "noisered.h"
 
+/* How many overlapping windows are transformed together; windows within
+ * a batch are independent apart from the smoothing, which is done in order. */
+#define BATCH 8
+#define BUFSIZE (WINDOWSIZE + (BATCH - 1) * HALFWINDOW)
+
 typedef struct {
-    float *window;
-    float *lastwindow;
+    float *window;      /* BUFSIZE input samples, the oldest first */
+    float *lastwindow;  /* Second half of the last reduced window */
     float *noisegate;
+    float *threshold;   /* exp() of noisegate + level*8 */
     float *smoothing;
+    double *spectra;    /* BATCH windows' spectra, then reduced windows */
+    double *work;       /* BATCH windows' Hann-windowed spectra */
+    float *power;       /* BATCH windows' power spectra */
 } chandata_t;
 
 /* Holds profile information */
@@ -25,32 +34,12 @@ typedef struct {
 
     chandata_t *chandata;
     size_t bufdata;
+    float *hann;
+    sox_sample_t *out;  /* Reduced audio not yet output, interleaved */
+    size_t out_pos, out_len;
+    sox_bool drained;   /* The last, partial window is in out */
 } priv_t;
 
-static void FFT(unsigned NumSamples,
-         int InverseTransform,
-         const float *RealIn, float *ImagIn, float *RealOut, float *ImagOut)
-{
-  unsigned i;
-  double * work;
-
-  lsx_valloc(work, 2 * NumSamples);
-  for (i = 0; i < 2 * NumSamples; i += 2) {
-    work[i] = RealIn[i >> 1];
-    work[i + 1] = ImagIn? ImagIn[i >> 1] : 0;
-  }
-  lsx_safe_cdft(2 * (int)NumSamples, InverseTransform? -1 : 1, work);
-  if (InverseTransform) for (i = 0; i < 2 * NumSamples; i += 2) {
-    RealOut[i >> 1] = work[i] / NumSamples;
-    ImagOut[i >> 1] = work[i + 1] / NumSamples;
-  }
-  else for (i = 0; i < 2 * NumSamples; i += 2) {
-    RealOut[i >> 1] = work[i];
-    ImagOut[i >> 1] = work[i + 1];
-  }
-  free(work);
-}
-
 /*
  * Get the options. Default file is stdin (if the audio
  * input file isn't coming from there, of course!)
@@ -91,11 +80,24 @@ static int sox_noisered_start(sox_effect_t * effp)
 
     lsx_vcalloc(data->chandata, channels);
     data->bufdata = 0;
+    lsx_valloc(data->out, channels * BATCH * HALFWINDOW);
+    data->out_pos = data->out_len = 0;
+    data->drained = sox_false;
     for (i = 0; i < channels; i ++) {
-        lsx_vcalloc(data->chandata[i].noisegate, FREQCOUNT);
-        lsx_vcalloc(data->chandata[i].smoothing, FREQCOUNT);
-        data->chandata[i].lastwindow = NULL;
+        chandata_t *chan = &data->chandata[i];
+        lsx_vcalloc(chan->window, BUFSIZE);
+        lsx_vcalloc(chan->lastwindow, HALFWINDOW);
+        lsx_vcalloc(chan->noisegate, FREQCOUNT);
+        lsx_vcalloc(chan->threshold, FREQCOUNT);
+        lsx_vcalloc(chan->smoothing, FREQCOUNT);
+        lsx_valloc(chan->spectra, BATCH * WINDOWSIZE);
+        lsx_valloc(chan->work, BATCH * WINDOWSIZE);
+        lsx_valloc(chan->power, BATCH * FREQCOUNT);
     }
+    lsx_valloc(data->hann, WINDOWSIZE);
+    for (i = 0; i < WINDOWSIZE; i ++)
+        data->hann[i] = 1;
+    lsx_apply_hann_f(data->hann, WINDOWSIZE);
     while (1) {
         unsigned long i1_ul;
         size_t i1;
@@ -128,46 +130,53 @@ static int sox_noisered_start(sox_effect_t * effp)
     if (ifp != stdin)
       fclose(ifp);
 
+    /* log(power) < noisegate + level*8 is power < exp(noisegate + level*8) */
+    for (fchannels = 0; fchannels < channels; fchannels ++)
+        for (i = 0; i < FREQCOUNT; i ++)
+            data->chandata[fchannels].threshold[i] =
+                exp(data->chandata[fchannels].noisegate[i] + data->threshold*8.0);
+
   effp->out_signal.length = SOX_UNKNOWN_LEN; /* TODO: calculate actual length */
 
     return (SOX_SUCCESS);
 }
 
-/* Mangle a single window. Each output sample (except the first and last
- * half-window) is the result of two distinct calls to this function,
- * due to overlapping windows. */
-static void reduce_noise(chandata_t* chan, float* window, double level)
+/* Transform one window of a channel's input buffer: its spectrum for the
+ * filter and the power spectrum of its Hann-windowed copy for the gate. */
+static void analyse_window(priv_t * data, chandata_t* chan, int w)
 {
-    float *inr, *ini, *outr, *outi, *power;
-    float *smoothing = chan->smoothing;
+    double *spectrum = chan->spectra + w * WINDOWSIZE;
+    double *work = chan->work + w * WINDOWSIZE;
+    float *power = chan->power + w * FREQCOUNT;
+    float const *window = chan->window + w * HALFWINDOW;
     int i;
 
-    lsx_vcalloc(inr, WINDOWSIZE * 5);
-    ini = inr + WINDOWSIZE;
-    outr = ini + WINDOWSIZE;
-    outi = outr + WINDOWSIZE;
-    power = outi + WINDOWSIZE;
-
-    for (i = 0; i < FREQCOUNT; i ++)
-        assert(smoothing[i] >= 0 && smoothing[i] <= 1);
-
-    memcpy(inr, window, WINDOWSIZE*sizeof(float));
+    for (i = 0; i < WINDOWSIZE; i ++) {
+        spectrum[i] = window[i];
+        work[i] = window[i] * data->hann[i];
+    }
+    lsx_safe_rdft(WINDOWSIZE, 1, spectrum);
+    lsx_safe_rdft(WINDOWSIZE, 1, work);
 
-    FFT(WINDOWSIZE, 0, inr, NULL, outr, outi);
+    power[0] = sqr(work[0]);
+    for (i = 2; i < WINDOWSIZE; i += 2)
+        power[i >> 1] = sqr(work[i]) + sqr(work[i + 1]);
+    power[i >> 1] = sqr(work[1]);
+}
 
-    memcpy(inr, window, WINDOWSIZE*sizeof(float));
-    lsx_apply_hann_f(inr, WINDOWSIZE);
-    lsx_power_spectrum_f(WINDOWSIZE, inr, power);
+/* Update the smoothing from one window's power spectrum and apply it to
+ * the window's spectrum.  Each window's smoothing depends on the previous
+ * window's so this must be done in order. */
+static void gate_window(chandata_t* chan, int w)
+{
+    double *spectrum = chan->spectra + w * WINDOWSIZE;
+    float const *power = chan->power + w * FREQCOUNT;
+    float *smoothing = chan->smoothing;
+    int i;
 
     for (i = 0; i < FREQCOUNT; i ++) {
-        float smooth;
-        float plog;
-        plog = log(power[i]);
-        if (power[i] != 0 && plog < chan->noisegate[i] + level*8.0)
-            smooth = 0.0;
-        else
-            smooth = 1.0;
-
+        float smooth =
+            power[i] != 0 && power[i] < chan->threshold[i] ? 0.0 : 1.0;
         smoothing[i] = smooth * 0.5 + smoothing[i] * 0.5;
     }
 
@@ -183,116 +192,146 @@ static void reduce_noise(chandata_t* chan, float* window, double level)
             smoothing[i] = 0.0;
     }
 
-    outr[0] *= smoothing[0];
-    outi[0] *= smoothing[0];
-    outr[FREQCOUNT-1] *= smoothing[FREQCOUNT-1];
-    outi[FREQCOUNT-1] *= smoothing[FREQCOUNT-1];
-
+    /* The real FFT's packing: DC, Nyquist, then the complex bins */
+    spectrum[0] *= smoothing[0];
+    spectrum[1] *= smoothing[FREQCOUNT-1];
     for (i = 1; i < FREQCOUNT-1; i ++) {
-        int j = WINDOWSIZE - i;
-        float smooth = smoothing[i];
-
-        outr[i] *= smooth;
-        outi[i] *= smooth;
-        outr[j] *= smooth;
-        outi[j] *= smooth;
+        spectrum[2 * i] *= smoothing[i];
+        spectrum[2 * i + 1] *= smoothing[i];
     }
+}
 
-    FFT(WINDOWSIZE, 1, outr, outi, inr, ini);
-    lsx_apply_hann_f(inr, WINDOWSIZE);
+/* Turn a gated spectrum back into a Hann-windowed block of audio */
+static void synthesise_window(priv_t * data, chandata_t* chan, int w)
+{
+    double *spectrum = chan->spectra + w * WINDOWSIZE;
+    int i;
+
+    lsx_safe_rdft(WINDOWSIZE, -1, spectrum);
+    for (i = 0; i < WINDOWSIZE; i ++)
+        spectrum[i] *= 2.0 / WINDOWSIZE * data->hann[i];
+}
 
-    memcpy(window, inr, WINDOWSIZE*sizeof(float));
+/* Reduce the noise in the first num_windows windows of every channel's
+ * buffer and put the first len samples of each window, overlap-added
+ * with the second half of the window before, in data->out.  Each output
+ * sample (except the first and last half-window) is the result of two
+ * windows. */
+static void process_windows(sox_effect_t * effp, priv_t * data,
+                            int num_windows, int len)
+{
+    int tracks = effp->in_signal.channels;
+    int i, n = tracks * num_windows;
+    sox_uint64_t clips = 0;
+
+    /* The transforms are independent across both channels and windows */
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if(sox_globals.use_threads) schedule(static)
+#endif
+    for (i = 0; i < n; i ++)
+        analyse_window(data, &data->chandata[i / num_windows], i % num_windows);
+
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if(sox_globals.use_threads) schedule(static)
+#endif
+    for (i = 0; i < tracks; i ++) {
+        int w;
+        for (w = 0; w < num_windows; w ++)
+            gate_window(&data->chandata[i], w);
+    }
 
-    for (i = 0; i < FREQCOUNT; i ++)
-        assert(smoothing[i] >= 0 && smoothing[i] <= 1);
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if(sox_globals.use_threads) schedule(static)
+#endif
+    for (i = 0; i < n; i ++)
+        synthesise_window(data, &data->chandata[i / num_windows], i % num_windows);
 
-    free(inr);
-}
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if(sox_globals.use_threads) schedule(static) \
+        reduction(+:clips)
+#endif
+    for (i = 0; i < tracks; i ++) {
+        chandata_t *chan = &data->chandata[i];
+        sox_sample_t *out = data->out + i;
+        int w, j;
+        SOX_SAMPLE_LOCALS;
 
-/* Do window management once we have a complete window, including mangling
- * the current window. */
-static int process_window(sox_effect_t * effp, priv_t * data, unsigned chan_num, unsigned num_chans,
-                          sox_sample_t *obuf, unsigned len) {
-    int j;
-    float* nextwindow;
-    int use = min(len, WINDOWSIZE)-min(len,(WINDOWSIZE/2));
-    chandata_t *chan = &(data->chandata[chan_num]);
-    int first = (chan->lastwindow == NULL);
-    SOX_SAMPLE_LOCALS;
-
-    lsx_vcalloc(nextwindow, WINDOWSIZE);
-
-    memcpy(nextwindow, chan->window+WINDOWSIZE/2,
-           sizeof(float)*(WINDOWSIZE/2));
-
-    reduce_noise(chan, chan->window, data->threshold);
-    if (!first) {
-        for (j = 0; j < use; j ++) {
-            float s = chan->window[j] + chan->lastwindow[WINDOWSIZE/2 + j];
-            obuf[chan_num + num_chans * j] =
-                SOX_FLOAT_32BIT_TO_SAMPLE(s, effp->clips);
-        }
-        free(chan->lastwindow);
-    } else {
-        for (j = 0; j < use; j ++) {
-            assert(chan->window[j] >= -1 && chan->window[j] <= 1);
-            obuf[chan_num + num_chans * j] =
-                SOX_FLOAT_32BIT_TO_SAMPLE(chan->window[j], effp->clips);
+        for (w = 0; w < num_windows; w ++) {
+            double const *window = chan->spectra + w * WINDOWSIZE;
+            for (j = 0; j < len; j ++, out += tracks) {
+                float s = window[j] + chan->lastwindow[j];
+                *out = SOX_FLOAT_32BIT_TO_SAMPLE(s, clips);
+            }
+            for (j = 0; j < HALFWINDOW; j ++)
+                chan->lastwindow[j] = window[HALFWINDOW + j];
         }
     }
-    chan->lastwindow = chan->window;
-    chan->window = nextwindow;
+    effp->clips += clips;
+    data->out_pos = 0;
+    data->out_len = (size_t)tracks * num_windows * len;
+}
+
+/* Give as many whole wide samples of the reduced audio in data->out as
+ * fit in obuf */
+static size_t flush_output(sox_effect_t * effp, priv_t * data,
+                           sox_sample_t *obuf, size_t osamp)
+{
+    size_t n = min(data->out_len - data->out_pos,
+                   osamp / effp->in_signal.channels * effp->in_signal.channels);
+
+    memcpy(obuf, data->out + data->out_pos, n * sizeof(*obuf));
+    data->out_pos += n;
+    return n;
+}
+
+/* Drop the input of the first num_windows windows from every channel */
+static void shift_windows(sox_effect_t * effp, priv_t * data, size_t num_windows)
+{
+    size_t i, shift = num_windows * HALFWINDOW;
 
-    return use;
+    data->bufdata -= shift;
+    for (i = 0; i < effp->in_signal.channels; i ++)
+        memmove(data->chandata[i].window, data->chandata[i].window + shift,
+                data->bufdata * sizeof(float));
 }
 
 /*
- * Read in windows, and call process_window once we get a whole one.
+ * Read in windows, and process as many whole ones as we have once the
+ * output of the last ones has all been given.
  */
 static int sox_noisered_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
                     size_t *isamp, size_t *osamp)
 {
     priv_t * data = (priv_t *) effp->priv;
-    size_t samp = min(*isamp, *osamp);
     size_t tracks = effp->in_signal.channels;
-    size_t track_samples = samp / tracks;
-    size_t ncopy = min(track_samples, WINDOWSIZE-data->bufdata);
-    size_t whole_window = (ncopy + data->bufdata == WINDOWSIZE);
-    int oldbuf = data->bufdata;
+    size_t ncopy = min(*isamp / tracks, BUFSIZE - data->bufdata);
+    size_t num_windows, done;
     size_t i;
 
     /* FIXME: Make this automatic for all effects */
     assert(effp->in_signal.channels == effp->out_signal.channels);
 
-    if (whole_window)
-        data->bufdata = WINDOWSIZE/2;
-    else
-        data->bufdata += ncopy;
-
-    /* Reduce noise on every channel. */
     for (i = 0; i < tracks; i ++) {
         SOX_SAMPLE_LOCALS;
-        chandata_t* chan = &(data->chandata[i]);
+        float *window = data->chandata[i].window + data->bufdata;
         size_t j;
 
-        if (chan->window == NULL)
-	    lsx_vcalloc(chan->window, WINDOWSIZE);
-
         for (j = 0; j < ncopy; j ++)
-            chan->window[oldbuf + j] =
+            window[j] =
                 SOX_SAMPLE_TO_FLOAT_32BIT(ibuf[i + tracks * j], effp->clips);
-
-        if (!whole_window)
-            continue;
-        else
-            process_window(effp, data, (unsigned) i, (unsigned) tracks, obuf, (unsigned) (oldbuf + ncopy));
     }
-
-    *isamp = tracks*ncopy;
-    if (whole_window)
-        *osamp = tracks*(WINDOWSIZE/2);
-    else
-        *osamp = 0;
+    data->bufdata += ncopy;
+    *isamp = tracks * ncopy;
+
+    done = flush_output(effp, data, obuf, *osamp);
+    num_windows = data->bufdata < WINDOWSIZE? 0 :
+        (data->bufdata - WINDOWSIZE) / HALFWINDOW + 1;
+    if (num_windows && data->out_pos == data->out_len) {
+        process_windows(effp, data, (int)num_windows, HALFWINDOW);
+        shift_windows(effp, data, num_windows);
+        done += flush_output(effp, data, obuf + done, *osamp - done);
+    }
+    *osamp = done;
 
     return SOX_SUCCESS;
 }
@@ -304,16 +343,27 @@ static int sox_noisered_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_
 static int sox_noisered_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
     priv_t * data = (priv_t *)effp->priv;
-    unsigned i;
-    unsigned tracks = effp->in_signal.channels;
-    *osamp = 0;
-    for (i = 0; i < tracks; i ++)
-        *osamp += process_window(effp, data, i, tracks, obuf, (unsigned) data->bufdata);
-
-    /* FIXME: This is very picky.  osamp needs to be big enough to get all
-     * remaining data or it will be discarded.
-     */
-    return (SOX_EOF);
+    size_t i;
+    size_t tracks = effp->in_signal.channels;
+    size_t use = data->bufdata - min(data->bufdata, HALFWINDOW);
+    size_t isamp = 0;
+
+    /* Whole windows, and output, that didn't fit in the output buffer */
+    if (data->bufdata >= WINDOWSIZE || data->out_pos < data->out_len) {
+        sox_noisered_flow(effp, NULL, obuf, &isamp, osamp);
+        return SOX_SUCCESS;
+    }
+
+    if (!data->drained) {
+        for (i = 0; i < tracks; i ++)
+            memset(data->chandata[i].window + data->bufdata, 0,
+                   (WINDOWSIZE - data->bufdata) * sizeof(float));
+        process_windows(effp, data, 1, (int)use);
+        data->drained = sox_true;
+    }
+    *osamp = flush_output(effp, data, obuf, *osamp);
+
+    return data->out_pos < data->out_len? SOX_SUCCESS : SOX_EOF;
 }
 
 /*
@@ -326,13 +376,19 @@ static int sox_noisered_stop(sox_effect_t * effp)
 
     for (i = 0; i < effp->in_signal.channels; i ++) {
         chandata_t* chan = &(data->chandata[i]);
+        free(chan->power);
+        free(chan->work);
+        free(chan->spectra);
         free(chan->lastwindow);
         free(chan->window);
         free(chan->smoothing);
+        free(chan->threshold);
         free(chan->noisegate);
     }
 
     free(data->chandata);
+    free(data->hann);
+    free(data->out);
 
     return (SOX_SUCCESS);
 }
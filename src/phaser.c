@@ -13,13 +13,9 @@ typedef struct {
   double     gain_in, gain_out, delay, decay, speed;
   lsx_wave_t mod_type;
 
-  int        * mod_buf;
-  size_t     mod_buf_len;
-  int        mod_pos;
-            
-  double     * delay_buf;
+  lsx_lfo_t  mod;
+  lsx_delay_t delay_line;
   size_t     delay_buf_len;
-  int        delay_pos;
 } priv_t;
 
 static int getopts(sox_effect_t * effp, int argc, char * * argv)
@@ -59,25 +55,22 @@ static int getopts(sox_effect_t * effp, int argc, char * * argv)
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *) effp->priv;
+  size_t mod_buf_len;
 
   p->delay_buf_len = p->delay * .001 * effp->in_signal.rate;
   if (p->delay_buf_len < 1) {
     lsx_fail("delay can't be less than %g", 1000 / effp->in_signal.rate);
     return SOX_EOF;
   }
-  lsx_vcalloc(p->delay_buf, p->delay_buf_len);
-
-  p->mod_buf_len = effp->in_signal.rate / p->speed;
-  if (p->mod_buf_len < 1) {
+  mod_buf_len = effp->in_signal.rate / p->speed;
+  if (mod_buf_len < 1) {
     lsx_fail("speed can't be more than %g", effp->in_signal.rate);
     return SOX_EOF;
   }
-  lsx_valloc(p->mod_buf, p->mod_buf_len);
-  lsx_generate_wave_table(p->mod_type, SOX_INT, p->mod_buf, p->mod_buf_len,
+  lsx_delay_init(&p->delay_line, p->delay_buf_len);
+  lsx_lfo_init(&p->mod, p->mod_type, SOX_INT, mod_buf_len,
       1., (double)p->delay_buf_len, M_PI_2);
 
-  p->delay_pos = p->mod_pos = 0;
-
   effp->out_signal.length = SOX_UNKNOWN_LEN; /* TODO: calculate actual length */
   return SOX_SUCCESS;
 }
@@ -89,12 +82,13 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf,
   size_t len = *isamp = *osamp = min(*isamp, *osamp);
 
   while (len--) {
-    double d = *ibuf++ * p->gain_in + p->delay_buf[
-      (p->delay_pos + p->mod_buf[p->mod_pos]) % p->delay_buf_len] * p->decay;
-    p->mod_pos = (p->mod_pos + 1) % p->mod_buf_len;
-    
-    p->delay_pos = (p->delay_pos + 1) % p->delay_buf_len;
-    p->delay_buf[p->delay_pos] = d;
+    /* The modulation runs from 1 to delay_buf_len, so this taps from
+     * delay_buf_len samples back to the last one */
+    double d = *ibuf++ * p->gain_in + lsx_delay_tap(&p->delay_line,
+      p->delay_buf_len - (size_t)lsx_lfo_at(&p->mod, 0)) * p->decay;
+    lsx_lfo_advance(&p->mod, 1);
+
+    lsx_delay_push(&p->delay_line, d);
 
     *obuf++ = SOX_ROUND_CLIP_COUNT(d * p->gain_out, effp->clips);
   }
@@ -105,8 +99,8 @@ static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *) effp->priv;
 
-  free(p->delay_buf);
-  free(p->mod_buf);
+  lsx_delay_stop(&p->delay_line);
+  lsx_lfo_stop(&p->mod);
   return SOX_SUCCESS;
 }
 
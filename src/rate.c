@@ -680,11 +680,15 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
   size_t odone = *osamp;
 
   sample_t const * s = rate_output(&p->rate, NULL, &odone);
-  lsx_save_samples(obuf, s, odone, &effp->clips);
+  if (effp->handler.flags & LSX_EFF_OUT_DOUBLE)
+    lsx_save_double_samples(obuf, s, odone);
+  else lsx_save_samples(obuf, s, odone, &effp->clips);
 
   if (*isamp && odone < *osamp) {
     sample_t * t = rate_input(&p->rate, NULL, *isamp);
-    lsx_load_samples(t, ibuf, *isamp);
+    if (effp->handler.flags & LSX_EFF_IN_DOUBLE)
+      lsx_load_double_samples(t, ibuf, *isamp);
+    else lsx_load_samples(t, ibuf, *isamp);
     rate_process(&p->rate);
   }
   else *isamp = 0;
@@ -730,7 +734,7 @@ sox_effect_handler_t const * lsx_rate_effect_fn(void)
   };
 
   static sox_effect_handler_t handler = {
-    "rate", usage, extra_usage, SOX_EFF_RATE,
+    "rate", usage, extra_usage, SOX_EFF_RATE | SOX_EFF_FLOAT,
     create, start, flow, drain, stop, 0, sizeof(priv_t)
   };
 
@@ -66,19 +66,24 @@ int lsx_rawstart(sox_format_t * ft, sox_bool default_rate,
   return SOX_SUCCESS;
 }
 
+/* Samples converted at a time, through a buffer on the stack */
+#define RAW_CHUNK 2048
+
 #define READ_SAMPLES_FUNC(type, size, sign, ctype, uctype, cast) \
   static size_t sox_read_ ## sign ## type ## _samples( \
       sox_format_t * ft, sox_sample_t *buf, size_t len) \
   { \
-    size_t n, nread; \
+    size_t n, nread, want, done = 0; \
     SOX_SAMPLE_LOCALS; \
-    ctype *data; \
-    lsx_valloc(data, len); \
-    nread = lsx_read_ ## type ## _buf(ft, (uctype *)data, len); \
-    for (n = 0; n < nread; n++) \
-      *buf++ = cast(data[n], ft->clips); \
-    free(data); \
-    return nread; \
+    ctype data[RAW_CHUNK]; \
+    do { \
+      want = min(len - done, RAW_CHUNK); \
+      nread = lsx_read_ ## type ## _buf(ft, (uctype *)data, want); \
+      for (n = 0; n < nread; n++) \
+        *buf++ = cast(data[n], ft->clips); \
+      done += nread; \
+    } while (nread == want && done < len); \
+    return done; \
   }
 
 READ_SAMPLES_FUNC(b, 1, u, uint8_t, uint8_t, SOX_UNSIGNED_8BIT_TO_SAMPLE)
@@ -99,14 +104,16 @@ READ_SAMPLES_FUNC(df, sizeof(double), su, double, double, SOX_FLOAT_64BIT_TO_SAM
       sox_format_t * ft, sox_sample_t const * buf, size_t len) \
   { \
     SOX_SAMPLE_LOCALS; \
-    size_t n, nwritten; \
-    ctype *data; \
-    lsx_valloc(data, len); \
-    for (n = 0; n < len; n++) \
-      data[n] = cast(buf[n], ft->clips); \
-    nwritten = lsx_write_ ## type ## _buf(ft, (uctype *)data, len); \
-    free(data); \
-    return nwritten; \
+    size_t n, nwritten, want, done = 0; \
+    ctype data[RAW_CHUNK]; \
+    do { \
+      want = min(len - done, RAW_CHUNK); \
+      for (n = 0; n < want; n++) \
+        data[n] = cast(*buf++, ft->clips); \
+      nwritten = lsx_write_ ## type ## _buf(ft, (uctype *)data, want); \
+      done += nwritten; \
+    } while (nwritten == want && done < len); \
+    return done; \
   }
 
 
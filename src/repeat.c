@@ -21,7 +21,7 @@
 typedef struct {
   unsigned      num_repeats, remaining_repeats;
   uint64_t      num_samples, remaining_samples;
-  FILE          * tmp_file;
+  lsx_tmpstore_t store;
 } priv_t;
 
 static int create(sox_effect_t * effp, int argc, char * * argv)
@@ -43,10 +43,7 @@ static int start(sox_effect_t * effp)
   if (!p->num_repeats)
     return SOX_EFF_NULL;
 
-  if (!(p->tmp_file = lsx_tmpfile())) {
-    lsx_fail("can't create temporary file: %s", strerror(errno));
-    return SOX_EOF;
-  }
+  lsx_tmpstore_init(&p->store, sox_globals.tmp_memory);
   p->num_samples = p->remaining_samples = 0;
   p->remaining_repeats = p->num_repeats;
   if (effp->in_signal.length != SOX_UNKNOWN_LEN && p->num_repeats != UINT_MAX)
@@ -63,7 +60,7 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
   priv_t * p = (priv_t *)effp->priv;
   size_t len = min(*isamp, *osamp);
   memcpy(obuf, ibuf, len * sizeof(*obuf));
-  if (fwrite(ibuf, sizeof(*ibuf), len, p->tmp_file) != len) {
+  if (lsx_tmpstore_write(&p->store, ibuf, len * sizeof(*ibuf)) != SOX_SUCCESS) {
     lsx_fail("error writing temporary file: %s", strerror(errno));
     return SOX_EOF;
   }
@@ -84,10 +81,11 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
       p->remaining_samples = p->num_samples;
       if (p->remaining_repeats != UINT_MAX)
         --p->remaining_repeats;
-      rewind(p->tmp_file);
     }
     n = min(p->remaining_samples, *osamp - odone);
-    if ((fread(obuf + odone, sizeof(*obuf), n, p->tmp_file)) != n) {
+    if (lsx_tmpstore_read(&p->store,
+          (p->num_samples - p->remaining_samples) * sizeof(*obuf),
+          obuf + odone, n * sizeof(*obuf)) != SOX_SUCCESS) {
       lsx_fail("error reading temporary file: %s", strerror(errno));
       return SOX_EOF;
     }
@@ -101,7 +99,7 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
 static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  lsx_close_tmpfile(p->tmp_file);
+  lsx_tmpstore_close(&p->store);
   return SOX_SUCCESS;
 }
 
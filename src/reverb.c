@@ -233,23 +233,32 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
 {
   priv_t * p = (priv_t *)effp->priv;
   size_t c, i, w, len = min(*isamp / p->ichannels, *osamp / p->ochannels);
+  double const * dibuf = (double const *)ibuf;
+  double * dobuf = (double *)obuf;
   SOX_SAMPLE_LOCALS;
 
   *isamp = len * p->ichannels, *osamp = len * p->ochannels;
   for (c = 0; c < p->ichannels; ++c)
     p->chan[c].dry = fifo_write(&p->chan[c].reverb.input_fifo, len, 0);
   for (i = 0; i < len; ++i) for (c = 0; c < p->ichannels; ++c)
-    p->chan[c].dry[i] = SOX_SAMPLE_TO_FLOAT_32BIT(*ibuf++, effp->clips);
+    p->chan[c].dry[i] = effp->handler.flags & LSX_EFF_IN_DOUBLE?
+        /* As SOX_SAMPLE_TO_FLOAT_32BIT but without clipping */
+        floor((*dibuf++ + 64) / 128) * 128 * (1. / (SOX_SAMPLE_MAX + 1.)) :
+        SOX_SAMPLE_TO_FLOAT_32BIT(*ibuf++, effp->clips);
   for (c = 0; c < p->ichannels; ++c)
     reverb_process(&p->chan[c].reverb, len);
   if (p->ichannels == 2) for (i = 0; i < len; ++i) for (w = 0; w < 2; ++w) {
     float out = (1 - p->wet_only) * p->chan[w].dry[i] +
       .5 * (p->chan[0].wet[w][i] + p->chan[1].wet[w][i]);
-    *obuf++ = SOX_FLOAT_32BIT_TO_SAMPLE(out, effp->clips);
+    if (effp->handler.flags & LSX_EFF_OUT_DOUBLE)
+      *dobuf++ = trunc(out * (SOX_SAMPLE_MAX + 1.));
+    else *obuf++ = SOX_FLOAT_32BIT_TO_SAMPLE(out, effp->clips);
   }
   else for (i = 0; i < len; ++i) for (w = 0; w < p->ochannels; ++w) {
     float out = (1 - p->wet_only) * p->chan[0].dry[i] + p->chan[0].wet[w][i];
-    *obuf++ = SOX_FLOAT_32BIT_TO_SAMPLE(out, effp->clips);
+    if (effp->handler.flags & LSX_EFF_OUT_DOUBLE)
+      *dobuf++ = trunc(out * (SOX_SAMPLE_MAX + 1.));
+    else *obuf++ = SOX_FLOAT_32BIT_TO_SAMPLE(out, effp->clips);
   }
   return SOX_SUCCESS;
 }
@@ -278,7 +287,7 @@ sox_effect_handler_t const *lsx_reverb_effect_fn(void)
     " [pre-delay(0ms)"
     " [wet-gain(0dB)"
     "]]]]]]", extra_usage,
-    SOX_EFF_MCHAN | SOX_EFF_CHAN,
+    SOX_EFF_MCHAN | SOX_EFF_CHAN | SOX_EFF_FLOAT,
     getopts, start, flow, NULL, stop, NULL, sizeof(priv_t)
   };
   return &handler;
@@ -7,25 +7,23 @@
  */
 
 /*
- * "reverse" effect, uses a temporary file created by lsx_tmpfile().
+ * "reverse" effect, uses temporary storage from lsx_tmpstore_write().
  */
 
 #include "sox_i.h"
 
 typedef struct {
-  off_t         pos;
-  FILE          * tmp_file;
+  uint64_t      pos;
+  sox_bool      draining;
+  lsx_tmpstore_t store;
 } priv_t;
 
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
   p->pos = 0;
-  p->tmp_file = lsx_tmpfile();
-  if (p->tmp_file == NULL) {
-    lsx_fail("can't create temporary file: %s", strerror(errno));
-    return SOX_EOF;
-  }
+  p->draining = sox_false;
+  lsx_tmpstore_init(&p->store, sox_globals.tmp_memory / effp->flows);
   return SOX_SUCCESS;
 }
 
@@ -33,7 +31,7 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
     sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  if (fwrite(ibuf, sizeof(*ibuf), *isamp, p->tmp_file) != *isamp) {
+  if (lsx_tmpstore_write(&p->store, ibuf, *isamp * sizeof(*ibuf)) != SOX_SUCCESS) {
     lsx_fail("error writing temporary file: %s", strerror(errno));
     return SOX_EOF;
   }
@@ -44,26 +42,21 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
 static int drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  int i, j;
+  size_t i, j;
 
-  if (p->pos == 0) {
-    fflush(p->tmp_file);
-    p->pos = ftello(p->tmp_file);
-    if (p->pos % sizeof(sox_sample_t) != 0) {
-      lsx_fail("temporary file has incorrect size");
-      return SOX_EOF;
-    }
-    p->pos /= sizeof(sox_sample_t);
+  if (!p->draining) {
+    p->pos = lsx_tmpstore_len(&p->store) / sizeof(sox_sample_t);
+    p->draining = sox_true;
   }
-  p->pos -= *osamp = min((off_t)*osamp, p->pos);
-  if (fseeko(p->tmp_file, (off_t)(p->pos * sizeof(sox_sample_t)), SEEK_SET) ||
-      fread(obuf, sizeof(sox_sample_t), *osamp, p->tmp_file) != *osamp) {
+  p->pos -= *osamp = min(*osamp, p->pos);
+  if (lsx_tmpstore_read(&p->store, p->pos * sizeof(sox_sample_t), obuf,
+        *osamp * sizeof(sox_sample_t)) != SOX_SUCCESS) {
     lsx_fail("error reading temporary file: %s", strerror(errno));
     return SOX_EOF;
   }
-  for (i = 0, j = *osamp - 1; i < j; ++i, --j) { /* reverse the samples */
+  for (i = 0, j = *osamp; i + 1 < j; ++i) { /* reverse the samples */
     sox_sample_t temp = obuf[i];
-    obuf[i] = obuf[j];
+    obuf[i] = obuf[--j];
     obuf[j] = temp;
   }
   return p->pos? SOX_SUCCESS : SOX_EOF;
@@ -72,7 +65,7 @@ static int drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  lsx_close_tmpfile(p->tmp_file);
+  lsx_tmpstore_close(&p->store);
   return SOX_SUCCESS;
 }
 
@@ -71,6 +71,10 @@ typedef struct {
     size_t   window_size;
     double      rms_sum;
 
+    double      *squares;   /* of the samples in the current flow */
+    size_t   squares_len;
+    double      start_mean, stop_mean; /* Least mean squares above threshold */
+
     char        leave_silence;
 
     /* State Machine */
@@ -235,6 +239,50 @@ static int sox_silence_getopts(sox_effect_t * effp, int argc, char **argv)
     return(SOX_SUCCESS);
 }
 
+static sox_bool aboveThreshold(sox_effect_t const * effp,
+    sox_sample_t value /* >= 0 */, double threshold, int unit)
+{
+  /* When scaling low bit data, noise values got scaled way up */
+  /* Only consider the original bits when looking for silence */
+ sox_sample_t masked_value = value & ((unsigned)-1 << (32 - effp->in_signal.precision));
+
+  double scaled_value = (double)masked_value / SOX_SAMPLE_MAX;
+
+  if (unit == '%')
+    scaled_value *= 100;
+  else if (unit == 'd')
+    scaled_value = linear_to_dB(scaled_value);
+
+  return scaled_value > threshold;
+}
+
+/* The least mean square of the RMS window that aboveThreshold() finds to
+ * be above the threshold, so that it need not be called for each sample.
+ * It is monotonic in the (truncated) RMS, so look for the least RMS above,
+ * then for the least mean square whose square root reaches that. */
+static double min_mean_square(sox_effect_t const * effp,
+    double threshold, int unit)
+{
+    sox_sample_t lo = 0, hi = SOX_SAMPLE_MAX;
+    double m;
+
+    if (!aboveThreshold(effp, hi, threshold, unit))
+        return HUGE_VAL;
+    while (lo < hi) {
+        sox_sample_t mid = lo + (hi - lo) / 2;
+        if (aboveThreshold(effp, mid, threshold, unit))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    m = (double)lo * lo;
+    while (sqrt(m) < lo)
+        m = nextafter(m, HUGE_VAL);
+    while (m > 0 && sqrt(nextafter(m, 0.)) >= lo)
+        m = nextafter(m, 0.);
+    return m;
+}
+
 static int sox_silence_start(sox_effect_t * effp)
 {
     priv_t *silence = (priv_t *)effp->priv;
@@ -266,6 +314,11 @@ static int sox_silence_start(sox_effect_t * effp)
         silence->stop_duration = temp * effp->in_signal.channels;
     }
 
+    silence->start_mean = min_mean_square(effp, silence->start_threshold,
+                                          silence->start_unit);
+    silence->stop_mean = min_mean_square(effp, silence->stop_threshold,
+                                         silence->stop_unit);
+
     if (silence->start)
         silence->mode = SILENCE_TRIM;
     else
@@ -286,49 +339,43 @@ static int sox_silence_start(sox_effect_t * effp)
     return(SOX_SUCCESS);
 }
 
-static sox_bool aboveThreshold(sox_effect_t const * effp,
-    sox_sample_t value /* >= 0 */, double threshold, int unit)
+/* Whether any (or all) of a wide sample's channels would take the RMS
+ * above the threshold, as each would if it were next into the window */
+static sox_bool frame_above(priv_t const * silence, double const * sq,
+    unsigned channels, double min_mean, sox_bool all)
 {
-  /* When scaling low bit data, noise values got scaled way up */
-  /* Only consider the original bits when looking for silence */
- sox_sample_t masked_value = value & ((unsigned)-1 << (32 - effp->in_signal.precision));
+    double sum = silence->rms_sum - *silence->window_current;
+    unsigned j;
 
-  double scaled_value = (double)masked_value / SOX_SAMPLE_MAX;
-
-  if (unit == '%')
-    scaled_value *= 100;
-  else if (unit == 'd')
-    scaled_value = linear_to_dB(scaled_value);
-
-  return scaled_value > threshold;
+    for (j = 0; j < channels; j++)
+        if (((sum + sq[j]) / silence->window_size >= min_mean) != all)
+            return !all;
+    return all;
 }
 
-static sox_sample_t compute_rms(sox_effect_t * effp, sox_sample_t sample)
+static void update_rms(priv_t * silence, double const * sq, unsigned channels)
 {
-    priv_t * silence = (priv_t *) effp->priv;
-    double new_sum;
-    sox_sample_t rms;
+    unsigned j;
 
-    new_sum = silence->rms_sum;
-    new_sum -= *silence->window_current;
-    new_sum += ((double)sample * (double)sample);
+    for (j = 0; j < channels; j++) {
+        silence->rms_sum -= *silence->window_current;
+        *silence->window_current = sq[j];
+        silence->rms_sum += *silence->window_current;
 
-    rms = sqrt(new_sum / silence->window_size);
-
-    return (rms);
+        silence->window_current++;
+        if (silence->window_current >= silence->window_end)
+            silence->window_current = silence->window;
+    }
 }
 
-static void update_rms(sox_effect_t * effp, sox_sample_t sample)
+static double const * squares(priv_t * silence, sox_sample_t const * ibuf,
+    size_t len)
 {
-    priv_t * silence = (priv_t *) effp->priv;
-
-    silence->rms_sum -= *silence->window_current;
-    *silence->window_current = ((double)sample * (double)sample);
-    silence->rms_sum += *silence->window_current;
+    size_t i;
 
-    silence->window_current++;
-    if (silence->window_current >= silence->window_end)
-        silence->window_current = silence->window;
+    for (i = 0; i < len; i++)
+        silence->squares[i] = (double)ibuf[i] * (double)ibuf[i];
+    return silence->squares;
 }
 
 /* Process signed long samples from ibuf to obuf. */
@@ -337,13 +384,19 @@ static int sox_silence_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_s
                     size_t *isamp, size_t *osamp)
 {
     priv_t * silence = (priv_t *) effp->priv;
+    unsigned channels = effp->in_signal.channels;
     int threshold;
-    size_t i, j;
+    double const * sq;
+    size_t i, n;
     size_t nrOfTicks, /* sometimes wide, sometimes non-wide samples */
       nrOfInSamplesRead, nrOfOutSamplesWritten; /* non-wide samples */
 
     nrOfInSamplesRead = 0;
     nrOfOutSamplesWritten = 0;
+    if (silence->squares_len < *isamp) {
+        silence->squares_len = *isamp;
+        lsx_revalloc(silence->squares, silence->squares_len);
+    }
 
     switch (silence->mode)
     {
@@ -358,28 +411,22 @@ static int sox_silence_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_s
 silence_trim:
             nrOfTicks = min((*isamp-nrOfInSamplesRead),
                             (*osamp-nrOfOutSamplesWritten)) /
-                           effp->in_signal.channels;
-            for(i = 0; i < nrOfTicks; i++)
+                           channels;
+            sq = squares(silence, ibuf, nrOfTicks * channels);
+            for(i = 0; i < nrOfTicks; i++, sq += channels)
             {
-                threshold = 0;
-                for (j = 0; j < effp->in_signal.channels; j++)
-                {
-                    threshold |= aboveThreshold(effp,
-                                                compute_rms(effp, ibuf[j]),
-                                                silence->start_threshold,
-                                                silence->start_unit);
-                }
+                threshold = frame_above(silence, sq, channels,
+                                        silence->start_mean, sox_false);
 
                 if (threshold)
                 {
                     /* Add to holdoff buffer */
-                    for (j = 0; j < effp->in_signal.channels; j++)
-                    {
-                        update_rms(effp, *ibuf);
-                        silence->start_holdoff[
-                            silence->start_holdoff_end++] = *ibuf++;
-                        nrOfInSamplesRead++;
-                    }
+                    update_rms(silence, sq, channels);
+                    memcpy(silence->start_holdoff + silence->start_holdoff_end,
+                           ibuf, channels * sizeof(*ibuf));
+                    silence->start_holdoff_end += channels;
+                    ibuf += channels;
+                    nrOfInSamplesRead += channels;
 
                     if (silence->start_holdoff_end >=
                             silence->start_duration)
@@ -399,13 +446,17 @@ silence_trim:
                 }
                 else /* !above Threshold */
                 {
+                    /* Discard the whole run of silence at once */
                     silence->start_holdoff_end = 0;
-                    for (j = 0; j < effp->in_signal.channels; j++)
-                    {
-                        update_rms(effp, ibuf[j]);
-                    }
-                    ibuf += effp->in_signal.channels;
-                    nrOfInSamplesRead += effp->in_signal.channels;
+                    n = 0;
+                    do
+                        update_rms(silence, sq + n * channels, channels);
+                    while (++n < nrOfTicks - i && !frame_above(silence,
+                        sq + n * channels, channels, silence->start_mean, sox_false));
+                    sq += (n - 1) * channels;
+                    i += n - 1;
+                    ibuf += n * channels;
+                    nrOfInSamplesRead += n * channels;
                 }
             } /* for nrOfTicks */
             break;
@@ -476,20 +527,15 @@ silence_trim_flush:
 silence_copy:
             nrOfTicks = min((*isamp-nrOfInSamplesRead),
                             (*osamp-nrOfOutSamplesWritten)) /
-                           effp->in_signal.channels;
+                           channels;
             if (silence->stop)
             {
                 /* Case A */
-                for(i = 0; i < nrOfTicks; i++)
+                sq = squares(silence, ibuf, nrOfTicks * channels);
+                for(i = 0; i < nrOfTicks; i++, sq += channels)
                 {
-                    threshold = 1;
-                    for (j = 0; j < effp->in_signal.channels; j++)
-                    {
-                        threshold &= aboveThreshold(effp,
-                                                    compute_rms(effp, ibuf[j]),
-                                                    silence->stop_threshold,
-                                                    silence->stop_unit);
-                    }
+                    threshold = frame_above(silence, sq, channels,
+                                            silence->stop_mean, sox_true);
 
                     /* Case 1a
                      * If above threshold, check to see if we where holding
@@ -511,30 +557,36 @@ silence_copy:
                     /* Case 1b */
                     else if (threshold)
                     {
-                        /* Not holding off so copy into output buffer */
-                        for (j = 0; j < effp->in_signal.channels; j++)
-                        {
-                            update_rms(effp, *ibuf);
-                            *obuf++ = *ibuf++;
-                            nrOfInSamplesRead++;
-                            nrOfOutSamplesWritten++;
-                        }
+                        /* Not holding off so copy the whole run of
+                         * non-silence into output buffer */
+                        n = 0;
+                        do
+                            update_rms(silence, sq + n * channels, channels);
+                        while (++n < nrOfTicks - i && frame_above(silence,
+                            sq + n * channels, channels, silence->stop_mean, sox_true));
+                        sq += (n - 1) * channels;
+                        i += n - 1;
+                        memcpy(obuf, ibuf, n * channels * sizeof(*ibuf));
+                        obuf += n * channels;
+                        ibuf += n * channels;
+                        nrOfInSamplesRead += n * channels;
+                        nrOfOutSamplesWritten += n * channels;
                     }
                     /* Case 2 */
                     else if (!threshold)
                     {
                         /* Add to holdoff buffer */
-                        for (j = 0; j < effp->in_signal.channels; j++)
-                        {
-                            update_rms(effp, *ibuf);
-                            if (silence->leave_silence) {
-                                *obuf++ = *ibuf;
-                                nrOfOutSamplesWritten++;
-                            }
-                            silence->stop_holdoff[
-                                silence->stop_holdoff_end++] = *ibuf++;
-                            nrOfInSamplesRead++;
+                        update_rms(silence, sq, channels);
+                        if (silence->leave_silence) {
+                            memcpy(obuf, ibuf, channels * sizeof(*ibuf));
+                            obuf += channels;
+                            nrOfOutSamplesWritten += channels;
                         }
+                        memcpy(silence->stop_holdoff + silence->stop_holdoff_end,
+                               ibuf, channels * sizeof(*ibuf));
+                        silence->stop_holdoff_end += channels;
+                        ibuf += channels;
+                        nrOfInSamplesRead += channels;
 
                         /* Check if holdoff buffer is greater than duration
                          */
@@ -585,10 +637,9 @@ silence_copy:
             else /* !(silence->stop) */
             {
                 /* Case B */
-                memcpy(obuf, ibuf, sizeof(sox_sample_t)*nrOfTicks*
-                                   effp->in_signal.channels);
-                nrOfInSamplesRead += (nrOfTicks*effp->in_signal.channels);
-                nrOfOutSamplesWritten += (nrOfTicks*effp->in_signal.channels);
+                memcpy(obuf, ibuf, sizeof(sox_sample_t)*nrOfTicks*channels);
+                nrOfInSamplesRead += (nrOfTicks*channels);
+                nrOfOutSamplesWritten += (nrOfTicks*channels);
             }
             break;
 
@@ -670,6 +721,7 @@ static int sox_silence_stop(sox_effect_t * effp)
   priv_t * silence = (priv_t *) effp->priv;
 
   free(silence->window);
+  free(silence->squares);
   free(silence->start_holdoff);
   free(silence->stop_holdoff);
 
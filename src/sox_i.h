@@ -57,6 +57,26 @@ assert_static(sizeof(off_t) == _FILE_OFFSET_BITS >> 3, OFF_T_BUILD_PROBLEM);
 FILE * lsx_tmpfile(void);
 void   lsx_close_tmpfile(FILE *);
 
+/* Temporary storage for effects that must hold all their input: the first
+ * part is kept in memory, up to the given budget, and the rest is spilled
+ * to a temporary file that is read back in large blocks. */
+typedef struct {
+  size_t   budget, mem_len, mem_size;
+  char     * mem;
+  FILE     * file;
+  uint64_t file_len;
+  sox_bool dirty, at_end, mapped;
+  char     * block, * block_buf, * write_buf;
+  uint64_t block_pos;
+  size_t   block_len;
+} lsx_tmpstore_t;
+
+void   lsx_tmpstore_init(lsx_tmpstore_t * t, size_t budget);
+int    lsx_tmpstore_write(lsx_tmpstore_t * t, void const * buf, size_t len);
+int    lsx_tmpstore_read(lsx_tmpstore_t * t, uint64_t pos, void * buf, size_t len);
+void   lsx_tmpstore_close(lsx_tmpstore_t * t);
+#define lsx_tmpstore_len(t) ((t)->mem_len + (t)->file_len)
+
 void lsx_debug_more_impl(char const * fmt, ...) LSX_PRINTF12;
 void lsx_debug_most_impl(char const * fmt, ...) LSX_PRINTF12;
 
@@ -122,6 +142,44 @@ void lsx_save_samples(sox_sample_t * const dest, double const * const src,
     size_t const n, sox_uint64_t * const clips);
 void lsx_load_samples(double * const dest, sox_sample_t const * const src,
     size_t const n);
+void lsx_save_double_samples(sox_sample_t * const dest, double const * const src,
+    size_t const n);
+void lsx_load_double_samples(double * const dest, sox_sample_t const * const src,
+    size_t const n);
+
+/* Delay line for modulated-delay effects.  Each sample is stored twice,
+ * length apart, so that taps 0 (the newest sample) to length can be read
+ * without wrapping; tap length is the newest sample again. */
+typedef struct {
+  double * buf;
+  size_t length;
+  size_t pos;     /* Index in buf of the newest sample */
+} lsx_delay_t;
+
+#define LSX_DELAY_BLOCK 256 /* Samples processed at a time by its users */
+
+void lsx_delay_init(lsx_delay_t * d, size_t length);
+void lsx_delay_stop(lsx_delay_t * d);
+void lsx_delay_write(lsx_delay_t * d, double const * x, size_t n);
+void lsx_delay_read(lsx_delay_t const * d, double * y, size_t delay, size_t n);
+#define lsx_delay_tap(d, k) ((d)->buf[(d)->pos + (k)])
+#define lsx_delay_push(d, x) do { \
+  (d)->pos = ((d)->pos? (d)->pos : (d)->length) - 1; \
+  (d)->buf[(d)->pos] = (d)->buf[(d)->pos + (d)->length] = (x); } while (0)
+
+/* Low-frequency oscillator: one cycle of a wave table, stored twice like a
+ * delay line so that the next length values can be read without wrapping */
+typedef struct {
+  double * table;
+  size_t length;
+  size_t pos;
+} lsx_lfo_t;
+
+void lsx_lfo_init(lsx_lfo_t * lfo, lsx_wave_t wave_type, sox_data_t data_type,
+    size_t length, double min, double max, double phase);
+void lsx_lfo_stop(lsx_lfo_t * lfo);
+#define lsx_lfo_at(lfo, k) ((lfo)->table[(lfo)->pos + (k)])
+#define lsx_lfo_advance(lfo, n) ((lfo)->pos = ((lfo)->pos + (n)) % (lfo)->length)
 
 #ifdef HAVE_BYTESWAP_H
 #include <byteswap.h>
@@ -250,6 +308,13 @@ char * lsx_cat_comments(sox_comments_t comments);
 int lsx_flow_copy(sox_effect_t * effp, const sox_sample_t * ibuf,
     sox_sample_t * obuf, size_t * isamp, size_t * osamp);
 int lsx_usage(sox_effect_t * effp);
+
+/* Set by the effects chain in an effect's copy of its handler's flags when
+ * it and the effect before or after it, both SOX_EFF_FLOAT, exchange
+ * doubles in place of sox_sample_ts; see lsx_save_double_samples */
+#define LSX_EFF_IN_DOUBLE  0x40000000
+#define LSX_EFF_OUT_DOUBLE 0x80000000
+
 #define EFFECT(f) extern sox_effect_handler_t const * lsx_##f##_effect_fn(void);
 #include "effects.h"
 #undef EFFECT
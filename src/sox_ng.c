@@ -21,6 +21,10 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE /* For struct ucred */
+#endif
+
 #include "soxconfig.h"
 #include "sox_ng.h"
 #include "util.h"
@@ -100,6 +104,14 @@
   #include <sys/ioctl.h>
 #endif
 
+#if defined HAVE_SYS_SOCKET_H && defined HAVE_SYS_UN_H && \
+    defined HAVE_SYS_WAIT_H && defined HAVE_UNISTD_H
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #include <sys/wait.h>
+  #define HAVE_SERVE 1
+#endif
+
 #ifdef HAVE_GETTIMEOFDAY
   #define TIME_FRAC 1e6
 #else
@@ -192,7 +204,8 @@ static size_t user_efftab_size = 0;
 static sox_effects_chain_t *effects_chain = NULL;
 static sox_effect_t *save_output_eff = NULL;
 
-static struct { char *name; int argc; char **argv; size_t argv_size; } **user_effargs = NULL;
+typedef struct { char *name; int argc; char **argv; size_t argv_size; } effargs_t;
+static effargs_t **user_effargs = NULL;
 static size_t *user_effargs_size = NULL;  /* array: size of user_effargs for each chain */
 /* Size of memory structures related to effects arguments (user_effargs[i],
  * user_effargs[i][j].argv) to be extended in steps of EFFARGS_STEP */
@@ -201,6 +214,38 @@ static size_t *nuser_effects = NULL;  /* array: number of effects in each chain
 static size_t current_eff_chain = 0;
 static size_t eff_chain_count = 0;
 static sox_bool very_first_effchain = sox_true;
+
+/* A scanning gain effect that will have the input read again, if any */
+static size_t replay_user = SOX_SIZE_MAX; /* its index in user_efftab */
+static size_t replay_effect = 0;          /* its index in effects_chain */
+static int32_t replay_ranqd1[2];          /* PRNG before adding and flowing */
+
+/* With --segments, how many stretches of a single input to process at once */
+static size_t segments = 0;
+
+/* With --no-plan, run the effects chains exactly as given */
+static sox_bool no_plan = sox_false;
+
+/* With --profile, the counters of the effects in the chains that have run,
+ * added up by their place in the chain, to report at exit */
+typedef enum {profile_off, profile_text, profile_json} profile_mode;
+static lsx_enum_item const profile_modes[] = {
+  LSX_ENUM_ITEM(profile_,text)
+  LSX_ENUM_ITEM(profile_,json)
+  {0, 0}};
+static profile_mode profile = profile_off;
+typedef struct {
+  char * name;
+  size_t position, flows;
+  sox_effect_stats_t stats;
+} profile_t;
+static profile_t * profiles = NULL;
+static size_t profiles_count = 0;
+
+/* With --index, a single input file's index if it has one that is valid,
+ * else the one being made as it is read */
+static sox_index_t * input_index = NULL;
+static sox_index_t * new_input_index = NULL;
   /* Indicates that not only the first effects chain is in effect (hrm), but
      also that it has never been restarted. Only then we may use the
      optimize_trim() hack. */
@@ -284,6 +329,10 @@ already_closed:
 
   free(sox_globals.tmp_path);
   sox_globals.tmp_path = NULL;
+  sox_index_close(input_index);
+  sox_index_close(new_input_index);
+  free(sox_globals.index_path);
+  sox_globals.index_path = NULL;
 
   free(play_rate_arg);
   free(effects_filename);
@@ -518,6 +567,24 @@ static size_t sox_read_wide(sox_format_t * ft, sox_sample_t * buf, size_t max)
   return len;
 }
 
+/* Measure the input as it is read from the start, to save its index at the
+ * end if it was all read */
+static void index_input(sox_sample_t const * buf, size_t ws)
+{
+  sox_format_t const * ft = files[0]->ft;
+
+  if (new_input_index->length == read_wide_samples && ws) {
+    sox_index_add(new_input_index, buf, ws * ft->signal.channels);
+    return;
+  }
+  if (new_input_index->length == read_wide_samples && !user_skip &&
+      !ft->sox_errno && (ft->signal.length == SOX_UNKNOWN_LEN ||
+      new_input_index->length * ft->signal.channels == ft->signal.length))
+    sox_index_save(new_input_index);
+  sox_index_close(new_input_index);
+  new_input_index = NULL;
+}
+
 static void balance_input(sox_sample_t * buf, size_t ws, file_t * f)
 {
   size_t s = ws * f->ft->signal.channels;
@@ -574,6 +641,8 @@ static int combiner_drain(sox_effect_t *effp, sox_sample_t * obuf, size_t * osam
     while (sox_true) {
       if (!user_skip)
         olen = sox_read_wide(files[current_input]->ft, obuf, *osamp);
+      if (new_input_index && current_input == 0)
+        index_input(obuf, olen);
       if (olen == 0) {   /* If EOF, go to the next input file. */
         if (++current_input < input_count) {
           if (combine_method == sox_sequence && !can_segue(current_input))
@@ -900,34 +969,6 @@ static void parse_effects(int argc, char ** argv)
   }
 } /* parse_effects */
 
-static char * * strtoargv(char * s, int * argc)
-{
-  sox_bool squote = sox_false;   /* Single quote mode (') is in effect. */
-  sox_bool dquote = sox_false;   /* Double quote mode (") is in effect. */
-  sox_bool esc    = sox_false;   /* Escape mode (\) is in effect. */
-  char * t, * * argv = NULL;
-
-  for (*argc = 0; *s;) {
-    for (; isspace((int)*s); ++s);    /* Skip past any (more) white space. */
-    if (*s) {                    /* Found an arg. */
-      lsx_revalloc(argv, *argc + 1);
-      argv[(*argc)++] = s;       /* Store pointer to start of arg. */
-                                 /* Find the end of the arg: */
-      for (t = s; *s && (esc || squote || dquote || !isspace((int)*s)); ++s)
-        if (!esc && !squote && *s == '"')
-          dquote = !dquote;      /* Toggle double quote mode. */
-        else if (!esc && !dquote && *s == '\'')
-          squote = !squote;      /* Toggle single quote mode. */
-        else if (!(esc = !esc && *s == '\\' && s[1] &&
-              (!squote && (s[1] == '"' || !dquote))))
-          *t++ = *s;             /* Only copy if not an active ', ", or \ */
-      s = *s ? s + 1 : s;        /* Skip the 1st white space char. */
-      *t = '\0';                 /* Terminate the arg. */
-    }
-  }
-  return argv;
-}                                /* strtoargv */
-
 static void read_user_effects(char const *filename)
 {
     FILE *file = lsx_fopen(filename, "r");
@@ -975,7 +1016,7 @@ static void read_user_effects(char const *filename)
 
       last_was_colon = sox_false;
 
-      argv = strtoargv(s, &argc);
+      argv = lsx_strtoargv(s, &argc);
 
       if (argv && argc == 1 && strcmp(argv[0], ":") == 0)
         last_was_colon = sox_true;
@@ -1034,11 +1075,10 @@ static void read_user_effects(char const *filename)
  * we add them, some may already be in the chain and we will need to free
  * them.
  */
-static void create_user_effects(void)
+static void create_user_effects(size_t num_effects)
 {
   size_t i;
   sox_effect_t *effp;
-  size_t num_effects = nuser_effects[current_eff_chain];
 
   /* extend user_efftab, if needed */
   if (user_efftab_size < num_effects) {
@@ -1070,6 +1110,348 @@ static void create_user_effects(void)
   }
 }
 
+/* The chain planner rewrites the user's effects before they are made:
+ * effects that reduce the number of channels, and rates that reduce the
+ * sample rate, are moved ahead of effects that would give the same result
+ * after them, runs of plain volume changes become one `vol', effects
+ * that would do nothing are dropped and a `remix' followed by a `remix'
+ * or `channels' becomes one `remix'.  The output is the same apart from
+ * where effects clip and in the least significant bits. */
+
+/* Effects that are linear, time-invariant and do the same to each channel,
+ * so they can come after any mixing of the channels instead of before */
+static char const * const linear_effects[] = {
+  "allpass", "band", "bandpass", "bandreject", "bass", "biquad", "deemph",
+  "equalizer", "fir", "gain", "highpass", "hilbert", "lowpass", "rate",
+  "riaa", "sinc", "treble", "vol", NULL};
+
+/* If an effect only changes the volume, get its linear gain */
+static sox_bool plain_gain(effargs_t const * e, double * gain)
+{
+  char type[11], dummy;
+  char const * t = type;
+  int n;
+
+  if (!strcmp(e->name, "gain")) {
+    *gain = 0;
+    if (e->argc > 1 ||
+        (e->argc && sscanf(e->argv[0], "%lf %c", gain, &dummy) != 1))
+      return sox_false;
+    *gain = dB_to_linear(*gain);
+    return sox_true;
+  }
+  if (strcmp(e->name, "vol") || e->argc < 1 || e->argc > 2 ||
+      (n = sscanf(e->argv[0], "%lf %10s %c", gain, type, &dummy)) < 1 ||
+      n > 2 || (n == 2 && e->argc == 2))   /* Not with the limiter */
+    return sox_false;
+  if (e->argc == 2)
+    t = e->argv[1];
+  else if (n == 1)
+    return sox_true;
+  n = strlen(t);
+  if (n && !lsx_strncasecmp(t, "dB", n))
+    *gain = dB_to_linear(*gain);
+  else if (n && !lsx_strncasecmp(t, "power", n))
+    *gain = *gain > 0 ? sqrt(*gain) : -sqrt(-*gain);
+  else if (!n || lsx_strncasecmp(t, "amplitude", n))
+    return sox_false;
+  return sox_true;
+}
+
+/* How many channels a `channels' or `remix' makes, or 0 if not known */
+static unsigned plan_channels(effargs_t const * e)
+{
+  unsigned n = 0;
+  int i;
+  char dummy;
+
+  if (!strcmp(e->name, "channels"))
+    return e->argc == 1 && sscanf(e->argv[0], "%u %c", &n, &dummy) == 1? n : 0;
+  if (strcmp(e->name, "remix"))
+    return 0;
+  for (i = 0; i < e->argc; ++i)
+    if (strcmp(e->argv[i], "-m") && strcmp(e->argv[i], "-a") &&
+        strcmp(e->argv[i], "-p"))
+      ++n;
+  return n;
+}
+
+/* The sample rate that a `rate' makes, or 0 if not known */
+static double plan_rate(effargs_t const * e)
+{
+  char * end;
+  double rate;
+
+  if (strcmp(e->name, "rate") || !e->argc)
+    return 0;
+  rate = strtod(e->argv[e->argc - 1], &end);
+  if (*end == 'k')
+    rate *= 1000, ++end;
+  return *end || rate <= 0? 0 : rate;
+}
+
+static sox_bool is_linear(effargs_t const * e)
+{
+  double gain;
+  size_t i;
+
+  for (i = 0; linear_effects[i] && strcmp(e->name, linear_effects[i]); ++i);
+  return linear_effects[i] &&
+    ((strcmp(e->name, "vol") && strcmp(e->name, "gain")) || plain_gain(e, &gain));
+}
+
+/* The channels and rate at the input to effect n of the chain, or 0 */
+static void plan_signal(size_t n, unsigned * channels, double * rate)
+{
+  effargs_t const * e = user_effargs[current_eff_chain];
+  size_t i;
+
+  *channels = files[current_input]->ft->signal.channels;
+  *rate = files[current_input]->ft->signal.rate;
+  if (combine_method == sox_sequence) /* The next input might differ */
+    *channels = 0, *rate = 0;
+  else if (combine_method != sox_concatenate)
+    for (*channels = 0, i = 0; i < input_count; ++i)
+      *channels = combine_method == sox_merge?
+        *channels + files[i]->ft->signal.channels :
+        max(*channels, files[i]->ft->signal.channels);
+  for (i = 0; i < n; ++i) {
+    if (!strcmp(e[i].name, "channels") || !strcmp(e[i].name, "remix"))
+      *channels = plan_channels(&e[i]);
+    else if (!strcmp(e[i].name, "rate"))
+      *rate = plan_rate(&e[i]);
+    else if (!is_linear(&e[i]))
+      *channels = 0, *rate = 0;
+  }
+}
+
+static void remove_effargs(size_t i)
+{
+  effargs_t * e = user_effargs[current_eff_chain];
+  effargs_t removed = e[i];
+  int k;
+
+  free(removed.name);
+  for (k = 0; k < removed.argc; ++k)
+    free(removed.argv[k]);
+  free(removed.argv);
+  memmove(&e[i], &e[i + 1], (--nuser_effects[current_eff_chain] - i) * sizeof(*e));
+  e[nuser_effects[current_eff_chain]].argv = NULL;
+  e[nuser_effects[current_eff_chain]].argv_size = 0;
+}
+
+/* A mixing matrix: how much of each input channel goes to each output */
+typedef struct {unsigned rows, cols; double * m;} mix_t;
+
+static void mix_init(mix_t * mix, unsigned rows, unsigned cols)
+{
+  mix->rows = rows;
+  mix->cols = cols;
+  mix->m = lsx_calloc((size_t)rows * max(cols, 1), sizeof(*mix->m));
+}
+
+/* Get the matrix of a `remix' whose output channels are made only of
+ * channel numbers and ranges of them, or of a `channels' given the number
+ * of channels going in */
+static sox_bool plan_mix(effargs_t const * e, unsigned in_channels, mix_t * mix)
+{
+  char * * argv = e->argv;
+  int argc = e->argc, pass;
+  sox_bool manual = sox_false, power = sox_false;
+  unsigned i, j, cols = 0;
+
+  if (!strcmp(e->name, "channels")) {
+    unsigned n = plan_channels(e);
+    if (!n || !in_channels)
+      return sox_false;
+    mix_init(mix, n, in_channels);
+    for (j = 0; j < n; ++j) {
+      unsigned in_per_out = (in_channels + n - 1 - j) / n;
+      if (in_channels > n) for (i = 0; i < in_per_out; ++i)
+        mix->m[j * in_channels + i * n + j] = 1. / in_per_out;
+      else mix->m[j * in_channels + j % in_channels] = 1;
+    }
+    return sox_true;
+  }
+  if (strcmp(e->name, "remix"))
+    return sox_false;
+  /* Options as remix's create() takes them */
+  if (argc && !strcmp(*argv, "-m")) manual = sox_true, ++argv, --argc;
+  if (argc && !strcmp(*argv, "-a")) manual = sox_false, ++argv, --argc;
+  if (argc && !strcmp(*argv, "-p")) power = sox_true, ++argv, --argc;
+  if (!argc)
+    return sox_false;
+  /* Find the highest channel used, then fill in the matrix */
+  for (pass = 0; pass < 2; ++pass) for (j = 0; j < (unsigned)argc; ++j) {
+    char const * text = argv[j];
+    unsigned in = 0;
+
+    while (*text) {
+      unsigned chan1, chan2;
+      int n;
+
+      if (*text < '0' || *text > '9' || sscanf(text, "%u%n", &chan1, &n) != 1)
+        return sox_false;
+      text += n;
+      chan2 = chan1;
+      if (*text == '-') {
+        ++text;
+        if (*text < '0' || *text > '9' || sscanf(text, "%u%n", &chan2, &n) != 1)
+          return sox_false;
+        text += n;
+      }
+      if (*text && *text++ != ',')
+        return sox_false;
+      if (!chan1 || !chan2) {   /* A silent channel */
+        if (chan1 || chan2 || in || *text)
+          return sox_false;
+        break;
+      }
+      if (chan2 < chan1) {unsigned t = chan1; chan1 = chan2; chan2 = t;}
+      cols = max(cols, chan2);
+      for (; chan1 <= chan2; ++chan1, ++in)
+        if (pass)
+          mix->m[j * cols + chan1 - 1] += 1;
+    }
+    if (pass && in && !manual)
+      for (i = 0; i < cols; ++i)
+        mix->m[j * cols + i] /= power? sqrt((double)in) : in;
+    if (!pass && j == (unsigned)argc - 1)
+      mix_init(mix, (unsigned)argc, cols);
+  }
+  return sox_true;
+}
+
+/* Make the remix of a matrix in place of effect i */
+static void set_mix(size_t i, mix_t const * mix)
+{
+  effargs_t * e = &user_effargs[current_eff_chain][i];
+  unsigned r, c;
+  int k;
+
+  for (k = 0; k < e->argc; ++k)
+    free(e->argv[k]);
+  free(e->name);
+  e->name = lsx_strdup("remix");
+  if (e->argv_size < mix->rows + 1) {
+    e->argv_size = (mix->rows + EFFARGS_STEP) / EFFARGS_STEP * EFFARGS_STEP;
+    lsx_revalloc(e->argv, e->argv_size);
+  }
+  e->argv[0] = lsx_strdup("-m");
+  for (r = 0; r < mix->rows; ++r) {
+    char * arg = lsx_malloc(mix->cols * 32 + 2), * a = arg;
+    for (c = 0; c < mix->cols; ++c)
+      if (mix->m[r * mix->cols + c] != 0)
+        a += sprintf(a, "%s%uv%.15g", a == arg? "" : ",", c + 1,
+            mix->m[r * mix->cols + c]);
+    if (a == arg)
+      strcpy(a, "0");
+    e->argv[r + 1] = arg;
+  }
+  e->argc = mix->rows + 1;
+}
+
+static void plan_user_effects(void)
+{
+  effargs_t * e = user_effargs[current_eff_chain];
+  size_t i, j;
+
+  if (no_plan)
+    return;
+
+  /* Move reductions in channels or rate as early as they can go */
+  for (i = 1; i < nuser_effects[current_eff_chain]; ++i) {
+    unsigned channels, out_channels = plan_channels(&e[i]);
+    double rate, out_rate = plan_rate(&e[i]), gain;
+    effargs_t moved = e[i];
+
+    plan_signal(i, &channels, &rate);
+    if (out_channels && (out_channels == 1 || out_channels < channels))
+      for (j = i; j && is_linear(&e[j - 1]); --j);
+    else if (out_rate && out_rate < rate)
+      for (j = i; j && plain_gain(&e[j - 1], &gain); --j);
+    else continue;
+    if (j == i)
+      continue;
+    lsx_report("moving `%s' ahead of `%s'", moved.name, e[j].name);
+    memmove(&e[j + 1], &e[j], (i - j) * sizeof(*e));
+    e[j] = moved;
+  }
+
+  /* Merge runs of volume changes */
+  for (i = 0; i < nuser_effects[current_eff_chain]; ++i) {
+    double gain, g;
+    char arg[32];
+
+    if (!plain_gain(&e[i], &gain))
+      continue;
+    for (j = i + 1; j < nuser_effects[current_eff_chain] &&
+        plain_gain(&e[j], &g); ++j)
+      gain *= g;
+    if (j == i + 1)
+      continue;
+    lsx_report("merging %" PRIuPTR " volume changes", j - i);
+    while (--j > i)
+      remove_effargs(j);
+    sprintf(arg, "%.15g", gain);
+    for (j = 0; j < (size_t)e[i].argc; ++j)
+      free(e[i].argv[j]);
+    free(e[i].name);
+    e[i].name = lsx_strdup("vol");
+    if (!e[i].argv_size)
+      lsx_revalloc(e[i].argv, e[i].argv_size = EFFARGS_STEP);
+    e[i].argv[0] = lsx_strdup(arg);
+    e[i].argc = 1;
+  }
+
+  /* Drop effects that would do nothing */
+  for (i = 0; i < nuser_effects[current_eff_chain]; ) {
+    unsigned channels;
+    double rate, gain;
+
+    plan_signal(i, &channels, &rate);
+    if ((plain_gain(&e[i], &gain) && gain == 1) ||
+        (channels && plan_channels(&e[i]) == channels &&
+         !strcmp(e[i].name, "channels")) ||
+        (rate && plan_rate(&e[i]) == rate)) {
+      lsx_report("dropping `%s', which would do nothing", e[i].name);
+      remove_effargs(i);
+    }
+    else ++i;
+  }
+
+  /* Do a remix and the remix or channels after it as one mix */
+  for (i = 0; i + 1 < nuser_effects[current_eff_chain]; ) {
+    mix_t first, second, both;
+    unsigned r, c, k;
+
+    if (!plan_mix(&e[i], 0, &first)) {
+      ++i;
+      continue;
+    }
+    second.m = NULL;
+    if (!plan_mix(&e[i + 1], first.rows, &second) ||
+        second.cols > first.rows) { /* Leave remix to say what's wrong */
+      free(second.m);
+      free(first.m);
+      ++i;
+      continue;
+    }
+    mix_init(&both, second.rows, first.cols);
+    for (r = 0; r < both.rows; ++r)
+      for (k = 0; k < second.cols; ++k)
+        for (c = 0; c < both.cols; ++c)
+          both.m[r * both.cols + c] +=
+            second.m[r * second.cols + k] * first.m[k * first.cols + c];
+    lsx_report("merging `%s' into `remix'", e[i + 1].name);
+    remove_effargs(i + 1);
+    set_mix(i, &both);
+    free(first.m);
+    free(second.m);
+    free(both.m);
+  }
+}
+
 /* Add all user effects to the chain.  If the output effect's rate or
  * channel count do not match the end of the effects chain then
  * insert effects to correct this.
@@ -1078,6 +1460,192 @@ static void create_user_effects(void)
  * chain from a previous run.  Also, it use a pre-existing
  * output effect if its been saved into save_output_eff.
  */
+/* A gain effect that normalises or balances normally stores all of its
+ * input to apply the gain it finds.  When the input is a regular file and
+ * the effects before the gain are simply made again from their arguments,
+ * it can instead have the input read again, if that costs less.  In bytes
+ * of I/O per sample: reading again costs the size in the file, plus 16 if
+ * it has to be decoded, plus 4 for each effect run again; storing costs 8
+ * to write and read it back unless it fits in memory. */
+static size_t choose_replay(sox_effects_chain_t const * chain)
+{
+  sox_format_t const * ft = files[0]->ft;
+  size_t n = nuser_effects[current_eff_chain], i;
+  double cost;
+
+  if (input_count != 1 || eff_chain_count != 1 || !ft->seekable ||
+      ft->signal.length == SOX_UNKNOWN_LEN ||
+      chain->global_info.plot != sox_plot_off)
+    return SOX_SIZE_MAX;
+  if (is_guarded)  /* Only --norm's gain, if nothing comes before it */
+    i = do_guarded_norm && n == 0 ? 0 : SOX_SIZE_MAX;
+  else for (i = 0; i < n; ++i) {
+    char const * name = user_efftab[i]->handler.name;
+    if (!strcmp(name, "gain") || !strcmp(name, "norm"))
+      break;
+    if (user_efftab[i]->handler.flags & SOX_EFF_ONCE)
+      return SOX_SIZE_MAX;
+  }
+  if (i >= n + is_guarded ||
+      ft->signal.length * sizeof(sox_sample_t) <= sox_globals.tmp_memory)
+    return SOX_SIZE_MAX;
+
+  cost = ft->encoding.bits_per_sample / 8. + 4. * i;
+  switch (ft->encoding.encoding) {
+    case SOX_ENCODING_SIGN2: case SOX_ENCODING_UNSIGNED:
+    case SOX_ENCODING_FLOAT: case SOX_ENCODING_ULAW: case SOX_ENCODING_ALAW:
+      break;
+    default: cost += 16;
+  }
+  lsx_debug("re-reading costs %g bytes/sample against 8 to store", cost);
+  return cost < 8 ? i : SOX_SIZE_MAX;
+}
+
+static void optimize_trim(void);
+
+/* Add the counters of the effects in a chain to the profile and reset them,
+ * so that effects used again are not counted twice */
+static void save_profile(sox_effects_chain_t * chain)
+{
+  size_t i, j, f;
+
+  for (i = 0; i < chain->length; ++i) {
+    sox_effect_t * effp = chain->effects[i];
+    sox_effect_stats_t stats;
+    profile_t * p;
+
+    sox_effects_chain_stats(chain, i, &stats);
+    for (f = 0; f < effp->flows; ++f)
+      memset(&effp[f].stats, 0, sizeof(effp[f].stats));
+    for (j = 0; j < profiles_count; ++j)
+      if (profiles[j].position == i &&
+          !strcmp(profiles[j].name, effp->handler.name))
+        break;
+    if (j == profiles_count) {
+      profiles = lsx_realloc(profiles, ++profiles_count * sizeof(*profiles));
+      memset(&profiles[j], 0, sizeof(profiles[j]));
+      profiles[j].name = lsx_strdup(effp->handler.name);
+      profiles[j].position = i;
+    }
+    p = &profiles[j];
+    p->flows = max(p->flows, effp->flows);
+    p->stats.flow_calls += stats.flow_calls;
+    p->stats.drain_calls += stats.drain_calls;
+    p->stats.samples_in += stats.samples_in;
+    p->stats.samples_out += stats.samples_out;
+    p->stats.stalls += stats.stalls;
+    p->stats.flow_time += stats.flow_time;
+    p->stats.flow_cpu_time += stats.flow_cpu_time;
+    p->stats.drain_time += stats.drain_time;
+    p->stats.drain_cpu_time += stats.drain_cpu_time;
+    p->stats.interleave_time += stats.interleave_time;
+  }
+}
+
+static void report_profile(void)
+{
+  size_t i;
+
+  if (profile == profile_json)
+    fprintf(stderr, "{\"effects\": [");
+  else fprintf(stderr, "\n%-2s %-10s %5s %8s %6s %12s %12s %7s %7s %8s %8s %8s %8s\n",
+      "#", "effect", "flows", "calls", "drains", "samples in", "samples out",
+      "avg in", "stalls", "flow s", "cpu s", "drain s", "il s");
+  for (i = 0; i < profiles_count; ++i) {
+    profile_t const * p = &profiles[i];
+    sox_effect_stats_t const * s = &p->stats;
+    double avg = s->flow_calls? (double)s->samples_in / s->flow_calls : 0;
+
+    if (profile == profile_json)
+      fprintf(stderr, "%s\n  {\"position\": %" PRIuPTR ", \"name\": \"%s\", "
+          "\"flows\": %" PRIuPTR ", \"flow_calls\": %" PRIu64 ", "
+          "\"drain_calls\": %" PRIu64 ", \"samples_in\": %" PRIu64 ", "
+          "\"samples_out\": %" PRIu64 ", \"average_block\": %.1f, "
+          "\"stalls\": %" PRIu64 ", \"flow_time\": %.6f, "
+          "\"flow_cpu_time\": %.6f, \"drain_time\": %.6f, "
+          "\"drain_cpu_time\": %.6f, \"interleave_time\": %.6f}",
+          i? "," : "", p->position, p->name, p->flows, s->flow_calls,
+          s->drain_calls, s->samples_in, s->samples_out, avg, s->stalls,
+          s->flow_time, s->flow_cpu_time, s->drain_time, s->drain_cpu_time,
+          s->interleave_time);
+    else fprintf(stderr, "%-2" PRIuPTR " %-10s %5" PRIuPTR " %8" PRIu64
+        " %6" PRIu64 " %12" PRIu64 " %12" PRIu64 " %7.0f %7" PRIu64
+        " %8.3f %8.3f %8.3f %8.3f\n", p->position, p->name, p->flows,
+        s->flow_calls, s->drain_calls, s->samples_in, s->samples_out, avg,
+        s->stalls, s->flow_time, s->flow_cpu_time + s->drain_cpu_time,
+        s->drain_time, s->interleave_time);
+  }
+  if (profile == profile_json)
+    fprintf(stderr, "\n]}\n");
+  for (i = 0; i < profiles_count; ++i)
+    free(profiles[i].name);
+  free(profiles);
+  profiles = NULL;
+  profiles_count = 0;
+}
+
+/* Called when the gain effect chosen above has seen all of its input:
+ * make again the effects before it and open the input again, as formats'
+ * seek()s only expect to be used before reading */
+static int replay_input(void)
+{
+  file_t * f = files[0];
+  sox_format_t * ft;
+  size_t i, n = effects_chain->length - replay_effect;
+  sox_effect_t * * saved = lsx_malloc(n * sizeof(*saved));
+  sox_signalinfo_t signal = combiner_signal;
+  int guard = -1;
+
+  if (profile)
+    save_profile(effects_chain);
+  for (i = n; i--; )
+    saved[i] = sox_pop_effect_last(effects_chain);
+  while (effects_chain->length > 1) {
+    sox_effect_t * effp = effects_chain->effects[effects_chain->length - 1];
+    for (i = 0; i < effp->flows; ++i)
+      effp[i].clips = 0; /* They will be counted again */
+    sox_delete_effect_last(effects_chain);
+  }
+
+  lsx_report("reading `%s' again", f->filename);
+  if (!(ft = sox_open_read(f->filename, &f->signal, &f->encoding, f->filetype))) {
+    for (i = 0; i < n; ++i)
+      sox_push_effect_last(effects_chain, saved[i]);
+    free(saved);
+    return SOX_EOF;
+  }
+  sox_close(f->ft);
+  f->ft = ft;
+  effects_chain->effects[0][0].obeg = effects_chain->effects[0][0].oend = 0;
+  current_input = 0;
+  input_eof = sox_false;
+  read_wide_samples = 0;
+  f->volume_clips = 0;
+
+  sox_globals.ranqd1 = replay_ranqd1[0];
+  create_user_effects(replay_user);
+  for (i = 0; i < replay_user; ++i) {
+    if (add_effect(effects_chain, user_efftab[i], &signal,
+          &ofile->ft->signal, &guard) != SOX_SUCCESS)
+      exit(2); /* Effects chain should have displayed an error message */
+    free(user_efftab[i]);
+  }
+  optimize_trim();
+  sox_globals.ranqd1 = replay_ranqd1[1];
+
+  for (i = 0; i < n; ++i)
+    sox_push_effect_last(effects_chain, saved[i]);
+  free(saved);
+  return SOX_SUCCESS;
+}
+
+/* The input's index, if the next effect will get all of it as it is */
+static sox_index_t const * unaltered_input_index(void)
+{
+  return very_first_effchain && input_index && files[0]->volume == 1 &&
+    !user_skip && read_wide_samples == 0? input_index : NULL;
+}
+
 static void add_effects(sox_effects_chain_t *chain)
 {
   sox_signalinfo_t signal = combiner_signal;
@@ -1093,13 +1661,22 @@ static void add_effects(sox_effects_chain_t *chain)
     sox_add_effect(chain, effp, &signal, &ofile->ft->signal);
     free(effp);
   }
+  replay_ranqd1[0] = sox_globals.ranqd1;
+  replay_user = choose_replay(chain);
+  replay_effect = 0;
 
   /* Add user specified effects; stop before `dither' */
   for (i = 0; i < nuser_effects[current_eff_chain] &&
       strcmp(user_efftab[i]->handler.name, "dither"); i++) {
+    chain->global_info.replay = i == replay_user;
+    chain->global_info.index = chain->length == 1? unaltered_input_index() : NULL;
     if (add_effect(chain, user_efftab[i], &signal, &ofile->ft->signal,
           &guard) != SOX_SUCCESS)
       exit(2); /* Effects chain should have displayed an error message */
+    if (chain->global_info.replay)
+      replay_effect = chain->length - 1;
+    chain->global_info.replay = sox_false;
+    chain->global_info.index = NULL;
     free(user_efftab[i]);
   }
 
@@ -1117,7 +1694,13 @@ static void add_effects(sox_effects_chain_t *chain)
     int no_guard = -1;
     args[0] = do_guarded_norm? "-nh" : guard? "-rh" : "-h";
     args[1] = norm_level;
+    chain->global_info.replay = replay_user == 0 && chain->length == 1;
+    chain->global_info.index = chain->length == 1? unaltered_input_index() : NULL;
     auto_effect(chain, "gain", norm_level ? 2 : 1, args, &signal, &no_guard);
+    if (chain->global_info.replay)
+      replay_effect = chain->length - 1;
+    chain->global_info.replay = sox_false;
+    chain->global_info.index = NULL;
     guard = 1;
   }
 
@@ -1799,11 +2382,537 @@ static void set_combiner_and_output_encoding_parameters(void)
   }
 }
 
+/* Effects whose output at any time depends only on the input from shortly
+ * before or after then, so that --segments can run a copy of the chain on
+ * each stretch of the input, starting and ending it that much outside the
+ * stretch.  If any of them remember their input, how long that must be
+ * depends on their parameters, so it is measured from the impulse response
+ * of a copy of the chain. */
+static struct {
+  char const * name;
+  sox_bool rings;
+} const segmentable[] = {
+  {"allpass"   , sox_true }, {"band"      , sox_true }, {"bandpass"  , sox_true },
+  {"bandreject", sox_true }, {"bass"      , sox_true }, {"biquad"    , sox_true },
+  {"channels"  , sox_false}, {"contrast"  , sox_false}, {"dcshift"   , sox_false},
+  {"deemph"    , sox_true }, {"equalizer" , sox_true }, {"gain"      , sox_false},
+  {"highpass"  , sox_true }, {"hilbert"   , sox_true }, {"loudness"  , sox_true },
+  {"lowpass"   , sox_true }, {"overdrive" , sox_true }, {"remix"     , sox_false},
+  {"reverb"    , sox_true }, {"riaa"      , sox_true }, {"sinc"      , sox_true },
+  {"swap"      , sox_false}, {"treble"    , sox_true }, {"vol"       , sox_false},
+};
+
+/* The effects' response to an impulse at frame `at' */
+typedef struct {
+  uint64_t made, seen;   /* Frames given to the effect and got from it */
+  uint64_t at, limit;
+  sox_sample_t level;    /* The level at which to note `middle' */
+  sox_sample_t peak;
+  uint64_t first, last;  /* The first and last frames that weren't silent */
+  uint64_t middle;       /* The last frame at or above `level' */
+  double rate;
+} ring_t;
+
+#define RING_IMPULSE (1 << 24)             /* Leaving 42dB for gain */
+#define RING_AT      ((uint64_t)1 << 16)   /* After the longest look-ahead */
+#define RING_SECONDS 600                   /* The longest it can ring */
+
+static int ring_drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  ring_t * r = *(ring_t * *)effp->priv;
+  size_t channels = effp->out_signal.channels, i, c;
+  size_t len = min(*osamp / channels, r->limit - r->made);
+
+  for (i = 0; i < len; ++i, ++r->made)
+    for (c = 0; c < channels; ++c)
+      *obuf++ = r->made == r->at? RING_IMPULSE : 0;
+  *osamp = len * channels;
+  return len? SOX_SUCCESS : SOX_EOF;
+}
+
+static sox_effect_handler_t const * ring_input_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "impulse", NULL, NULL, SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+    NULL, NULL, NULL, ring_drain, NULL, NULL, sizeof(ring_t *)
+  };
+  return &handler;
+}
+
+/* Note where the response is, and stop once it has been silent for as long
+ * as it lasted, or for a second */
+static int ring_flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t UNUSED * obuf, size_t * isamp, size_t * osamp)
+{
+  ring_t * r = *(ring_t * *)effp->priv;
+  size_t channels = effp->in_signal.channels, i, c;
+
+  for (i = 0; i < *isamp / channels; ++i, ++r->seen) {
+    sox_sample_t m = 0;
+    for (c = 0; c < channels; ++c, ++ibuf)
+      m = max(m, *ibuf < 0? -(*ibuf + 1) : *ibuf);
+    if (m) {
+      if (!r->last)
+        r->first = r->seen;
+      r->last = r->seen;
+      r->peak = max(r->peak, m);
+      if (m >= r->level)
+        r->middle = r->seen;
+    }
+  }
+  *osamp = 0;
+  return r->seen > r->at && r->seen - max(r->last, r->at) >
+    max(r->rate, max(r->last, r->at) - r->at)? SOX_EOF : SOX_SUCCESS;
+}
+
+static sox_effect_handler_t const * ring_output_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "response", NULL, NULL, SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_PREC,
+    NULL, NULL, ring_flow, NULL, NULL, NULL, sizeof(ring_t *)
+  };
+  return &handler;
+}
+
+typedef struct {
+  sox_format_t * ft;
+  sox_effects_chain_t * chain;
+  uint64_t to_read;      /* Input frames still to read */
+  uint64_t skip, length; /* Output frames to drop, then to keep */
+  sox_sample_t * buf;    /* The frames kept */
+  size_t len, size;      /* in samples */
+  sox_bool error;
+} segment_t;
+
+/* The frames of --segments in progress, as they are passed to the dither
+ * and output effects of the main effects chain */
+static struct {
+  segment_t * s;
+  int n, i;              /* How many are running at once; the one to output */
+  size_t done;           /* Samples of s[i] output */
+  uint64_t pos, total;   /* Frames of the input started and in all */
+  uint64_t piece, warm_up;
+  size_t at_once;
+  sox_effect_t * * pre;  /* The effects of the main chain that they replace */
+  size_t npre;
+  sox_bool error;
+} segs;
+
+/* The index in the effects chain of the dither or of the output, which the
+ * segments' output goes to */
+static size_t segments_end(void)
+{
+  size_t i;
+
+  for (i = 1; i + 1 < effects_chain->length &&
+      strcmp(effects_chain->effects[i][0].handler.name, "dither"); ++i);
+  return i;
+}
+
+/* The input of a segment's effects chain, reading from its own sox_format_t */
+static int segment_drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  segment_t * s = *(segment_t * *)effp->priv;
+  size_t channels = effp->out_signal.channels;
+  size_t len = min(*osamp / channels, s->to_read);
+
+  len = len? sox_read(s->ft, obuf, len * channels) / channels : 0;
+  if (!len && s->ft->sox_errno) {
+    lsx_fail("`%s' %s: %s",
+        s->ft->filename, s->ft->sox_errstr, sox_strerror(s->ft->sox_errno));
+    s->error = sox_true;
+  }
+  s->to_read -= len;
+  *osamp = len * channels;
+  return len? SOX_SUCCESS : SOX_EOF;
+}
+
+static sox_effect_handler_t const * segment_input_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "input", NULL, NULL, SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+    NULL, NULL, NULL, segment_drain, NULL, NULL, sizeof(segment_t *)
+  };
+  return &handler;
+}
+
+/* The output of a segment's effects chain: drop the warm-up and keep the
+ * rest of the stretch */
+static int segment_flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t UNUSED * obuf, size_t * isamp, size_t * osamp)
+{
+  segment_t * s = *(segment_t * *)effp->priv;
+  size_t channels = effp->in_signal.channels, n = *isamp / channels;
+  size_t skip = min(n, s->skip);
+
+  s->skip -= skip;
+  n = min(n - skip, s->length);
+  s->length -= n;
+  n *= channels;
+  if (s->len + n > s->size) {
+    s->size = max(s->len + n, 2 * s->size);
+    lsx_revalloc(s->buf, s->size);
+  }
+  memcpy(s->buf + s->len, ibuf + skip * channels, n * sizeof(*s->buf));
+  s->len += n;
+  *osamp = 0;
+  return s->length? SOX_SUCCESS : SOX_EOF;
+}
+
+static sox_effect_handler_t const * segment_output_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "output", NULL, NULL, SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_PREC,
+    NULL, NULL, segment_flow, NULL, NULL, NULL, sizeof(segment_t *)
+  };
+  return &handler;
+}
+
+static void add_segment_effect(sox_effects_chain_t * chain, sox_effect_t * effp,
+    sox_signalinfo_t * signal)
+{
+  if (sox_add_effect(chain, effp, signal, &ofile->ft->signal) != SOX_SUCCESS)
+    exit(2); /* The effects chain should have displayed an error message */
+  free(effp);
+}
+
+static sox_effect_t * segment_effect(char const * name, int argc, char * * argv)
+{
+  sox_effect_t * effp = sox_create_effect(sox_find_effect(name));
+
+  if (sox_effect_options(effp, argc, argv) == SOX_EOF)
+    exit(1); /* The failing effect should have displayed an error message */
+  return effp;
+}
+
+/* Make a copy of the effects chain as add_effects() made it up to the
+ * dither, between the given input and output */
+static sox_effects_chain_t * segment_chain(sox_effect_t * input,
+    sox_effect_t * output, sox_signalinfo_t signal)
+{
+  sox_effects_chain_t * chain =
+    sox_create_effects_chain(&combiner_encoding, &ofile->ft->encoding);
+  size_t i, n = nuser_effects[current_eff_chain];
+
+  add_segment_effect(chain, input, &signal);
+  for (i = 0; i < n && strcmp(user_effargs[current_eff_chain][i].name, "dither"); ++i)
+    add_segment_effect(chain, segment_effect(user_effargs[current_eff_chain][i].name,
+        user_effargs[current_eff_chain][i].argc,
+        user_effargs[current_eff_chain][i].argv), &signal);
+  if (signal.channels != ofile->ft->signal.channels)
+    add_segment_effect(chain, segment_effect("channels", 0, NULL), &signal);
+  add_segment_effect(chain, output, &signal);
+  return chain;
+}
+
+/* Run a copy of the effects up to the dither on an impulse */
+static void ring(ring_t * r)
+{
+  sox_effects_chain_t * chain;
+  sox_effect_t * input = sox_create_effect(ring_input_fn());
+  sox_effect_t * output = sox_create_effect(ring_output_fn());
+  sox_signalinfo_t signal = combiner_signal;
+  size_t i, f;
+
+  r->made = r->seen = r->first = r->last = r->middle = 0;
+  r->peak = 0;
+  *(ring_t * *)input->priv = r;
+  *(ring_t * *)output->priv = r;
+  signal.length = SOX_UNKNOWN_LEN;
+  chain = segment_chain(input, output, signal);
+  sox_flow_effects(chain, NULL, NULL);
+  for (i = 0; i < chain->length; ++i)  /* An impulse may well clip */
+    for (f = 0; f < chain->effects[i][0].flows; ++f)
+      chain->effects[i][f].clips = 0;
+  sox_delete_effects_chain(chain);
+}
+
+/* The frames that the effects up to the dither need before and after a
+ * stretch for their output there to be as from a single run, to within the
+ * rounding of a double, or SOX_SIZE_MAX if they ring for too long.
+ *
+ * The response is followed until it rounds to silence, and the time that
+ * it took to fall to that from half-way (in decibels) from its peak tells
+ * how much longer it takes to fall below what a double can hold. */
+static size_t ring_time(void)
+{
+  ring_t r;
+  uint64_t last;
+  double tau = 0, time;
+
+  memset(&r, 0, sizeof(r));
+  r.at = RING_AT;
+  r.limit = RING_AT + (uint64_t)(RING_SECONDS * combiner_signal.rate);
+  r.level = SOX_SAMPLE_MAX;
+  r.rate = combiner_signal.rate;
+  ring(&r);
+  if (r.made >= r.limit) /* Still ringing at the end */
+    return SOX_SIZE_MAX;
+  if (!r.last)
+    return 0;
+  last = r.last;
+  if (r.peak > 1) {
+    r.level = (sox_sample_t)sqrt((double)r.peak);
+    r.limit = last + 1;
+    ring(&r);
+    if (last > r.middle)
+      tau = (last - r.middle) / log(2. * r.level);
+  }
+  /* From a level of 1/2 to the level, relative to the impulse, of a
+   * double's least significant bit, with the sum of the rest of it */
+  time = max(r.at - r.first, last - r.at) +
+    tau * (log(.5 / RING_IMPULSE * 9007199254740992.) + log(1 + tau));
+  return time < RING_SECONDS * combiner_signal.rate?
+    (size_t)ceil(time) : SOX_SIZE_MAX;
+}
+
+/* The warm-up needed in frames, or SOX_SIZE_MAX if the effects chain can't
+ * be run in segments */
+static size_t segment_warm_up(void)
+{
+  sox_format_t const * ft = files[0]->ft;
+  char const * reason = NULL;
+  size_t i, j, end = segments_end(), warm_up = 0;
+  sox_bool rings = sox_false;
+
+  if (input_count != 1 || eff_chain_count != 1 || is_player || is_guarded)
+    reason = "there must be one input file, one output file and no --guard";
+  else if (!ft->seekable || !ft->handler.seek ||
+      ft->signal.length == SOX_UNKNOWN_LEN || files[0]->volume != 1)
+    reason = "the input must be seekable, of known length and not rebalanced";
+  else if (combiner_signal.rate != ofile->ft->signal.rate ||
+      effects_chain->global_info.plot != sox_plot_off ||
+      replay_user != SOX_SIZE_MAX || read_wide_samples)
+    reason = "the effects chain is not suitable";
+  for (i = 1; !reason && i < end; ++i) {
+    char const * name = effects_chain->effects[i][0].handler.name;
+    for (j = 0; j < array_length(segmentable) &&
+        strcmp(name, segmentable[j].name); ++j);
+    if (j == array_length(segmentable)) {
+      lsx_warn("--segments: `%s' cannot be run in segments", name);
+      return SOX_SIZE_MAX;
+    }
+    rings |= segmentable[j].rings;
+  }
+  for (i = 0; !reason && i < nuser_effects[current_eff_chain]; ++i) {
+    int k, argc = user_effargs[current_eff_chain][i].argc;
+    char * * argv = user_effargs[current_eff_chain][i].argv;
+    if (!strcmp(user_effargs[current_eff_chain][i].name, "gain"))
+      for (k = 0; k < argc; ++k) /* Those that scan all of the input */
+        if (argv[k][0] == '-' && strpbrk(argv[k] + 1, "nebBr")) {
+          lsx_warn("--segments: `gain %s' cannot be run in segments", argv[k]);
+          return SOX_SIZE_MAX;
+        }
+  }
+  if (reason) {
+    lsx_warn("--segments: %s", reason);
+    return SOX_SIZE_MAX;
+  }
+  if (rings && (warm_up = ring_time()) == SOX_SIZE_MAX)
+    lsx_warn("--segments: the effects ring for too long to be run in segments");
+  return warm_up;
+}
+
+/* How long a stretch each segment is and how many to run at once, keeping
+ * the output that they hold within --temp-memory.  False if that leaves
+ * too little to be worth it. */
+static sox_bool plan_segments(size_t warm_up)
+{
+  size_t frame = effects_chain->effects[segments_end()][0].in_signal.channels *
+    sizeof(sox_sample_t);
+  uint64_t piece;
+
+  segs.total = files[0]->ft->signal.length / combiner_signal.channels;
+  segs.warm_up = warm_up;
+  piece = max(30 * combiner_signal.rate, 20. * warm_up);
+  piece = max(1, min(piece, (segs.total + segments - 1) / segments));
+  if (piece * segments * frame > sox_globals.tmp_memory)
+    piece = max(sox_globals.tmp_memory / segments / frame, 4 * (uint64_t)warm_up);
+  segs.piece = max(piece, 1);
+  segs.at_once = min(segments, sox_globals.tmp_memory / (segs.piece * frame));
+  if (segs.at_once < 2) {
+    lsx_warn("--segments: %g seconds' warm-up needs more than the --temp-memory",
+        warm_up / combiner_signal.rate);
+    return sox_false;
+  }
+  return sox_true;
+}
+
+/* Make a copy of the effects chain up to the dither, reading the input
+ * from frame `start' to frame `end' (or to its end if that is 0) */
+static void open_segment(segment_t * s, uint64_t start, uint64_t end)
+{
+  file_t * f = files[0];
+  sox_signalinfo_t signal = combiner_signal;
+  sox_effect_t * input = sox_create_effect(segment_input_fn());
+  sox_effect_t * output = sox_create_effect(segment_output_fn());
+
+  memset(s, 0, sizeof(*s));
+  if (!(s->ft = sox_open_read(f->filename, &f->signal, &f->encoding, f->filetype)))
+    exit(2);
+  s->to_read = end? end - start : UINT64_MAX;
+  if (start && sox_seek(s->ft, start * signal.channels, SOX_SEEK_SET) != SOX_SUCCESS) {
+    lsx_warn("`%s': cannot seek to %s", f->filename,
+        str_time(start / signal.rate));
+    s->to_read = 0;
+  }
+  signal.length = end? (end - start) * signal.channels : SOX_UNKNOWN_LEN;
+  *(segment_t * *)input->priv = s;
+  *(segment_t * *)output->priv = s;
+  s->chain = segment_chain(input, output, signal);
+}
+
+/* Count a segment's clipping against the effects of the main chain */
+static void close_segment(segment_t * s)
+{
+  size_t i, f;
+
+  if (s->chain->length == segs.npre + 2)
+    for (i = 1; i + 1 < s->chain->length; ++i)
+      for (f = 0; f < s->chain->effects[i][0].flows; ++f) {
+        segs.pre[i - 1][f].clips += s->chain->effects[i][f].clips;
+        s->chain->effects[i][f].clips = 0;
+      }
+  if (profile)
+    save_profile(s->chain);
+  sox_delete_effects_chain(s->chain);
+  sox_close(s->ft);
+  free(s->buf);
+  s->buf = NULL;
+}
+
+/* Run a copy of the effects chain on each of the next stretches of the
+ * input at once.  Each copy starts and ends `warm_up' frames outside its
+ * stretch, so its output there matches that of a single chain. */
+static void run_segments(void)
+{
+  int i;
+
+  for (segs.n = 0; segs.n < (int)segs.at_once && segs.pos < segs.total;
+      ++segs.n, segs.pos += segs.piece) {
+    segment_t * s = &segs.s[segs.n];
+    uint64_t start = segs.pos > segs.warm_up? segs.pos - segs.warm_up : 0;
+    uint64_t end = segs.pos + segs.piece;
+    open_segment(s, start, end + segs.warm_up < segs.total? end + segs.warm_up : 0);
+    s->skip = segs.pos - start;
+    s->length = end < segs.total? segs.piece : UINT64_MAX;
+  }
+
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if(sox_globals.use_threads) schedule(static)
+#endif
+  for (i = 0; i < segs.n; ++i)
+    sox_flow_effects(segs.s[i].chain, NULL, NULL);
+
+  for (i = 0; i < segs.n; ++i)
+    segs.error |= segs.s[i].error;
+  segs.i = 0;
+  segs.done = 0;
+  read_wide_samples = min(segs.pos, segs.total);
+}
+
+/* The first effect of the main chain while it runs on the segments' output */
+static int segments_drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  size_t channels = effp->out_signal.channels, len;
+  segment_t * s;
+
+  while (segs.i == segs.n || segs.done == segs.s[segs.i].len) {
+    if (segs.i < segs.n) {
+      close_segment(&segs.s[segs.i++]);
+      segs.done = 0;
+    } else if (segs.error || user_abort || segs.pos >= segs.total) {
+      *osamp = 0;
+      return SOX_EOF;
+    } else run_segments();
+  }
+  s = &segs.s[segs.i];
+  len = min(*osamp / channels * channels, s->len - segs.done);
+  memcpy(obuf, s->buf + segs.done, len * sizeof(*obuf));
+  segs.done += len;
+  *osamp = len;
+  return SOX_SUCCESS;
+}
+
+static sox_effect_handler_t const * segments_input_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "segments", NULL, NULL, SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+    NULL, NULL, NULL, segments_drain, NULL, NULL, 0
+  };
+  return &handler;
+}
+
+/* Run the input in segments and the main effects chain from its dither (if
+ * any) onwards on their output in turn, so that the dither and any effects
+ * after it are as from a single run */
+static int process_segments(void)
+{
+  size_t end = segments_end(), n = effects_chain->length - end, i;
+  sox_effect_t * input, * * tail = lsx_calloc(n, sizeof(*tail)), * effp;
+  sox_signalinfo_t signal = effects_chain->effects[end][0].in_signal;
+  int flow_status;
+
+  lsx_report("processing %lu segments of %g seconds at once after %g seconds' warm-up",
+      (unsigned long)segs.at_once, segs.piece / combiner_signal.rate,
+      segs.warm_up / combiner_signal.rate);
+  if (new_input_index) { /* Nothing reads it all from the start */
+    sox_index_close(new_input_index);
+    new_input_index = NULL;
+  }
+
+  /* Take the effects before the dither out of the main chain, putting
+   * one that gives the segments' output in their place */
+  for (i = n; i > 0; --i)
+    tail[i - 1] = sox_pop_effect_last(effects_chain);
+  segs.npre = end - 1;
+  segs.pre = lsx_calloc(segs.npre, sizeof(*segs.pre));
+  for (i = segs.npre; i > 0; --i)
+    segs.pre[i - 1] = sox_pop_effect_last(effects_chain);
+  input = sox_pop_effect_last(effects_chain);
+  effp = sox_create_effect(segments_input_fn());
+  signal.length = SOX_UNKNOWN_LEN;
+  sox_add_effect(effects_chain, effp, &signal, &signal);
+  free(effp);
+  for (i = 0; i < n; ++i)
+    sox_push_effect_last(effects_chain, tail[i]);
+
+  segs.s = lsx_calloc(segs.at_once, sizeof(*segs.s));
+  segs.pos = 0;
+  segs.n = segs.i = 0;
+  flow_status = sox_flow_effects(effects_chain, update_status, NULL);
+  while (segs.i < segs.n)
+    close_segment(&segs.s[segs.i++]);
+  free(segs.s);
+  if (segs.error)
+    flow_status = SOX_EOF;
+  if (profile)
+    save_profile(effects_chain);
+
+  /* Put the main chain back as it was */
+  for (i = n; i > 0; --i)
+    tail[i - 1] = sox_pop_effect_last(effects_chain);
+  sox_delete_effect_last(effects_chain);
+  sox_push_effect_last(effects_chain, input);
+  for (i = 0; i < segs.npre; ++i)
+    sox_push_effect_last(effects_chain, segs.pre[i]);
+  for (i = 0; i < n; ++i)
+    sox_push_effect_last(effects_chain, tail[i]);
+  free(segs.pre);
+  free(tail);
+
+  input_eof = sox_true;
+  current_input = input_count;
+  return flow_status;
+}
+
 static int process(void)
 {         /* Input(s) -> Balancing -> Combiner -> Effects -> Output */
   int flow_status;
+  size_t warm_up;
 
-  create_user_effects();
+  plan_user_effects();
+  create_user_effects(nuser_effects[current_eff_chain]);
 
   calculate_combiner_signal_parameters();
   set_combiner_and_output_encoding_parameters();
@@ -1875,7 +2984,18 @@ static int process(void)
     d = now.tv_sec - load_timeofday.tv_sec + (now.tv_usec - load_timeofday.tv_usec) / TIME_FRAC;
     lsx_debug("start-up time = %g", d);
   }
-  flow_status = sox_flow_effects(effects_chain, update_status, NULL);
+  replay_ranqd1[1] = sox_globals.ranqd1;
+  if (segments > 1 && very_first_effchain &&
+      (warm_up = segment_warm_up()) != SOX_SIZE_MAX && plan_segments(warm_up))
+    flow_status = process_segments();
+  else {
+    flow_status = sox_flow_effects(effects_chain, update_status, NULL);
+    if (flow_status == SOX_REPLAY)
+      flow_status = replay_input() == SOX_SUCCESS ?
+        sox_flow_effects(effects_chain, update_status, NULL) : SOX_EOF;
+    if (profile)
+      save_profile(effects_chain);
+  }
 
   /* Don't return SOX_EOF if
    * 1) input reach EOF and there are more input files to process or
@@ -2000,6 +3120,9 @@ static void usage(void)
 "GLOBAL OPTIONS (gopts) (can be specified at any point before the first effect):",
 "--buffer BYTES           Set the size of all processing buffers (default 8192)",
 "--clobber                Don't prompt to overwrite output file (default)",
+#ifdef HAVE_SERVE
+"--client SOCKET ...      As the first option, have a --serve process run this",
+#endif
 "--combine concatenate    Concatenate all input files (default for sox, rec)",
 "--combine sequence       Sequence all input files (default for play)",
 "-D, --no-dither          Don't dither automatically",
@@ -2010,8 +3133,10 @@ static void usage(void)
 "--help-effect NAME       Show usage of effect NAME, or NAME=all for all",
 "--help-format NAME       Show info on format NAME, or NAME=all for all",
 "--i, --info              Behave as soxi(1)",
+"--index DIRECTORY        Keep measurements of input files to use again",
 "--input-buffer BYTES     Override the input buffer size (default: as --buffer)",
 "--no-clobber             Prompt to overwrite output file",
+"--no-plan                Run the effects exactly as given, without reordering",
 "-m, --combine mix        Mix multiple input files (instead of concatenating)",
 "--combine mix-power      Mix to equal power (instead of concatenating)",
 "-M, --combine merge      Merge multiple input files (instead of concatenating)"
@@ -2026,12 +3151,18 @@ static void usage(void)
 "--norm                   Guard (see --guard) & normalise",
 "--play-rate-arg ARG      Default `rate' argument for auto-resample with `play'",
 "--plot gnuplot|octave    Generate script to plot response of filter effect",
+"--profile[=json]         Report the time and samples of each effect at exit",
 "-q, --no-show-progress   Run in quiet mode; opposite of -S",
 "--replay-gain track|album|off  Default: off (sox, rec), track (play)",
 "-R                       Use default random numbers (same on each run of SoX)",
 "-S, --show-progress      Display progress while processing audio data",
+"--segments NUM           Process NUM stretches of a single input at once",
+#ifdef HAVE_SERVE
+"--serve SOCKET [JOBS]    As the first option, run commands sent by --client",
+#endif
 "--single-threaded        Disable parallel effects channels processing",
 "--temp DIRECTORY         Specify the directory to use for temporary files",
+"--temp-memory MEGABYTES  Memory an effect may use before using temporary files",
 "-T, --combine multiply   Multiply samples of corresponding channels from all",
 "                         input files (instead of concatenating)",
 "--version                Display version number of SoX and exit",
@@ -2268,6 +3399,11 @@ static struct lsx_option_t const long_options[] = {
   {"no-clobber"      , lsx_option_arg_none    , NULL, 0},
   {"multi-threaded"  , lsx_option_arg_none    , NULL, 0},
   {"dft-min"         , lsx_option_arg_required, NULL, 0}, /* 25 */
+  {"temp-memory"     , lsx_option_arg_required, NULL, 0},
+  {"index"           , lsx_option_arg_required, NULL, 0},
+  {"segments"        , lsx_option_arg_required, NULL, 0},
+  {"profile"         , lsx_option_arg_optional, NULL, 0},
+  {"no-plan"         , lsx_option_arg_none    , NULL, 0}, /* 30 */
 
   /*
    * These instead are index by their letters, which limits the
@@ -2475,6 +3611,35 @@ static char parse_gopts_and_fopts(file_t * f)
         }
         sox_globals.log2_dft_min_size = i;
         break;
+
+      case 26:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 0 || i > 1 << 20) {
+          lsx_fail("temporary memory must be in range 0 to 1048576 megabytes");
+          exit(1);
+        }
+        sox_globals.tmp_memory = min((uint64_t)i << 20, (uint64_t)SOX_SIZE_MAX);
+        break;
+
+      case 27:
+        free(sox_globals.index_path);
+        sox_globals.index_path = lsx_strdup(optstate.arg);
+        break;
+
+      case 28:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 1 || i > 1024) {
+          lsx_fail("segments must be in range 1 to 1024");
+          exit(1);
+        }
+        segments = i;
+        break;
+
+      case 29:
+        profile = optstate.arg?
+          enum_option(optstate.arg, optstate.lngind, profile_modes) : profile_text;
+        sox_globals.profile = sox_true;
+        break;
+
+      case 30: no_plan = sox_true; break;
       }
       break;
 
@@ -2738,7 +3903,7 @@ static void parse_options_and_filenames(int argc, char **argv)
     strcpy(str, argv[0]);
     strcat(str, " ");
     strcat(str, env_opts);
-    argv2 = strtoargv(str, &argc2);
+    argv2 = lsx_strtoargv(str, &argc2);
     lsx_getopt_init(argc2, argv2, getoptstr, long_options, lsx_getopt_flag_opterr, 1, &optstate);
     if (parse_gopts_and_fopts(&opts)) {
       lsx_fail("invalid option for "SOX_OPTS);
@@ -2786,7 +3951,31 @@ static double soxi_total;
 static size_t soxi_file_count;
 
 typedef enum {Full, Type, Rate, Channels, Samples, Duration, Duration_secs,
-    Bits, Bitrate, Precision, Encoding, Annotation} soxi_t;
+    Bits, Bitrate, Precision, Encoding, Annotation, Levels} soxi_t;
+
+/* Show the peak and RMS levels from the file's index, making it if need be */
+static void soxi_levels(sox_format_t * ft)
+{
+  sox_index_t * index = sox_index_load(ft);
+  sox_index_block_t total;
+  double peak;
+
+  if (!index) {
+    sox_sample_t buf[8192];
+    size_t len;
+
+    index = sox_index_create(ft);
+    while ((len = sox_read(ft, buf, array_length(buf))))
+      sox_index_add(index, buf, len);
+    if (!ft->sox_errno)
+      sox_index_save(index);
+  }
+  sox_index_total(index, index->channels, &total);
+  peak = max(SOX_SAMPLE_TO_FLOAT_64BIT(total.max,), -SOX_SAMPLE_TO_FLOAT_64BIT(total.min,));
+  printf("%.2f %.2f\n", linear_to_dB(peak), index->length ?
+      10 * log10(total.sum2 / (index->length * index->channels)) : -HUGE_VAL);
+  sox_index_close(index);
+}
 
 static int soxi1(soxi_t const * type, char const * filename)
 {
@@ -2820,6 +4009,7 @@ static int soxi1(soxi_t const * type, char const * filename)
       do printf("%s\n", *p); while (*++p);
     }
     break;
+    case Levels: soxi_levels(ft); break;
     case Full: display_file_info(ft, NULL, sox_false); break;
   }
   return !!sox_close(ft);
@@ -2830,10 +4020,11 @@ static void soxi_usage(int return_code)
   display_SoX_version(stdout);
   printf(
     "\n"
-    "Usage: soxi_ng [-V[level]] [-T] [-t|-r|-c|-s|-d|-D|-b|-B|-p|-e|-a] infile1 ...\n"
+    "Usage: soxi_ng [-V[level]] [-T] [-i dir] [-t|-r|-c|-s|-d|-D|-b|-B|-p|-e|-a|-l] infile1 ...\n"
     "\n"
     "-V[n]\tIncrement or set verbosity level (default is 2)\n"
     "-T\tWith -s, -d or -D, display the total across all given files\n"
+    "-i\tKeep measurements of the files in the given directory to use again\n"
     "\n"
     "-t\tShow detected file-type\n"
     "-r\tShow sample-rate\n"
@@ -2847,6 +4038,7 @@ static void soxi_usage(int return_code)
     "-p\tShow estimated sample precision in bits\n"
     "-e\tShow the name of the audio encoding\n"
     "-a\tShow file comments (annotations) if available\n"
+    "-l\tShow the peak and RMS levels in dB\n"
     "\n"
     "With no options, as much information as is available is shown for\n"
     "each given file.\n"
@@ -2856,7 +4048,7 @@ static void soxi_usage(int return_code)
 
 static int soxi(int argc, char * const * argv)
 {
-  static char const opts[] = "trcsdDbBpea?TV::";
+  static char const opts[] = "trcsdDbBpeal?TV::i:";
   soxi_t type = Full;
   int opt, num_errors = 0;
   sox_bool do_total = sox_false;
@@ -2881,7 +4073,11 @@ static int soxi(int argc, char * const * argv)
     }
     else if (opt == 'T')
       do_total = sox_true;
-    else if ((type = 1 + (strchr(opts, opt) - opts)) > Annotation)
+    else if (opt == 'i') {
+      free(sox_globals.index_path);
+      sox_globals.index_path = lsx_strdup(optstate.arg);
+    }
+    else if ((type = 1 + (strchr(opts, opt) - opts)) > Levels)
       soxi_usage(1);
 
   if (type == Full)
@@ -2947,6 +4143,401 @@ static sox_bool cmp_comment_text(char const * c1, char const * c2)
   return c1 && c2 && !strcasecmp(c1, c2);
 }
 
+#ifdef HAVE_SERVE
+
+/* sox_ng --serve runs jobs sent by sox_ng --client over a Unix socket.
+ * Each job is run by a process forked from the server once it has
+ * initialised libSoX, so the job starts with that already done.
+ *
+ * The client sends a header of the payload's length and the number of
+ * arguments, with its stdin, stdout and stderr attached, then the payload:
+ * its working directory, the arguments and its environment, each
+ * NUL-terminated.  The server replies with the job's exit status.
+ * Meanwhile, the client sends the number of any signal that would stop it
+ * and the server sends that to the job; if the client goes away, the job
+ * is sent SIGTERM.
+ *
+ * A job runs with the server's rights, so the socket is made accessible
+ * only to its owner and each end checks that the other is the same user. */
+
+extern char * * environ;
+
+static sox_bool write_all(int fd, void const * buf, size_t len)
+{
+  char const * p = buf;
+
+  while (len) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return sox_false;
+    p += n, len -= n;
+  }
+  return sox_true;
+}
+
+static sox_bool read_all(int fd, void * buf, size_t len)
+{
+  char * p = buf;
+
+  while (len) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return sox_false;
+    p += n, len -= n;
+  }
+  return sox_true;
+}
+
+/* Whether the process at the other end of a socket is our user's */
+static sox_bool same_user(int fd)
+{
+#if defined SO_PEERCRED && defined __linux__
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+
+  return !getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) &&
+    cred.uid == getuid();
+#elif defined HAVE_GETPEEREID
+  uid_t uid;
+  gid_t gid;
+
+  return !getpeereid(fd, &uid, &gid) && uid == getuid();
+#else
+  (void)fd;
+  return sox_false; /* Can't tell, so don't trust it */
+#endif
+}
+
+static int unix_socket(char const * path, struct sockaddr_un * addr)
+{
+  int fd;
+
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    lsx_fail("socket name `%s' is too long", path);
+    exit(1);
+  }
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  strcpy(addr->sun_path, path);
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    lsx_fail("can't create a socket: %s", strerror(errno));
+    exit(1);
+  }
+  return fd;
+}
+
+static int client_fd = -1;
+
+/* Pass a signal on to the job instead of stopping the client */
+static void client_signal(int sig)
+{
+  int32_t s = sig;
+
+  if (write(client_fd, &s, sizeof(s)) < 0) {
+    /* Nothing to do; the job's status will tell */
+  }
+}
+
+/* Run argv[3]... on the server at argv[2].  Returns only if there is no
+ * server there, in which case the caller runs the job itself. */
+static void client(int argc, char * * argv)
+{
+  struct sockaddr_un addr;
+  int fd = unix_socket(argv[2], &addr), fds[3] = {0, 1, 2}, i;
+  char cwd[4096], * * env;
+  char * payload, * p;
+  uint32_t header[2];
+  int32_t status;
+  size_t len;
+  struct iovec iov;
+  struct msghdr msg;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } control;
+  struct cmsghdr * cmsg;
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    lsx_report("can't connect to `%s' (%s); running the job here",
+        argv[2], strerror(errno));
+    close(fd);
+    return;
+  }
+  if (!same_user(fd)) {
+    lsx_warn("the server on `%s' isn't run by this user; running the job here",
+        argv[2]);
+    close(fd);
+    return;
+  }
+  if (!getcwd(cwd, sizeof(cwd))) {
+    lsx_fail("can't get the working directory: %s", strerror(errno));
+    exit(1);
+  }
+
+  len = strlen(cwd) + 1 + strlen(argv[0]) + 1;
+  for (i = 3; i < argc; ++i)
+    len += strlen(argv[i]) + 1;
+  for (env = environ; *env; ++env)
+    len += strlen(*env) + 1;
+  p = payload = lsx_malloc(len);
+  p += sprintf(p, "%s", cwd) + 1;
+  p += sprintf(p, "%s", argv[0]) + 1;
+  for (i = 3; i < argc; ++i)
+    p += sprintf(p, "%s", argv[i]) + 1;
+  for (env = environ; *env; ++env)
+    p += sprintf(p, "%s", *env) + 1;
+  header[0] = (uint32_t)len;
+  header[1] = (uint32_t)(argc - 2);
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = header;
+  iov.iov_len = sizeof(header);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  client_fd = fd;
+  setsig(SIGINT, client_signal);
+  setsig(SIGTERM, client_signal);
+  setsig(SIGHUP, client_signal);
+  if (sendmsg(fd, &msg, 0) != sizeof(header) || !write_all(fd, payload, len) ||
+      !read_all(fd, &status, sizeof(status))) {
+    lsx_fail("lost the connection to `%s'", argv[2]);
+    exit(1);
+  }
+  exit((int)status);
+}
+
+/* Receive a job and set up this process to run it */
+static sox_bool receive_job(int fd, int * argc, char * * * argv)
+{
+  uint32_t header[2];
+  int fds[3], i, n;
+  char * payload, * p, * end, * * args, * * env;
+  struct iovec iov;
+  struct msghdr msg;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } control;
+  struct cmsghdr * cmsg;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = header;
+  iov.iov_len = sizeof(header);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  if (recvmsg(fd, &msg, 0) != sizeof(header) ||
+      !(cmsg = CMSG_FIRSTHDR(&msg)) || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(fds)) || header[1] < 1)
+    return sox_false;
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+  payload = lsx_malloc((size_t)header[0] + 1);
+  if (!read_all(fd, payload, header[0]))
+    return sox_false;
+  payload[header[0]] = '\0';
+  end = payload + header[0];
+
+  args = lsx_calloc((size_t)header[1] + 1, sizeof(*args));
+  for (p = payload + strlen(payload) + 1, i = 0; i < (int)header[1]; ++i) {
+    if (p >= end)
+      return sox_false;
+    args[i] = p;
+    p += strlen(p) + 1;
+  }
+  for (n = 0, end = p; end < payload + header[0]; end += strlen(end) + 1)
+    ++n;
+  env = lsx_calloc((size_t)n + 1, sizeof(*env));
+  for (i = 0; i < n; p += strlen(p) + 1)
+    env[i++] = p;
+
+  if (chdir(payload) < 0)
+    return sox_false;
+  for (i = 0; i < 3; ++i) {
+    dup2(fds[i], i);
+    if (fds[i] > 2)
+      close(fds[i]);
+  }
+  environ = env;
+  *argc = (int)header[1];
+  *argv = args;
+  return sox_true;
+}
+
+static int job_pipe[2];
+
+static void job_ended(int sig)
+{
+  char c = (char)sig;
+
+  if (write(job_pipe[1], &c, 1) < 0) {
+    /* The pipe is full, so the supervisor will look anyway */
+  }
+}
+
+/* Wait for a job to end, passing on the client's signals to it, and
+ * return an exit status for it, like a shell's if it was killed. */
+static int32_t supervise(pid_t pid, int conn)
+{
+  sox_bool connected = sox_true;
+  int wstatus;
+
+  while (waitpid(pid, &wstatus, WNOHANG) == 0) {
+    fd_set fds;
+    char c;
+
+    FD_ZERO(&fds);
+    FD_SET(job_pipe[0], &fds);
+    if (connected)
+      FD_SET(conn, &fds);
+    if (select(max(conn, job_pipe[0]) + 1, &fds, NULL, NULL, NULL) < 0)
+      continue;
+    if (FD_ISSET(job_pipe[0], &fds) && read(job_pipe[0], &c, 1) < 0)
+      continue;
+    if (connected && FD_ISSET(conn, &fds)) {
+      int32_t sig;
+      if (read_all(conn, &sig, sizeof(sig)))
+        kill(pid, sig == SIGINT || sig == SIGHUP? sig : SIGTERM);
+      else {  /* The client has gone, so stop its job */
+        connected = sox_false;
+        kill(pid, SIGTERM);
+      }
+    }
+  }
+  return WIFEXITED(wstatus)? WEXITSTATUS(wstatus) :
+         WIFSIGNALED(wstatus)? 128 + WTERMSIG(wstatus) : 1;
+}
+
+/* Lock `path'.lock for as long as this server runs, then bind to path,
+ * replacing a socket left behind by a server that was killed but not one
+ * that a server is still listening on. */
+static void listen_on(int fd, struct sockaddr_un * addr, char const * path)
+{
+  char * lockname = lsx_malloc(strlen(path) + sizeof(".lock"));
+  struct flock lock;
+  struct stat st;
+  int lockfd, bound;
+  mode_t mask = umask(0177);  /* Only its owner can connect */
+
+  sprintf(lockname, "%s.lock", path);
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  if ((lockfd = open(lockname, O_RDWR | O_CREAT, 0600)) < 0) {
+    lsx_fail("can't open `%s': %s", lockname, strerror(errno));
+    exit(1);
+  }
+  if (fcntl(lockfd, F_SETLK, &lock) < 0) {
+    lsx_fail("a server is already running on `%s'", path);
+    exit(1);
+  }
+  fcntl(lockfd, F_SETFD, FD_CLOEXEC);
+  free(lockname);
+
+  if ((bound = bind(fd, (struct sockaddr *)addr, sizeof(*addr))) < 0 &&
+      errno == EADDRINUSE && !stat(path, &st) && S_ISSOCK(st.st_mode)) {
+    struct sockaddr_un probe_addr;
+    int probe = unix_socket(path, &probe_addr);
+
+    if (!connect(probe, (struct sockaddr *)&probe_addr, sizeof(probe_addr))) {
+      lsx_fail("a server is already listening on `%s'", path);
+      exit(1);
+    }
+    close(probe);
+    unlink(path);
+    bound = bind(fd, (struct sockaddr *)addr, sizeof(*addr));
+  }
+  if (bound < 0 || listen(fd, 64) < 0) {
+    lsx_fail("can't listen on `%s': %s", path, strerror(errno));
+    exit(1);
+  }
+  umask(mask);
+}
+
+/* Serve jobs on the socket at argv[2], running as many at once as given
+ * by argv[3] or else as there are processors.  Returns only in a process
+ * that is to run a job, with that job's command line. */
+static void serve(int * argc, char * * * argv)
+{
+  struct sockaddr_un addr;
+  int fd = unix_socket((*argv)[2], &addr), conn, running = 0, jobs = 0;
+
+  if (*argc > 3 && (sscanf((*argv)[3], "%d", &jobs) != 1 || jobs < 1)) {
+    lsx_fail("the number of jobs must be a positive integer");
+    exit(1);
+  }
+#ifdef _SC_NPROCESSORS_ONLN
+  if (!jobs)
+    jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  jobs = max(jobs, 1);
+
+  listen_on(fd, &addr, (*argv)[2]);
+  sox_format_init();
+  lsx_report("serving on `%s', %d jobs at once", addr.sun_path, jobs);
+
+  while (sox_true) {
+    pid_t pid;
+
+    for (; running; --running)  /* Wait for a job slot to be free */
+      if (waitpid(-1, NULL, running < jobs? WNOHANG : 0) <= 0)
+        break;
+    if ((conn = accept(fd, NULL, NULL)) < 0) {
+      if (errno != EINTR && errno != ECONNABORTED)
+        lsx_warn("accept: %s", strerror(errno));
+      continue;
+    }
+    if (!same_user(conn)) {
+      lsx_warn("refusing a job from another user");
+      close(conn);
+      continue;
+    }
+    if ((pid = fork()) < 0)
+      lsx_warn("can't start a job: %s", strerror(errno));
+    else if (pid)
+      ++running;
+    else {
+      /* Receive the job and run it in a child of ours, then send its
+       * exit status back. */
+      int32_t status = 1;
+
+      close(fd);
+      setsig(SIGPIPE, SIG_IGN);
+      if (receive_job(conn, argc, argv) && !pipe(job_pipe)) {
+        setsig(SIGCHLD, job_ended);
+        if ((pid = fork()) == 0) {
+          close(conn);
+          close(job_pipe[0]);
+          close(job_pipe[1]);
+          setsig(SIGCHLD, SIG_DFL);
+          setsig(SIGPIPE, SIG_DFL);
+          return;
+        }
+        if (pid > 0)
+          status = supervise(pid, conn);
+      }
+      write_all(conn, &status, sizeof(status));
+      _exit(0);
+    }
+    close(conn);
+  }
+}
+
+#endif /* HAVE_SERVE */
+
 #ifdef _WIN32
 static int sox_main(int argc, char **argv)
 #else
@@ -2958,10 +4549,29 @@ int main(int argc, char **argv)
 
   if (argc < 2) { usage(); exit(1); }
 
-  gettimeofday(&load_timeofday, NULL);
   myname = argv[0];
   sox_globals.output_message_handler = output_message;
 
+#ifdef HAVE_SERVE
+  if (argc > 2 && !strcmp(argv[1], "--client")) {
+    client(argc, argv);
+    argv[2] = argv[0];
+    argc -= 2, argv += 2;
+  }
+#endif
+
+  if (sox_init() != SOX_SUCCESS)
+    exit(1);
+
+#ifdef HAVE_SERVE
+  if (argc > 2 && !strcmp(argv[1], "--serve")) {
+    serve(&argc, &argv);
+    myname = argv[0];
+  }
+#endif
+
+  gettimeofday(&load_timeofday, NULL);
+
   if (0 != sox_basename(mybase, sizeof(mybase), myname))
   {
     if (0 == lsx_strncasecmp(mybase, "play", 4))
@@ -2976,9 +4586,6 @@ int main(int argc, char **argv)
       (!strcmp(argv[1], "--i") || !strcmp(argv[1], "--info")))
     --argc, ++argv, sox_mode = sox_soxi;
 
-  if (sox_init() != SOX_SUCCESS)
-    exit(1);
-
   stdin_is_a_tty = isatty(fileno(stdin));
   errno = 0; /* Both isatty & fileno may set errno. */
 
@@ -3081,6 +4688,10 @@ int main(int argc, char **argv)
   for (i = 0; i < input_count; i++)
     set_replay_gain(files[i]->ft->oob.comments, files[i]);
 
+  if (sox_globals.index_path && input_count == 1 && sox_mode != sox_rec &&
+      !(input_index = sox_index_load(files[0]->ft)) && files[0]->ft->seekable)
+    new_input_index = sox_index_create(files[0]->ft);
+
   setsig(SIGINT, SIG_DFL);
 #ifndef _WIN32
   setsig(SIGPIPE, SIG_IGN);
@@ -3136,6 +4747,8 @@ int main(int argc, char **argv)
 
   sox_delete_effects_chain(effects_chain);
   delete_eff_chains();
+  if (profile)
+    report_profile();
 
   for (i = 0; i < file_count; ++i)
     if (files[i]->ft->clips != 0)
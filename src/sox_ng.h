@@ -485,6 +485,7 @@ libSoX functions may return these codes or others that map from errno codes.
 enum sox_error_t {
   SOX_SUCCESS = 0,     /**< Function succeeded = 0 */
   SOX_EOF = -1,        /**< End Of File or other error = -1 */
+  SOX_REPLAY = 1,      /**< An effect's drain asks for its input again = 1 */
   SOX_EHDR = 2000,     /**< Invalid Audio Header = 2000 */
   SOX_EFMT,            /**< Unsupported data format = 2001 */
   SOX_ENOMEM,          /**< Can't alloc memory = 2002 */
@@ -1040,6 +1041,8 @@ if clipping occurs.
 #define SOX_EFF_MODIFY   256         /**< Client API: Effect does not modify sample values (but might remove or duplicate samples or insert zeros) */
 #define SOX_EFF_ALPHA    512         /* No longer used */
 #define SOX_EFF_INTERNAL 1024        /**< Client API: Effect present in libSoX but not valid for use by SoX command-line tools */
+#define SOX_EFF_FLOAT    2048        /**< Client API: Effect's flow and drain can also exchange unclipped double samples with an adjacent effect that has this flag (libSoX's own effects only) */
+#define SOX_EFF_ONCE     4096        /**< Client API: Effect does more than give output (writes a file, prints a report) so must not be run again on the same input */
 
 /**
 Client API:
@@ -1312,6 +1315,15 @@ typedef struct sox_globals {
   Plugins should use similarly-sized DFTs to get best performance.
   */
   size_t       log2_dft_min_size;
+
+  /**
+  Bytes of temporary data that effects such as reverse may hold in memory
+  before using a temporary file.
+  */
+  size_t       tmp_memory;
+
+  char       * index_path;       /**< Private: client-configured directory in which to cache file indexes */
+  sox_bool     profile;          /**< true to time the effects' flow and drain calls; see sox_effects_chain_stats() */
 } sox_globals_t;
 
 /**
@@ -1465,6 +1477,50 @@ typedef struct sox_oob {
   /* TBD: Non-decoded chunks, etc: */
 } sox_oob_t;
 
+/**
+Client API:
+I/O callbacks for sox_open_read_callbacks() and sox_open_write_callbacks(),
+through which a format handler reads or writes its bytes instead of through
+a FILE. Each is passed the client_data given when opening.
+*/
+typedef struct sox_io_callbacks {
+  /** Reads up to len bytes into buf. Returns the number read, 0 at the
+  end of the stream or -1 on error; it may return fewer than len. Required
+  for reading. */
+  sox_int64_t (LSX_API * read)(void * client_data, void * buf, size_t len);
+
+  /** Writes len bytes from buf. Returns the number written, or -1 on error.
+  Required for writing. */
+  sox_int64_t (LSX_API * write)(void * client_data, void const * buf, size_t len);
+
+  /** Moves to offset from SEEK_SET, SEEK_CUR or SEEK_END. Returns 0 on
+  success. NULL if the stream cannot seek. */
+  int (LSX_API * seek)(void * client_data, sox_int64_t offset, int whence);
+
+  /** Returns the current offset, or -1 on error. NULL if the stream cannot
+  seek. */
+  sox_int64_t (LSX_API * tell)(void * client_data);
+} sox_io_callbacks_t;
+
+/**
+Client API:
+Settings shared by many transcodings of files of the same type, such as
+short call recordings, made with sox_transcode(). Create with
+sox_transcoder_create() and free with sox_transcoder_delete().
+*/
+typedef struct sox_transcoder {
+  sox_signalinfo_t     signal;           /**< Private: input signal info */
+  sox_encodinginfo_t   in_encoding;      /**< Private: input encoding info */
+  sox_encodinginfo_t   out_encoding;     /**< Private: output encoding info */
+  sox_bool             has_signal;       /**< Private: signal was given */
+  sox_bool             has_in_encoding;  /**< Private: in_encoding was given */
+  sox_bool             has_out_encoding; /**< Private: out_encoding was given */
+  char               * in_type;          /**< Private: input file type, or null */
+  char               * out_type;         /**< Private: output file type, or null */
+  sox_sample_t       * buf;              /**< Private: sample buffer */
+  size_t               bufsiz;           /**< Private: its size in samples */
+} sox_transcoder_t;
+
 /**
 Client API:
 Data passed to/from the format handler
@@ -1512,6 +1568,10 @@ struct sox_format {
   sox_uint64_t     data_start;      /**< Offset at which headers end and sound data begins (set by lsx_check_read_params) */
   sox_format_handler_t handler;     /**< Format handler for this file */
   void             * priv;          /**< Format handler's private data area */
+  sox_io_callbacks_t const * io;    /**< Client's I/O callbacks, used instead of fp if not NULL */
+  void             * io_data;       /**< Client data passed to them */
+  sox_bool         io_eof;          /**< io->read has returned 0 */
+  sox_bool         io_error;        /**< An I/O callback has failed */
 };
 
 /**
@@ -1525,6 +1585,41 @@ typedef struct sox_format_tab {
   sox_format_fn_t fn; /**< Function to call to get format handler's information */
 } sox_format_tab_t;
 
+/**
+Client API:
+Measurements of one channel of one block of a file's audio.
+*/
+typedef struct sox_index_block {
+  sox_sample_t min;   /**< Lowest sample value */
+  sox_sample_t max;   /**< Highest sample value */
+  sox_uint64_t clips; /**< Number of samples at full scale */
+  double       sum;   /**< Sum of the samples, scaled to [-1, 1) */
+  double       sum2;  /**< Sum of the squares of the scaled samples */
+} sox_index_block_t;
+
+/**
+Client API:
+Measurements of a file's audio, block by block, cached in the directory
+sox_globals.index_path and keyed by the file's name, type, encoding, size
+and modification time so that they need only be made once.
+*/
+typedef struct sox_index {
+  unsigned            channels;   /**< Number of channels measured */
+  sox_uint64_t        block_len;  /**< Wide samples in each block but the last */
+  sox_uint64_t        length;     /**< Wide samples measured */
+  size_t              num_blocks; /**< Blocks measured, including any partial last one */
+  sox_index_block_t * blocks;     /**< num_blocks * channels of them, block by block */
+  sox_sample_t        full_scale; /**< Private: lowest positive value counted as a clip */
+  size_t              pos;        /**< Private: samples so far in the last block */
+  size_t              size;       /**< Private: blocks allocated */
+  sox_uint64_t        file_size;  /**< Private: the file's size when measured */
+  sox_int64_t         mtime;      /**< Private: and its modification time */
+  sox_encodinginfo_t  encoding;   /**< Private: how its samples were read */
+  char                filetype[16]; /**< Private: as which type */
+  char              * name;       /**< Private: its absolute path */
+  char              * path;       /**< Private: the index's path */
+} sox_index_t;
+
 /**
 Client API:
 Global parameters for effects.
@@ -1532,8 +1627,41 @@ Global parameters for effects.
 typedef struct sox_effects_globals {
   sox_plot_t plot;         /**< To help the user choose effect & options */
   sox_globals_t * global_info; /**< Pointer to associated SoX globals */
+
+  /**
+  Set by the client while adding an effect that, instead of storing all of
+  its input, may return SOX_REPLAY from drain(). sox_flow_effects() then
+  returns SOX_REPLAY and the client should replace the effects before it
+  with new ones, send the same input from the beginning and flow again.
+  */
+  sox_bool replay;
+
+  /**
+  Set by the client while adding an effect whose input will be the whole of
+  a file that has a valid index, so that the effect can use its
+  measurements instead of making them.
+  */
+  sox_index_t const * index;
 } sox_effects_globals_t;
 
+/**
+Client API:
+Counters kept for each flow of an effect while a chain runs; see
+sox_effects_chain_stats(). Times are in seconds.
+*/
+typedef struct sox_effect_stats {
+  sox_uint64_t flow_calls;      /**< Calls to the handler's flow function */
+  sox_uint64_t drain_calls;     /**< Calls to the handler's drain function */
+  sox_uint64_t samples_in;      /**< Samples taken by flow */
+  sox_uint64_t samples_out;     /**< Samples given by flow and drain */
+  sox_uint64_t stalls;          /**< Times the effect was passed over because its input held fewer than imin samples */
+  double       flow_time;       /**< Wall-clock time in flow */
+  double       flow_cpu_time;   /**< CPU time of the calling thread in flow */
+  double       drain_time;      /**< Wall-clock time in drain */
+  double       drain_cpu_time;  /**< CPU time of the calling thread in drain */
+  double       interleave_time; /**< Time spent interleaving or deinterleaving the effect's output for the next effect */
+} sox_effect_stats_t;
+
 /**
 Client API:
 Effect handler information.
@@ -1572,6 +1700,7 @@ struct sox_effect {
   size_t                   obeg;      /**< output buffer: start of valid data section */
   size_t                   oend;      /**< output buffer: one past valid data section (oend-obeg is length of current content) */
   size_t               imin;          /**< minimum input buffer content required for calling this effect's flow function; set via lsx_effect_set_imin() */
+  sox_effect_stats_t   stats;         /**< Counters for this flow; see sox_effects_chain_stats() */
 };
 
 /**
@@ -1826,6 +1955,25 @@ sox_open_mem_read(
     LSX_PARAM_IN_OPT_Z char             const * filetype    /**< Previously-determined file type, or NULL to auto-detect. */
     );
 
+/**
+Client API:
+Opens a decoding session that reads through the client's I/O callbacks, for
+example straight from network buffers. It can seek only if io->seek and
+io->tell are given. Returned handle must be closed with sox_close(), which
+leaves client_data to the client.
+@returns The handle for the new session, or null on failure.
+*/
+LSX_RETURN_OPT
+sox_format_t *
+LSX_API
+sox_open_read_callbacks(
+    LSX_PARAM_IN       sox_io_callbacks_t const * io,        /**< I/O callbacks (required); must remain valid until sox_close(). */
+    LSX_PARAM_IN_OPT   void                     * client_data, /**< Passed to the callbacks. */
+    LSX_PARAM_IN_OPT   sox_signalinfo_t   const * signal,    /**< Information already known about audio stream, or NULL if none. */
+    LSX_PARAM_IN_OPT   sox_encodinginfo_t const * encoding,  /**< Information already known about sample encoding, or NULL if none. */
+    LSX_PARAM_IN_OPT_Z char               const * filetype   /**< Previously-determined file type, or NULL to auto-detect. */
+    );
+
 /**
 Client API:
 Returns true if the format handler for the specified file type supports the specified encoding.
@@ -1904,6 +2052,26 @@ sox_open_memstream_write(
     LSX_PARAM_IN_OPT   sox_oob_t          const * oob              /**< Out-of-band data to add to file, or NULL if none. */
     );
 
+/**
+Client API:
+Opens an encoding session that writes through the client's I/O callbacks.
+Formats that rewrite their header at the end need io->seek and io->tell.
+Returned handle must be closed with sox_close(), which leaves client_data to
+the client.
+@returns The new session handle, or null on failure.
+*/
+LSX_RETURN_OPT
+sox_format_t *
+LSX_API
+sox_open_write_callbacks(
+    LSX_PARAM_IN       sox_io_callbacks_t const * io,          /**< I/O callbacks (required); must remain valid until sox_close(). */
+    LSX_PARAM_IN_OPT   void                     * client_data, /**< Passed to the callbacks. */
+    LSX_PARAM_IN       sox_signalinfo_t   const * signal,      /**< Information about desired audio stream (required). */
+    LSX_PARAM_IN_OPT   sox_encodinginfo_t const * encoding,    /**< Information about desired sample encoding, or NULL to use defaults. */
+    LSX_PARAM_IN_Z     char               const * filetype,    /**< File type (required). */
+    LSX_PARAM_IN_OPT   sox_oob_t          const * oob          /**< Out-of-band data to add to file, or NULL if none. */
+    );
+
 /**
 Client API:
 Reads samples from a decoding session into a sample buffer.
@@ -1954,6 +2122,126 @@ sox_seek(
     int whence /**< Set to SOX_SEEK_SET. */
     );
 
+/**
+Client API:
+Prepares to transcode many files with the same input and output types and
+encodings, checking the file types once and reusing one sample buffer.
+The samples are copied unchanged, so if the input's rate, channels or
+precision are given, the output type and encoding must be able to take
+them without rate, remix or dither.
+@returns The transcoder, or null if a file type is unknown or the output
+can't take the input's rate, channels or precision.
+*/
+LSX_RETURN_OPT
+sox_transcoder_t *
+LSX_API
+sox_transcoder_create(
+    LSX_PARAM_IN_OPT   sox_signalinfo_t   const * signal,       /**< Information already known about the input audio, e.g. of headerless files, or NULL if none. */
+    LSX_PARAM_IN_OPT   sox_encodinginfo_t const * in_encoding,  /**< Information already known about the input encoding, or NULL if none. */
+    LSX_PARAM_IN_OPT_Z char               const * in_type,      /**< Input file type, or NULL to auto-detect each file. */
+    LSX_PARAM_IN_OPT   sox_encodinginfo_t const * out_encoding, /**< Output encoding, or NULL for the output type's default. */
+    LSX_PARAM_IN_OPT_Z char               const * out_type      /**< Output file type, or NULL to use each output file's extension. */
+    );
+
+/**
+Client API:
+Transcodes one file, copying its samples unchanged into a new file of the
+transcoder's output type and encoding. Fails if the output can't take the
+input's rate, channels or precision without rate, remix or dither.
+@returns SOX_SUCCESS if successful.
+*/
+int
+LSX_API
+sox_transcode(
+    LSX_PARAM_INOUT sox_transcoder_t * transcoder, /**< Transcoder pointer. */
+    LSX_PARAM_IN_Z  char const       * in_path,    /**< Path of the file to read. */
+    LSX_PARAM_IN_Z  char const       * out_path    /**< Path of the file to write. */
+    );
+
+/**
+Client API:
+Frees a transcoder.
+*/
+void
+LSX_API
+sox_transcoder_delete(
+    LSX_PARAM_IN_OPT sox_transcoder_t * transcoder /**< Transcoder pointer, or null. */
+    );
+
+/**
+Client API:
+Loads the index of a file opened for reading, if sox_globals.index_path is
+set and it holds an index made since the file was last modified.
+@returns The index, or null if there isn't a valid one.
+*/
+LSX_RETURN_OPT
+sox_index_t *
+LSX_API
+sox_index_load(
+    LSX_PARAM_IN sox_format_t const * ft /**< Format pointer. */
+    );
+
+/**
+Client API:
+Starts a new index of a file opened for reading, to be given all of its
+samples in order with sox_index_add() then saved with sox_index_save().
+It can only be saved if sox_globals.index_path is set and the file is a
+regular file.
+@returns The index.
+*/
+LSX_RETURN_VALID
+sox_index_t *
+LSX_API
+sox_index_create(
+    LSX_PARAM_IN sox_format_t const * ft /**< Format pointer. */
+    );
+
+/**
+Client API:
+Measures some more of the samples of the file being indexed.
+*/
+void
+LSX_API
+sox_index_add(
+    LSX_PARAM_INOUT sox_index_t * index, /**< Index pointer. */
+    LSX_PARAM_IN_COUNT(len) sox_sample_t const * buf, /**< Interleaved samples. */
+    size_t len /**< Number of samples in buf. */
+    );
+
+/**
+Client API:
+Writes an index to sox_globals.index_path, replacing any older one.
+@returns SOX_SUCCESS if successful.
+*/
+int
+LSX_API
+sox_index_save(
+    LSX_PARAM_IN sox_index_t const * index /**< Index pointer. */
+    );
+
+/**
+Client API:
+Adds up the measurements of one channel, or of all of them if channel is
+index->channels.
+*/
+void
+LSX_API
+sox_index_total(
+    LSX_PARAM_IN sox_index_t const * index, /**< Index pointer. */
+    unsigned channel, /**< Channel number, from 0. */
+    LSX_PARAM_OUT sox_index_block_t * total /**< Receives the totals. */
+    );
+
+/**
+Client API:
+Frees an index.
+*/
+void
+LSX_API
+sox_index_close(
+    LSX_PARAM_IN_OPT sox_index_t * index /**< Index pointer, or null. */
+    );
+
 /**
 Client API:
 Finds a format handler by name.
@@ -2086,6 +2374,24 @@ sox_flow_effects(
     LSX_PARAM_IN_OPT void * client_data /**< Data to pass into callback. */
     );
 
+/**
+Client API:
+Gets the counters of effect number n of an effects chain (0 is the first),
+summed over its flows, since it was added to the chain. Each flow's own are
+in chain->effects[n][flow].stats. The times are only measured while
+sox_get_globals()->profile is true; otherwise they stay at 0. With several
+flows running on several threads, the times add up to more than the time
+that passed.
+@returns SOX_SUCCESS, or SOX_EOF if there is no effect number n.
+*/
+int
+LSX_API
+sox_effects_chain_stats(
+    LSX_PARAM_IN  sox_effects_chain_t const * chain, /**< Effects chain. */
+    size_t n,                                        /**< Index of the effect in the chain. */
+    LSX_PARAM_OUT sox_effect_stats_t * stats         /**< Receives the counters. */
+    );
+
 /**
 Client API:
 Gets the number of clips that occurred while running an effects chain.
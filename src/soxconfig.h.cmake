@@ -7,11 +7,13 @@
 #cmakedefine HAVE_AMRWB               1
 #cmakedefine HAVE_AO                  1
 #cmakedefine HAVE_BYTESWAP_H          1
+#cmakedefine HAVE_CLOCK_GETTIME       1
 #cmakedefine HAVE_COREAUDIO           1
 #cmakedefine HAVE_FENV_H              1
 #cmakedefine HAVE_FLAC                1
 #cmakedefine HAVE_FMEMOPEN            1
 #cmakedefine HAVE_FSEEKO              1
+#cmakedefine HAVE_GETPEEREID          1
 #cmakedefine HAVE_GETTIMEOFDAY        1
 #cmakedefine HAVE_GLOB_H              1
 #define HAVE_GSM                      1
@@ -34,6 +36,7 @@
 #cmakedefine HAVE_OSS                 1
 #cmakedefine HAVE_PNG                 1
 #cmakedefine HAVE_POPEN               1
+#cmakedefine HAVE_PTHREAD_H          1
 #cmakedefine HAVE_PULSEAUDIO          1
 #cmakedefine HAVE_SNDFILE             1
 #cmakedefine HAVE_SNDFILE_1_0_18      1
@@ -48,11 +51,15 @@
 #cmakedefine HAVE_SUN_AUDIOIO_H       1
 #cmakedefine HAVE_SYS_AUDIOIO_H       1
 #cmakedefine HAVE_SYS_SOUNDCARD_H     1
+#cmakedefine HAVE_SYS_MMAN_H          1
+#cmakedefine HAVE_SYS_SOCKET_H        1
 #cmakedefine HAVE_SYS_STAT_H          1
 #cmakedefine HAVE_SYS_TIMEB_H         1
 #cmakedefine HAVE_SYS_TIME_H          1
 #cmakedefine HAVE_SYS_TYPES_H         1
+#cmakedefine HAVE_SYS_UN_H            1
 #cmakedefine HAVE_SYS_UTSNAME_H       1
+#cmakedefine HAVE_SYS_WAIT_H          1
 #cmakedefine HAVE_TERMIOS_H           1
 #cmakedefine HAVE_UNISTD_H            1
 #cmakedefine HAVE_VSNPRINTF           1
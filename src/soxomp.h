@@ -23,6 +23,9 @@
   #if _OPENMP >= 201107 /* OpenMP 3.1 */
     #define HAVE_OPENMP_3_1 1
   #endif
+  #if _OPENMP >= 201307 /* OpenMP 4.0 */
+    #define HAVE_OPENMP_4_0 1
+  #endif
 #endif
 
 #ifdef HAVE_OPENMP
@@ -75,16 +75,21 @@ typedef struct {
   sox_bool   log10_axis;   /* plot frequency on log10 axis */
   int        low_freq, high_freq;
 
+  int        strip_cols;   /* write PNGs of this many columns as we go */
+
   /* Shared work area */
   double     * shared, * * shared_ptr;
+  struct strips * strips, * * strips_ptr;
 
   /* Per-channel work area */
   uint64_t   skip;
   int        dft_size, step_size, block_steps, block_num, rows, cols, read;
   int        x_size, end, end_min, last_end;
+  int        batch, frames;     /* max and current number of queued DFTs */
   sox_bool   truncated;
-  double     * buf;             /* [dft_size] */
-  double     * dft_buf;         /* [dft_size] */
+  double     * buf;             /* [dft_size + (batch - 1) * step_size] */
+  double     * dft_buf;         /* [batch * dft_size] */
+  double     * powers;          /* [batch * (dft_size / 2 + 1)] */
   double     * window;          /* [dft_size + 1] */
   double     block_norm, max;
   double     * magnitudes;      /* [dft_size / 2 + 1] */
@@ -118,19 +123,42 @@ typedef struct {
                                   [(unsigned)(row) / TILE_HEIGHT]\
                                   [((unsigned)(row) % TILE_HEIGHT) * TILE_WIDTH\
                                    + (unsigned)(col) % TILE_WIDTH])
-static void free_tiles(priv_t *p)
+static void free_tile_col(priv_t *p, unsigned tile_col)
 {
-  unsigned tile_col, tile_row;
-  unsigned tile_cols = (p->cols + TILE_WIDTH - 1) / TILE_WIDTH;
+  unsigned tile_row;
 
-  for (tile_col = 0; tile_col < tile_cols; tile_col++) {
+  if (p->tiles[tile_col]) {
     for (tile_row = 0; tile_row < p->tile_rows; tile_row++)
       free(p->tiles[tile_col][tile_row]);
     free(p->tiles[tile_col]);
+    p->tiles[tile_col] = NULL;
   }
+}
+
+static void free_tiles(priv_t *p)
+{
+  unsigned tile_col;
+  unsigned tile_cols = (p->cols + TILE_WIDTH - 1) / TILE_WIDTH;
+
+  for (tile_col = 0; tile_col < tile_cols; tile_col++)
+    free_tile_col(p, tile_col);
   free(p->tiles);
 }
 
+/*
+ * With -P, the image is written as a series of PNG strips of strip_cols
+ * columns as soon as every channel has computed them, after which their
+ * tiles are freed, so memory use doesn't grow with the length of the audio.
+ * The channels may be processed by different threads so the last channel
+ * to finish a strip writes it and all changes to the tile arrays are made
+ * while holding the lock.
+ */
+struct strips {
+  omp_lock_t lock;
+  int        written;           /* Number of strips written so far */
+  int        * done;            /* [channels] Strips completed per channel */
+};
+
 #define secs(cols) \
   ((double)(cols) * p->step_size * p->block_steps / effp->in_signal.rate)
 
@@ -225,13 +253,13 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
   char const * next;
   int c;
   lsx_getopt_t optstate;
-  lsx_getopt_init(argc, argv, "+S:d:x:X:y:Y:z:Z:q:p:W:w:st:c:AarmnlhTo:LR:", NULL, lsx_getopt_flag_none, 1, &optstate);
+  lsx_getopt_init(argc, argv, "+S:d:x:X:y:Y:z:Z:q:p:W:w:st:c:AarmnlhTo:LR:P:", NULL, lsx_getopt_flag_none, 1, &optstate);
 
   p->dB_range = 120, p->spectrum_points = 249, p->perm = 1; /* Non-0 defaults */
   p->out_name = "spectrogram.png", p->comment = "Created by SoX";
 
   /* Default to 0 -> nyquist freq. But don't have sample rate at this point so
-   * set high_freq=-1 as flag. Replace with nyquist freq in stop() function. */
+   * set high_freq=-1 as flag. Replace with nyquist freq in start() function. */
   p->low_freq = -1;
   p->high_freq = -1;
 
@@ -245,6 +273,7 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
     GETOPT_NUMERIC(optstate, 'q', spectrum_points, 0 , p->spectrum_points)
     GETOPT_NUMERIC(optstate, 'p', perm          ,  1 , 6)
     GETOPT_NUMERIC(optstate, 'W', window_adjust , -10, 10)
+    GETOPT_NUMERIC(optstate, 'P', strip_cols    , 100, MAX_X_SIZE)
     case 'w': p->win_type = lsx_enum_option(c, optstate.arg, window_options);   break;
     case 's': p->slack_overlap    = sox_true;   break;
     case 'A': p->alt_palette      = sox_true;   break;
@@ -299,6 +328,18 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
   if (p->alt_palette)
     p->spectrum_points = min(p->spectrum_points, (int)alt_palette_len);
   p->shared_ptr = &p->shared;
+  p->strips_ptr = &p->strips;
+  if (p->strip_cols) {
+    if (p->normalize) {
+      lsx_fail("-n can't be used with -P");
+      return SOX_EOF;
+    }
+    if (!strcmp(p->out_name, "-")) {
+      lsx_fail("-P can't write to stdout");
+      return SOX_EOF;
+    }
+    p->strip_cols = (p->strip_cols + TILE_WIDTH - 1) / TILE_WIDTH * TILE_WIDTH;
+  }
   if (!strcmp(p->out_name, "-")) {
     if (effp->global_info->global_info->stdout_in_use_by) {
       lsx_fail("stdout already in use by `%s'", effp->global_info->global_info->stdout_in_use_by);
@@ -391,8 +432,20 @@ static int start(sox_effect_t * effp)
     p->skip = d;
   }
 
+  /* set default values for frequency range */
+  if (p->high_freq == -1) {
+    p->high_freq = effp->in_signal.rate/2;
+  }
+  if (p->low_freq == -1) {
+    p->low_freq = p->log10_axis ? 1 : 0;
+  }
+
   p->x_size = p->x_size0;
 
+  /* Strips need no overall width, just a scale */
+  if (p->strip_cols && !p->x_size && !pixels_per_sec && !p->duration_str)
+    pixels_per_sec = 100;
+
   /* If we're supposed to scale the spectrogram to the length of the audio
    * but the audio length is unknown, emit a warning to this effect */
   if (!duration && effp->in_signal.length == SOX_UNKNOWN_LEN &&
@@ -421,6 +474,8 @@ static int start(sox_effect_t * effp)
     }
     break;
   }
+  if (p->strip_cols && !p->x_size0 && !p->duration_str)
+    p->x_size = INT_MAX;
 
   if (p->y_size) {
     p->dft_size = 2 * (p->y_size - 1);
@@ -433,9 +488,15 @@ static int start(sox_effect_t * effp)
    for (p->dft_size = 128; p->dft_size <= y; p->dft_size <<= 1);
   }
 
-  /* Now that dft_size is set, allocate variable-sized elements of priv_t */
-  lsx_vcalloc(p->buf, p->dft_size);
-  lsx_vcalloc(p->dft_buf, p->dft_size);
+  /* Now that dft_size is set, allocate variable-sized elements of priv_t
+   * except for buf, whose size depends on step_size. */
+#if HAVE_FFTW
+  p->batch = 1;
+#else
+  p->batch = range_limit((1 << 18) / p->dft_size, 1, 64);
+#endif
+  lsx_vcalloc(p->dft_buf, p->batch * p->dft_size);
+  lsx_vcalloc(p->powers, p->batch * (p->dft_size / 2 + 1));
   lsx_vcalloc(p->window, p->dft_size + 1);
   lsx_vcalloc(p->magnitudes, p->dft_size / 2 + 1);
 
@@ -466,10 +527,19 @@ static int start(sox_effect_t * effp)
   p->max = -p->dB_range;
   p->read = (p->step_size - p->dft_size) / 2;
   p->tile_rows = (p->rows + TILE_HEIGHT - 1) / TILE_HEIGHT;
+  lsx_vcalloc(p->buf, p->dft_size + (p->batch - 1) * p->step_size);
+
+  if (p->strip_cols && !effp->flow) {
+    p->strips = lsx_calloc(1, sizeof(*p->strips));
+    lsx_vcalloc(p->strips->done, effp->in_signal.channels);
+    omp_init_lock(&p->strips->lock);
+  }
 
   return SOX_SUCCESS;
 }
 
+static void strip_done(sox_effect_t * effp);
+
 static int do_column(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
@@ -487,10 +557,14 @@ static int do_column(sox_effect_t * effp)
     unsigned tile_col_index = p->cols / TILE_WIDTH;
     unsigned i;
 
+    if (p->strip_cols)
+      omp_set_lock(&(*p->strips_ptr)->lock);
     lsx_revalloc(p->tiles, p->cols / TILE_WIDTH + 1);
     lsx_valloc(p->tiles[tile_col_index], p->rows);
     for (i = 0; i < p->tile_rows; i++)
       p->tiles[tile_col_index][i] = lsx_malloc(PAGE_SIZE);
+    if (p->strip_cols)
+      omp_unset_lock(&(*p->strips_ptr)->lock);
   }
   ++p->cols;
 
@@ -501,16 +575,91 @@ static int do_column(sox_effect_t * effp)
   }
   memset(p->magnitudes, 0, p->rows * sizeof(*p->magnitudes));
   p->block_num = 0;
+  if (p->strip_cols && p->cols % p->strip_cols == 0)
+    strip_done(effp);
   return SOX_SUCCESS;
 }
 
+/* Compute the power spectrum of one windowed frame of audio in dft_buf */
+static void frame_power(priv_t * p, double * dft_buf, double * power)
+{
+  int i;
+
+#if HAVE_FFTW
+  fftw_execute(p->fftw_plan);
+  /* Convert from FFTW's "half complex" format to an array of magnitudes.
+   * In HC format, the values are stored:
+   * r0, r1, r2 ... r(n/2), i(n+1)/2-1 .. i2, i1
+   */
+  power[0] = sqr(dft_buf[0]);
+  for (i = 1; i < p->dft_size / 2; ++i)
+    power[i] = sqr(dft_buf[i]) + sqr(dft_buf[p->dft_size - i]);
+  power[p->dft_size / 2] = sqr(dft_buf[p->dft_size / 2]);
+#else /* ! HAVE_FFTW */
+  if (is_p2(p->dft_size)) {
+    lsx_safe_rdft(p->dft_size, 1, dft_buf);
+    power[0] = sqr(dft_buf[0]);
+    for (i = 1; i < p->dft_size >> 1; ++i)
+      power[i] = sqr(dft_buf[2*i]) + sqr(dft_buf[2*i+1]);
+    power[p->dft_size >> 1] = sqr(dft_buf[1]);
+  } else {
+    memset(power, 0, p->rows * sizeof(*power));
+    rdft_p(*p->shared_ptr, dft_buf, power, p->dft_size);
+  }
+#endif /* ! HAVE_FFTW */
+}
+
+/* Transform the queued frames, which all use the current window, add
+ * their power spectra to the columns in order, then move the part of
+ * the next frame that we already have to the start of buf. */
+static int do_frames(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  int k, status = SOX_SUCCESS;
+
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if(sox_globals.use_threads && p->frames > 1) \
+      schedule(static)
+#endif
+  for (k = 0; k < p->frames; ++k) {
+    double * dft_buf = p->dft_buf + k * p->dft_size;
+    double const * in = p->buf + k * p->step_size;
+    int i;
+
+    for (i = 0; i < p->dft_size; ++i) dft_buf[i] = in[i] * p->window[i];
+    frame_power(p, dft_buf, p->powers + k * p->rows);
+  }
+
+  for (k = 0; k < p->frames && !p->truncated; ++k) {
+    double const * power = p->powers + k * p->rows;
+    int i;
+
+    for (i = 0; i < p->rows; ++i) p->magnitudes[i] += power[i];
+    if (++p->block_num == p->block_steps && do_column(effp) == SOX_EOF) {
+      status = SOX_EOF;
+      break;
+    }
+  }
+
+  if (p->frames) {
+    memmove(p->buf, p->buf + p->frames * p->step_size,
+        (p->dft_size - p->step_size + p->read) * sizeof(*p->buf));
+    p->frames = 0;
+  }
+  return status;
+}
+
+/*
+ * Frames of dft_size samples start every step_size samples.  Rather than
+ * shift the buffer along for every frame, up to "batch" frames are queued
+ * in buf and transformed together.
+ */
 static int flow(sox_effect_t * effp,
     const sox_sample_t * ibuf, sox_sample_t * obuf,
     size_t * isamp, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
   size_t len = *isamp = *osamp = min(*isamp, *osamp);
-  int i;
 
   memcpy(obuf, ibuf, len * sizeof(*obuf)); /* Pass on audio unaffected */
 
@@ -524,47 +673,27 @@ static int flow(sox_effect_t * effp,
     p->skip = 0;
   }
   while (!p->truncated) {
+    double * buf = p->buf + p->frames * p->step_size
+                          + p->dft_size - p->step_size;
     if (p->read == p->step_size) {
-      memmove(p->buf, p->buf + p->step_size,
-          (p->dft_size - p->step_size) * sizeof(*p->buf));
       p->read = 0;
+      if (p->frames == p->batch && do_frames(effp) == SOX_EOF)
+        return SOX_EOF;
+      buf = p->buf + p->frames * p->step_size + p->dft_size - p->step_size;
     }
     for (; len && p->read < p->step_size; --len, ++p->read, --p->end)
-      p->buf[p->dft_size - p->step_size + p->read] =
-        SOX_SAMPLE_TO_FLOAT_64BIT(*ibuf++,);
+      buf[p->read] = SOX_SAMPLE_TO_FLOAT_64BIT(*ibuf++,);
     if (p->read != p->step_size)
       break;
 
-    if ((p->end = max(p->end, p->end_min)) != p->last_end)
+    if ((p->end = max(p->end, p->end_min)) != p->last_end) {
+      if (do_frames(effp) == SOX_EOF)
+        return SOX_EOF;
       make_window(p, p->last_end = p->end);
-    for (i = 0; i < p->dft_size; ++i) p->dft_buf[i] = p->buf[i] * p->window[i];
-#if HAVE_FFTW
-    fftw_execute(p->fftw_plan);
-    /* Convert from FFTW's "half complex" format to an array of magnitudes.
-     * In HC format, the values are stored:
-     * r0, r1, r2 ... r(n/2), i(n+1)/2-1 .. i2, i1
-     */
-    p->magnitudes[0] += sqr(p->dft_buf[0]);
-    for (i = 1; i < p->dft_size / 2; ++i) {
-      p->magnitudes[i] += sqr(p->dft_buf[i]) + sqr(p->dft_buf[p->dft_size - i
-]);
-    }
-    p->magnitudes[p->dft_size / 2] += sqr(p->dft_buf[p->dft_size / 2]);
-#else /* ! HAVE_FFTW */
-    if (is_p2(p->dft_size)) {
-      lsx_safe_rdft(p->dft_size, 1, p->dft_buf);
-      p->magnitudes[0] += sqr(p->dft_buf[0]);
-      for (i = 1; i < p->dft_size >> 1; ++i)
-        p->magnitudes[i] += sqr(p->dft_buf[2*i]) + sqr(p->dft_buf[2*i+1]);
-      p->magnitudes[p->dft_size >> 1] += sqr(p->dft_buf[1]);
     }
-    else rdft_p(*p->shared_ptr, p->dft_buf, p->magnitudes, p->dft_size);
-#endif /* ! HAVE_FFTW */
-
-    if (++p->block_num == p->block_steps && do_column(effp) == SOX_EOF)
-      return SOX_EOF;
+    ++p->frames;
   }
-  return SOX_SUCCESS;
+  return do_frames(effp);
 }
 
 static int drain(sox_effect_t * effp, sox_sample_t * obuf_, size_t * osamp)
@@ -731,13 +860,147 @@ static int axis(double to, int max_steps, double * limit, char * * prefix)
   return step * scale + .5;
 }
 
+/* Plot the spectrogram columns col0 to col0+ncols-1 of all the channels,
+ * one above the other, with its bottom-left corner at pixel (x, y) */
+static void plot(sox_effect_t * effp, png_byte * pixels, int cols,
+    int x, int y, int col0, int ncols)
+{
+  priv_t * p = (priv_t *) effp->priv;
+  int chans = effp->in_signal.channels;
+  float log10_low_freq = log10f((float)p->low_freq);
+  float log10_high_freq = log10f((float)p->high_freq);
+  float nyquist_freq = (float)effp->in_signal.rate / 2;
+  float log_scale_factor = (log10_high_freq- log10_low_freq)/(float)p->rows;
+  float lin_scale_factor = (p->high_freq-p->low_freq)/(float)(p->rows);
+  int chan;
+
+  for (chan = 0; chan < chans; ++chan) {
+    priv_t * q = (priv_t *)(effp - effp->flow + chan)->priv;
+    int row, base = y + (chans - 1 - chan) * (p->rows + 1);
+
+    for (row = 0; row < p->rows; ++row) {
+      int dBfsi, col;
+      float freq;
+
+      if (p->log10_axis) {
+	freq = powf(10.0f, (float)row * log_scale_factor + log10_low_freq);
+      } else {
+	freq = (float)row * lin_scale_factor + p->low_freq;
+      }
+      /* dBfsi: index into dBfs[] corresponding to frequency at this row */
+      dBfsi = lrint(freq * p->rows / nyquist_freq);
+      /* It is possible that upper freq > Nyquist freq: deal with that */
+      if (dBfsi >= p->rows) {
+	dBfsi = p->rows - 1;
+      }
+      for (col = 0; col < ncols; ++col) {
+	pixel(x + col, base + row) = colour(p, pdBfs(q, dBfsi, col0 + col));
+      }
+    }
+  }
+}
+
+static void write_png(priv_t const * p, char const * name,
+    png_byte * pixels, int rows, int cols, png_color * palette)
+{
+  png_structp png;
+  png_infop   png_info;
+  png_bytepp  png_rows;
+  FILE *      file;
+
+  lsx_valloc(png_rows, rows);
+  if (p->using_stdout) {
+    SET_BINARY_MODE(stdout);
+    file = stdout;
+  } else {
+    file = lsx_fopen(name, "wb");
+    if (!file) {
+      lsx_fail("failed to create `%s': %s", name, strerror(errno));
+      goto error;
+    }
+  }
+  png = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0,0);
+  png_info = png_create_info_struct(png);
+  png_init_io(png, file);
+  png_set_PLTE(png, png_info, palette, fixed_palette + p->spectrum_points);
+  png_set_IHDR(png, png_info, (png_uint_32)cols, (png_uint_32)rows, 8,
+      PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+      PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  { int row;
+    for (row = 0; row < rows; ++row)    /* Put (0,0) at bottom-left of PNG */
+      png_rows[rows - 1 - row] = (png_bytep)(pixels + row * cols);
+  }
+  png_set_rows(png, png_info, png_rows);
+  png_write_png(png, png_info, PNG_TRANSFORM_IDENTITY, NULL);
+  png_destroy_write_struct(&png, &png_info);
+  if (!p->using_stdout)
+    fclose(file);
+error:
+  free(png_rows);
+}
+
+/* Write columns col0 to col0+ncols-1 as a raw spectrogram in the file
+ * whose name is the output file name with "-" and the strip number
+ * inserted before its extension. */
+static void write_strip(sox_effect_t * effp, int col0, int ncols, int strip)
+{
+  priv_t *   p      = (priv_t *) effp->priv;
+  int        chans  = effp->in_signal.channels;
+  int        rows   = p->rows * chans + chans - 1;
+  char const * dot  = strrchr(p->out_name, '.');
+  char *     name   = lsx_malloc(strlen(p->out_name) + 16);
+  png_byte * pixels;
+  png_color  palette[256];
+
+  if (!dot || strchr(dot, '/'))
+    dot = p->out_name + strlen(p->out_name);
+  sprintf(name, "%.*s-%05d%s", (int)(dot - p->out_name), p->out_name, strip + 1, dot);
+
+  make_palette(p, palette);
+  lsx_valloc(pixels, ncols * rows);
+  memset(pixels, Background, ncols * rows * sizeof(*pixels));
+  plot(effp, pixels, ncols, 0, 0, col0, ncols);
+  write_png(p, name, pixels, rows, ncols, palette);
+  free(pixels);
+  free(name);
+}
+
+/* Called by each channel when it completes a strip; writes out and frees
+ * the strips that all channels have completed. */
+static void strip_done(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *) effp->priv;
+  struct strips * strips = *p->strips_ptr;
+  int chans = effp->in_signal.channels;
+  int chan;
+
+  omp_set_lock(&strips->lock);
+  ++strips->done[effp->flow];
+  while (sox_true) {
+    int tile_col, col0 = strips->written * p->strip_cols;
+
+    for (chan = 0; chan < chans && strips->done[chan] > strips->written; ++chan);
+    if (chan < chans)
+      break;
+    write_strip(effp, col0, p->strip_cols, strips->written++);
+    for (chan = 0; chan < chans; ++chan) {
+      priv_t * q = (priv_t *)(effp - effp->flow + chan)->priv;
+      for (tile_col = col0 / TILE_WIDTH;
+           tile_col < (col0 + p->strip_cols) / TILE_WIDTH; ++tile_col)
+        free_tile_col(q, (unsigned)tile_col);
+    }
+  }
+  omp_unset_lock(&strips->lock);
+}
+
 #define below 48
 #define left 58
 #define between 37
 #define spectrum_width 14
 #define right 35
 
-static int stop(sox_effect_t * effp) /* only called, by end(), on flow 0 */
+/* Draw the whole spectrogram with its axes and legends and write it out */
+static void write_image(sox_effect_t * effp)
 {
   priv_t *    p        = (priv_t *) effp->priv;
   uLong       font_len = 96 * font_y;
@@ -750,22 +1013,9 @@ static int stop(sox_effect_t * effp) /* only called, by end(), on flow 0 */
   int         tick_len = 3 - p->no_axes;
   float       autogain = 0.0;	/* Is changed if the -n flag was supplied */
 
-  float log10_low_freq, log10_high_freq;
-  float nyquist_freq = (float)effp->in_signal.rate / 2;
-
-  /* set default values for frequency range */
-  if (p->high_freq == -1) {
-    p->high_freq = effp->in_signal.rate/2;
-  }
-  if (p->low_freq == -1) {
-    p->low_freq = p->log10_axis ? 1 : 0;
-  }
-
-  log10_low_freq = log10f((float)p->low_freq);
-  log10_high_freq = log10f((float)p->high_freq);
+  float log10_low_freq = log10f((float)p->low_freq);
+  float log10_high_freq = log10f((float)p->high_freq);
 
-  free(p->shared);
-  lsx_debug("signal-max=%g", p->max);
   font = lsx_malloc(font_len);
   assert(uncompress(font, &font_len, fixed, sizeof(fixed)-1) == Z_OK);
   make_palette(p, palette);
@@ -780,58 +1030,37 @@ static int stop(sox_effect_t * effp) /* only called, by end(), on flow 0 */
      */
     autogain = -p->max;
 
-  {
+  if (p->normalize) {
     int chan;
 
     for (chan = 0; chan < chans; ++chan) {
-      float log_scale_factor = (log10_high_freq- log10_low_freq)/(float)p->rows;
-      float lin_scale_factor = (p->high_freq-p->low_freq)/(float)(p->rows);
       priv_t * q = (priv_t *)(effp - effp->flow + chan)->priv;
-      int row, base;
+      int row, col;
 
-      if (p->normalize) {
-	int row, col;
+      for (row=p->rows-1; row >=0; row--)
+	for (col=p->cols-1; col >=0; col--)
+	  pdBfs(q, row, col) += autogain;
+    }
+  }
 
-	for (row=p->rows-1; row >=0; row--)
-	  for (col=p->cols-1; col >=0; col--)
-	    pdBfs(q, row, col) += autogain;
-      }
+  plot(effp, pixels, cols, !p->raw * left, !p->raw * below, 0, p->cols);
 
-      base = !p->raw * below + (chans - 1 - chan) * (p->rows + 1);
+  if (!p->raw && !p->no_axes) {
+    int chan;
 
-      for (row = 0; row < p->rows; ++row) {
-	int dBfsi, col;
-	float freq;
+    for (chan = 0; chan < chans; ++chan) {
+      int base = below + (chans - 1 - chan) * (p->rows + 1);
+      int row, x;
 
-	if (p->log10_axis) {
-	  freq = powf(10.0f, (float)row * log_scale_factor + log10_low_freq);
-	} else {
-	  freq = (float)row * lin_scale_factor + p->low_freq;
-	}
-	/* dBfsi: index into dBfs[] corresponding to frequency at this row */
-	dBfsi = lrint(freq * p->rows / nyquist_freq);
-	/* It is possible that upper freq > Nyquist freq: deal with that */
-	if (dBfsi >= p->rows) {
-	  dBfsi = p->rows - 1;
-	}
-	for (col = 0; col < p->cols; ++col) {
-	  pixel(!p->raw * left + col, base + row) =
-	    colour(p, pdBfs(q, dBfsi, col));
-	}
-	/* Y-axis lines */
-	if (!p->raw && !p->no_axes) {
-	  pixel(left - 1, base + row) = Grid;
-	  pixel(left + p->cols, base + row) = Grid;
-	}
+      /* Y-axis lines */
+      for (row = 0; row < p->rows; ++row) {
+	pixel(left - 1, base + row) = Grid;
+	pixel(left + p->cols, base + row) = Grid;
       }
-      if (!p->raw && !p->no_axes) {
-	int x;
-
-	/* X-axis lines */
-        for (x = -1; x <= p->cols; ++x) {
-	  pixel(left + x, base - 1) = Grid;
-	  pixel(left + x, base + p->rows) = Grid;
-	}
+      /* X-axis lines */
+      for (x = -1; x <= p->cols; ++x) {
+	pixel(left + x, base - 1) = Grid;
+	pixel(left + x, base + p->rows) = Grid;
       }
     }
   }
@@ -1007,61 +1236,40 @@ static int stop(sox_effect_t * effp) /* only called, by end(), on flow 0 */
   }
   free(font);
 
-  /* Create the PNG */
-  {
-    png_structp png;
-    png_infop   png_info;
-    png_bytepp  png_rows;
-    FILE *      file;
-
-    lsx_valloc(png_rows, rows);
-    if (p->using_stdout) {
-      SET_BINARY_MODE(stdout);
-      file = stdout;
-    } else {
-      file = lsx_fopen(p->out_name, "wb");
-      if (!file) {
-	lsx_fail("failed to create `%s': %s", p->out_name, strerror(errno));
-	goto error;
-      }
-    }
-    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0,0);
-    png_info = png_create_info_struct(png);
-    png_init_io(png, file);
-    png_set_PLTE(png, png_info, palette, fixed_palette + p->spectrum_points);
-    png_set_IHDR(png, png_info, (png_uint_32)cols, (png_uint_32)rows, 8,
-	PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
-	PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-    { int row;
-      for (row = 0; row < rows; ++row)    /* Put (0,0) at bottom-left of PNG */
-	png_rows[rows - 1 - row] = (png_bytep)(pixels + row * cols);
-    }
-    png_set_rows(png, png_info, png_rows);
-    png_write_png(png, png_info, PNG_TRANSFORM_IDENTITY, NULL);
-    png_destroy_write_struct(&png, &png_info);
-    if (!p->using_stdout)
-      fclose(file);
-error:
-    free(png_rows);
-  }
+  write_png(p, p->out_name, pixels, rows, cols, palette);
   free(pixels);
-  free_tiles(p);
-  free(p->buf);
-  free(p->dft_buf);
-  free(p->window);
-  free(p->magnitudes);
-#if HAVE_FFTW
-  fftw_destroy_plan(p->fftw_plan);
-#endif
-  return SOX_SUCCESS;
+}
+
+static void stop(sox_effect_t * effp) /* only called, by end(), on flow 0 */
+{
+  priv_t * p = (priv_t *) effp->priv;
+
+  free(p->shared);
+  lsx_debug("signal-max=%g", p->max);
+  if (p->strip_cols) {
+    struct strips * strips = p->strips;
+    int done = strips->written * p->strip_cols;
+
+    if (p->cols > done)
+      write_strip(effp, done, p->cols - done, strips->written);
+    omp_destroy_lock(&strips->lock);
+    free(strips->done);
+    free(strips);
+  }
+  else write_image(effp);
 }
 
 static int end(sox_effect_t * effp)
 {
   priv_t *p = (priv_t *)effp->priv;
   if (effp->flow == 0)
-    return stop(effp);
+    stop(effp);
   free_tiles(p);
+  free(p->buf);
+  free(p->dft_buf);
+  free(p->powers);
+  free(p->window);
+  free(p->magnitudes);
 #if HAVE_FFTW
   if (p->fftw_plan) fftw_destroy_plan(p->fftw_plan);
 #endif
@@ -1097,10 +1305,11 @@ sox_effect_handler_t const * lsx_spectrogram_effect_fn(void)
 "-o text Output file name; default `spectrogram.png'",
 "-d time Audio duration to fit to the X-axis",
 "-S pos  Start the spectrogram at the given input time",
+"-P num  Write raw PNG strips num pixels wide as the audio is processed",
     NULL
   };
   static sox_effect_handler_t handler = {
-    "spectrogram", usage, extra_usage, SOX_EFF_MODIFY,
+    "spectrogram", usage, extra_usage, SOX_EFF_MODIFY | SOX_EFF_ONCE,
     getopts, start, flow, drain, end, 0, sizeof(priv_t)};
 
   return &handler;
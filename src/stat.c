@@ -355,7 +355,7 @@ static char const * const extra_usage[] = {
 static sox_effect_handler_t sox_stat_effect = {
   "stat",
   usage, extra_usage,
-  SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+  SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_ONCE,
   sox_stat_getopts,
   sox_stat_start,
   sox_stat_flow,
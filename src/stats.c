@@ -18,14 +18,31 @@
 #include "sox_i.h"
 #include <ctype.h>
 
+typedef struct {           /* Figures for one channel over one -p period */
+  double    sigma_x, sigma_x2, min_sigma_x2, max_sigma_x2, min, max;
+  off_t     num_samples;
+} period_t;
+
+typedef struct {           /* Completed periods waiting for all channels */
+  omp_lock_t lock;
+  size_t    ring_len;
+  period_t  * ring;
+  unsigned  * done;
+} reports_t;
+
 typedef struct {
   int       scale_bits, hex_bits;
-  double    time_constant, scale;
+  double    time_constant, scale, period;
+  sox_bool  json;
 
   double    last, sigma_x, sigma_x2, avg_sigma_x2, min_sigma_x2, max_sigma_x2;
   double    min, max, mult, min_run, min_runs, max_run, max_runs;
   off_t     num_samples, tc_samples, min_count, max_count;
   uint32_t  maskLo, maskHi;
+
+  off_t     period_samples, period_num;
+  period_t  cur;
+  reports_t reports, * reports_ptr;
 } priv_t;
 
 static int getopts(sox_effect_t * effp, int argc, char **argv)
@@ -33,15 +50,18 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
   priv_t * p = (priv_t *)effp->priv;
   int c;
   lsx_getopt_t optstate;
-  lsx_getopt_init(argc, argv, "+x:b:w:s:", NULL, lsx_getopt_flag_none, 1, &optstate);
+  lsx_getopt_init(argc, argv, "+x:b:w:s:p:j", NULL, lsx_getopt_flag_none, 1, &optstate);
 
   p->time_constant = .05;
   p->scale = 1;
+  p->reports_ptr = &p->reports;
   while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
     GETOPT_NUMERIC(optstate, 'x', hex_bits      ,  2 , 32)
     GETOPT_NUMERIC(optstate, 'b', scale_bits    ,  2 , 32)
     GETOPT_NUMERIC(optstate, 'w', time_constant ,  .01 , 10)
     GETOPT_NUMERIC(optstate, 's', scale         ,  -99, 99)
+    GETOPT_NUMERIC(optstate, 'p', period        ,  .01, 86400)
+    case 'j': p->json = sox_true; break;
     default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
   }
   if (p->hex_bits)
@@ -49,6 +69,14 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
   return optstate.ind != argc? lsx_usage(effp) : SOX_SUCCESS;
 }
 
+static void period_reset(period_t * w)
+{
+  w->sigma_x = w->sigma_x2 = 0;
+  w->min = w->min_sigma_x2 = 2;
+  w->max = w->max_sigma_x2 = -2;
+  w->num_samples = 0;
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
@@ -61,50 +89,187 @@ static int start(sox_effect_t * effp)
   p->max = -p->min;
   p->num_samples = 0;
   p->maskLo = p->maskHi = 0;
+
+  period_reset(&p->cur);
+  p->period_num = 0;
+  p->period_samples = p->period * effp->in_signal.rate + .5;
+  if (p->period && p->period_samples < 1) /* Less than a sample: use one */
+    p->period_samples = 1;
+  if (p->period && !effp->flow) {
+    reports_t * r = p->reports_ptr;
+    /* Flows finish each buffer together so can be at most this far apart */
+    r->ring_len = sox_globals.bufsiz / effp->flows / p->period_samples + 2;
+    r->ring = lsx_calloc(r->ring_len * effp->flows, sizeof(*r->ring));
+    r->done = lsx_calloc(r->ring_len, sizeof(*r->done));
+    omp_init_lock(&r->lock);
+    if (!p->json)
+      fprintf(stderr, "time,channel,dc_offset,min_level,max_level,"
+          "pk_lev_db,rms_lev_db,rms_pk_db,rms_tr_db\n");
+  }
   return SOX_SUCCESS;
 }
 
-static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
-    sox_sample_t * obuf, size_t * ilen, size_t * olen)
+static void print_dB(priv_t const * p, char const * name, double x)
+{
+  if (p->json)
+    fprintf(stderr, x > 0? ",\"%s\":%.2f" : ",\"%s\":null", name, linear_to_dB(x));
+  else if (x > 0)
+    fprintf(stderr, ",%.2f", linear_to_dB(x));
+  else fprintf(stderr, ",-inf");
+}
+
+static void print_period(priv_t const * p, period_t const * w, double time,
+    unsigned channel)
+{
+  double ms = w->sigma_x2 / w->num_samples;
+  double pk_ms = w->max_sigma_x2 >= 0? w->max_sigma_x2 : ms;
+  double tr_ms = w->max_sigma_x2 >= 0? w->min_sigma_x2 : ms;
+
+  if (p->json)
+    fprintf(stderr, "{\"time\":%.3f,\"channel\":%u,\"dc_offset\":%.6f,"
+        "\"min_level\":%.6f,\"max_level\":%.6f", time, channel,
+        w->sigma_x / w->num_samples, w->min, w->max);
+  else fprintf(stderr, "%.3f,%u,%.6f,%.6f,%.6f", time, channel,
+        w->sigma_x / w->num_samples, w->min, w->max);
+  print_dB(p, "pk_lev_db", max(-w->min, w->max));
+  print_dB(p, "rms_lev_db", sqrt(ms));
+  print_dB(p, "rms_pk_db", sqrt(pk_ms));
+  print_dB(p, "rms_tr_db", sqrt(tr_ms));
+  fprintf(stderr, p->json? "}\n" : "\n");
+}
+
+/* Hand in this flow's figures for the current period; the last channel
+ * to do so prints the lot, so records come out in time and channel order */
+static void report(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  size_t len = *ilen = *olen = min(*ilen, *olen);
-  memcpy(obuf, ibuf, len * sizeof(*obuf));
+  reports_t * r = p->reports_ptr;
+  size_t slot = p->period_num % r->ring_len;
+  unsigned i;
+
+  omp_set_lock(&r->lock);
+  r->ring[slot * effp->flows + effp->flow] = p->cur;
+  if (++r->done[slot] == effp->flows) {
+    double time = (double)p->period_num * p->period_samples / effp->in_signal.rate;
+    for (i = 0; i < effp->flows; ++i)
+      print_period(p, &r->ring[slot * effp->flows + i], time, i + 1);
+    fflush(stderr);
+    r->done[slot] = 0;
+  }
+  omp_unset_lock(&r->lock);
+  ++p->period_num;
+  period_reset(&p->cur);
+}
 
-  for (; len--; ++ibuf, ++p->num_samples) {
-    double d = SOX_SAMPLE_TO_FLOAT_64BIT(*ibuf,);
+/* Sums, extremes and bit masks are reductions with no dependency between
+ * samples so can be vectorised; the exponential RMS is a recurrence and
+ * stays scalar, and peak runs need a scalar pass only when a block touches
+ * the current minimum or maximum. */
+static void accumulate(priv_t * p, sox_sample_t const * ibuf, size_t len)
+{
+  sox_sample_t lo = SOX_SAMPLE_MAX, hi = SOX_SAMPLE_MIN;
+  uint32_t maskLo = 0, maskHi = 0;
+  int64_t sum = 0;
+  double sum2 = 0, min_ms = 2, max_ms = -2, avg = p->avg_sigma_x2;
+  double d_lo, d_hi, sigma_x, sigma_x2;
+  size_t i, i0;
+
+#ifdef HAVE_OPENMP_4_0
+  #pragma omp simd reduction(min:lo) reduction(max:hi) \
+      reduction(|:maskLo,maskHi) reduction(+:sum,sum2)
+#endif
+  for (i = 0; i < len; ++i) {
+    sox_sample_t x = ibuf[i];
+    double d = x;
+    lo = min(lo, x);
+    hi = max(hi, x);
+    maskLo |= x;
+    maskHi |= x < 0? ~x : x;
+    sum += x;
+    sum2 += d * d;
+  }
 
-    if (d < p->min)
-      p->min = d, p->min_count = 1, p->min_run = 1, p->min_runs = 0;
-    else if (d == p->min) {
-      ++p->min_count;
-      p->min_run = d == p->last? p->min_run + 1 : 1;
+  i0 = p->num_samples >= p->tc_samples? 0 :
+      min(len, (size_t)(p->tc_samples - p->num_samples));
+  for (i = 0; i < i0; ++i) {
+    double d = SOX_SAMPLE_TO_FLOAT_64BIT(ibuf[i],);
+    avg = avg * p->mult + (1 - p->mult) * sqr(d);
+  }
+  for (; i < len; ++i) {
+    double d = SOX_SAMPLE_TO_FLOAT_64BIT(ibuf[i],);
+    avg = avg * p->mult + (1 - p->mult) * sqr(d);
+    min_ms = min(min_ms, avg);
+    max_ms = max(max_ms, avg);
+  }
+  p->avg_sigma_x2 = avg;
+  p->min_sigma_x2 = min(p->min_sigma_x2, min_ms);
+  p->max_sigma_x2 = max(p->max_sigma_x2, max_ms);
+
+  d_lo = SOX_SAMPLE_TO_FLOAT_64BIT(lo,);
+  d_hi = SOX_SAMPLE_TO_FLOAT_64BIT(hi,);
+  if (d_lo < p->min)
+    p->min = d_lo, p->min_count = 0, p->min_run = 0, p->min_runs = 0;
+  if (d_hi > p->max)
+    p->max = d_hi, p->max_count = 0, p->max_run = 0, p->max_runs = 0;
+  if (d_lo == p->min || d_hi == p->max) {
+    double last = p->last;
+    for (i = 0; i < len; ++i) {
+      double d = SOX_SAMPLE_TO_FLOAT_64BIT(ibuf[i],);
+      if (d == p->min) {
+        ++p->min_count;
+        p->min_run = d == last? p->min_run + 1 : 1;
+      }
+      else if (last == p->min)
+        p->min_runs += sqr(p->min_run);
+      if (d == p->max) {
+        ++p->max_count;
+        p->max_run = d == last? p->max_run + 1 : 1;
+      }
+      else if (last == p->max)
+        p->max_runs += sqr(p->max_run);
+      last = d;
     }
-    else if (p->last == p->min)
+  }
+  else {  /* No peaks here, so just end any run left from the last block */
+    if (p->last == p->min)
       p->min_runs += sqr(p->min_run);
-
-    if (d > p->max)
-      p->max = d, p->max_count = 1, p->max_run = 1, p->max_runs = 0;
-    else if (d == p->max) {
-      ++p->max_count;
-      p->max_run = d == p->last? p->max_run + 1 : 1;
-    }
-    else if (p->last == p->max)
+    if (p->last == p->max)
       p->max_runs += sqr(p->max_run);
+  }
+  p->last = SOX_SAMPLE_TO_FLOAT_64BIT(ibuf[len - 1],);
+
+  sigma_x = SOX_SAMPLE_TO_FLOAT_64BIT((double)sum,);
+  sigma_x2 = SOX_SAMPLE_TO_FLOAT_64BIT(SOX_SAMPLE_TO_FLOAT_64BIT(sum2,),);
+  p->sigma_x += sigma_x;
+  p->sigma_x2 += sigma_x2;
+  p->maskLo |= maskLo;
+  p->maskHi |= maskHi;
+  p->num_samples += len;
+
+  p->cur.sigma_x += sigma_x;
+  p->cur.sigma_x2 += sigma_x2;
+  p->cur.min = min(p->cur.min, d_lo);
+  p->cur.max = max(p->cur.max, d_hi);
+  p->cur.min_sigma_x2 = min(p->cur.min_sigma_x2, min_ms);
+  p->cur.max_sigma_x2 = max(p->cur.max_sigma_x2, max_ms);
+  p->cur.num_samples += len;
+}
 
-    p->sigma_x += d;
-    p->sigma_x2 += sqr(d);
-    p->avg_sigma_x2 = p->avg_sigma_x2 * p->mult + (1 - p->mult) * sqr(d);
+static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
+    sox_sample_t * obuf, size_t * ilen, size_t * olen)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t len = *ilen = *olen = min(*ilen, *olen);
+  memcpy(obuf, ibuf, len * sizeof(*obuf));
 
-    if (p->num_samples >= p->tc_samples) {
-      if (p->avg_sigma_x2 > p->max_sigma_x2)
-        p->max_sigma_x2 = p->avg_sigma_x2;
-      if (p->avg_sigma_x2 < p->min_sigma_x2)
-        p->min_sigma_x2 = p->avg_sigma_x2;
-    }
-    p->last = d;
-    p->maskLo |= *ibuf;
-    p->maskHi |= *ibuf < 0? ~*ibuf : *ibuf;
+  while (len) {
+    size_t n = len;
+    if (p->period_samples)
+      n = min(n, (size_t)(p->period_samples - p->cur.num_samples));
+    accumulate(p, ibuf, n);
+    ibuf += n, len -= n;
+    if (p->period_samples && p->cur.num_samples == p->period_samples)
+      report(effp);
   }
   return SOX_SUCCESS;
 }
@@ -117,6 +282,8 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * olen)
     p->min_runs += sqr(p->min_run);
   if (p->last == p->max)
     p->max_runs += sqr(p->max_run);
+  if (p->period_samples && p->cur.num_samples)
+    report(effp);
 
   (void)obuf, *olen = 0;
   return SOX_SUCCESS;
@@ -156,7 +323,15 @@ static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
 
-  if (!effp->flow) {
+  if (p->period) {
+    if (effp->flow == effp->flows - 1) {
+      reports_t * r = p->reports_ptr;
+      omp_destroy_lock(&r->lock);
+      free(r->ring);
+      free(r->done);
+    }
+  }
+  else if (!effp->flow) {
     double min_runs = 0, max_count = 0, min = 2, max = -2, max_sigma_x = 0, sigma_x2 = 0, min_sigma_x2 = 2, max_sigma_x2 = 0, avg_peak = 0;
     off_t num_samples = 0, min_count = 0, max_runs = 0;
     uint32_t maskLo = 0, maskHi = 0;
@@ -288,18 +463,20 @@ static int stop(sox_effect_t * effp)
 
 sox_effect_handler_t const * lsx_stats_effect_fn(void)
 {
-  static char const usage[] = "[-b bits|-x bits|-s scale] [-w window-time]";
+  static char const usage[] = "[-b bits|-x bits|-s scale] [-w window-time] [-p period [-j]]";
   static char const * const extra_usage[] = {
     "-b N     Scale DC offset and Min/Max levels to signed value of N bits",
     "-x N     The same, but display them as signed hexadecimal",
     "-s N     The same, but scale them by a floating poiint value",
     "-w time  Show Pk/RMS levels for a window of N seconds (default: 0.05)",
+    "-p time  Instead, output CSV figures for each period of N seconds",
+    "-j       Output the periodic figures as JSON lines instead of CSV",
     NULL
   };
   static sox_effect_handler_t handler = {
     "stats",
     usage, extra_usage,
-    SOX_EFF_MODIFY,
+    SOX_EFF_MODIFY | SOX_EFF_ONCE,
     getopts, start, flow, drain, stop, NULL, sizeof(priv_t)};
   return &handler;
 }
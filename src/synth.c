@@ -82,6 +82,8 @@ static lsx_enum_item const combine_type[] = {
 
 typedef enum {Linear, Square, Exp, Exp_cycle} sweep_t;	/* :+/- */
 
+#define BLOCK 1024 /* Samples of each channel made at a time */
+
 typedef struct {
   /* options */
   type_t type;
@@ -94,6 +96,9 @@ typedef struct {
   /* internal stuff */
   double lp_last_out, hp_last_out, hp_last_in, ap_last_out, ap_last_in;
   double cycle_start_time_s, c0, c1, c2, c3, c4, c5, c6;
+  double step;            /* Exponential sweep's growth per sample */
+  int32_t ranqd1;         /* Each channel's own noise generator */
+  double * out;           /* A block of the synth wave */
 
   double * buffer;
   size_t buffer_len, pos;
@@ -379,6 +384,18 @@ case3:  if (!isfinite(chan->vdelay_mix)) goto vwhat;
 
 
 
+/* Scramble a seed from the global generator so that the channels'
+ * noise doesn't start at nearby points of the same sequence */
+static int32_t seed(int32_t r)
+{
+  uint32_t x = (uint32_t)r;
+
+  x ^= x >> 16; x *= 0x7feb352dU;
+  x ^= x >> 15; x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return (int32_t)x;
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
@@ -400,6 +417,7 @@ static int start(sox_effect_t * effp)
     channel_t *  chan = &p->channels[i];
     *chan = p->getopts_channels[i % p->getopts_nchannels];
     set_default_parameters(chan);
+    lsx_valloc(chan->out, BLOCK);
 
     if (chan->combine == synth_vdelay) {
      /* I don't know why you need two extra samples, but if you don't
@@ -495,9 +513,11 @@ static int start(sox_effect_t * effp)
       case Exp: chan->mult = p->samples_to_do?
           log(chan->freq2 / chan->freq) / p->samples_to_do * effp->in_signal.rate : 1;
         chan->freq /= chan->mult;
+        chan->step = exp(chan->mult / effp->in_signal.rate);
         break;
       case Exp_cycle: chan->mult = p->samples_to_do?
           (log(chan->freq2) - log(chan->freq)) / p->samples_to_do : 1;
+        chan->step = exp(chan->mult);
         break;
     }
     lsx_debug("type=%s, combine=%s, samples_to_do=%" PRIu64 ", f1=%g, f2=%g, "
@@ -507,6 +527,10 @@ static int start(sox_effect_t * effp)
         p->samples_to_do, chan->freq, chan->freq2,
         chan->offset, chan->phase, chan->p1, chan->p2, chan->p3, chan->mult);
   }
+  /* After pluck's excitation, so as not to change it */
+  for (i = 0; i < p->number_of_channels; ++i)
+    p->channels[i].ranqd1 = seed(RANQD1);
+
   p->gain = 1;
   effp->out_signal.mult = p->no_headroom? NULL : &p->gain;
   effp->out_signal.length = p->samples_to_do ?
@@ -514,242 +538,330 @@ static int start(sox_effect_t * effp)
   return SOX_SUCCESS;
 }
 
-#define elapsed_time_s p->samples_done / effp->in_signal.rate
+/* sin(2 * M_PI * phase) for phase in [0, 1), within 1e-11: the Taylor
+ * series to x^15 over [-M_PI/2, M_PI/2], where the rest is folded to */
+static double sin_cycle(double phase)
+{
+  double q = phase - (phase >= .5);                    /* [-.5, .5) */
+  double x = 2 * M_PI * (fabs(q) > .25? (q < 0? -.5 : .5) - q : q);
+  double x2 = x * x;
 
-static int flow(sox_effect_t * effp, const sox_sample_t * ibuf, sox_sample_t * obuf,
-    size_t * isamp, size_t * osamp)
+  return x * (1 + x2 * (-1. / 6 + x2 * (1. / 120 + x2 * (-1. / 5040 +
+      x2 * (1. / 362880 + x2 * (-1. / 39916800 + x2 * (1. / 6227020800. +
+      x2 * (-1. / 1307674368000.))))))));
+}
+
+/* Each sample's position in the cycle, from sample s onwards */
+static void make_phases(channel_t * chan, uint64_t s, size_t n,
+    sox_rate_t rate, double * phase)
 {
-  priv_t * p = (priv_t *) effp->priv;
-  unsigned len = min(*isamp, *osamp) / effp->in_signal.channels;
-  unsigned c, done;
-  int result = SOX_SUCCESS;
+  size_t i;
 
-  for (done = 0; done < len && result == SOX_SUCCESS; ++done) {
-    for (c = 0; c < effp->in_signal.channels; c++) {
-      sox_sample_t synth_input = *ibuf++;
-      channel_t *  chan = &p->channels[c];
-      double synth_out;              /* [-1, 1] */
-
-      if (chan->type < synth_noise) { /* Need to calculate phase: */
-        double phase;            /* [0, 1) */
-        switch (chan->sweep) {
-          case Linear:
-            phase = (chan->freq + p->samples_done * chan->mult) *
-                elapsed_time_s;
-            break;
-          case Square:
-            phase = (chan->freq + sign(chan->mult) * 
-                sqr(p->samples_done * chan->mult)) * elapsed_time_s;
-            break;
-          case Exp:
-            phase = chan->freq * exp(chan->mult * elapsed_time_s);
-            break;
-          case Exp_cycle: default: {
-            double f = chan->freq * exp(p->samples_done * chan->mult);
-            double cycle_elapsed_time_s = elapsed_time_s - chan->cycle_start_time_s;
-            if (f * cycle_elapsed_time_s >= 1) {  /* move to next cycle */
-              chan->cycle_start_time_s += 1 / f;
-              cycle_elapsed_time_s = elapsed_time_s - chan->cycle_start_time_s;
-            }
-            phase = f * cycle_elapsed_time_s;
-            break;
-          }
+  switch (chan->sweep) {
+    case Linear:
+      for (i = 0; i < n; ++i) {
+        double t = (double)(s + i);
+        phase[i] = (chan->freq + t * chan->mult) * t / rate;
+      }
+      break;
+    case Square:
+      for (i = 0; i < n; ++i) {
+        double t = (double)(s + i);
+        phase[i] = (chan->freq + sign(chan->mult) * sqr(t * chan->mult)) *
+            t / rate;
+      }
+      break;
+    case Exp: {
+      /* Step from an exact value at the start of each block */
+      double e = exp(chan->mult * (double)s / rate);
+      for (i = 0; i < n; ++i, e *= chan->step)
+        phase[i] = chan->freq * e;
+      break;
+    }
+    case Exp_cycle: default: {
+      double f = chan->freq * exp((double)s * chan->mult);
+      for (i = 0; i < n; ++i, f *= chan->step) {
+        double elapsed_time_s = (double)(s + i) / rate;
+        double cycle_elapsed_time_s = elapsed_time_s - chan->cycle_start_time_s;
+        if (f * cycle_elapsed_time_s >= 1) {  /* move to next cycle */
+          chan->cycle_start_time_s += 1 / f;
+          cycle_elapsed_time_s = elapsed_time_s - chan->cycle_start_time_s;
         }
-        phase = fmod(phase + chan->phase, 1.0);
-
-        switch (chan->type) {
-          case synth_sine:
-            synth_out = sin(2 * M_PI * phase);
-            break;
-
-          case synth_square:
-            /* |_______           | +1
-             * |       |          |
-             * |_______|__________|  0
-             * |       |          |
-             * |       |__________| -1
-             * |                  |
-             * 0       p1          1
-             */
-            synth_out = -1 + 2 * (phase < chan->p1);
-            break;
-
-          case synth_sawtooth:
-            /* |           __| +1
-             * |        __/  |
-             * |_______/_____|  0
-             * |  __/        |
-             * |_/           | -1
-             * |             |
-             * 0             1
-             */
-            synth_out = -1 + 2 * phase;
-            break;
-
-          case synth_triangle:
-            /* |    .    | +1
-             * |   / \   |
-             * |__/___\__|  0
-             * | /     \ |
-             * |/       \| -1
-             * |         |
-             * 0   p1    1
-             */
-
-            if (phase < chan->p1)
-              synth_out = -1 + 2 * phase / chan->p1;          /* In rising part of period */
-            else
-              synth_out = 1 - 2 * (phase - chan->p1) / (1 - chan->p1); /* In falling part */
-            break;
-
-          case synth_trapezium:
-            /* |    ______             |+1
-             * |   /      \            |
-             * |__/________\___________| 0
-             * | /          \          |
-             * |/            \_________|-1
-             * |                       |
-             * 0   p1    p2   p3       1
-             */
-            if (phase < chan->p1)       /* In rising part of period */
-              synth_out = -1 + 2 * phase / chan->p1;
-            else if (phase < chan->p2)  /* In high part of period */
-              synth_out = 1;
-            else if (phase < chan->p3)  /* In falling part */
-              synth_out = 1 - 2 * (phase - chan->p2) / (chan->p3 - chan->p2);
-            else                        /* In low part of period */
-              synth_out = -1;
-            break;
-
-          case synth_exp:
-            /* |             |              | +1
-             * |            | |             |
-             * |          _|   |_           | 0
-             * |       __-       -__        |
-             * |____---             ---____ | f(p2)
-             * |                            |
-             * 0             p1             1
-             */
-            synth_out = dB_to_linear(chan->p2 * -200);  /* 0 ..  1 */
-            if (phase < chan->p1)
-              synth_out = synth_out * exp(phase * log(1 / synth_out) / chan->p1);
-            else
-              synth_out = synth_out * exp((1 - phase) * log(1 / synth_out) / (1 - chan->p1));
-            synth_out = synth_out * 2 - 1;      /* map 0 .. 1 to -1 .. +1 */
-            break;
-
-          default: synth_out = 0;
+        phase[i] = f * cycle_elapsed_time_s;
+      }
+      break;
+    }
+  }
+  for (i = 0; i < n; ++i) {
+    double d = phase[i] + chan->phase;
+    phase[i] = d - floor(d);
+  }
+}
+
+/* n samples of the synth wave, in [-1, 1], from sample s onwards */
+static void make_wave(channel_t * chan, uint64_t s, size_t n,
+    sox_rate_t rate, double * out)
+{
+  size_t i;
+
+  if (chan->type < synth_noise) { /* Need to calculate phase: */
+    double const * phase = out;
+    make_phases(chan, s, n, rate, out);
+
+    switch (chan->type) {
+      case synth_sine:
+        for (i = 0; i < n; ++i)
+          out[i] = sin_cycle(phase[i]);
+        break;
+
+      case synth_square:
+        /* |_______           | +1
+         * |       |          |
+         * |_______|__________|  0
+         * |       |          |
+         * |       |__________| -1
+         * |                  |
+         * 0       p1          1
+         */
+        for (i = 0; i < n; ++i)
+          out[i] = -1 + 2 * (phase[i] < chan->p1);
+        break;
+
+      case synth_sawtooth:
+        /* |           __| +1
+         * |        __/  |
+         * |_______/_____|  0
+         * |  __/        |
+         * |_/           | -1
+         * |             |
+         * 0             1
+         */
+        for (i = 0; i < n; ++i)
+          out[i] = -1 + 2 * phase[i];
+        break;
+
+      case synth_triangle:
+        /* |    .    | +1
+         * |   / \   |
+         * |__/___\__|  0
+         * | /     \ |
+         * |/       \| -1
+         * |         |
+         * 0   p1    1
+         */
+        for (i = 0; i < n; ++i) {
+          if (phase[i] < chan->p1)
+            out[i] = -1 + 2 * phase[i] / chan->p1;          /* In rising part of period */
+          else
+            out[i] = 1 - 2 * (phase[i] - chan->p1) / (1 - chan->p1); /* In falling part */
         }
-      } else switch (chan->type) {
-        case synth_whitenoise:
-          synth_out = DRANQD1;
-          break;
+        break;
 
-        case synth_tpdfnoise:
-          synth_out = .5 * (DRANQD1 + DRANQD1);
-          break;
+      case synth_trapezium:
+        /* |    ______             |+1
+         * |   /      \            |
+         * |__/________\___________| 0
+         * | /          \          |
+         * |/            \_________|-1
+         * |                       |
+         * 0   p1    p2   p3       1
+         */
+        for (i = 0; i < n; ++i) {
+          if (phase[i] < chan->p1)       /* In rising part of period */
+            out[i] = -1 + 2 * phase[i] / chan->p1;
+          else if (phase[i] < chan->p2)  /* In high part of period */
+            out[i] = 1;
+          else if (phase[i] < chan->p3)  /* In falling part */
+            out[i] = 1 - 2 * (phase[i] - chan->p2) / (chan->p3 - chan->p2);
+          else                           /* In low part of period */
+            out[i] = -1;
+        }
+        break;
 
-        case synth_pinknoise: { /* "Paul Kellet's refined method" */
+      case synth_exp: {
+        /* |             |              | +1
+         * |            | |             |
+         * |          _|   |_           | 0
+         * |       __-       -__        |
+         * |____---             ---____ | f(p2)
+         * |                            |
+         * 0             p1             1
+         */
+        double low = dB_to_linear(chan->p2 * -200);  /* 0 ..  1 */
+        double range = log(1 / low);
+        for (i = 0; i < n; ++i) {
+          double d;
+          if (phase[i] < chan->p1)
+            d = low * exp(phase[i] * range / chan->p1);
+          else
+            d = low * exp((1 - phase[i]) * range / (1 - chan->p1));
+          out[i] = d * 2 - 1;      /* map 0 .. 1 to -1 .. +1 */
+        }
+        break;
+      }
+
+      default: memset(out, 0, n * sizeof(*out));
+    }
+  } else switch (chan->type) {
+    case synth_whitenoise:
+      for (i = 0; i < n; ++i)
+        out[i] = dranqd1(chan->ranqd1);
+      break;
+
+    case synth_tpdfnoise:
+      for (i = 0; i < n; ++i) {
+        double d = dranqd1(chan->ranqd1);
+        out[i] = .5 * (d + dranqd1(chan->ranqd1));
+      }
+      break;
+
+    case synth_pinknoise: /* "Paul Kellet's refined method" */
 #define _ .125 / (65536. * 32768.)
-          double d = RANQD1;
-          chan->c0 = .99886 * chan->c0 + d * (.0555179*_); 
-          chan->c1 = .99332 * chan->c1 + d * (.0750759*_); 
-          chan->c2 = .96900 * chan->c2 + d * (.1538520*_); 
-          chan->c3 = .86650 * chan->c3 + d * (.3104856*_); 
-          chan->c4 = .55000 * chan->c4 + d * (.5329522*_); 
-          chan->c5 = -.7616 * chan->c5 - d * (.0168980*_); 
-          synth_out = chan->c0 + chan->c1 + chan->c2 + chan->c3
-                    + chan->c4 + chan->c5 + chan->c6 + d * (.5362*_); 
-          chan->c6 = d * (.115926*_); 
-          break;
+      for (i = 0; i < n; ++i) {
+        double d = ranqd1(chan->ranqd1);
+        chan->c0 = .99886 * chan->c0 + d * (.0555179*_);
+        chan->c1 = .99332 * chan->c1 + d * (.0750759*_);
+        chan->c2 = .96900 * chan->c2 + d * (.1538520*_);
+        chan->c3 = .86650 * chan->c3 + d * (.3104856*_);
+        chan->c4 = .55000 * chan->c4 + d * (.5329522*_);
+        chan->c5 = -.7616 * chan->c5 - d * (.0168980*_);
+        out[i] = chan->c0 + chan->c1 + chan->c2 + chan->c3
+               + chan->c4 + chan->c5 + chan->c6 + d * (.5362*_);
+        chan->c6 = d * (.115926*_);
+      }
+      break;
 #undef _
-        }
 
-        case synth_brownnoise:
-          do synth_out = chan->lp_last_out + DRANQD1 * (1. / 16);
-          while (fabs(synth_out) > 1);
-          chan->lp_last_out = synth_out;
-          break;
+    case synth_brownnoise:
+      for (i = 0; i < n; ++i) {
+        double d;
+        do d = chan->lp_last_out + dranqd1(chan->ranqd1) * (1. / 16);
+        while (fabs(d) > 1);
+        out[i] = chan->lp_last_out = d;
+      }
+      break;
 
-        case synth_pluck: {
-          double d = chan->buffer[chan->pos];
+    case synth_pluck:
+      for (i = 0; i < n; ++i) {
+        double d = chan->buffer[chan->pos];
 
-          chan->hp_last_out = 
-             (d - chan->hp_last_in) * chan->c3 + chan->hp_last_out * chan->c2;
-          chan->hp_last_in = d;
-        
-          synth_out = range_limit(chan->hp_last_out, -1, 1);
+        chan->hp_last_out =
+           (d - chan->hp_last_in) * chan->c3 + chan->hp_last_out * chan->c2;
+        chan->hp_last_in = d;
 
-          chan->lp_last_out = d = d * chan->c1 + chan->lp_last_out * chan->c0;
+        out[i] = range_limit(chan->hp_last_out, -1, 1);
 
-          chan->ap_last_out = chan->buffer[chan->pos] =
-            (d - chan->ap_last_out) * chan->c4 + chan->ap_last_in;
-          chan->ap_last_in = d;
+        chan->lp_last_out = d = d * chan->c1 + chan->lp_last_out * chan->c0;
 
-          chan->pos = chan->pos + 1 == chan->buffer_len? 0 : chan->pos + 1;
-          break;
-        }
+        chan->ap_last_out = chan->buffer[chan->pos] =
+          (d - chan->ap_last_out) * chan->c4 + chan->ap_last_in;
+        chan->ap_last_in = d;
 
-        default: synth_out = 0;
+        chan->pos = chan->pos + 1 == chan->buffer_len? 0 : chan->pos + 1;
       }
+      break;
+
+    default: memset(out, 0, n * sizeof(*out));
+  }
+}
 
-      /* Add offset, but prevent clipping: */
-      synth_out = synth_out * (1 - fabs(chan->offset)) + chan->offset;
-
-      switch (chan->combine) {
-        case synth_create: synth_out *=  SOX_SAMPLE_MAX; break;
-        case synth_mix   : synth_out = (synth_out * SOX_SAMPLE_MAX + synth_input) * .5; break;
-        case synth_amod  : synth_out = (synth_out + 1) * synth_input * .5; break;
-        case synth_fmod  : synth_out *=  synth_input; break;
-        case synth_vdelay: {
-          /* vdelay_fixed is the constant delay,
-           * vdelay_extra is the depth of the extra delay, both in secs
-           * vdelay_mix, 0 to 1: 0=all input, 1=all delayed, .5=half and half
-           */
-          size_t vlen = chan->vdelay_len;
-          sox_rate_t sr = effp->in_signal.rate;
-          double offset;        /* Floating-point offset from vpos */
-          int lindex, rindex;   /* Integral index before and after it */
-
-          chan->vdelay_buffer[chan->vpos] = synth_input;
-
-          /* Convert synth_out [-1 to 1] to 0 to 1, add the constant delay
-           * and convert to the number of samples ago.
-           */
-          offset = (chan->vdelay_fixed + (chan->vdelay_extra * ((synth_out + 1.0) / 2.0))) * sr;
-          /* This should never happen */
-          if (offset >= (double)chan->vdelay_len ||
-              offset <= -(double)chan->vdelay_len)
-            lsx_warn("vdelay's sample offset (%g) "
-                     "exceeds the delay buffer size (%d)",
-                     offset, (int)chan->vdelay_len);
-
-          /* For less noise, interpolate between the two samples
-           * either side of the floating-point sample offset */
-          lindex = ((chan->vpos -  (int)ceil(offset)) + vlen) % vlen;
-          rindex = ((chan->vpos - (int)trunc(offset)) + vlen) % vlen;
-          if (lindex == rindex) {
-            synth_out = synth_input * (1.0f - chan->vdelay_mix) +
-                        chan->vdelay_buffer[lindex] * chan->vdelay_mix;
-          } else {
-            /* How far through the sample frame the FP offset is, 0-1 */
-            double fraction = 1 - (offset - trunc(offset));
-            synth_out = synth_input * (1.0f - chan->vdelay_mix) +
-			chan->vdelay_mix * (
-                          chan->vdelay_buffer[lindex] * (1.0f - fraction) +
-                          chan->vdelay_buffer[rindex] * fraction
-			);
-          }
-          if (++chan->vpos == vlen) chan->vpos=0;
+/* Make n samples of one channel, whose input and output are every
+ * channels samples of ibuf and obuf */
+static void synth_channel(sox_effect_t * effp, channel_t * chan, size_t n,
+    const sox_sample_t * ibuf, sox_sample_t * obuf, unsigned channels)
+{
+  priv_t * p = (priv_t *) effp->priv;
+  size_t i;
+
+  make_wave(chan, p->samples_done, n, effp->in_signal.rate, chan->out);
+
+  for (i = 0; i < n; ++i, ibuf += channels, obuf += channels) {
+    sox_sample_t synth_input = *ibuf;
+    double synth_out = chan->out[i];
+
+    /* Add offset, but prevent clipping: */
+    synth_out = synth_out * (1 - fabs(chan->offset)) + chan->offset;
+
+    switch (chan->combine) {
+      case synth_create: synth_out *=  SOX_SAMPLE_MAX; break;
+      case synth_mix   : synth_out = (synth_out * SOX_SAMPLE_MAX + synth_input) * .5; break;
+      case synth_amod  : synth_out = (synth_out + 1) * synth_input * .5; break;
+      case synth_fmod  : synth_out *=  synth_input; break;
+      case synth_vdelay: {
+        /* vdelay_fixed is the constant delay,
+         * vdelay_extra is the depth of the extra delay, both in secs
+         * vdelay_mix, 0 to 1: 0=all input, 1=all delayed, .5=half and half
+         */
+        size_t vlen = chan->vdelay_len;
+        sox_rate_t sr = effp->in_signal.rate;
+        double offset;        /* Floating-point offset from vpos */
+        int lindex, rindex;   /* Integral index before and after it */
+
+        chan->vdelay_buffer[chan->vpos] = synth_input;
+
+        /* Convert synth_out [-1 to 1] to 0 to 1, add the constant delay
+         * and convert to the number of samples ago.
+         */
+        offset = (chan->vdelay_fixed + (chan->vdelay_extra * ((synth_out + 1.0) / 2.0))) * sr;
+        /* This should never happen */
+        if (offset >= (double)chan->vdelay_len ||
+            offset <= -(double)chan->vdelay_len)
+          lsx_warn("vdelay's sample offset (%g) "
+                   "exceeds the delay buffer size (%d)",
+                   offset, (int)chan->vdelay_len);
+
+        /* For less noise, interpolate between the two samples
+         * either side of the floating-point sample offset */
+        lindex = ((chan->vpos -  (int)ceil(offset)) + vlen) % vlen;
+        rindex = ((chan->vpos - (int)trunc(offset)) + vlen) % vlen;
+        if (lindex == rindex) {
+          synth_out = synth_input * (1.0f - chan->vdelay_mix) +
+                      chan->vdelay_buffer[lindex] * chan->vdelay_mix;
+        } else {
+          /* How far through the sample frame the FP offset is, 0-1 */
+          double fraction = 1 - (offset - trunc(offset));
+          synth_out = synth_input * (1.0f - chan->vdelay_mix) +
+                      chan->vdelay_mix * (
+                        chan->vdelay_buffer[lindex] * (1.0f - fraction) +
+                        chan->vdelay_buffer[rindex] * fraction
+                      );
         }
-        break;
+        if (++chan->vpos == vlen) chan->vpos=0;
       }
-      *obuf++ = synth_out < 0? synth_out * p->gain - .5 : synth_out * p->gain + .5;
+      break;
     }
-    if (++p->samples_done == p->samples_to_do)
+    *obuf = synth_out < 0? synth_out * p->gain - .5 : synth_out * p->gain + .5;
+  }
+}
+
+static int flow(sox_effect_t * effp, const sox_sample_t * ibuf, sox_sample_t * obuf,
+    size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *) effp->priv;
+  unsigned channels = effp->in_signal.channels;
+  size_t len = min(*isamp, *osamp) / channels, done, n;
+  int result = SOX_SUCCESS;
+
+  for (done = 0; done < len && result == SOX_SUCCESS; done += n) {
+    int c;
+
+    n = min(len - done, BLOCK);
+    if (p->samples_to_do && p->samples_to_do - p->samples_done <= n) {
+      n = p->samples_to_do - p->samples_done;
       result = SOX_EOF;
+    }
+
+    /* The channels are independent of each other */
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if(sox_globals.use_threads && channels > 1) \
+        schedule(static)
+#endif
+    for (c = 0; c < (int)channels; ++c)
+      synth_channel(effp, &p->channels[c], n, ibuf + done * channels + c,
+          obuf + done * channels + c, channels);
+    p->samples_done += n;
   }
-  *isamp = *osamp = done * effp->in_signal.channels;
+  *isamp = *osamp = done * channels;
   return result;
 }
 
@@ -762,6 +874,7 @@ static int stop(sox_effect_t * effp)
 
   for (i = 0; i < p->number_of_channels; ++i) {
     free(p->channels[i].buffer);
+    free(p->channels[i].out);
     if (p->channels[i].combine == synth_vdelay)
       free(p->channels[i].vdelay_buffer);
   }
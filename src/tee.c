@@ -0,0 +1,414 @@
+/* libSoX effect: tee - copy the audio to another file as it passes
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The audio is passed on unchanged and a copy of each block is put in a
+ * queue of up to QUEUE_BLOCKS blocks.  A thread of its own takes the blocks
+ * from the queue through an effects chain of the branch's effects, any
+ * rate, channels and dither that the output file needs and the output file.
+ * A full queue holds up the main chain, so the slowest output sets the
+ * pace, but each encodes while the others do. */
+
+#include "sox_i.h"
+
+#ifdef HAVE_PTHREAD_H
+
+#include <pthread.h>
+#include <string.h>
+
+#define QUEUE_BLOCKS 8
+
+typedef struct {
+  /* Options */
+  char const        * filename, * filetype;
+  sox_signalinfo_t  signal;       /* Only the rate and channels */
+  sox_encodinginfo_t encoding;
+  sox_bool          no_dither;
+  char              * text;       /* The branch's effects, split in place */
+  sox_effect_t      * * effects;  /* Made by getopts, added by start */
+  size_t            neffects;
+
+  /* The branch */
+  sox_format_t      * ft;
+  sox_effects_chain_t * chain;
+  pthread_t         thread;
+  pthread_mutex_t   mutex;
+  pthread_cond_t    space, data;
+  sox_bool          started, running;
+  sox_sample_t      * block[QUEUE_BLOCKS];
+  size_t            len[QUEUE_BLOCKS];
+  uint64_t          head, tail;   /* Blocks put in and taken out */
+  size_t            offset;       /* Into the block at the tail */
+  sox_bool          eof, done, error;
+} priv_t;
+
+static lsx_enum_item const encodings[] = {
+  {"signed-integer"  , SOX_ENCODING_SIGN2},
+  {"unsigned-integer", SOX_ENCODING_UNSIGNED},
+  {"floating-point"  , SOX_ENCODING_FLOAT},
+  {"mu-law"          , SOX_ENCODING_ULAW},
+  {"a-law"           , SOX_ENCODING_ALAW},
+  {0, 0}};
+
+/* The branch's first effect: takes blocks from the queue */
+static int queue_drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  priv_t * p = *(priv_t * *)effp->priv;
+  size_t i, n;
+  sox_bool empty;
+
+  pthread_mutex_lock(&p->mutex);
+  while (p->tail == p->head && !p->eof)
+    pthread_cond_wait(&p->data, &p->mutex);
+  empty = p->tail == p->head;
+  pthread_mutex_unlock(&p->mutex);
+  if (empty) {
+    *osamp = 0;
+    return SOX_EOF;
+  }
+  i = p->tail % QUEUE_BLOCKS;
+  n = min(*osamp / effp->out_signal.channels * effp->out_signal.channels,
+      p->len[i] - p->offset);
+  memcpy(obuf, p->block[i] + p->offset, n * sizeof(*obuf));
+  *osamp = n;
+  if ((p->offset += n) == p->len[i]) {
+    pthread_mutex_lock(&p->mutex);
+    p->offset = 0;
+    ++p->tail;
+    pthread_cond_signal(&p->space);
+    pthread_mutex_unlock(&p->mutex);
+  }
+  return SOX_SUCCESS;
+}
+
+static sox_effect_handler_t const * queue_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {"tee-queue", NULL, NULL,
+    SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_INTERNAL,
+    NULL, NULL, NULL, queue_drain, NULL, NULL, sizeof(priv_t *)
+  };
+  return &handler;
+}
+
+/* The branch's last effect: writes to the output file */
+static int file_flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t UNUSED * obuf, size_t * isamp, size_t * osamp)
+{
+  priv_t * p = *(priv_t * *)effp->priv;
+  size_t len = *isamp? sox_write(p->ft, ibuf, *isamp) : 0;
+
+  *osamp = 0;
+  if (len != *isamp) {
+    if (p->ft->sox_errno)
+      lsx_fail("`%s' %s: %s", p->ft->filename,
+          p->ft->sox_errstr, sox_strerror(p->ft->sox_errno));
+    p->error = sox_true;
+    return SOX_EOF;
+  }
+  return SOX_SUCCESS;
+}
+
+static sox_effect_handler_t const * file_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {"tee-output", NULL, NULL,
+    SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_PREC | SOX_EFF_INTERNAL,
+    NULL, NULL, file_flow, NULL, NULL, NULL, sizeof(priv_t *)
+  };
+  return &handler;
+}
+
+static int getopts(sox_effect_t * effp, int argc, char * * argv)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  lsx_getopt_t optstate;
+  size_t len = 0;
+  char * * words;
+  int c, i, nwords;
+
+  sox_init_encodinginfo(&p->encoding);
+  lsx_getopt_init(argc, argv, "+t:b:e:C:r:c:Dn", NULL, lsx_getopt_flag_none, 1, &optstate);
+  while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
+    GETOPT_NUMERIC(optstate, 'b', encoding.bits_per_sample, 1, 64)
+    GETOPT_NUMERIC(optstate, 'C', encoding.compression, -1000, 1000)
+    GETOPT_NUMERIC(optstate, 'c', signal.channels, 1, 65535)
+    case 't': p->filetype = optstate.arg; break;
+    case 'D': p->no_dither = sox_true; break;
+    case 'n': p->filetype = "null", p->filename = "-n"; break;
+    case 'e':
+      if ((c = lsx_enum_option(c, optstate.arg, encodings)) == INT_MAX)
+        return lsx_usage(effp);
+      p->encoding.encoding = c;
+      break;
+    case 'r': {
+      char * end;
+      p->signal.rate = lsx_parse_frequency(optstate.arg, &end);
+      if (p->signal.rate <= 0 || *end) {
+        lsx_fail("invalid sample rate `%s'", optstate.arg);
+        return lsx_usage(effp);
+      }
+      break;
+    }
+    default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  argc -= optstate.ind, argv += optstate.ind;
+  if (!p->filename) {
+    if (!argc)
+      return lsx_usage(effp);
+    p->filename = *argv++, --argc;
+  }
+
+  /* The rest are the branch's effects, in one or more arguments, which are
+   * split as the shell would so that quoted filenames can contain spaces */
+  for (i = 0; i < argc; ++i)
+    len += strlen(argv[i]) + 1;
+  p->text = lsx_calloc(len + 1, 1);
+  for (i = 0; i < argc; ++i)
+    strcat(strcat(p->text, argv[i]), " ");
+  words = lsx_strtoargv(p->text, &nwords);
+  for (i = 0; i < nwords; ) {
+    sox_effect_handler_t const * handler = sox_find_effect(words[i]);
+    sox_effect_t * e;
+    int n;
+
+    if (!handler || (handler->flags & SOX_EFF_INTERNAL)) {
+      lsx_fail("`%s' is not an effect", words[i]);
+      free(words);
+      return SOX_EOF;
+    }
+    for (n = 1; i + n < nwords && !sox_find_effect(words[i + n]); ++n);
+    e = sox_create_effect(handler);
+    lsx_revalloc(p->effects, p->neffects + 1);
+    p->effects[p->neffects++] = e;
+    c = sox_effect_options(e, n - 1, words + i + 1);
+    i += n;
+    if (c != SOX_SUCCESS) {
+      free(words);
+      return SOX_EOF;
+    }
+  }
+  free(words);
+  return SOX_SUCCESS;
+}
+
+static void * branch(void * arg)
+{
+  priv_t * p = (priv_t *)arg;
+
+  sox_flow_effects(p->chain, NULL, NULL);
+  pthread_mutex_lock(&p->mutex);
+  p->done = sox_true;
+  pthread_cond_signal(&p->space);
+  pthread_mutex_unlock(&p->mutex);
+  return NULL;
+}
+
+static sox_bool add(priv_t * p, sox_effect_t * e, sox_signalinfo_t * signal,
+    sox_signalinfo_t const * out)
+{
+  int result = sox_add_effect(p->chain, e, signal, out);
+
+  free(e);
+  return result == SOX_SUCCESS;
+}
+
+static sox_bool add_auto(priv_t * p, char const * name,
+    sox_signalinfo_t * signal)
+{
+  sox_effect_t * e = sox_create_effect(sox_find_effect(name));
+
+  sox_effect_options(e, 0, NULL);
+  return add(p, e, signal, &p->ft->signal);
+}
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  sox_signalinfo_t signal = effp->in_signal, out;
+  sox_bool dither = sox_false;
+  sox_effect_t * e;
+  size_t i;
+
+  signal.mult = NULL;
+  out = signal;
+  if (p->signal.rate)
+    out.rate = p->signal.rate;
+  if (p->signal.channels)
+    out.channels = p->signal.channels;
+
+  p->chain = sox_create_effects_chain(effp->in_encoding, &p->encoding);
+  e = sox_create_effect(queue_effect_fn());
+  *(priv_t * *)e->priv = p;
+  if (!add(p, e, &signal, &signal))
+    return SOX_EOF;
+  for (i = 0; i < p->neffects; ++i) {
+    dither |= !strcmp(p->effects[i]->handler.name, "dither");
+    e = p->effects[i], p->effects[i] = NULL;
+    if (!add(p, e, &signal, &out))
+      return SOX_EOF;
+  }
+
+  out = signal;
+  if (effp->in_encoding && (i = sox_precision(effp->in_encoding->encoding,
+          effp->in_encoding->bits_per_sample)))
+    out.precision = i; /* That of the input, as for the main output */
+  if (p->signal.rate)
+    out.rate = p->signal.rate;
+  if (p->signal.channels)
+    out.channels = p->signal.channels;
+  if (signal.length != SOX_UNKNOWN_LEN)
+    out.length = signal.length / signal.channels * out.channels /
+      signal.rate * out.rate + .5;
+  if (!(p->ft = sox_open_write(p->filename, &out, &p->encoding, p->filetype,
+          NULL, NULL)))
+    return SOX_EOF;
+  p->chain->out_enc = &p->ft->encoding;
+  if (signal.channels < p->ft->signal.channels &&
+      signal.rate != p->ft->signal.rate && !add_auto(p, "rate", &signal))
+    return SOX_EOF;
+  if (signal.channels != p->ft->signal.channels &&
+      !add_auto(p, "channels", &signal))
+    return SOX_EOF;
+  if (signal.rate != p->ft->signal.rate && !add_auto(p, "rate", &signal))
+    return SOX_EOF;
+  if (!dither && !p->no_dither && signal.precision > p->ft->signal.precision &&
+      p->ft->signal.precision < 24 && !add_auto(p, "dither", &signal))
+    return SOX_EOF;
+  e = sox_create_effect(file_effect_fn());
+  *(priv_t * *)e->priv = p;
+  if (!add(p, e, &signal, &p->ft->signal))
+    return SOX_EOF;
+
+  for (i = 0; i < QUEUE_BLOCKS; ++i)
+    lsx_valloc(p->block[i], sox_globals.bufsiz);
+  pthread_mutex_init(&p->mutex, NULL);
+  pthread_cond_init(&p->space, NULL);
+  pthread_cond_init(&p->data, NULL);
+  p->started = sox_true;
+  if (pthread_create(&p->thread, NULL, branch, p)) {
+    lsx_fail("can't start a thread for `%s'", p->filename);
+    return SOX_EOF;
+  }
+  p->running = sox_true;
+  return SOX_SUCCESS;
+}
+
+static int flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t len = min(*isamp, *osamp) / effp->in_signal.channels * effp->in_signal.channels;
+  sox_bool done;
+
+  memcpy(obuf, ibuf, len * sizeof(*obuf));
+  if (!(*isamp = *osamp = len)) /* An empty block would end the branch */
+    return SOX_SUCCESS;
+  pthread_mutex_lock(&p->mutex);
+  while (p->head - p->tail == QUEUE_BLOCKS && !p->done)
+    pthread_cond_wait(&p->space, &p->mutex);
+  done = p->done;
+  pthread_mutex_unlock(&p->mutex);
+  if (done) /* The branch has finished, e.g. with trim, or failed */
+    return p->error? SOX_EOF : SOX_SUCCESS;
+
+  /* Only this thread touches the block at the head until it is counted */
+  memcpy(p->block[p->head % QUEUE_BLOCKS], ibuf, len * sizeof(*ibuf));
+  p->len[p->head % QUEUE_BLOCKS] = len;
+  pthread_mutex_lock(&p->mutex);
+  ++p->head;
+  pthread_cond_signal(&p->data);
+  pthread_mutex_unlock(&p->mutex);
+  return SOX_SUCCESS;
+}
+
+/* Let the branch finish what is in the queue and wait for it */
+static void finish(priv_t * p)
+{
+  if (!p->running)
+    return;
+  pthread_mutex_lock(&p->mutex);
+  p->eof = sox_true;
+  pthread_cond_signal(&p->data);
+  pthread_mutex_unlock(&p->mutex);
+  pthread_join(p->thread, NULL);
+  p->running = sox_false;
+}
+
+static int drain(sox_effect_t * effp, sox_sample_t UNUSED * obuf, size_t * osamp)
+{
+  *osamp = 0;
+  finish((priv_t *)effp->priv);
+  return SOX_EOF;
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t i;
+
+  finish(p);
+  if (p->started) {
+    pthread_mutex_destroy(&p->mutex);
+    pthread_cond_destroy(&p->space);
+    pthread_cond_destroy(&p->data);
+  }
+  if (p->chain)
+    sox_delete_effects_chain(p->chain); /* Effects write their reports */
+  if (p->ft)
+    sox_close(p->ft);
+  p->chain = NULL, p->ft = NULL, p->started = sox_false;
+  for (i = 0; i < QUEUE_BLOCKS; ++i)
+    free(p->block[i]), p->block[i] = NULL;
+  return p->error? SOX_EOF : SOX_SUCCESS;
+}
+
+static int lsx_kill(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t i;
+
+  for (i = 0; i < p->neffects; ++i) if (p->effects[i]) { /* Not added */
+    p->effects[i]->handler.kill(p->effects[i]);
+    free(p->effects[i]->priv);
+    free(p->effects[i]);
+  }
+  free(p->effects);
+  free(p->text);
+  return SOX_SUCCESS;
+}
+
+sox_effect_handler_t const * lsx_tee_effect_fn(void)
+{
+  static char const usage[] =
+    "[-t type] [-b bits] [-e encoding] [-C factor] [-r rate] [-c channels] [-D]\n"
+    "\tfile|-n ['effect [args]' ...]";
+  static char const * const extra_usage[] = {
+    "-t type      File type of the copy (default: from the file name)",
+    "-b/-e/-C     Its bits per sample, encoding and compression",
+    "-r/-c        Its sample rate and number of channels",
+    "-D           Don't dither the copy to fewer bits",
+    "-n           Send the copy to the null file",
+    "effect       Effects for the copy only, quoted so sox_ng leaves them",
+    NULL
+  };
+  static sox_effect_handler_t handler = {
+    "tee", usage, extra_usage,
+    SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_ONCE,
+    getopts, start, flow, drain, stop, lsx_kill, sizeof(priv_t)
+  };
+  return &handler;
+}
+
+#endif
@@ -19,11 +19,14 @@
 
 #include "sox_i.h"
 #include "fifo.h"
+#include <ctype.h>
+#include <float.h>
 
 typedef struct {
   /* Configuration parameters: */
   size_t channels;
   sox_bool quick_search; /* Whether to quick search or linear search */
+  sox_bool dft_search;   /* Whether to search by cross-correlation */
   double factor;         /* 1 for no change, < 1 for slower, > 1 for faster. */
   size_t search;         /* Wide samples to search for best overlap position */
   size_t segment;        /* Processing segment length in wide samples */
@@ -35,6 +38,9 @@ typedef struct {
   fifo_t input_fifo;
   float * overlap_buf;
   fifo_t output_fifo;
+  int dft_length;        /* For the cross-correlation search */
+  double * dft_a, * dft_b;
+  double * dft_low;      /* Lowest each position's difference could be */
 
   /* Counters: */
   uint64_t samples_in;
@@ -55,6 +61,80 @@ static float difference(const float * a, const float * b, size_t length)
   return diff;
 }
 
+/* Find the same least-squares optimum as the linear search below but via
+ * the FFT: sum((a-b)^2) = sum(a^2) + sum(b^2) - 2 sum(a*b), where sum(a^2)
+ * is the same for every position, sum(b^2) is a running sum and sum(a*b) at
+ * every position comes from one cross-correlation.  Correlating the
+ * interleaved data at lags that are multiples of the number of channels
+ * sums the per-channel correlations, so all channels are done at once.
+ *
+ * difference() sums in single precision, and the running sum here loses
+ * precision after loud audio, so where positions are within rounding error
+ * of each other (as in silence) the two could choose differently.  Those
+ * that could be the best, given bounds on both errors, are therefore
+ * measured again with difference() and chosen between as the linear search
+ * would. */
+static size_t tempo_best_overlap_position_dft(tempo_t * t, float const * new_win)
+{
+  size_t i, c, best_pos = 0;
+  size_t n = t->channels * t->overlap;
+  size_t m = t->channels * (t->search - 1 + t->overlap);
+  double * a = t->dft_a, * b = t->dft_b;
+  double energy = 0, energy_a = 0, energy_b = 0, least_high = 0;
+  double scale = 2. / t->dft_length, drift, fft_error;
+  double tolerance = 2. * n * FLT_EPSILON; /* Relative to the energies */
+  float least_diff = 0;
+  sox_bool found = sox_false;
+
+  for (i = 0; i < n; ++i) {
+    a[i] = t->overlap_buf[i];
+    energy_a += sqr(a[i]);
+  }
+  memset(a + n, 0, (t->dft_length - n) * sizeof(*a));
+  for (i = 0; i < m; ++i) {
+    b[i] = new_win[i];
+    energy_b += sqr(b[i]);
+  }
+  memset(b + m, 0, (t->dft_length - m) * sizeof(*b));
+
+  lsx_safe_rdft(t->dft_length, 1, a);
+  lsx_safe_rdft(t->dft_length, 1, b);
+  b[0] *= a[0];
+  b[1] *= a[1];
+  for (i = 2; i < (size_t)t->dft_length; i += 2) { /* b *= conj(a) */
+    double tmp = b[i];
+    b[i  ] = a[i] * tmp    + a[i+1] * b[i+1];
+    b[i+1] = a[i] * b[i+1] - a[i+1] * tmp;
+  }
+  lsx_safe_rdft(t->dft_length, -1, b);
+
+  for (i = 0; i < n; ++i)
+    energy += sqr(new_win[i]);
+  drift = DBL_EPSILON * n * energy;
+  fft_error = DBL_EPSILON * t->dft_length * sqrt(energy_a * energy_b);
+  for (i = 0; i < t->search; ++i) {
+    double diff = energy_a + energy - 2 * scale * b[t->channels * i];
+    double error = tolerance * (energy_a + fabs(energy)) + drift + fft_error +
+      FLT_MIN;
+    t->dft_low[i] = diff - error;
+    if (!i || diff + error < least_high)
+      least_high = diff + error;
+    if (i + 1 < t->search) for (c = 0; c < t->channels; ++c) {
+      double in = sqr(new_win[n + t->channels * i + c]);
+      double out = sqr(new_win[t->channels * i + c]);
+      energy += in - out;
+      drift += DBL_EPSILON * (fabs(energy) + in + out);
+    }
+  }
+  for (i = 0; i < t->search; ++i)
+    if (t->dft_low[i] <= least_high) {
+      float diff = difference(new_win + t->channels * i, t->overlap_buf, n);
+      if (!found || diff < least_diff)
+        least_diff = diff, best_pos = i, found = sox_true;
+    }
+  return best_pos;
+}
+
 /* Find where the two segments are most alike over the overlap period. */
 static size_t tempo_best_overlap_position(tempo_t * t, float const * new_win)
 {
@@ -107,7 +187,9 @@ static void tempo_process(tempo_t * t)
       offset = t->search / 2;
       fifo_write(&t->output_fifo, t->overlap, (float *) fifo_read_ptr(&t->input_fifo) + t->channels * offset);
     } else {
-      offset = tempo_best_overlap_position(t, fifo_read_ptr(&t->input_fifo));
+      offset = t->dft_search?
+        tempo_best_overlap_position_dft(t, fifo_read_ptr(&t->input_fifo)) :
+        tempo_best_overlap_position(t, fifo_read_ptr(&t->input_fifo));
       tempo_overlap(t, t->overlap_buf,
           (float *) fifo_read_ptr(&t->input_fifo) + t->channels * offset,
           fifo_write(&t->output_fifo, t->overlap, NULL));
@@ -165,7 +247,8 @@ static void tempo_flush(tempo_t * t)
 }
 
 static void tempo_setup(tempo_t * t,
-  double sample_rate, sox_bool quick_search, double factor,
+  double sample_rate, sox_bool quick_search, sox_bool direct_search,
+  double factor,
   double segment_ms, double search_ms, double overlap_ms)
 {
   size_t max_skip;
@@ -178,6 +261,24 @@ static void tempo_setup(tempo_t * t,
   if (t->overlap * 2 > t->segment)
     t->overlap -= 8;
   lsx_valloc(t->overlap_buf, t->overlap * t->channels);
+
+  /* The linear search costs search * overlap multiply-adds per channel;
+   * the cross-correlation costs three real FFTs of the whole window.
+   * Use whichever is cheaper unless a quick search was asked for. */
+  if (!quick_search && !direct_search && t->search > 1) {
+    size_t n = t->channels * (t->search - 1 + t->overlap);
+    int log2_len = 1;
+
+    while (((size_t)1 << log2_len) < n)
+      ++log2_len;
+    if (t->search * t->overlap * t->channels > (size_t)(3 * log2_len + 8) << log2_len) {
+      t->dft_search = sox_true;
+      t->dft_length = 1 << log2_len;
+      lsx_valloc(t->dft_a, t->dft_length);
+      lsx_valloc(t->dft_b, t->dft_length);
+      lsx_valloc(t->dft_low, t->search);
+    }
+  }
   max_skip = ceil(factor * (t->segment - t->overlap));
   t->process_size = max(max_skip + t->overlap, t->segment) + t->search;
   memset(fifo_reserve(&t->input_fifo, t->search / 2), 0, (t->search / 2) * t->channels * sizeof(float));
@@ -185,6 +286,9 @@ static void tempo_setup(tempo_t * t,
 
 static void tempo_delete(tempo_t * t)
 {
+  free(t->dft_low);
+  free(t->dft_b);
+  free(t->dft_a);
   free(t->overlap_buf);
   fifo_delete(&t->output_fifo);
   fifo_delete(&t->input_fifo);
@@ -204,7 +308,7 @@ static tempo_t * tempo_create(size_t channels)
 
 typedef struct {
   tempo_t     * tempo;
-  sox_bool    quick_search;
+  sox_bool    quick_search, direct_search;
   double      factor, segment_ms, search_ms, overlap_ms;
 } priv_t;
 
@@ -218,11 +322,12 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
   static const double searches_div[] = {5.587, 6,  2.14, 2};
   int c;
   lsx_getopt_t optstate;
-  lsx_getopt_init(argc, argv, "+qmls", NULL, lsx_getopt_flag_none, 1, &optstate);
+  lsx_getopt_init(argc, argv, "+qdmls", NULL, lsx_getopt_flag_none, 1, &optstate);
 
   p->segment_ms = p->search_ms = p->overlap_ms = HUGE_VAL;
   while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
     case 'q': p->quick_search  = sox_true;   break;
+    case 'd': p->direct_search = sox_true;   break;
     case 'm': profile = Music; break;
     case 's': profile = Speech; break;
     case 'l': profile = Linear; p->search_ms = 0; break;
@@ -261,8 +366,8 @@ static int start(sox_effect_t * effp)
     return SOX_EFF_NULL;
 
   p->tempo = tempo_create((size_t)effp->in_signal.channels);
-  tempo_setup(p->tempo, effp->in_signal.rate, p->quick_search, p->factor,
-      p->segment_ms, p->search_ms, p->overlap_ms);
+  tempo_setup(p->tempo, effp->in_signal.rate, p->quick_search,
+      p->direct_search, p->factor, p->segment_ms, p->search_ms, p->overlap_ms);
 
   effp->out_signal.length = SOX_UNKNOWN_LEN;
   if (effp->in_signal.length != SOX_UNKNOWN_LEN) {
@@ -315,10 +420,11 @@ static int stop(sox_effect_t * effp)
 sox_effect_handler_t const * lsx_tempo_effect_fn(void)
 {
   static const char usage[] =
-    "[-q] [-m|-s|-l] factor [segment [search [overlap]]]";
+    "[-q] [-d] [-m|-s|-l] factor [segment [search [overlap]]]";
 
   static char const * const extra_usage[] = {
 "-q      Use tree searches instead of linear ones",
+"-d      Try each position directly, never by cross-correlation",
 "-m      Optimize segment, search and overlap for music",
 "-s      Optimize segment, search and overlap for speech",
 "-l      Optimize segment, search and overlap for linear processing",
@@ -343,8 +449,12 @@ static int pitch_getopts(sox_effect_t * effp, int argc, char **argv)
 {
   double d;
   char dummy, arg[100], **argv2;
-  int result, pos = (argc > 1 && !strcmp(argv[1], "-q"))? 2 : 1;
+  int result, pos = 1;
 
+  /* Skip the options, but not a negative shift */
+  while (pos < argc && argv[pos][0] == '-' &&
+      !isdigit((int)argv[pos][1]) && argv[pos][1] != '.')
+    ++pos;
   lsx_valloc(argv2, argc);
   if (argc <= pos || sscanf(argv[pos], "%lf %c", &d, &dummy) != 1)
     return lsx_usage(effp);
@@ -370,9 +480,10 @@ static int pitch_start(sox_effect_t * effp)
 sox_effect_handler_t const * lsx_pitch_effect_fn(void)
 {
   static sox_effect_handler_t handler;
-  static char const * const usage = "[-q] shift [segment [search [overlap]]]";
+  static char const * const usage = "[-q] [-d] shift [segment [search [overlap]]]";
   static char const * const extra_usage[] = {
 "-q      Use tree searches instead of linear ones",
+"-d      Try each position directly, never by cross-correlation",
 "OPTION  RANGE  DFLT  DESCRIPTION",
 "shift    any         Pitch shift in cents; >0 is higher, <0 is lower",
 "segment .1-100 82    Segment size in milliseconds",
@@ -340,3 +340,33 @@ void lsx_close_dllibrary(
   }
 #endif /* HAVE_LIBLTDL */
 }
+
+/* Split a string into arguments in place, as a shell would with its quotes
+ * and backslashes.  The returned array should be freed. */
+char * * lsx_strtoargv(char * s, int * argc)
+{
+  sox_bool squote = sox_false;   /* Single quote mode (') is in effect. */
+  sox_bool dquote = sox_false;   /* Double quote mode (") is in effect. */
+  sox_bool esc    = sox_false;   /* Escape mode (\) is in effect. */
+  char * t, * * argv = NULL;
+
+  for (*argc = 0; *s;) {
+    for (; isspace((int)*s); ++s);    /* Skip past any (more) white space. */
+    if (*s) {                    /* Found an arg. */
+      lsx_revalloc(argv, *argc + 1);
+      argv[(*argc)++] = s;       /* Store pointer to start of arg. */
+                                 /* Find the end of the arg: */
+      for (t = s; *s && (esc || squote || dquote || !isspace((int)*s)); ++s)
+        if (!esc && !squote && *s == '"')
+          dquote = !dquote;      /* Toggle double quote mode. */
+        else if (!esc && !dquote && *s == '\'')
+          squote = !squote;      /* Toggle single quote mode. */
+        else if (!(esc = !esc && *s == '\\' && s[1] &&
+              (!squote && (s[1] == '"' || !dquote))))
+          *t++ = *s;             /* Only copy if not an active ', ", or \ */
+      s = *s ? s + 1 : s;        /* Skip the 1st white space char. */
+      *t = '\0';                 /* Terminate the arg. */
+    }
+  }
+  return argv;
+}                                /* lsx_strtoargv */
@@ -282,3 +282,5 @@ extern int lsx_strncasecmp(char const *s1, char const *s2, size_t n);
 
 extern int lsx_sscanf(const char *str, const char *format, ...);
 #define sscanf lsx_sscanf
+
+extern char * * lsx_strtoargv(char * s, int * argc);
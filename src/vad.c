@@ -16,6 +16,7 @@
  */
 
 #include "sox_i.h"
+#include "fft4g.h"
 
 typedef struct {
   double    * dftBuf, * noiseSpectrum, * spectrum, * measures, meanMeas;
@@ -36,6 +37,8 @@ typedef struct {                /* Configuration parameters: */
   double    noiseTcUpMult, noiseTcDownMult;
   double    measureTcMult, triggerMeasTcMult;
   double    * spectrumWindow, * cepstrumWindow;
+  int       * dft_br;           /* Real FFT tables, made at start */
+  double    * dft_sc;
   channel_t * channels;
 } priv_t;
 
@@ -127,6 +130,11 @@ static int start(sox_effect_t * effp)
     lsx_vcalloc(c->measures, p->measuresLen);
   }
 
+  /* Making the tables now leaves the transforms free to run in parallel */
+  lsx_vcalloc(p->dft_br, dft_br_len(p->dftLen_ws));
+  lsx_vcalloc(p->dft_sc, dft_sc_len(p->dftLen_ws));
+  lsx_rdft((int)p->dftLen_ws, 1, p->channels[0].dftBuf, p->dft_br, p->dft_sc);
+
   lsx_vcalloc(p->spectrumWindow, p->measureLen_ws);
   for (i = 0; i < p->measureLen_ws; ++i)
     p->spectrumWindow[i] = -2./ SOX_SAMPLE_MIN / sqrt((double)p->measureLen_ws);
@@ -187,12 +195,16 @@ static double measure(
     priv_t * p, channel_t * c, size_t index_ns, unsigned step_ns, int bootCount)
 {
   double mult, result = 0;
-  size_t i;
+  size_t i, n;
 
-  for (i = 0; i < p->measureLen_ws; ++i, index_ns = (index_ns + step_ns) % p->samplesLen_ns)
+  /* The window may wrap once around the end of the samples */
+  n = min(p->measureLen_ws, (p->samplesLen_ns - index_ns + step_ns - 1) / step_ns);
+  for (i = 0; i < n; ++i, index_ns += step_ns)
+    c->dftBuf[i] = p->samples[index_ns] * p->spectrumWindow[i];
+  for (index_ns -= p->samplesLen_ns; i < p->measureLen_ws; ++i, index_ns += step_ns)
     c->dftBuf[i] = p->samples[index_ns] * p->spectrumWindow[i];
   memset(c->dftBuf + i, 0, (p->dftLen_ws - i) * sizeof(*c->dftBuf));
-  lsx_safe_rdft((int)p->dftLen_ws, 1, c->dftBuf);
+  lsx_rdft((int)p->dftLen_ws, 1, c->dftBuf, p->dft_br, p->dft_sc);
 
   memset(c->dftBuf, 0, p->spectrumStart * sizeof(*c->dftBuf));
   for (i = p->spectrumStart; i < p->spectrumEnd; ++i) {
@@ -207,7 +219,7 @@ static double measure(
     c->dftBuf[i] = d * p->cepstrumWindow[i - p->spectrumStart];
   }
   memset(c->dftBuf + i, 0, ((p->dftLen_ws >> 1) - i) * sizeof(*c->dftBuf));
-  lsx_safe_rdft((int)p->dftLen_ws >> 1, 1, c->dftBuf);
+  lsx_rdft((int)p->dftLen_ws >> 1, 1, c->dftBuf, p->dft_br, p->dft_sc);
 
   for (i = p->cepstrumStart; i < p->cepstrumEnd; ++i)
     result += sqr(c->dftBuf[2 * i]) + sqr(c->dftBuf[2 * i + 1]);
@@ -219,18 +231,35 @@ static int flowTrigger(sox_effect_t * effp, sox_sample_t const * ibuf,
     sox_sample_t * obuf, size_t * ilen, size_t * olen)
 {
   priv_t * p = (priv_t *)effp->priv;
+  unsigned channels = effp->in_signal.channels;
   sox_bool hasTriggered = sox_false;
   size_t i, idone = 0, numMeasuresToFlush = 0;
 
   while (idone < *ilen && !hasTriggered) {
-    p->measureTimer_ns -= effp->in_signal.channels;
-    for (i = 0; i < effp->in_signal.channels; ++i, ++idone) {
-      channel_t * c = &p->channels[i];
-      p->samples[p->samplesIndex_ns++] = *ibuf++;
-      if (!p->measureTimer_ns) {
-        size_t x = (p->samplesIndex_ns + p->samplesLen_ns - p->measureLen_ns) % p->samplesLen_ns;
-        double meas = measure(p, c, x, effp->in_signal.channels, p->bootCount);
-        c->measures[p->measuresIndex] = meas;
+    /* Take the samples up to the next measurement in one go */
+    size_t len = min(*ilen - idone, p->measureTimer_ns);
+    len = min(len, p->samplesLen_ns - p->samplesIndex_ns);
+    memcpy(p->samples + p->samplesIndex_ns, ibuf, len * sizeof(*ibuf));
+    ibuf += len, idone += len;
+    p->samplesIndex_ns += len;
+    p->measureTimer_ns -= len;
+
+    if (!p->measureTimer_ns) {
+      /* Each channel's window ends where it did when channels were stored
+       * one at a time; the channels are measured independently. */
+      size_t x = p->samplesIndex_ns + 2 * p->samplesLen_ns - p->measureLen_ns - channels + 1;
+      int ch;
+
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for if(sox_globals.use_threads) schedule(static)
+#endif
+      for (ch = 0; ch < (int)channels; ++ch)
+        p->channels[ch].measures[p->measuresIndex] = measure(p,
+            &p->channels[ch], (x + ch) % p->samplesLen_ns, channels, p->bootCount);
+
+      for (i = 0; i < channels; ++i) {
+        channel_t * c = &p->channels[i];
+        double meas = c->measures[p->measuresIndex];
         c->meanMeas = c->meanMeas * p->triggerMeasTcMult +
             meas *(1 - p->triggerMeasTcMult);
 
@@ -291,6 +320,8 @@ static int stop(sox_effect_t * effp)
     free(c->dftBuf);
   }
   free(p->channels);
+  free(p->dft_sc);
+  free(p->dft_br);
   free(p->cepstrumWindow);
   free(p->spectrumWindow);
   free(p->samples);
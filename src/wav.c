@@ -95,12 +95,13 @@ typedef struct {
     /* following used by *ADPCM wav files */
     unsigned short nCoefs;          /* ADPCM: number of coef sets */
     short         *lsx_ms_adpcm_i_coefs;          /* ADPCM: coef sets           */
-    void          *ms_adpcm_data;   /* Private data of adpcm decoder */
+    void         **ms_adpcm_data;   /* Private data of adpcm decoder, per block */
+    size_t         batch;           /* Blocks decoded or encoded at once */
     unsigned char *packet;          /* Temporary buffer for packets */
     short         *samples;         /* interleaved samples buffer */
     short         *samplePtr;       /* Pointer to current sample  */
     short         *sampleTop;       /* End of samples-buffer      */
-    unsigned short blockSamplesRemaining;/* Samples remaining per channel */
+    size_t         blockSamplesRemaining;/* Samples remaining per channel */
     int            state[16];       /* step-size info for *ADPCM writes */
 
     /* following used by GSM 6.10 wav */
@@ -124,114 +125,142 @@ static const char write_error_msg[] = "write error";
 
 
 /****************************************************************************/
-/* IMA ADPCM Support Functions Section                                      */
+/* Common ADPCM Support Functions Section                                   */
 /****************************************************************************/
 
 /*
- *
- * ImaAdpcmReadBlock - Grab and decode complete block of samples
- *
+ * Number of ADPCM blocks to decode or encode at once.  Blocks being
+ * decoded are handed out to worker threads so it is 1 unless there are
+ * several of those.
  */
-static unsigned short  ImaAdpcmReadBlock(sox_format_t * ft)
+static size_t AdpcmBatch(void)
 {
-    priv_t *       wav = (priv_t *) ft->priv;
-    size_t bytesRead;
-    int samplesThisBlock;
-
-    /* Pull in the packet and check the header */
-    bytesRead = lsx_readbuf(ft, wav->packet, (size_t)wav->blockAlign);
-    samplesThisBlock = wav->samplesPerBlock;
-    if (bytesRead < wav->blockAlign)
-    {
-        /* If it looks like a valid header is around then try and */
-        /* work with partial blocks.  Specs say it should be null */
-        /* padded but I guess this is better than trailing quiet. */
-        samplesThisBlock = lsx_ima_samples_in((size_t)0, (size_t)ft->signal.channels, bytesRead, (size_t) 0);
-        if (samplesThisBlock == 0 || samplesThisBlock > wav->samplesPerBlock)
-        {
-            lsx_warn("Premature EOF on input file");
-            return 0;
-        }
-    }
-
-    wav->samplePtr = wav->samples;
-
-    /* For a full block, the following should be true: */
-    /* wav->samplesPerBlock = blockAlign - 8byte header + 1 sample in header */
-    lsx_ima_block_expand_i(ft->signal.channels, wav->packet, wav->samples, samplesThisBlock);
-    return samplesThisBlock;
-
+#ifdef HAVE_OPENMP
+    if (sox_globals.use_threads && omp_get_max_threads() > 1)
+        return 64;
+#endif
+    return 1;
 }
 
-/****************************************************************************/
-/* MS ADPCM Support Functions Section                                       */
-/****************************************************************************/
-
 /*
  *
- * AdpcmReadBlock - Grab and decode complete block of samples
+ * AdpcmReadBlocks - Grab and decode up to wav->batch complete blocks of
+ * samples.  Each block starts afresh, so they are decoded in parallel.
+ * Returns the number of samples per channel now in wav->samples.
  *
  */
-static unsigned short  AdpcmReadBlock(sox_format_t * ft)
+static size_t AdpcmReadBlocks(sox_format_t * ft)
 {
     priv_t *       wav = (priv_t *) ft->priv;
-    size_t bytesRead;
-    int samplesThisBlock;
-    const char *errmsg;
-
-    /* Pull in the packet and check the header */
-    bytesRead = lsx_readbuf(ft, wav->packet, (size_t) wav->blockAlign);
-    samplesThisBlock = wav->samplesPerBlock;
-    if (bytesRead < wav->blockAlign)
+    size_t chans = ft->signal.channels;
+    size_t blocks = wav->batch, bytesRead, full, partial = 0;
+    const char *errmsg = NULL;
+    int i, n;
+
+    /* Don't read past the data chunk into whatever follows it */
+    if (!wav->ignoreSize) {
+        uint64_t left = (wav->numSamples + wav->samplesPerBlock - 1) / wav->samplesPerBlock;
+        if (blocks > left)
+            blocks = left? left : 1;
+    }
+
+    /* Pull in the packets */
+    bytesRead = lsx_readbuf(ft, wav->packet, blocks * wav->blockAlign);
+    full = bytesRead / wav->blockAlign;
+    if (full < blocks)
     {
         /* If it looks like a valid header is around then try and */
         /* work with partial blocks.  Specs say it should be null */
         /* padded but I guess this is better than trailing quiet. */
-        samplesThisBlock = lsx_ms_adpcm_samples_in((size_t)0, (size_t)ft->signal.channels, bytesRead, (size_t)0);
-        if (samplesThisBlock == 0 || samplesThisBlock > wav->samplesPerBlock)
+        size_t rest = bytesRead - full * wav->blockAlign;
+
+        if (wav->formatTag == WAVE_FORMAT_IMA_ADPCM)
+            partial = lsx_ima_samples_in((size_t)0, chans, rest, (size_t)0);
+        else
+            partial = lsx_ms_adpcm_samples_in((size_t)0, chans, rest, (size_t)0);
+        if (partial == 0 || partial > wav->samplesPerBlock)
         {
-            lsx_warn("Premature EOF on input file");
-            return 0;
+            partial = 0;
+            if (!full) {
+                lsx_warn("Premature EOF on input file");
+                return 0;
+            }
         }
     }
 
-    errmsg = lsx_ms_adpcm_block_expand_i(wav->ms_adpcm_data, ft->signal.channels, wav->nCoefs, wav->lsx_ms_adpcm_i_coefs, wav->packet, wav->samples, samplesThisBlock);
+    n = full + (partial != 0);
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if(sox_globals.use_threads && n > 1) schedule(static)
+#endif
+    for (i = 0; i < n; ++i) {
+        unsigned char *packet = wav->packet + (size_t)i * wav->blockAlign;
+        short *samples = wav->samples + (size_t)i * wav->samplesPerBlock * chans;
+        int samplesThisBlock = (size_t)i < full? wav->samplesPerBlock : (int)partial;
+
+        /* For a full IMA block, the following should be true: */
+        /* samplesPerBlock = blockAlign - 8byte header + 1 sample in header */
+        if (wav->formatTag == WAVE_FORMAT_IMA_ADPCM)
+            lsx_ima_block_expand_i(chans, packet, samples, samplesThisBlock);
+        else {
+            const char *msg = lsx_ms_adpcm_block_expand_i(wav->ms_adpcm_data[i], chans, wav->nCoefs, wav->lsx_ms_adpcm_i_coefs, packet, samples, samplesThisBlock);
+            if (msg) {
+#ifdef HAVE_OPENMP
+                #pragma omp critical
+#endif
+                errmsg = msg;
+            }
+        }
+    }
 
     if (errmsg)
         lsx_warn("%s", errmsg);
 
-    return samplesThisBlock;
+    wav->samplePtr = wav->samples;
+    return full * wav->samplesPerBlock + partial;
 }
 
 /****************************************************************************/
 /* Common ADPCM Write Function                                              */
 /****************************************************************************/
 
-static int xxxAdpcmWriteBlock(sox_format_t * ft)
+static void AdpcmMashBlock(sox_format_t * ft, short *samples, int *state, unsigned char *packet)
 {
     priv_t * wav = (priv_t *) ft->priv;
-    size_t chans, ct;
+    unsigned chans = ft->signal.channels;
+
+    if (wav->formatTag == WAVE_FORMAT_ADPCM) {
+        lsx_ms_adpcm_block_mash_i(chans, samples, wav->samplesPerBlock, state, packet, wav->blockAlign);
+    }else{ /* WAVE_FORMAT_IMA_ADPCM */
+        lsx_ima_block_mash_i(chans, samples, wav->samplesPerBlock, state, packet, 9);
+    }
+}
+
+static int xxxAdpcmWriteBlocks(sox_format_t * ft)
+{
+    priv_t * wav = (priv_t *) ft->priv;
+    size_t chans, ct, sbsize, blocks, i;
     short *p;
 
     chans = ft->signal.channels;
+    sbsize = chans * wav->samplesPerBlock;
     p = wav->samplePtr;
     ct = p - wav->samples;
     if (ct>=chans) {
+        blocks = (ct + sbsize - 1) / sbsize;
         /* zero-fill samples if needed to complete block */
-        for (p = wav->samplePtr; p < wav->sampleTop; p++) *p=0;
-        /* compress the samples to wav->packet */
-        if (wav->formatTag == WAVE_FORMAT_ADPCM) {
-            lsx_ms_adpcm_block_mash_i((unsigned) chans, wav->samples, wav->samplesPerBlock, wav->state, wav->packet, wav->blockAlign);
-        }else{ /* WAVE_FORMAT_IMA_ADPCM */
-            lsx_ima_block_mash_i((unsigned) chans, wav->samples, wav->samplesPerBlock, wav->state, wav->packet, 9);
-        }
-        /* write the compressed packet */
-        if (lsx_writebuf(ft, wav->packet, (size_t) wav->blockAlign) != wav->blockAlign)
+        for (p = wav->samplePtr; p < wav->samples + blocks * sbsize; p++) *p=0;
+        /* compress the samples to wav->packet.  Each block starts with
+         * the step sizes the one before it ended with, so this is done in
+         * order; the encoders share out the trials within each block. */
+        for (i = 0; i < blocks; ++i)
+            AdpcmMashBlock(ft, wav->samples + i * sbsize, wav->state, wav->packet + i * wav->blockAlign);
+        /* write the compressed packets */
+        if (lsx_writebuf(ft, wav->packet, blocks * wav->blockAlign) != blocks * wav->blockAlign)
             write_error();
         /* update lengths and samplePtr */
-        wav->dataLength += wav->blockAlign;
+        wav->dataLength += blocks * wav->blockAlign;
         if (pad_nsamps)
-          wav->numSamples += wav->samplesPerBlock;
+          wav->numSamples += blocks * wav->samplesPerBlock;
         else
           wav->numSamples += ct/chans;
         wav->samplePtr = wav->samples;
@@ -764,6 +793,7 @@ static int startread(sox_format_t * ft)
 
 
     wav->lsx_ms_adpcm_i_coefs = NULL;
+    wav->ms_adpcm_data = NULL;
     wav->packet = NULL;
     wav->samples = NULL;
 
@@ -820,7 +850,8 @@ static int startread(sox_format_t * ft)
             lsx_fail_errno(ft,SOX_EOF,"ADPCM file nCoefs (%.4hx) makes no sense", wav->nCoefs);
             return SOX_EOF;
         }
-        wav->packet = lsx_malloc((size_t)wav->blockAlign);
+        wav->batch = AdpcmBatch();
+        wav->packet = lsx_malloc(wav->batch * wav->blockAlign);
 
         len -= 4;
 
@@ -830,11 +861,16 @@ static int startread(sox_format_t * ft)
             return SOX_EOF;
         }
 
-        lsx_valloc(wav->samples, wChannels * wav->samplesPerBlock);
+        lsx_valloc(wav->samples, wav->batch * wChannels * wav->samplesPerBlock);
 
         /* nCoefs, lsx_ms_adpcm_i_coefs used by adpcm.c */
         lsx_valloc(wav->lsx_ms_adpcm_i_coefs, wav->nCoefs * 2);
-        wav->ms_adpcm_data = lsx_ms_adpcm_alloc(wChannels);
+        lsx_valloc(wav->ms_adpcm_data, wav->batch);
+        {
+            size_t i;
+            for (i = 0; i < wav->batch; i++)
+                wav->ms_adpcm_data[i] = lsx_ms_adpcm_alloc(wChannels);
+        }
         {
             int i, errct=0;
             for (i=0; len>=2 && i < 2*wav->nCoefs; i++) {
@@ -874,10 +910,11 @@ static int startread(sox_format_t * ft)
             return SOX_EOF;
         }
 
-        wav->packet = lsx_malloc((size_t)wav->blockAlign);
+        wav->batch = AdpcmBatch();
+        wav->packet = lsx_malloc(wav->batch * wav->blockAlign);
         len -= 2;
 
-        lsx_valloc(wav->samples, wChannels * wav->samplesPerBlock);
+        lsx_valloc(wav->samples, wav->batch * wChannels * wav->samplesPerBlock);
 
         bytespersample = 2;  /* AFTER de-compression */
         break;
@@ -1194,10 +1231,7 @@ static size_t read_samples(sox_format_t * ft, sox_sample_t *buf, size_t len)
             while (done < len) { /* Still want data? */
                 /* See if need to read more from disk */
                 if (wav->blockSamplesRemaining == 0) {
-                    if (wav->formatTag == WAVE_FORMAT_IMA_ADPCM)
-                        wav->blockSamplesRemaining = ImaAdpcmReadBlock(ft);
-                    else
-                        wav->blockSamplesRemaining = AdpcmReadBlock(ft);
+                    wav->blockSamplesRemaining = AdpcmReadBlocks(ft);
                     if (wav->blockSamplesRemaining == 0)
                     {
                         /* Don't try to read any more samples */
@@ -1278,7 +1312,12 @@ static int stopread(sox_format_t * ft)
     free(wav->packet);
     free(wav->samples);
     free(wav->lsx_ms_adpcm_i_coefs);
-    free(wav->ms_adpcm_data);
+    if (wav->ms_adpcm_data) {
+        size_t i;
+        for (i = 0; i < wav->batch; i++)
+            free(wav->ms_adpcm_data[i]);
+        free(wav->ms_adpcm_data);
+    }
     free(wav->comment);
     wav->comment = NULL;
 
@@ -1337,10 +1376,11 @@ wave_format_adpcm:
             /* #channels already range-checked for overflow in wavwritehdr() */
             for (ch=0; ch<ft->signal.channels; ch++)
                 wav->state[ch] = 0;
+            wav->batch = AdpcmBatch();
             sbsize = ft->signal.channels * wav->samplesPerBlock;
-            wav->packet = lsx_malloc((size_t)wav->blockAlign);
-            lsx_valloc(wav->samples, sbsize);
-            wav->sampleTop = wav->samples + sbsize;
+            wav->packet = lsx_malloc(wav->batch * wav->blockAlign);
+            lsx_valloc(wav->samples, wav->batch * sbsize);
+            wav->sampleTop = wav->samples + wav->batch * sbsize;
             wav->samplePtr = wav->samples;
             break;
 
@@ -1709,7 +1749,7 @@ static size_t write_samples(sox_format_t * ft, const sox_sample_t *buf, size_t l
 
                 wav->samplePtr = p;
                 if (p == wav->sampleTop)
-                    xxxAdpcmWriteBlock(ft);
+                    xxxAdpcmWriteBlocks(ft);
 
             }
             return total_len - len;
@@ -1740,7 +1780,7 @@ static int stopwrite(sox_format_t * ft)
         {
         case WAVE_FORMAT_IMA_ADPCM:
         case WAVE_FORMAT_ADPCM:
-            if (xxxAdpcmWriteBlock(ft))
+            if (xxxAdpcmWriteBlocks(ft))
 		return SOX_EOF;
             break;
         case WAVE_FORMAT_GSM610:
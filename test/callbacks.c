@@ -0,0 +1,156 @@
+/*
+ * callbacks.c: Write an AIFF file into memory through libsox's I/O
+ * callbacks, then read it back through them, straight through and after
+ * seeking, and check that the samples are the ones written.
+ *
+ * AIFF is used because its writer always seeks back to complete the header
+ * and its reader seeks back to the sound data after reading the chunks.
+ *
+ * Exits 0 if all is well, 1 otherwise.
+ */
+
+#include "sox_ng.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CHANNELS 2
+#define FRAMES 100000
+#define SEEK_TO 54321
+
+typedef struct {
+    char *data;
+    size_t size, alloc, pos;
+} buffer_t;
+
+static sox_int64_t buffer_read(void *client_data, void *buf, size_t len)
+{
+    buffer_t *b = (buffer_t *)client_data;
+
+    if (len > b->size - b->pos)
+	len = b->size - b->pos;
+    memcpy(buf, b->data + b->pos, len);
+    b->pos += len;
+    return (sox_int64_t)len;
+}
+
+static sox_int64_t buffer_write(void *client_data, void const *buf, size_t len)
+{
+    buffer_t *b = (buffer_t *)client_data;
+
+    if (b->pos + len > b->alloc) {
+	b->alloc = (b->pos + len) * 2;
+	if (!(b->data = realloc(b->data, b->alloc)))
+	    return -1;
+    }
+    if (b->pos > b->size)	/* Filling a gap left by seeking forwards */
+	memset(b->data + b->size, 0, b->pos - b->size);
+    memcpy(b->data + b->pos, buf, len);
+    b->pos += len;
+    if (b->pos > b->size)
+	b->size = b->pos;
+    return (sox_int64_t)len;
+}
+
+static int buffer_seek(void *client_data, sox_int64_t offset, int whence)
+{
+    buffer_t *b = (buffer_t *)client_data;
+    sox_int64_t base = whence == SEEK_SET? 0 :
+		       whence == SEEK_CUR? (sox_int64_t)b->pos : (sox_int64_t)b->size;
+
+    if (base + offset < 0)
+	return -1;
+    b->pos = (size_t)(base + offset);
+    return 0;
+}
+
+static sox_int64_t buffer_tell(void *client_data)
+{
+    return (sox_int64_t)((buffer_t *)client_data)->pos;
+}
+
+static sox_io_callbacks_t const buffer_io =
+    {buffer_read, buffer_write, buffer_seek, buffer_tell};
+
+/* Read n samples from in and check them against expected */
+static int check(sox_format_t *in, sox_sample_t const *expected, size_t n,
+		 char const *how)
+{
+    static sox_sample_t got[FRAMES * CHANNELS];
+    size_t i, number_read = 0, r;
+
+    while (number_read < n &&
+	   (r = sox_read(in, got + number_read, n - number_read)) > 0)
+	number_read += r;
+    if (number_read != n) {
+	fprintf(stderr, "%s: read %lu samples instead of %lu\n", how,
+		(unsigned long)number_read, (unsigned long)n);
+	return 1;
+    }
+    for (i = 0; i < n; i++)
+	if (got[i] != expected[i]) {
+	    fprintf(stderr, "%s: sample %lu is %ld instead of %ld\n", how,
+		    (unsigned long)i, (long)got[i], (long)expected[i]);
+	    return 1;
+	}
+    return 0;
+}
+
+int
+main(void)
+{
+    static sox_sample_t samples[FRAMES * CHANNELS];
+    sox_signalinfo_t signal = {44100, CHANNELS, 16, 0, NULL};
+    buffer_t buffer = {NULL, 0, 0, 0};
+    sox_format_t *ft;
+    unsigned long seed = 1;
+    size_t i;
+    int errors = 0;
+
+    /* 16-bit values so that they survive the round trip exactly */
+    for (i = 0; i < FRAMES * CHANNELS; i++) {
+	seed = (seed * 1103515245 + 12345) & 0xffffffff;
+	samples[i] = (sox_sample_t)(seed & 0xffff0000);
+    }
+
+    if (sox_init() != SOX_SUCCESS || sox_format_init() != SOX_SUCCESS)
+	return 1;
+
+    ft = sox_open_write_callbacks(&buffer_io, &buffer, &signal, NULL, "aiff", NULL);
+    if (!ft) {
+	fprintf(stderr, "Can't open the output\n");
+	return 1;
+    }
+    if (sox_write(ft, samples, FRAMES * CHANNELS) != FRAMES * CHANNELS) {
+	fprintf(stderr, "Can't write the samples\n");
+	return 1;
+    }
+    if (sox_close(ft) != SOX_SUCCESS) {
+	fprintf(stderr, "Can't complete the output\n");
+	return 1;
+    }
+
+    buffer.pos = 0;
+    ft = sox_open_read_callbacks(&buffer_io, &buffer, NULL, NULL, NULL);
+    if (!ft) {
+	fprintf(stderr, "Can't open the input\n");
+	return 1;
+    }
+    if (ft->signal.length != FRAMES * CHANNELS ||
+	ft->signal.channels != CHANNELS || ft->signal.rate != 44100) {
+	fprintf(stderr, "The header was not completed\n");
+	errors++;
+    }
+    errors += check(ft, samples, FRAMES * CHANNELS, "Reading");
+    if (sox_seek(ft, SEEK_TO * CHANNELS, SOX_SEEK_SET) != SOX_SUCCESS) {
+	fprintf(stderr, "Can't seek the input\n");
+	errors++;
+    } else
+	errors += check(ft, samples + SEEK_TO * CHANNELS,
+			(FRAMES - SEEK_TO) * CHANNELS, "Seeking");
+    sox_close(ft);
+
+    free(buffer.data);
+    sox_quit();
+    return errors != 0;
+}
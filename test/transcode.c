@@ -0,0 +1,76 @@
+/*
+ * transcode.c: Transcode in.ul and in.al, 8kHz mono headerless files, to
+ * 16-bit WAV in ul.wav and al.wav with one transcoder, and check that
+ * transcoders refuse to write at another rate, with other channels or with
+ * less precision, both when created and for a file, here in.wav.
+ *
+ * Exits 0 if all is well, 1 otherwise.
+ */
+
+#include "sox_ng.h"
+#include <stdio.h>
+
+static int errors = 0;
+
+static void refuse(char const *what, sox_transcoder_t *t)
+{
+    if (t) {
+	fprintf(stderr, "A transcoder was created %s\n", what);
+	errors++;
+    }
+    sox_transcoder_delete(t);
+}
+
+int
+main(void)
+{
+    sox_signalinfo_t signal = {8000, 1, 0, SOX_UNSPEC, NULL};
+    sox_signalinfo_t stereo = {8000, 2, 0, SOX_UNSPEC, NULL};
+    sox_encodinginfo_t s16, ulaw;
+    sox_transcoder_t *t;
+
+    if (sox_init() != SOX_SUCCESS || sox_format_init() != SOX_SUCCESS)
+	return 1;
+
+    sox_init_encodinginfo(&s16);
+    s16.encoding = SOX_ENCODING_SIGN2;
+    s16.bits_per_sample = 16;
+    sox_init_encodinginfo(&ulaw);
+    ulaw.encoding = SOX_ENCODING_ULAW;
+    ulaw.bits_per_sample = 8;
+
+    /* The input types come from the files' extensions */
+    t = sox_transcoder_create(&signal, NULL, NULL, &s16, "wav");
+    if (!t) {
+	fprintf(stderr, "Can't create a transcoder\n");
+	return 1;
+    }
+    if (sox_transcode(t, "in.ul", "ul.wav") != SOX_SUCCESS ||
+	sox_transcode(t, "in.al", "al.wav") != SOX_SUCCESS) {
+	fprintf(stderr, "Can't transcode\n");
+	errors++;
+    }
+    sox_transcoder_delete(t);
+
+    refuse("to write CD audio at 8kHz",
+	   sox_transcoder_create(&signal, NULL, NULL, NULL, "cdr"));
+    refuse("to write stereo CVSD",
+	   sox_transcoder_create(&stereo, NULL, NULL, NULL, "cvsd"));
+    refuse("to write 16-bit input as u-law",
+	   sox_transcoder_create(&signal, &s16, "raw", &ulaw, "wav"));
+
+    /* in.wav's rate and channels are only known once it is opened */
+    t = sox_transcoder_create(NULL, NULL, NULL, NULL, "cdr");
+    if (!t) {
+	fprintf(stderr, "Can't create a transcoder\n");
+	return 1;
+    }
+    if (sox_transcode(t, "in.wav", "in.cdr") == SOX_SUCCESS) {
+	fprintf(stderr, "An 8kHz file was transcoded to CD audio\n");
+	errors++;
+    }
+    sox_transcoder_delete(t);
+
+    sox_quit();
+    return errors != 0;
+}